@@ -0,0 +1,47 @@
+#include "AnimationLod.h"
+#include "AnimationManager.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Minerva
+{
+    size_t AnimationLodSettings::FindBand(float distance) const
+    {
+        for (size_t i = 0; i < bands.size(); i++)
+        {
+            if (distance < bands[i].distance)
+                return i;
+        }
+        return bands.size() - 1;
+    }
+
+    void SelectAnimationLod(const AnimationLodSettings& settings, const glm::vec3& cameraPos, 
+    const glm::mat4& model, const std::vector<InstanceData>& instances, std::vector<Animator>& animators,
+    std::vector<int>& bandCounts)
+    {
+        bandCounts.assign(settings.bands.size(), 0);
+        if (animators.empty() || settings.bands.empty())
+            return;
+
+        //Squared distance of the nearest instance drawing each pose
+        thread_local std::vector<float> nearest;
+        nearest.assign(animators.size(), std::numeric_limits<float>::max());
+        for (size_t i = 0; i < instances.size(); i++)
+        {
+            glm::vec3 position = glm::vec3(model * glm::vec4(instances[i].instancePos, 1.0f));
+            glm::vec3 offset = position - cameraPos;
+            float& poseDistance = nearest[i % animators.size()];
+            poseDistance = std::min(poseDistance, glm::dot(offset, offset));
+        }
+
+        for (size_t i = 0; i < animators.size(); i++)
+        {
+            size_t band = settings.FindBand(std::sqrt(nearest[i]));
+            const AnimationLodBand& lod = settings.bands[band];
+            int interval = std::max(lod.updateInterval, 1);
+            //The phase depends only on the animator, so it stays stable when the camera moves
+            animators[i].SetLod(interval, static_cast<int>(i % interval), lod.prunedSkeleton);
+            bandCounts[band]++;
+        }
+    }
+}
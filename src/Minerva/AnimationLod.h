@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+#include <limits>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+namespace Minerva
+{
+    /// @brief Is a distance band of the animation LOD
+    struct AnimationLodBand
+    {
+        //The band covers the poses whose nearest instance is closer than this distance, in world units
+        float distance;
+        //The pose is evaluated once every updateInterval frames, the other frames reuse the last pose
+        int updateInterval;
+        //Evaluates only the bones of the pruned skeleton, the small subtrees stay in the bind pose
+        bool prunedSkeleton;
+    };
+
+    /// @brief Settings of the animation LOD. The bands are sorted by distance, the poses farther 
+    /// than every band use the last one
+    struct AnimationLodSettings
+    {
+        bool enabled = false;
+        std::vector<AnimationLodBand> bands
+        {
+            {10.0f, 1, false},
+            {25.0f, 2, false},
+            {50.0f, 4, false},
+            {std::numeric_limits<float>::max(), 8, true}
+        };
+        //Subtrees shorter than this fraction of the skeleton (fingers, face, toes) are pruned
+        float pruneExtent = 0.05f;
+
+        /// @brief Returns the index of the band which covers the distance
+        size_t FindBand(float distance) const;
+    };
+
+    class Animator;
+
+    /// @brief Assigns a LOD band to every animator. The instance i draws the pose i % animators.size(),
+    /// so the band of a pose is chosen by the nearest of its instances. The animators of a band 
+    /// update on different frames, so the cost of the band is spread evenly
+    /// @param settings The distance bands
+    /// @param cameraPos The position of the camera in world space
+    /// @param model The model matrix applied to every instance
+    /// @param instances The instance data of the scene
+    /// @param animators The animators of the scene
+    /// @param bandCounts Receives the number of animators in each band
+    void SelectAnimationLod(const AnimationLodSettings& settings, const glm::vec3& cameraPos, 
+    const glm::mat4& model, const std::vector<InstanceData>& instances, std::vector<Animator>& animators,
+    std::vector<int>& bandCounts);
+}
@@ -3,20 +3,282 @@
 #include "Mesh.h"
 #include "ModelLoader.h"
 #include "EngineVars.h"
+#include "MeshCache.h"
 #include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <cstdio>
 
 namespace Minerva
 {
-    void Animation::CreateAnimation(const std::string &animationPath, ModelLoader* model)
+    constexpr uint32_t COOKED_CLIP_MAGIC = 0x4C43494Du; //"MICL"
+    //Bump it whenever the layout of the file or of the tracks changes
+    constexpr uint32_t COOKED_CLIP_VERSION = 2;
+
+    struct CookedClipHeader
+    {
+        uint32_t magic = COOKED_CLIP_MAGIC;
+        uint32_t version = COOKED_CLIP_VERSION;
+        uint64_t sourceStamp = 0;
+        uint64_t settingsHash = 0;
+        uint64_t skeletonHash = 0;
+        float duration = 0.0f;
+        int32_t ticksPerSecond = 0;
+        float sampleRate = 0.0f;
+        uint32_t trackCount = 0;
+    };
+
+    /// @brief A track of a cooked clip, followed by its keys or by its three compressed tracks
+    struct CookedTrackRecord
+    {
+        int32_t joint = 0;
+        int32_t id = 0;
+        float inverseSampleInterval = 0.0f;
+        uint32_t compressed = 0;
+        //Keys of the position, rotation and scale tracks
+        uint32_t keyCounts[3] = {};
+    };
+
+    /// @brief Size and write time of the source clip. Hashing the whole file would cost more than loading the cooked clip
+    static uint64_t SourceStamp(const std::string& path)
+    {
+        std::error_code error;
+        uint64_t size = std::filesystem::file_size(path, error);
+        if (error)
+            return 0;
+        auto writeTime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+        if (error)
+            return 0;
+        return HashBytes(&writeTime, sizeof(writeTime), HashBytes(&size, sizeof(size)));
+    }
+
+    /// @brief Hash of every setting that changes the cooked tracks, and of the bones of the model
+    static uint64_t HashClipSettings(float sampleRate, const ClipCompressionSettings& compression, 
+    const std::map<std::string, Mesh::BoneInfo>& bones)
+    {
+        //Field by field, so the padding of the structs doesn't reach the hash
+        uint64_t hash = HashBytes(&sampleRate, sizeof(sampleRate));
+        hash = HashBytes(&compression.enabled, sizeof(compression.enabled), hash);
+        hash = HashBytes(&compression.positionError, sizeof(compression.positionError), hash);
+        hash = HashBytes(&compression.rotationError, sizeof(compression.rotationError), hash);
+        hash = HashBytes(&compression.scaleError, sizeof(compression.scaleError), hash);
+        for (const auto& [name, bone] : bones)
+        {
+            hash = HashBytes(name.c_str(), name.size() + 1, hash);
+            hash = HashBytes(&bone.id, sizeof(bone.id), hash);
+            hash = HashBytes(&bone.offset, sizeof(bone.offset), hash);
+        }
+        return hash;
+    }
+
+    //Folder of the cooked files inside the folder of the source clips, so they can be ignored and wiped at once
+    constexpr const char* COOKED_FOLDER = "Cooked/";
+
+    /// @brief Returns the path of the file named after name and hash, in the cooked folder next to sourcePath
+    static std::string HashedPath(const std::string& sourcePath, const std::string& name, uint64_t hash, const char* extension)
+    {
+        char hashName[17];
+        snprintf(hashName, sizeof(hashName), "%016llx", static_cast<unsigned long long>(hash));
+        std::string directory = sourcePath.substr(0, sourcePath.find_last_of("/\\") + 1);
+        return directory + COOKED_FOLDER + name + "." + hashName + extension;
+    }
+
+    void Animation::CreateAnimation(const std::string &animationPath, ModelLoader* model, float sampleRate,
+    const ClipCompressionSettings& compression)
+    {
+        ImportClip(animationPath, model->infoBoneMap, sampleRate, compression);
+        RegisterBones(*model);
+    }
+    void Animation::ImportClip(const std::string &animationPath, const std::map<std::string, Mesh::BoneInfo> &modelBones, 
+    float sampleRate, const ClipCompressionSettings &compression)
     {
+        path = animationPath;
+        //Every variant of the clip has its own file, so the benchmarks don't overwrite the clips of the sample
+        uint64_t sourceStamp = SourceStamp(animationPath);
+        uint64_t settingsHash = HashClipSettings(sampleRate, compression, modelBones);
+        std::string cookedPath = HashedPath(animationPath, std::filesystem::path(animationPath).filename().string(), 
+        settingsHash, ".clip");
+        if (sourceStamp != 0 && LoadCookedClip(cookedPath, sourceStamp, settingsHash))
+            return;
+
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(animationPath, aiProcess_Triangulate);
         assert(scene && scene->mRootNode);
         auto animation = scene->mAnimations[0];
         duration = static_cast<float>(animation->mDuration);
         ticksPerSecond = static_cast<int>(animation->mTicksPerSecond);
-        ReadHeirarchyData(rootNode, scene->mRootNode);
-        ReadMissingBones(animation, *model);
+        ReadTracks(animation, scene->mRootNode, modelBones);
+        //Only the bones of the model get a palette slot, the other joints don't move any vertex
+        skeleton = Skeleton::FromHierarchy(scene->mRootNode, modelBones);
+        trackJoints.resize(bones.size());
+        for (size_t i = 0; i < bones.size(); i++)
+            trackJoints[i] = skeleton->FindJoint(bones[i].name);
+        if (sampleRate > 0.0f)
+            Resample(sampleRate);
+        if (compression.enabled)
+            Compress(compression);
+        CompileSkeleton();
+        if (sourceStamp != 0)
+            CookClip(cookedPath, sourceStamp, settingsHash);
+    }
+    void Animation::RegisterBones(ModelLoader &model)
+    {
+        for (size_t i = 0; i < bones.size(); i++)
+        {
+            const std::string& name = skeleton->names[trackJoints[i]];
+            if (model.infoBoneMap.find(name) == model.infoBoneMap.end())
+            {
+                model.infoBoneMap[name].id = model.boneNumber;
+                model.boneNumber++;
+            }
+            bones[i].id = model.infoBoneMap[name].id;
+        }
+    }
+    bool Animation::LoadCookedClip(const std::string &cookedPath, uint64_t sourceStamp, uint64_t settingsHash)
+    {
+        MappedFile file;
+        if (!file.Open(cookedPath))
+            return false;
+        FileCursor cursor(file);
+        CookedClipHeader header;
+        if (!cursor.Read(&header, sizeof(header)) || header.magic != COOKED_CLIP_MAGIC 
+        || header.version != COOKED_CLIP_VERSION || header.sourceStamp != sourceStamp || header.settingsHash != settingsHash)
+            return false;
+        //The skeleton lives next to the cooked clip, shared with the other clips of the rig
+        std::shared_ptr<const Skeleton> clipSkeleton = Skeleton::Load(HashedPath(path, "skeleton", 
+        header.skeletonHash, ".skeleton"), header.skeletonHash);
+        if (!clipSkeleton || !cursor.Fits(cursor.offset, static_cast<uint64_t>(header.trackCount) * sizeof(CookedTrackRecord)))
+            return false;
+
+        std::vector<Bone> tracks;
+        std::vector<int> jointsOfTracks;
+        tracks.reserve(header.trackCount);
+        for (uint32_t i = 0; i < header.trackCount; i++)
+        {
+            CookedTrackRecord record;
+            if (!cursor.Read(&record, sizeof(record)) || record.joint < 0 
+            || record.joint >= static_cast<int32_t>(clipSkeleton->joints.size()))
+                return false;
+            //The names live in the skeleton, the tracks only know their joint
+            Bone bone(std::string(), record.id);
+            bone.inverseSampleInterval = record.inverseSampleInterval;
+            bone.compressed = record.compressed != 0;
+            bool valid = true;
+            if (bone.compressed)
+            {
+                CompressedTrack* compressedTracks[3] = {&bone.compressedPositions, &bone.compressedRotations, &bone.compressedScales};
+                for (int track = 0; track < 3 && valid; track++)
+                {
+                    CompressedTrack& compressedTrack = *compressedTracks[track];
+                    valid = cursor.Read(&compressedTrack.minimum, sizeof(glm::vec3)) && cursor.Read(&compressedTrack.step, sizeof(glm::vec3))
+                    && cursor.Read(compressedTrack.frames, record.keyCounts[track])
+                    && cursor.Read(compressedTrack.values, static_cast<uint64_t>(record.keyCounts[track]) * 3);
+                }
+            }
+            else
+            {
+                valid = cursor.Read(bone.positions, record.keyCounts[0]) && cursor.Read(bone.rotations, record.keyCounts[1])
+                && cursor.Read(bone.scales, record.keyCounts[2]);
+            }
+            if (!valid)
+                return false;
+            bone.numPositions = static_cast<int>(record.keyCounts[0]);
+            bone.numRotations = static_cast<int>(record.keyCounts[1]);
+            bone.numScalings = static_cast<int>(record.keyCounts[2]);
+            tracks.emplace_back(std::move(bone));
+            jointsOfTracks.emplace_back(record.joint);
+        }
+
+        duration = header.duration;
+        ticksPerSecond = header.ticksPerSecond;
+        sampleRate = header.sampleRate;
+        bones = std::move(tracks);
+        trackJoints = std::move(jointsOfTracks);
+        skeleton = std::move(clipSkeleton);
+        CompileSkeleton();
+        return true;
+    }
+    void Animation::CookClip(const std::string &cookedPath, uint64_t sourceStamp, uint64_t settingsHash) const
+    {
+        std::string skeletonPath = HashedPath(path, "skeleton", skeleton->hash, ".skeleton");
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(skeletonPath).parent_path(), error);
+        if (!std::filesystem::exists(skeletonPath, error))
+            skeleton->Cook(skeletonPath);
+
+        CookedClipHeader header;
+        header.sourceStamp = sourceStamp;
+        header.settingsHash = settingsHash;
+        header.skeletonHash = skeleton->hash;
+        header.duration = duration;
+        header.ticksPerSecond = ticksPerSecond;
+        header.sampleRate = sampleRate;
+        header.trackCount = static_cast<uint32_t>(bones.size());
+        std::vector<unsigned char> file;
+        AppendBytes(file, &header, sizeof(header));
+        for (size_t i = 0; i < bones.size(); i++)
+        {
+            const Bone& bone = bones[i];
+            CookedTrackRecord record;
+            record.joint = trackJoints[i];
+            record.id = bone.id;
+            record.inverseSampleInterval = bone.inverseSampleInterval;
+            record.compressed = bone.compressed;
+            if (bone.compressed)
+            {
+                const CompressedTrack* compressedTracks[3] = {&bone.compressedPositions, &bone.compressedRotations, &bone.compressedScales};
+                for (int track = 0; track < 3; track++)
+                    record.keyCounts[track] = static_cast<uint32_t>(compressedTracks[track]->KeyCount());
+                AppendBytes(file, &record, sizeof(record));
+                for (const CompressedTrack* compressedTrack : compressedTracks)
+                {
+                    AppendBytes(file, &compressedTrack->minimum, sizeof(glm::vec3));
+                    AppendBytes(file, &compressedTrack->step, sizeof(glm::vec3));
+                    AppendBytes(file, compressedTrack->frames.data(), compressedTrack->frames.size() * sizeof(uint16_t));
+                    AppendBytes(file, compressedTrack->values.data(), compressedTrack->values.size() * sizeof(uint16_t));
+                }
+            }
+            else
+            {
+                record.keyCounts[0] = static_cast<uint32_t>(bone.positions.size());
+                record.keyCounts[1] = static_cast<uint32_t>(bone.rotations.size());
+                record.keyCounts[2] = static_cast<uint32_t>(bone.scales.size());
+                AppendBytes(file, &record, sizeof(record));
+                AppendBytes(file, bone.positions.data(), bone.positions.size() * sizeof(KeyPosition));
+                AppendBytes(file, bone.rotations.data(), bone.rotations.size() * sizeof(KeyRotation));
+                AppendBytes(file, bone.scales.data(), bone.scales.size() * sizeof(KeyScale));
+            }
+        }
+        WriteFileAtomically(cookedPath, file.data(), file.size());
+    }
+    void Animation::Resample(float rate)
+    {
+        //Without the ticks per second the time of a sample is unknown
+        if (ticksPerSecond <= 0)
+            return;
+        float sampleInterval = ticksPerSecond / rate;
+        for (auto& bone : bones)
+            bone.Resample(sampleInterval, duration);
+        sampleRate = rate;
+    }
+    void Animation::Compress(const ClipCompressionSettings &settings)
+    {
+        if (sampleRate <= 0.0f)
+            Resample(DEFAULT_COMPRESSION_RATE);
+        if (sampleRate <= 0.0f)
+        {
+            std::cout << "The clip " << path << " has no ticks per second and can't be compressed\n";
+            return;
+        }
+        for (auto& bone : bones)
+            bone.Compress(settings, duration);
+    }
+    size_t Animation::MemoryUsage() const
+    {
+        size_t bytes = 0;
+        for (const auto& bone : bones)
+            bytes += bone.MemoryUsage();
+        return bytes;
     }
     Bone *Animation::FindBone(const std::string &name)
     {
@@ -29,97 +291,364 @@ namespace Minerva
         if (iter == bones.end()) return nullptr;
         else return &(*iter);
     }
-    void Animation::ReadMissingBones(const aiAnimation *animation, ModelLoader &model)
+    void Animation::ReadTracks(const aiAnimation *animation, const aiNode *root, 
+    const std::map<std::string, Mesh::BoneInfo> &modelBones)
     {
         int size = animation->mNumChannels;
 
-        auto& boneInfoMap = model.infoBoneMap;//getting infoBoneMap from ModelLoader class
-        int& boneCount = model.boneNumber; //getting the boneNumber from ModelLoader class
-
         //reading channels(bones engaged in an animation and their keyframes)
         for (int i = 0; i < size; i++)
         {
             auto channel = animation->mChannels[i];
             std::string boneName = channel->mNodeName.data;
+            //A track without its node never reaches the skeleton
+            if (!root->FindNode(channel->mNodeName))
+                continue;
 
-            if (boneInfoMap.find(boneName) == boneInfoMap.end())
-            {
-                boneInfoMap[boneName].id = boneCount;
-                boneCount++;
-            }
-            bones.push_back(Bone(channel->mNodeName.data,
-                boneInfoMap[channel->mNodeName.data].id, channel));
+            //The nodes missing from the model get their id from RegisterBones
+            auto boneInfo = modelBones.find(boneName);
+            bones.push_back(Bone(boneName, boneInfo != modelBones.end() ? boneInfo->second.id : -1, channel));
         }
+    }
 
-        animBoneInfoMap = boneInfoMap;
+    void Animation::CompileSkeleton()
+    {
+        joints.assign(skeleton->joints.size(), ClipJoint());
+        //The first track of a joint animates it
+        for (size_t i = bones.size(); i-- > 0;)
+        {
+            if (trackJoints[i] >= 0)
+                joints[trackJoints[i]].trackIndex = static_cast<int>(i);
+        }
+        PruneSkeleton(0.0f);
     }
-    void Animation::ReadHeirarchyData(AssimpNodeData &dest, const aiNode *src)
+
+    void Animation::PruneSkeleton(float extent)
     {
-        assert(src);
+        const auto& skeleton = this->skeleton->joints;
+        //Joint positions of the bind pose, the parents come first
+        std::vector<Affine3x4> bindPose(skeleton.size());
+        for (size_t i = 0; i < skeleton.size(); i++)
+        {
+            if (skeleton[i].parent >= 0)
+                MultiplyAffine(bindPose[skeleton[i].parent], skeleton[i].bindTransform, bindPose[i]);
+            else
+                bindPose[i] = skeleton[i].bindTransform;
+        }
+        auto jointPosition = [&](size_t node)
+        {
+            return glm::vec3(bindPose[node].rows[0].w, bindPose[node].rows[1].w, bindPose[node].rows[2].w);
+        };
 
-        dest.name = src->mName.data;
-        dest.transformation = ModelLoader::ConvertMatrixToGLMFormat(src->mTransformation);
-        dest.childrenCount = src->mNumChildren;
+        //Length of the longest chain of bones below every node, the children come after their parent
+        std::vector<float> reach(skeleton.size(), 0.0f);
+        for (size_t i = skeleton.size(); i-- > 1;)
+        {
+            int parent = skeleton[i].parent;
+            if (parent >= 0)
+            {
+                float chain = glm::length(jointPosition(i) - jointPosition(parent)) + reach[i];
+                reach[parent] = std::max(reach[parent], chain);
+            }
+        }
 
-        for (unsigned int i = 0; i < src->mNumChildren; i++)
+        float skeletonReach = skeleton.empty() ? 0.0f : reach[0];
+        std::vector<bool> pruned(skeleton.size(), false);
+        prunedTracks.clear();
+        for (size_t i = 0; i < skeleton.size(); i++)
         {
-            AssimpNodeData newData;
-            ReadHeirarchyData(newData, src->mChildren[i]);
-            dest.children.push_back(newData);
+            const SkeletonJoint& node = skeleton[i];
+            ClipJoint& clipJoint = joints[i];
+            bool parentPruned = node.parent >= 0 && pruned[node.parent];
+            pruned[i] = parentPruned || (node.parent >= 0 && reach[i] < extent * skeletonReach);
+            clipJoint.prunedTrackIndex = -1;
+            if (!pruned[i] && clipJoint.trackIndex >= 0)
+            {
+                clipJoint.prunedTrackIndex = static_cast<int>(prunedTracks.size());
+                prunedTracks.emplace_back(clipJoint.trackIndex);
+            }
         }
     }
 
-    void Animator::CreateAnimator(Animation *Animation)
+    std::vector<int> Animation::MapTracks(const Animation &other) const
     {
-        currentTime = 0.0;
-        currentAnimation = Animation;
+        //The clips of the same skeleton compare joints, the others compare the names of the joints
+        bool sameSkeleton = skeleton == other.skeleton;
+        std::vector<int> trackMap(bones.size(), -1);
+        for (size_t i = 0; i < bones.size(); i++)
+        {
+            for (size_t j = 0; j < other.bones.size(); j++)
+            {
+                if (sameSkeleton ? trackJoints[i] == other.trackJoints[j] 
+                : skeleton->names[trackJoints[i]] == other.skeleton->names[other.trackJoints[j]])
+                {
+                    trackMap[i] = static_cast<int>(j);
+                    break;
+                }
+            }
+        }
+        return trackMap;
+    }
+
+    float Animation::DurationInSeconds() const
+    {
+        return ticksPerSecond > 0 ? duration / ticksPerSecond : duration;
+    }
 
-        for (int i = 0; i < MAX_BONES; i++)
-            engineRenderer.UNBoneMatrices.finalBoneMatrices[i] = glm::mat4(1.0f);
+    void Animator::CreateAnimator(Animation *Animation, float startTime, float playbackSpeed)
+    {
+        currentAnimation = Animation;
+        currentTime = fmod(startTime, currentAnimation->duration);
+        speed = playbackSpeed;
+        cursors.assign(currentAnimation->bones.size(), TrackCursor());
+        cachedPoseValid = false;
+        weight = 1.0f;
+        fadeRate = 0.0f;
+        layers.clear();
+        layers.reserve(MAX_ANIMATION_LAYERS);
     }
 
-    void Animator::UpdateAnimation(float dt)
+    void Animator::UpdateAnimation(float dt, BonePalette& palette, uint64_t frame)
     {
         deltaTime = dt;
         if (currentAnimation)
         {
-            currentTime += currentAnimation->ticksPerSecond * dt;
-            currentTime = fmod(currentTime, currentAnimation->duration);
-            CalculateBoneTransform(&currentAnimation->rootNode, glm::mat4(1.0f));
-            
+            UpdateWeights(dt);
+            //The time advances on every frame, so the reduced rate doesn't slow the clip down
+            UpdateTime(dt);
+            if (updateInterval <= 1)
+            {
+                CalculateBoneTransform(palette);
+                return;
+            }
+
+            if (!cachedPoseValid || (frame + updatePhase) % updateInterval == 0)
+            {
+                cachedPose.resize(currentAnimation->skeleton->paletteSize);
+                CalculateBoneTransform(cachedPose.data());
+                cachedPoseValid = true;
+            }
+            //The palettes of the frames in flight are different buffers, so the pose is copied every frame
+            std::copy(cachedPose.begin(), cachedPose.end(), palette.finalBoneMatrices);
         }
     }
 
-    void Animator::PlayAnimation(Animation *pAnimation)
+    void Animator::SetLod(int interval, int phase, bool pruned)
+    {
+        //The cached pose doesn't match the new skeleton
+        if (pruned != prunedSkeleton)
+            cachedPoseValid = false;
+        updateInterval = interval;
+        updatePhase = phase;
+        prunedSkeleton = pruned;
+    }
+
+    void Animator::UpdateWeights(float dt)
+    {
+        weight = std::clamp(weight + fadeRate * dt, 0.0f, 1.0f);
+        if (fadeRate > 0.0f && weight >= 1.0f)
+            fadeRate = 0.0f;
+        for (auto& layer : layers)
+            layer.weight = std::clamp(layer.weight + layer.fadeRate * dt, 0.0f, 1.0f);
+        //Moving the layers reuses their storage, nothing is allocated
+        layers.erase(std::remove_if(layers.begin(), layers.end(), [](const AnimationLayer& layer)
+        {
+            return layer.fadeRate < 0.0f && layer.weight <= 0.0f;
+        }), layers.end());
+    }
+
+    void Animator::UpdateTime(float dt)
+    {
+        /*The synchronized layers share the normalized time of the current clip. The shared cycle 
+        lasts the weighted average of their durations, so every clip keeps its natural pace*/
+        float clipDuration = currentAnimation->DurationInSeconds();
+        float syncedWeight = weight, syncedDuration = weight * clipDuration;
+        for (const auto& layer : layers)
+        {
+            if (layer.synchronized)
+            {
+                syncedWeight += layer.weight;
+                syncedDuration += layer.weight * layer.animation->DurationInSeconds();
+            }
+        }
+        float rate = 1.0f;
+        if (syncedWeight > 0.0f && syncedDuration > 0.0f)
+            rate = clipDuration * syncedWeight / syncedDuration;
+
+        currentTime += currentAnimation->ticksPerSecond * speed * rate * dt;
+        currentTime = fmod(currentTime, currentAnimation->duration);
+        float phase = currentTime / currentAnimation->duration;
+        for (auto& layer : layers)
+        {
+            if (layer.synchronized)
+                layer.time = phase * layer.animation->duration;
+            else
+                layer.time = fmod(layer.time + layer.animation->ticksPerSecond * speed * dt, layer.animation->duration);
+        }
+    }
+
+    void Animator::PlayAnimation(Animation *pAnimation, float startTime)
     {
         currentAnimation = pAnimation;
-        currentTime = 0.0f;
-    }
-    void Animator::CalculateBoneTransform(const AssimpNodeData *node, glm::mat4 parentTransform)
-    {
-        std::string nodeName = node->name;
-        glm::mat4 nodeTransform = node->transformation;
-	
-        Bone* Bone = currentAnimation->FindBone(nodeName);
-	
-        if(Bone)
-        {
-            Bone->Update(currentTime);
-            nodeTransform = Bone->localTransform;
-        }
-	
-        glm::mat4 globalTransformation = parentTransform * nodeTransform;
-	
-        auto& boneInfoMap = currentAnimation->animBoneInfoMap;
-        if (boneInfoMap.find(nodeName) != boneInfoMap.end())
-        {
-            int index = boneInfoMap[nodeName].id;
-            glm::mat4 offset = boneInfoMap[nodeName].offset;
-            engineRenderer.UNBoneMatrices.finalBoneMatrices[index] = globalTransformation * offset;
-            
-        }
-	
-        for (int i = 0; i < node->childrenCount; i++)
-            CalculateBoneTransform(&node->children[i], globalTransformation);
+        currentTime = fmod(startTime, currentAnimation->duration);
+        cursors.assign(currentAnimation->bones.size(), TrackCursor());
+        cachedPoseValid = false;
+        weight = 1.0f;
+        fadeRate = 0.0f;
+        layers.clear();
+    }
+
+    void Animator::CrossFade(Animation *pAnimation, float fadeTime, float startTime)
+    {
+        if (fadeTime <= 0.0f || !currentAnimation)
+        {
+            PlayAnimation(pAnimation, startTime);
+            return;
+        }
+        //The lightest layer makes room for the clip playing now
+        if (layers.size() >= MAX_ANIMATION_LAYERS)
+        {
+            layers.erase(std::min_element(layers.begin(), layers.end(), 
+            [](const AnimationLayer& a, const AnimationLayer& b) { return a.weight < b.weight; }));
+        }
+
+        //Everything playing now fades out at the same pace, the track maps follow the new clip
+        for (auto& layer : layers)
+        {
+            layer.fadeRate = -1.0f / fadeTime;
+            layer.synchronized = false;
+            layer.trackMap = pAnimation->MapTracks(*layer.animation);
+        }
+        AnimationLayer previous;
+        previous.animation = currentAnimation;
+        previous.time = currentTime;
+        previous.weight = weight;
+        previous.fadeRate = -1.0f / fadeTime;
+        previous.cursors = std::move(cursors);
+        previous.trackMap = pAnimation->MapTracks(*currentAnimation);
+        layers.emplace_back(std::move(previous));
+
+        currentAnimation = pAnimation;
+        currentTime = fmod(startTime, currentAnimation->duration);
+        cursors.assign(currentAnimation->bones.size(), TrackCursor());
+        weight = 0.0f;
+        fadeRate = 1.0f / fadeTime;
+    }
+
+    void Animator::SetBlendWeight(Animation *pAnimation, float blendWeight)
+    {
+        if (pAnimation == currentAnimation)
+        {
+            weight = blendWeight;
+            fadeRate = 0.0f;
+            return;
+        }
+        for (auto& layer : layers)
+        {
+            if (layer.animation == pAnimation && layer.fadeRate >= 0.0f)
+            {
+                layer.weight = blendWeight;
+                return;
+            }
+        }
+        if (layers.size() >= MAX_ANIMATION_LAYERS)
+            return;
+
+        AnimationLayer layer;
+        layer.animation = pAnimation;
+        layer.weight = blendWeight;
+        layer.synchronized = true;
+        layer.time = currentTime / currentAnimation->duration * pAnimation->duration;
+        layer.cursors.assign(pAnimation->bones.size(), TrackCursor());
+        layer.trackMap = currentAnimation->MapTracks(*pAnimation);
+        layers.emplace_back(std::move(layer));
+    }
+    void Animator::CalculateBoneTransform(BonePalette& palette)
+    {
+        CalculateBoneTransform(palette.finalBoneMatrices);
+    }
+
+    void Animator::CalculateBoneTransform(glm::mat4* boneMatrices)
+    {
+        //Scratch space of the pose. It grows only once per thread
+        PosePool& pool = PosePool::ForThisThread();
+        thread_local std::vector<Affine3x4> localTransforms;
+        thread_local std::vector<Affine3x4> globalTransforms;
+        const auto& skeleton = currentAnimation->skeleton->joints;
+        const auto& clipJoints = currentAnimation->joints;
+        const auto& bones = currentAnimation->bones;
+
+        //The pruned skeleton gathers only its own tracks, packed in the order of prunedTracks
+        const auto& prunedTracks = currentAnimation->prunedTracks;
+        size_t trackCount = prunedSkeleton ? prunedTracks.size() : bones.size();
+        TrsKeys& keys = pool.Acquire(trackCount);
+        for (size_t i = 0; i < trackCount; i++)
+        {
+            size_t track = prunedSkeleton ? prunedTracks[i] : i;
+            bones[track].GatherKeys(currentTime, &cursors[track], keys, i);
+        }
+        if (localTransforms.size() < trackCount)
+            localTransforms.resize(trackCount);
+
+        float totalWeight = weight;
+        for (const auto& layer : layers)
+            totalWeight += layer.weight;
+        if (layers.empty() || totalWeight <= 0.0f)
+        {
+            ComposeTrs(keys, localTransforms.data(), rotationAccuracy);
+            pool.Release();
+        }
+        else
+        {
+            //Every clip is interpolated in local TRS space and added to the blended pose with its weight
+            TrsKeys& blended = pool.Acquire(trackCount);
+            blended.Clear();
+            if (weight > 0.0f)
+                AccumulateTrs(keys, weight / totalWeight, blended, rotationAccuracy);
+            for (auto& layer : layers)
+            {
+                if (layer.weight <= 0.0f)
+                    continue;
+                const auto& layerBones = layer.animation->bones;
+                for (size_t i = 0; i < trackCount; i++)
+                {
+                    size_t track = prunedSkeleton ? prunedTracks[i] : i;
+                    int layerTrack = layer.trackMap[track];
+                    if (layerTrack >= 0)
+                    {
+                        layerBones[layerTrack].GatherKeys(layer.time, &layer.cursors[layerTrack], keys, i);
+                    }
+                    else
+                    {
+                        const TrackBindPose& bindPose = currentAnimation->skeleton->bindPoses[currentAnimation->trackJoints[track]];
+                        keys.SetConstant(i, bindPose.position, bindPose.rotation, bindPose.scale);
+                    }
+                }
+                AccumulateTrs(keys, layer.weight / totalWeight, blended, rotationAccuracy);
+            }
+            ComposeTrs(blended, localTransforms.data(), rotationAccuracy);
+            pool.Release(2);
+        }
+
+        if (globalTransforms.size() < skeleton.size())
+            globalTransforms.resize(skeleton.size());
+        for (size_t i = 0; i < skeleton.size(); i++)
+        {
+            const SkeletonJoint& node = skeleton[i];
+            int track = prunedSkeleton ? clipJoints[i].prunedTrackIndex : clipJoints[i].trackIndex;
+            const Affine3x4& nodeTransform = track >= 0 ? localTransforms[track] : node.bindTransform;
+
+            if (node.parent >= 0)
+                MultiplyAffine(globalTransforms[node.parent], nodeTransform, globalTransforms[i]);
+            else
+                globalTransforms[i] = nodeTransform;
+
+            if (node.paletteSlot >= 0)
+            {
+                Affine3x4 boneTransform;
+                MultiplyAffine(globalTransforms[i], node.offset, boneTransform);
+                StoreAffine(boneTransform, boneMatrices[node.paletteSlot]);
+            }
+        }
     }
 }
\ No newline at end of file
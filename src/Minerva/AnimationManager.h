@@ -3,6 +3,7 @@
 #include "Bone.h"
 #include "Renderer.h"
 #include "Mesh.h"
+#include "Skeleton.h"
 #include <map>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -10,32 +11,108 @@
 
 namespace Minerva
 {
-    struct AssimpNodeData
+    /// @brief Is the part of a skeleton joint that depends on the clip
+    struct ClipJoint
     {
-        glm::mat4 transformation;
-        std::string name;
-        int childrenCount;
-        std::vector<AssimpNodeData> children;
+        //Index of the animated track inside Animation::bones, -1 if the joint isn't animated
+        int trackIndex = -1;
+        //Index of the track inside Animation::prunedTracks, -1 if the pruned skeleton keeps the bind transform
+        int prunedTrackIndex = -1;
     };
 
-
     class ModelLoader;
 
+    //Samples per second used to compress the clips imported without a sample rate
+    constexpr float DEFAULT_COMPRESSION_RATE = 30.0f;
+
     class Animation
     {
     public:
         float duration;
         int ticksPerSecond;
         std::vector<Bone> bones;
-        AssimpNodeData rootNode;
-        std::map<std::string, Mesh::BoneInfo> animBoneInfoMap;
+        //Shared by every clip of the same rig
+        std::shared_ptr<const Skeleton> skeleton;
+        //Joint animated by each track
+        std::vector<int> trackJoints;
+        //Tracks of each joint of the skeleton
+        std::vector<ClipJoint> joints;
+        //Tracks evaluated by the pruned skeleton of the animation LOD
+        std::vector<int> prunedTracks;
+        std::string path;
+        //Samples per second of the resampled tracks, zero if the source keys are kept
+        float sampleRate = 0.0f;
         Animation() = default; 
-        void CreateAnimation(const std::string& animationPath, ModelLoader* model);
+        /// @brief Imports the first clip of the file, then adds its animated nodes missing from the bones of the model
+        /// @param animationPath The path of the clip
+        /// @param model The model animated by the clip
+        /// @param sampleRate If greater than zero the tracks are resampled at this rate (samples per second),
+        /// so the keys can be found in constant time
+        /// @param compression The settings of the compression, applied when enabled
+        void CreateAnimation(const std::string& animationPath, ModelLoader* model, float sampleRate = 0.0f,
+        const ClipCompressionSettings& compression = ClipCompressionSettings());
+        /// @brief Imports the first clip of the file without touching the model, so many clips can be imported 
+        /// at once. The clip is read from its cooked file when the source and the settings still match, otherwise 
+        /// it is imported and cooked again. RegisterBones must follow before the clip is played
+        /// @param modelBones The bones of the model animated by the clip
+        void ImportClip(const std::string& animationPath, const std::map<std::string, Mesh::BoneInfo>& modelBones,
+        float sampleRate = 0.0f, const ClipCompressionSettings& compression = ClipCompressionSettings());
+        /// @brief Adds the animated nodes missing from the bones of the model and gives every track the id of its bone.
+        /// The clips register in loading order, so the ids don't depend on which clip was imported first
+        void RegisterBones(ModelLoader& model);
+        /// @brief Resamples all the tracks
+        /// @param rate The samples per second
+        void Resample(float rate);
+        /// @brief Compresses all the tracks. A clip which wasn't resampled is resampled at 
+        /// DEFAULT_COMPRESSION_RATE first
+        void Compress(const ClipCompressionSettings& settings);
+        /// @brief Returns the bytes used by the keys of the clip
+        size_t MemoryUsage() const;
         Bone* FindBone(const std::string& name);
-        void ReadMissingBones(const aiAnimation* animation, ModelLoader& model);
-        void ReadHeirarchyData(AssimpNodeData& dest, const aiNode* src);
+        /// @brief Reads the tracks of the nodes in the hierarchy. The tracks of the nodes missing from the bones 
+        /// of the model have no id until RegisterBones
+        void ReadTracks(const aiAnimation* animation, const aiNode* root, const std::map<std::string, Mesh::BoneInfo>& modelBones);
+        /// @brief Links the joints of the skeleton to the tracks. The joints are resolved by index, so the 
+        /// pose evaluation doesn't need any string
+        void CompileSkeleton();
+        /// @brief Maps a cooked clip and reads its tracks, the skeleton is shared or read from its own cooked file
+        /// @return False when the file is missing, corrupted or cooked from another source or other settings
+        bool LoadCookedClip(const std::string& cookedPath, uint64_t sourceStamp, uint64_t settingsHash);
+        /// @brief Writes the tracks into a cooked clip and the skeleton into its cooked file, unless it exists
+        void CookClip(const std::string& cookedPath, uint64_t sourceStamp, uint64_t settingsHash) const;
+        /// @brief Selects the tracks of the pruned skeleton. A subtree whose joints are all closer to 
+        /// its root than extent * the reach of the whole skeleton stays in the bind pose
+        /// @param extent The fraction of the skeleton reach, zero keeps every track
+        void PruneSkeleton(float extent);
+        /// @brief Finds the tracks of another clip which animate the same bones of this clip
+        /// @param other The other clip
+        /// @return For each track of this clip the index of the track inside other, -1 if missing
+        std::vector<int> MapTracks(const Animation& other) const;
+        /// @brief Returns the duration in seconds
+        float DurationInSeconds() const;
+    };
+
+    /// @brief Is a clip blended with the current clip of an animator
+    struct AnimationLayer
+    {
+        Animation* animation = nullptr;
+        float time = 0.0f;
+        float weight = 0.0f;
+        //Weight added every second, negative while a crossfade removes the layer
+        float fadeRate = 0.0f;
+        //The layer follows the normalized time of the current clip, so cycles like walk and run stay in step
+        bool synchronized = false;
+        std::vector<TrackCursor> cursors;
+        //For each track of the current clip the track of the layer clip, -1 when the layer doesn't animate it
+        std::vector<int> trackMap;
     };
 
+    //Maximum number of clips blended with the current one
+    constexpr size_t MAX_ANIMATION_LAYERS = 7;
+
+
+    /// @brief Is the animation state of a single instance. Every instance owns its animator, so 
+    /// instances can play different clips at different times and speeds
     class Animator
     {
     public: 
@@ -43,11 +120,65 @@ namespace Minerva
         Animation* currentAnimation;
         float currentTime;
         float deltaTime;
+        float speed = 1.0f;
+        //One cursor for each track of the current clip
+        std::vector<TrackCursor> cursors;
+        //Blend weight of the current clip, the weights of the clip and of the layers are normalized
+        float weight = 1.0f;
+        float fadeRate = 0.0f;
+        //Clips blended with the current one. Without layers the pose is the current clip alone
+        std::vector<AnimationLayer> layers;
+        NlerpAccuracy rotationAccuracy = NlerpAccuracy::Corrected;
+        //Animation LOD: the pose is evaluated on the frames where (frame + updatePhase) % updateInterval is zero
+        int updateInterval = 1;
+        int updatePhase = 0;
+        bool prunedSkeleton = false;
         Animator() = default;
-        void CreateAnimator(Animation* Animation);
-        void UpdateAnimation(float dt);
-        void PlayAnimation(Animation* pAnimation);
-        void CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 parentTransform);
+        /// @brief Initializes the animator state
+        /// @param Animation The clip played by the animator
+        /// @param startTime The starting time of the clip in ticks
+        /// @param playbackSpeed The multiplier applied to the clip ticks per second
+        void CreateAnimator(Animation* Animation, float startTime = 0.0f, float playbackSpeed = 1.0f);
+        /// @brief Advances the clip and writes the resulting pose into the palette
+        /// @param dt The delta time of the frame
+        /// @param palette The palette of the instance inside the current frame storage buffer
+        /// @param frame The index of the frame, used by the animation LOD to skip the updates
+        void UpdateAnimation(float dt, BonePalette& palette, uint64_t frame = 0);
+        /// @brief Sets the LOD of the animator. With an interval greater than one the last pose is 
+        /// cached, the frames without an update copy it into the palette
+        /// @param interval The frames between two evaluations of the pose
+        /// @param phase The frame of the interval where the pose is evaluated
+        /// @param pruned Evaluates the pruned skeleton of the clip
+        void SetLod(int interval, int phase, bool pruned);
+        /// @brief Switches clip
+        /// @param pAnimation The new clip
+        /// @param startTime The starting time in ticks, wrapped on the duration of the new clip
+        void PlayAnimation(Animation* pAnimation, float startTime = 0.0f);
+        /// @brief Fades from the clips playing now to a new clip. The old clips keep playing as layers
+        /// until their weight reaches zero
+        /// @param pAnimation The new clip
+        /// @param fadeTime The duration of the crossfade in seconds, zero switches like PlayAnimation
+        /// @param startTime The starting time of the new clip in ticks
+        void CrossFade(Animation* pAnimation, float fadeTime, float startTime = 0.0f);
+        /// @brief Sets the blend weight of a clip. A clip different from the current one is added as a 
+        /// layer, synchronized with the current clip, or updated if already playing
+        /// @param pAnimation The clip
+        /// @param blendWeight The weight, zero keeps the layer silent
+        void SetBlendWeight(Animation* pAnimation, float blendWeight);
+        /// @brief Evaluates the pose. The local transforms of all tracks are built by the SIMD kernels, 
+        /// then the compiled skeleton is walked in a single linear loop of affine products
+        /// @param palette The palette where the final bone matrices are written
+        void CalculateBoneTransform(BonePalette& palette);
+
+    private:
+        //Last pose evaluated, valid only while the animator runs at a reduced rate
+        std::vector<glm::mat4> cachedPose;
+        bool cachedPoseValid = false;
 
+        void CalculateBoneTransform(glm::mat4* boneMatrices);
+        /// @brief Advances the weights of the crossfades and removes the layers faded out
+        void UpdateWeights(float dt);
+        /// @brief Advances the time of the current clip and of the layers
+        void UpdateTime(float dt);
     };
 }
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "AssetLoader.h"
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <algorithm>
+
+namespace Minerva
+{
+    using AssetClock = std::chrono::high_resolution_clock;
+
+    static double MillisecondsSince(AssetClock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(AssetClock::now() - start).count();
+    }
+
+    /// @brief Runs every task as its own job. A task which throws doesn't stop the others, its exception
+    /// is thrown again on the calling thread once the wave is done
+    static void RunWave(JobSystem& jobSystem, const std::vector<std::function<void()>>& tasks)
+    {
+        std::vector<std::exception_ptr> errors(tasks.size());
+        jobSystem.ParallelFor(tasks.size(), 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                try
+                {
+                    tasks[i]();
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                }
+            }
+        });
+        for (const auto& error : errors)
+        {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    }
+
+    LoadedAssets AssetLoader::Load(const SampleType &sample, ModelLoader &model, const TextureManager &textures,
+    JobSystem &jobSystem) const
+    {
+        LoadedAssets assets;
+        AssetLoadTimes& times = assets.times;
+        assets.threadCount = jobSystem.ThreadCount();
+
+        //The clips need the bones of the model, the texture needs nothing. The threads left idle by
+        //the wave help parsing the model
+        model.jobSystem = &jobSystem;
+        auto waveStart = AssetClock::now();
+        RunWave(jobSystem,
+        {
+            [&]()
+            {
+                auto start = AssetClock::now();
+                model.LoadModel(sample.modelName, sample.meshOptimization, sample.meshLod);
+                times.model = MillisecondsSince(start);
+            },
+            [&]()
+            {
+                auto start = AssetClock::now();
+                assets.texture = textures.DecodeTexture(sample.textureName);
+                times.texture = MillisecondsSince(start);
+            }
+        });
+        times.modelWave = MillisecondsSince(waveStart);
+        if (!model.HasSkeleton())
+            return assets;
+
+        //The clips only read the bones of the model, each one writes its own slot
+        size_t clipCount = std::min(static_cast<size_t>(std::max(sample.animNumber, 0)), sample.animName.size());
+        assets.clips.resize(clipCount);
+        std::vector<double> clipTimes(clipCount, 0.0);
+        std::vector<std::function<void()>> clipTasks;
+        for (size_t i = 0; i < clipCount; i++)
+        {
+            clipTasks.emplace_back([&, i]()
+            {
+                auto start = AssetClock::now();
+                Animation& clip = assets.clips[i];
+                clip.ImportClip(ANIMATIONS_PATH + sample.animName[i], model.infoBoneMap, sample.animSampleRate,
+                sample.animCompression);
+                if (sample.animLod.enabled)
+                    clip.PruneSkeleton(sample.animLod.pruneExtent);
+                clipTimes[i] = MillisecondsSince(start);
+            });
+        }
+        waveStart = AssetClock::now();
+        RunWave(jobSystem, clipTasks);
+        times.clipWave = MillisecondsSince(waveStart);
+        for (double clipTime : clipTimes)
+            times.clips += clipTime;
+
+        //In loading order, so the bones added to the model are the same on every run
+        auto start = AssetClock::now();
+        for (auto& clip : assets.clips)
+            clip.RegisterBones(model);
+        times.bones = MillisecondsSince(start);
+        return assets;
+    }
+}
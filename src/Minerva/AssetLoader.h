@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "AnimationManager.h"
+#include "TextureManager.h"
+#include "ModelLoader.h"
+#include "JobSystem.h"
+
+namespace Minerva
+{
+    /// @brief Milliseconds spent by every phase of a load. The phases of a wave run at the same time,
+    /// so the wall time of a wave is shorter than the sum of its phases
+    struct AssetLoadTimes
+    {
+        double model = 0.0;
+        double texture = 0.0;
+        //Sum of the time spent on every clip
+        double clips = 0.0;
+        //Wall time of the wave importing the model while the texture is decoded
+        double modelWave = 0.0;
+        //Wall time of the wave importing the clips
+        double clipWave = 0.0;
+        //Time spent adding the animated nodes of the clips to the bones of the model
+        double bones = 0.0;
+        double Total() const { return modelWave + clipWave + bones; }
+    };
+
+    /// @brief The CPU payloads of a sample, handed to the upload stage
+    struct LoadedAssets
+    {
+        TextureData texture;
+        std::vector<Animation> clips;
+        AssetLoadTimes times;
+        unsigned threadCount = 1;
+    };
+
+    /// @brief Loads the assets of a sample on the job system. The model is imported while the texture is
+    /// decoded, then every clip is imported by its own job against the bones of the model. Nothing touches
+    /// the device, the calling thread uploads the payloads afterwards
+    class AssetLoader
+    {
+    public:
+        /// @brief Loads the texture, the model and, when the model has a skeleton, the clips of the sample
+        /// @param sample The sample, its mesh optimization settings are used as they are
+        /// @param model The loader receiving the model, usually an empty scene
+        /// @param textures Decodes the texture
+        /// @param jobSystem The started job system, the caller works as one of its threads
+        /// @return The decoded texture and the clips, ready to be played
+        LoadedAssets Load(const SampleType& sample, ModelLoader& model, const TextureManager& textures,
+        JobSystem& jobSystem) const;
+    private:
+        const std::string ANIMATIONS_PATH = "C:/UNIMI/TESI/Phoenix/src/Minerva/Animations/";
+    };
+}
@@ -0,0 +1,74 @@
+#include "BakedAnimation.h"
+#include "AnimationManager.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace Minerva
+{
+    void BakedAnimations::Bake(std::vector<Animation> &animations, float frameRate, int boneCount, 
+    JobSystem &jobSystem)
+    {
+        if (animations.size() > MAX_BAKED_CLIPS)
+            throw std::runtime_error("too many clips to bake!");
+
+        header = BakedAnimationHeader{};
+        header.boneCount = static_cast<uint32_t>(std::clamp(boneCount, 1, MAX_BONES));
+        header.clipCount = static_cast<uint32_t>(animations.size());
+        uint32_t totalFrames = 0;
+        for (size_t clip = 0; clip < animations.size(); clip++)
+        {
+            Animation& animation = animations[clip];
+            BakedClipInfo& info = header.clips[clip];
+            float ticksPerSecond = animation.ticksPerSecond > 0 ? static_cast<float>(animation.ticksPerSecond) : 1.0f;
+            info.duration = animation.duration / ticksPerSecond;
+            info.frameRate = frameRate;
+            info.frameCount = static_cast<uint32_t>(std::ceil(info.duration * frameRate)) + 1;
+            info.firstFrame = totalFrames;
+            totalFrames += info.frameCount;
+        }
+        frames.assign(static_cast<size_t>(totalFrames) * header.boneCount, ToAffine(glm::mat4(1.0f)));
+
+        for (size_t clip = 0; clip < animations.size(); clip++)
+        {
+            Animation& animation = animations[clip];
+            const BakedClipInfo& info = header.clips[clip];
+            float ticksPerFrame = animation.duration / (info.duration * frameRate);
+            //Every job evaluates its frames with its own animator
+            jobSystem.ParallelFor(info.frameCount, 8, [&](size_t begin, size_t end)
+            {
+                Animator animator;
+                animator.CreateAnimator(&animation);
+                BonePalette palette;
+                for (size_t frame = begin; frame < end; frame++)
+                {
+                    //The bones the clip does not animate keep the identity, like the live palettes
+                    for (int bone = 0; bone < MAX_BONES; bone++)
+                        palette.finalBoneMatrices[bone] = glm::mat4(1.0f);
+                    animator.currentTime = std::min(frame * ticksPerFrame, animation.duration);
+                    animator.CalculateBoneTransform(palette);
+                    Affine3x4* bakedFrame = &frames[(info.firstFrame + frame) * header.boneCount];
+                    for (uint32_t bone = 0; bone < header.boneCount; bone++)
+                        bakedFrame[bone] = ToAffine(palette.finalBoneMatrices[bone]);
+                }
+            });
+        }
+    }
+
+    size_t BakedAnimations::BufferSize() const
+    {
+        return sizeof(BakedAnimationHeader) + frames.size() * sizeof(Affine3x4);
+    }
+
+    void BakedAnimations::CopyTo(void *data) const
+    {
+        memcpy(data, &header, sizeof(BakedAnimationHeader));
+        if (!frames.empty())
+        {
+            memcpy(static_cast<char*>(data) + sizeof(BakedAnimationHeader), frames.data(), 
+            frames.size() * sizeof(Affine3x4));
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "PoseKernels.h"
+
+namespace Minerva
+{
+    class Animation;
+    class JobSystem;
+
+    //Maximum number of clips in the baked animation buffer, it must match base.vert
+    constexpr int MAX_BAKED_CLIPS = 16;
+
+    /// @brief Describes where a clip lives inside the baked animation buffer
+    struct BakedClipInfo
+    {
+        uint32_t firstFrame;
+        uint32_t frameCount;
+        //Frames per second
+        float frameRate;
+        //Duration in seconds
+        float duration;
+    };
+
+    /// @brief Is the head of the baked animation buffer, the frames follow it. The layout matches 
+    /// the std430 block bakedBufferObj of base.vert
+    struct BakedAnimationHeader
+    {
+        uint32_t boneCount;
+        uint32_t clipCount;
+        uint32_t padding[2];
+        BakedClipInfo clips[MAX_BAKED_CLIPS];
+    };
+
+    /// @brief Holds the bone palettes of every clip sampled at a fixed rate. The vertex shader reads 
+    /// them with the clip, time offset and speed of the instance, so the CPU has no per frame 
+    /// animation work. Every frame stores boneCount affine transforms
+    class BakedAnimations
+    {
+    public:
+        BakedAnimationHeader header {};
+        std::vector<Affine3x4> frames;
+        /// @brief Samples every clip. The frames are evaluated in parallel
+        /// @param animations The clips, at most MAX_BAKED_CLIPS
+        /// @param frameRate The frames per second of the baked clips
+        /// @param boneCount The number of palette slots of the model
+        /// @param jobSystem The started job system
+        void Bake(std::vector<Animation>& animations, float frameRate, int boneCount, JobSystem& jobSystem);
+        /// @brief Returns the size of the buffer which holds the header and the frames
+        size_t BufferSize() const;
+        /// @brief Writes the header and the frames into the mapped memory of the buffer
+        void CopyTo(void* data) const;
+    };
+}
@@ -1,4 +1,7 @@
 #include "Bone.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
 
 namespace Minerva
 {
@@ -40,93 +43,302 @@ namespace Minerva
         }
 
     }
-    int Bone::GetPositionIndex(float animationTime)
+    Bone::Bone(const std::string &name, int ID): numPositions(0), numRotations(0), numScalings(0), 
+    localTransform(1.0f), name(name), id(ID)
     {
-        for (int index = 0; index < numPositions - 1; ++index)
-        {
-            if (animationTime < positions[index + 1].timeStamp)
-                return index;
-        }
-        assert(0);
     }
-    int Bone::GetRotationIndex(float animationTime)
+    /// @brief Finds the key which starts the interval containing animationTime
+    template<typename Key>
+    static int FindKeyIndex(const std::vector<Key>& keys, float animationTime, 
+    float inverseSampleInterval, int* cursor)
     {
-        for (int index = 0; index < numRotations - 1; ++index)
+        int lastSegment = static_cast<int>(keys.size()) - 2;
+        if (inverseSampleInterval > 0.0f)
+            return std::clamp(static_cast<int>(animationTime * inverseSampleInterval), 0, lastSegment);
+
+        int index = 0;
+        if (cursor)
         {
-            if (animationTime < rotations[index + 1].timeStamp)
-                return index;
+            index = std::clamp(*cursor, 0, lastSegment);
+            //The clip looped or the time went backwards, so the search restarts
+            if (animationTime < keys[index].timeStamp)
+                index = 0;
         }
-        assert(0);
+        while (index < lastSegment && animationTime >= keys[index + 1].timeStamp)
+            index++;
+
+        if (cursor)
+            *cursor = index;
+        return index;
     }
-    int Bone::GetScaleIndex(float animationTime)
+
+    int Bone::GetPositionIndex(float animationTime, int* cursor) const
     {
-        for (int index = 0; index < numScalings - 1; ++index)
-        {
-            if (animationTime < scales[index + 1].timeStamp)
-                return index;
-        }
-        assert(0);
+        return FindKeyIndex(positions, animationTime, inverseSampleInterval, cursor);
+    }
+    int Bone::GetRotationIndex(float animationTime, int* cursor) const
+    {
+        return FindKeyIndex(rotations, animationTime, inverseSampleInterval, cursor);
+    }
+    int Bone::GetScaleIndex(float animationTime, int* cursor) const
+    {
+        return FindKeyIndex(scales, animationTime, inverseSampleInterval, cursor);
     }
 
-    float Bone::GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime)
+    float Bone::GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime) const
     {
         float scaleFactor = 0.0f;
         float midWayLength = animationTime - lastTimeStamp;
         float framesDiff = nextTimeStamp - lastTimeStamp;
         scaleFactor = midWayLength / framesDiff;
-        return scaleFactor;
+        return std::clamp(scaleFactor, 0.0f, 1.0f);
+    }
+
+    static glm::vec3 SampleVectorTrack(const CompressedTrack& track, float frame, int* cursor)
+    {
+        if (1 == track.KeyCount())
+            return track.DecodeVector(0);
+        int key = track.FindKey(frame, cursor);
+        return glm::mix(track.DecodeVector(key), track.DecodeVector(key + 1), track.GetFactor(key, frame));
     }
 
-    glm::mat4 Bone::InterpolatePosition(float animationTime)
+    glm::vec3 Bone::SamplePosition(float animationTime, int* cursor) const
     {
+        if (compressed)
+            return SampleVectorTrack(compressedPositions, animationTime * inverseSampleInterval, cursor);
         if (1 == numPositions)
-            return glm::translate(glm::mat4(1.0f), positions[0].position);
+            return positions[0].position;
 
-        int p0Index = GetPositionIndex(animationTime);
+        int p0Index = GetPositionIndex(animationTime, cursor);
         int p1Index = p0Index + 1;
         float scaleFactor = GetScaleFactor(positions[p0Index].timeStamp,
             positions[p1Index].timeStamp, animationTime);
-        glm::vec3 finalPosition = glm::mix(positions[p0Index].position,
-            positions[p1Index].position, scaleFactor);
-        return glm::translate(glm::mat4(1.0f), finalPosition);
+        return glm::mix(positions[p0Index].position, positions[p1Index].position, scaleFactor);
     }
 
-    glm::mat4 Bone::InterpolateRotation(float animationTime)
+    glm::quat Bone::SampleRotation(float animationTime, int* cursor) const
     {
-        if (1 == numRotations)
+        if (compressed)
         {
-            auto rotation = glm::normalize(rotations[0].orientation);
-            return glm::toMat4(rotation);
+            const CompressedTrack& track = compressedRotations;
+            if (1 == track.KeyCount())
+                return track.DecodeRotation(0);
+            float frame = animationTime * inverseSampleInterval;
+            int key = track.FindKey(frame, cursor);
+            return glm::normalize(glm::slerp(track.DecodeRotation(key), track.DecodeRotation(key + 1),
+            track.GetFactor(key, frame)));
         }
+        if (1 == numRotations)
+            return glm::normalize(rotations[0].orientation);
 
-        int p0Index = GetRotationIndex(animationTime);
+        int p0Index = GetRotationIndex(animationTime, cursor);
         int p1Index = p0Index + 1;
         float scaleFactor = GetScaleFactor(rotations[p0Index].timeStamp,
             rotations[p1Index].timeStamp, animationTime);
         glm::quat finalRotation = glm::slerp(rotations[p0Index].orientation,
             rotations[p1Index].orientation, scaleFactor);
-        finalRotation = glm::normalize(finalRotation);
-        return glm::toMat4(finalRotation);
+        return glm::normalize(finalRotation);
     }
 
-    glm::mat4 Bone::InterpolateScaling(float animationTime)
+    glm::vec3 Bone::SampleScale(float animationTime, int* cursor) const
     {
+        if (compressed)
+            return SampleVectorTrack(compressedScales, animationTime * inverseSampleInterval, cursor);
         if (1 == numScalings)
-            return glm::scale(glm::mat4(1.0f), scales[0].scale);
+            return scales[0].scale;
 
-        int p0Index = GetScaleIndex(animationTime);
+        int p0Index = GetScaleIndex(animationTime, cursor);
         int p1Index = p0Index + 1;
         float scaleFactor = GetScaleFactor(scales[p0Index].timeStamp,
             scales[p1Index].timeStamp, animationTime);
-        glm::vec3 finalScale = glm::mix(scales[p0Index].scale, scales[p1Index].scale
-            , scaleFactor);
-        return glm::scale(glm::mat4(1.0f), finalScale);
+        return glm::mix(scales[p0Index].scale, scales[p1Index].scale, scaleFactor);
+    }
+
+    glm::mat4 Bone::InterpolatePosition(float animationTime, int* cursor) const
+    {
+        return glm::translate(glm::mat4(1.0f), SamplePosition(animationTime, cursor));
+    }
+
+    glm::mat4 Bone::InterpolateRotation(float animationTime, int* cursor) const
+    {
+        return glm::toMat4(SampleRotation(animationTime, cursor));
+    }
+
+    glm::mat4 Bone::InterpolateScaling(float animationTime, int* cursor) const
+    {
+        return glm::scale(glm::mat4(1.0f), SampleScale(animationTime, cursor));
+    }
+    glm::mat4 Bone::Sample(float animationTime, TrackCursor* cursor) const
+    {
+        glm::mat4 translation = InterpolatePosition(animationTime, cursor ? &cursor->position : nullptr);
+        glm::mat4 rotation = InterpolateRotation(animationTime, cursor ? &cursor->rotation : nullptr);
+        glm::mat4 scale = InterpolateScaling(animationTime, cursor ? &cursor->scale : nullptr);
+        return translation * rotation * scale;
+    }
+    /// @brief Finds the two keys of a compressed track around frame and returns their factor
+    template<typename Value, typename Decode>
+    static float GatherTrackKeys(const CompressedTrack& track, float frame, int* cursor, 
+    Value& key0, Value& key1, Decode decode)
+    {
+        if (1 == track.KeyCount())
+        {
+            key0 = key1 = decode(track, 0);
+            return 0.0f;
+        }
+        int key = track.FindKey(frame, cursor);
+        key0 = decode(track, key);
+        key1 = decode(track, key + 1);
+        return track.GetFactor(key, frame);
+    }
+
+    void Bone::GatherKeys(float animationTime, TrackCursor* cursor, TrsKeys& keys, size_t lane) const
+    {
+        glm::vec3 position0, position1, scale0, scale1;
+        glm::quat rotation0, rotation1;
+        if (compressed)
+        {
+            float frame = animationTime * inverseSampleInterval;
+            auto decodeVector = [](const CompressedTrack& track, int key) { return track.DecodeVector(key); };
+            auto decodeRotation = [](const CompressedTrack& track, int key) { return track.DecodeRotation(key); };
+            keys.positionFactor[lane] = GatherTrackKeys(compressedPositions, frame, 
+            cursor ? &cursor->position : nullptr, position0, position1, decodeVector);
+            keys.rotationFactor[lane] = GatherTrackKeys(compressedRotations, frame, 
+            cursor ? &cursor->rotation : nullptr, rotation0, rotation1, decodeRotation);
+            keys.scaleFactor[lane] = GatherTrackKeys(compressedScales, frame, 
+            cursor ? &cursor->scale : nullptr, scale0, scale1, decodeVector);
+        }
+        else
+        {
+            int p0Index = 0, p1Index = 0;
+            keys.positionFactor[lane] = 0.0f;
+            if (numPositions > 1)
+            {
+                p0Index = GetPositionIndex(animationTime, cursor ? &cursor->position : nullptr);
+                p1Index = p0Index + 1;
+                keys.positionFactor[lane] = GetScaleFactor(positions[p0Index].timeStamp,
+                positions[p1Index].timeStamp, animationTime);
+            }
+
+            int r0Index = 0, r1Index = 0;
+            keys.rotationFactor[lane] = 0.0f;
+            if (numRotations > 1)
+            {
+                r0Index = GetRotationIndex(animationTime, cursor ? &cursor->rotation : nullptr);
+                r1Index = r0Index + 1;
+                keys.rotationFactor[lane] = GetScaleFactor(rotations[r0Index].timeStamp,
+                rotations[r1Index].timeStamp, animationTime);
+            }
+
+            int s0Index = 0, s1Index = 0;
+            keys.scaleFactor[lane] = 0.0f;
+            if (numScalings > 1)
+            {
+                s0Index = GetScaleIndex(animationTime, cursor ? &cursor->scale : nullptr);
+                s1Index = s0Index + 1;
+                keys.scaleFactor[lane] = GetScaleFactor(scales[s0Index].timeStamp,
+                scales[s1Index].timeStamp, animationTime);
+            }
+            position0 = positions[p0Index].position;
+            position1 = positions[p1Index].position;
+            rotation0 = rotations[r0Index].orientation;
+            rotation1 = rotations[r1Index].orientation;
+            scale0 = scales[s0Index].scale;
+            scale1 = scales[s1Index].scale;
+        }
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            keys.position0[axis][lane] = position0[axis];
+            keys.position1[axis][lane] = position1[axis];
+            keys.scale0[axis][lane] = scale0[axis];
+            keys.scale1[axis][lane] = scale1[axis];
+        }
+        //glm stores the quaternions as x, y, z, w
+        for (int axis = 0; axis < 4; axis++)
+        {
+            keys.rotation0[axis][lane] = rotation0[axis];
+            keys.rotation1[axis][lane] = rotation1[axis];
+        }
     }
+
     void Bone::Update(float animationTime)
     {
-        glm::mat4 translation = InterpolatePosition(animationTime);
-        glm::mat4 rotation = InterpolateRotation(animationTime);
-        glm::mat4 scale = InterpolateScaling(animationTime);
-        localTransform = translation * rotation * scale;
+        localTransform = Sample(animationTime);
+    }
+
+    void Bone::Resample(float sampleInterval, float duration)
+    {
+        if (compressed)
+            throw std::runtime_error("the compressed bone " + name + " can't be resampled");
+        int sampleCount = static_cast<int>(std::ceil(duration / sampleInterval)) + 1;
+        std::vector<KeyPosition> resampledPositions(sampleCount);
+        std::vector<KeyRotation> resampledRotations(sampleCount);
+        std::vector<KeyScale> resampledScales(sampleCount);
+        for (int i = 0; i < sampleCount; i++)
+        {
+            float timeStamp = std::min(i * sampleInterval, duration);
+            resampledPositions[i] = {SamplePosition(timeStamp), timeStamp};
+            resampledRotations[i] = {SampleRotation(timeStamp), timeStamp};
+            resampledScales[i] = {SampleScale(timeStamp), timeStamp};
+        }
+
+        //Constant tracks keep their single key, they never search for an index
+        if (numPositions > 1)
+        {
+            positions = std::move(resampledPositions);
+            numPositions = sampleCount;
+        }
+        if (numRotations > 1)
+        {
+            rotations = std::move(resampledRotations);
+            numRotations = sampleCount;
+        }
+        if (numScalings > 1)
+        {
+            scales = std::move(resampledScales);
+            numScalings = sampleCount;
+        }
+        inverseSampleInterval = 1.0f / sampleInterval;
+    }
+
+    void Bone::Compress(const ClipCompressionSettings& settings, float duration)
+    {
+        if (inverseSampleInterval <= 0.0f)
+            throw std::runtime_error("the tracks of bone " + name + " must be resampled before the compression");
+
+        //Every animated track was resampled on the same frames
+        int frameCount = std::max({numPositions, numRotations, numScalings});
+        float sampleInterval = 1.0f / inverseSampleInterval;
+        std::vector<glm::vec3> positionSamples(frameCount), scaleSamples(frameCount);
+        std::vector<glm::quat> rotationSamples(frameCount);
+        for (int i = 0; i < frameCount; i++)
+        {
+            float timeStamp = std::min(i * sampleInterval, duration);
+            positionSamples[i] = SamplePosition(timeStamp);
+            rotationSamples[i] = SampleRotation(timeStamp);
+            scaleSamples[i] = SampleScale(timeStamp);
+        }
+
+        compressedPositions = CompressVectorTrack(positionSamples, settings.positionError);
+        compressedRotations = CompressRotationTrack(rotationSamples, settings.rotationError);
+        compressedScales = CompressVectorTrack(scaleSamples, settings.scaleError);
+        numPositions = compressedPositions.KeyCount();
+        numRotations = compressedRotations.KeyCount();
+        numScalings = compressedScales.KeyCount();
+        positions = std::vector<KeyPosition>();
+        rotations = std::vector<KeyRotation>();
+        scales = std::vector<KeyScale>();
+        compressed = true;
+    }
+
+    size_t Bone::MemoryUsage() const
+    {
+        if (compressed)
+        {
+            return compressedPositions.MemoryUsage() + compressedRotations.MemoryUsage() + 
+            compressedScales.MemoryUsage();
+        }
+        return positions.size() * sizeof(KeyPosition) + rotations.size() * sizeof(KeyRotation) + 
+        scales.size() * sizeof(KeyScale);
     }
 }
\ No newline at end of file
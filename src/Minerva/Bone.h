@@ -5,6 +5,8 @@
 #include <vector>
 #include <string>
 #include <assimp/anim.h>
+#include "PoseKernels.h"
+#include "ClipCompression.h"
 namespace Minerva
 {
     struct KeyPosition
@@ -24,6 +26,15 @@ namespace Minerva
         glm::vec3 scale;
         float timeStamp;
     };
+    /// @brief Remembers the last key used on each track of a bone. Since the animation time 
+    /// advances a little every frame, the search restarts from here instead of key 0
+    struct TrackCursor
+    {
+        int position = 0;
+        int rotation = 0;
+        int scale = 0;
+    };
+
     class Bone
     {
     public:
@@ -34,16 +45,57 @@ namespace Minerva
         int numRotations;
         int numScalings;
         glm::mat4 localTransform;
+        //Empty for the tracks of a cooked clip, the skeleton holds the names
         std::string name;
         int id;
+        /*Is different from zero only when the keys are evenly spaced by 1 / inverseSampleInterval ticks.
+        In that case the key index is computed directly from the time*/
+        float inverseSampleInterval = 0.0f;
+        /*When true the keys live in the compressed tracks and the key vectors are empty. 
+        Compressed tracks are always sampled on frames of 1 / inverseSampleInterval ticks*/
+        bool compressed = false;
+        CompressedTrack compressedPositions;
+        CompressedTrack compressedRotations;
+        CompressedTrack compressedScales;
         Bone(const std::string& name, int ID, const aiNodeAnim* channel);
-        int GetPositionIndex(float animationTime);
-        int GetRotationIndex(float animationTime);
-        int GetScaleIndex(float animationTime);
-        float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime);
-        glm::mat4 InterpolatePosition(float animationTime);
-        glm::mat4 InterpolateRotation(float animationTime);
-        glm::mat4 InterpolateScaling(float animationTime);
+        /// @brief Creates a bone without keys, filled by a cooked clip
+        Bone(const std::string& name, int ID);
+        int GetPositionIndex(float animationTime, int* cursor = nullptr) const;
+        int GetRotationIndex(float animationTime, int* cursor = nullptr) const;
+        int GetScaleIndex(float animationTime, int* cursor = nullptr) const;
+        float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime) const;
+        glm::vec3 SamplePosition(float animationTime, int* cursor = nullptr) const;
+        glm::quat SampleRotation(float animationTime, int* cursor = nullptr) const;
+        glm::vec3 SampleScale(float animationTime, int* cursor = nullptr) const;
+        glm::mat4 InterpolatePosition(float animationTime, int* cursor = nullptr) const;
+        glm::mat4 InterpolateRotation(float animationTime, int* cursor = nullptr) const;
+        glm::mat4 InterpolateScaling(float animationTime, int* cursor = nullptr) const;
+        /// @brief Samples the local transform of the bone without touching the bone state. 
+        /// The same track can be sampled by many animators
+        /// @param animationTime The time in ticks
+        /// @param cursor The cursor of the animator, used when the track isn't uniformly sampled
+        /// @return The local transform
+        glm::mat4 Sample(float animationTime, TrackCursor* cursor = nullptr) const;
+        /// @brief Finds the keys around animationTime and their interpolation factors, without 
+        /// interpolating. The keys are written into one lane of the SoA batch evaluated by ComposeTrs
+        /// @param animationTime The time in ticks
+        /// @param cursor The cursor of the animator, used when the track isn't uniformly sampled
+        /// @param keys The batch
+        /// @param lane The index of the bone inside the batch
+        void GatherKeys(float animationTime, TrackCursor* cursor, TrsKeys& keys, size_t lane) const;
+        /// @brief Replaces the keys of all tracks with keys evenly spaced in time. 
+        /// The new keys are sampled from the source keys
+        /// @param sampleInterval The distance between two keys in ticks
+        /// @param duration The duration of the clip in ticks
+        void Resample(float sampleInterval, float duration);
+        /// @brief Replaces the keys with compressed tracks: constant tracks collapse to one key, the 
+        /// keys which can be interpolated within the tolerances are removed and the remaining ones are 
+        /// quantized. The tracks must have been resampled
+        /// @param settings The tolerances
+        /// @param duration The duration of the clip in ticks
+        void Compress(const ClipCompressionSettings& settings, float duration);
+        /// @brief Returns the bytes used by the keys of the bone
+        size_t MemoryUsage() const;
         void Update(float animationTime);
         ~Bone() = default;
     };
@@ -0,0 +1,225 @@
+#include "ClipCompression.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace Minerva
+{
+    static constexpr float QUANTIZED_VECTOR_RANGE = 65535.0f;
+    //Smallest-three components are stored on 15 bits, the 16th bits hold the index of the largest one
+    static constexpr float QUANTIZED_ROTATION_RANGE = 32767.0f;
+    static constexpr float SQRT_2 = 1.41421356f;
+
+    int CompressedTrack::FindKey(float frame, int* cursor) const
+    {
+        int lastSegment = KeyCount() - 2;
+        if (lastSegment < 0)
+            return 0;
+        //No key was removed, so key i lies on frame i
+        if (frames.back() == lastSegment + 1)
+            return std::clamp(static_cast<int>(frame), 0, lastSegment);
+
+        int index = 0;
+        if (cursor)
+        {
+            index = std::clamp(*cursor, 0, lastSegment);
+            //The clip looped or the time went backwards, so the search restarts
+            if (frame < frames[index])
+                index = 0;
+        }
+        while (index < lastSegment && frame >= frames[index + 1])
+            index++;
+
+        if (cursor)
+            *cursor = index;
+        return index;
+    }
+
+    float CompressedTrack::GetFactor(int key, float frame) const
+    {
+        if (KeyCount() < 2)
+            return 0.0f;
+        float factor = (frame - frames[key]) / static_cast<float>(frames[key + 1] - frames[key]);
+        return std::clamp(factor, 0.0f, 1.0f);
+    }
+
+    glm::vec3 CompressedTrack::DecodeVector(int key) const
+    {
+        const uint16_t* packed = &values[key * 3];
+        return minimum + step * glm::vec3(packed[0], packed[1], packed[2]);
+    }
+
+    glm::quat CompressedTrack::DecodeRotation(int key) const
+    {
+        const uint16_t* packed = &values[key * 3];
+        const float scale = 2.0f / (QUANTIZED_ROTATION_RANGE * SQRT_2), bias = -1.0f / SQRT_2;
+        float a = (packed[0] & 0x7FFF) * scale + bias;
+        float b = (packed[1] & 0x7FFF) * scale + bias;
+        float c = (packed[2] & 0x7FFF) * scale + bias;
+        float largest = std::sqrt(std::max(0.0f, 1.0f - a * a - b * b - c * c));
+        //glm::quat takes w, x, y, z. The stored components keep their order around the largest one
+        switch ((packed[0] >> 15) | ((packed[1] >> 15) << 1))
+        {
+            case 0: return glm::quat(c, largest, a, b);
+            case 1: return glm::quat(c, a, largest, b);
+            case 2: return glm::quat(c, a, b, largest);
+            default: return glm::quat(largest, a, b, c);
+        }
+    }
+
+    size_t CompressedTrack::MemoryUsage() const
+    {
+        return sizeof(CompressedTrack) + frames.size() * sizeof(uint16_t) + values.size() * sizeof(uint16_t);
+    }
+
+    static void EncodeVector(const glm::vec3& vector, const glm::vec3& minimum, const glm::vec3& step,
+    uint16_t* packed)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float normalized = step[axis] > 0.0f ? (vector[axis] - minimum[axis]) / step[axis] : 0.0f;
+            packed[axis] = static_cast<uint16_t>(std::lround(std::clamp(normalized, 0.0f, QUANTIZED_VECTOR_RANGE)));
+        }
+    }
+
+    static void EncodeRotation(glm::quat rotation, uint16_t* packed)
+    {
+        rotation = glm::normalize(rotation);
+        int largest = 0;
+        for (int i = 1; i < 4; i++)
+        {
+            if (std::fabs(rotation[i]) > std::fabs(rotation[largest]))
+                largest = i;
+        }
+        //q and -q are the same rotation, so the dropped component is always positive
+        if (rotation[largest] < 0.0f)
+            rotation = -rotation;
+
+        for (int i = 0, component = 0; i < 4; i++)
+        {
+            if (i == largest)
+                continue;
+            float normalized = std::clamp((rotation[i] * SQRT_2 + 1.0f) * 0.5f, 0.0f, 1.0f);
+            packed[component] = static_cast<uint16_t>(std::lround(normalized * QUANTIZED_ROTATION_RANGE));
+            component++;
+        }
+        packed[0] |= static_cast<uint16_t>((largest & 1) << 15);
+        packed[1] |= static_cast<uint16_t>((largest >> 1) << 15);
+    }
+
+    float RotationAngle(const glm::quat& a, const glm::quat& b)
+    {
+        glm::quat first = glm::normalize(a), second = glm::normalize(b);
+        if (glm::dot(first, second) < 0.0f)
+            second = -second;
+        //acos loses most of its precision near 1, the chord between the quaternions doesn't
+        float chord = glm::length(glm::vec4(first.x - second.x, first.y - second.y, first.z - second.z,
+        first.w - second.w));
+        return 4.0f * std::asin(std::min(1.0f, chord * 0.5f));
+    }
+
+    /*Keeps the frames needed to rebuild every sample within the tolerance. Starting from a key, the
+    segment grows while the interpolation of its decoded end points stays close to all the samples
+    it covers. The check runs on the decoded keys, so the bound includes the quantization error*/
+    template<typename Sample, typename Decode, typename Interpolate, typename Distance>
+    static std::vector<int> ReduceKeys(const std::vector<Sample>& samples, float maxError, Decode decode,
+    Interpolate interpolate, Distance distance)
+    {
+        int sampleCount = static_cast<int>(samples.size());
+        if (sampleCount > 65536)
+            throw std::runtime_error("animation track too long to be compressed");
+
+        //Constant tracks collapse to a single key
+        Sample first = decode(0);
+        bool constant = true;
+        for (int i = 0; i < sampleCount && constant; i++)
+            constant = distance(first, samples[i]) <= maxError;
+        if (constant)
+            return {0};
+
+        //The frames and the midpoints between them are checked, the source interpolates its frames too
+        auto segmentFits = [&](int start, int end)
+        {
+            Sample startKey = decode(start), endKey = decode(end);
+            for (int i = start; i <= end; i++)
+            {
+                float factor = static_cast<float>(i - start) / (end - start);
+                if (distance(interpolate(startKey, endKey, factor), samples[i]) > maxError)
+                    return false;
+                if (i == end)
+                    break;
+                float midFactor = (i + 0.5f - start) / (end - start);
+                Sample midSample = interpolate(samples[i], samples[i + 1], 0.5f);
+                if (distance(interpolate(startKey, endKey, midFactor), midSample) > maxError)
+                    return false;
+            }
+            return true;
+        };
+
+        std::vector<int> keys {0};
+        int start = 0;
+        while (start < sampleCount - 1)
+        {
+            int end = start + 1;
+            while (end + 1 < sampleCount && segmentFits(start, end + 1))
+                end++;
+            keys.emplace_back(end);
+            start = end;
+        }
+        return keys;
+    }
+
+    /// @brief Keeps only the quantized values of the selected frames
+    static void StoreKeys(CompressedTrack& track, const std::vector<uint16_t>& allValues,
+    const std::vector<int>& keys)
+    {
+        for (int frame : keys)
+        {
+            track.frames.emplace_back(static_cast<uint16_t>(frame));
+            track.values.insert(track.values.end(), &allValues[frame * 3], &allValues[frame * 3] + 3);
+        }
+    }
+
+    CompressedTrack CompressVectorTrack(const std::vector<glm::vec3>& samples, float maxError)
+    {
+        CompressedTrack track;
+        glm::vec3 maximum = samples[0];
+        track.minimum = samples[0];
+        for (const auto& sample : samples)
+        {
+            track.minimum = glm::min(track.minimum, sample);
+            maximum = glm::max(maximum, sample);
+        }
+        track.step = (maximum - track.minimum) / QUANTIZED_VECTOR_RANGE;
+
+        std::vector<uint16_t> allValues(samples.size() * 3);
+        for (size_t i = 0; i < samples.size(); i++)
+            EncodeVector(samples[i], track.minimum, track.step, &allValues[i * 3]);
+
+        CompressedTrack decoder = track;
+        decoder.values = allValues;
+        std::vector<int> keys = ReduceKeys(samples, maxError,
+            [&](int frame) { return decoder.DecodeVector(frame); },
+            [](const glm::vec3& a, const glm::vec3& b, float factor) { return glm::mix(a, b, factor); },
+            [](const glm::vec3& a, const glm::vec3& b) { return glm::length(a - b); });
+        StoreKeys(track, allValues, keys);
+        return track;
+    }
+
+    CompressedTrack CompressRotationTrack(const std::vector<glm::quat>& samples, float maxError)
+    {
+        CompressedTrack track;
+        std::vector<uint16_t> allValues(samples.size() * 3);
+        for (size_t i = 0; i < samples.size(); i++)
+            EncodeRotation(samples[i], &allValues[i * 3]);
+
+        CompressedTrack decoder;
+        decoder.values = allValues;
+        std::vector<int> keys = ReduceKeys(samples, maxError,
+            [&](int frame) { return decoder.DecodeRotation(frame); },
+            [](const glm::quat& a, const glm::quat& b, float factor) { return glm::slerp(a, b, factor); },
+            RotationAngle);
+        StoreKeys(track, allValues, keys);
+        return track;
+    }
+}
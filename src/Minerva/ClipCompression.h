@@ -0,0 +1,58 @@
+#pragma once
+#include <glm/glm.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/quaternion.hpp>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace Minerva
+{
+    /// @brief Tolerances of the import-time clip compression. The errors are measured on the local
+    /// transform of every bone against the resampled source track
+    struct ClipCompressionSettings
+    {
+        bool enabled = false;
+        //Maximum distance between the compressed and the source translation, in model units
+        float positionError = 0.01f;
+        //Maximum angle between the compressed and the source rotation, in radians
+        float rotationError = 0.001f;
+        //Maximum distance between the compressed and the source scale
+        float scaleError = 0.001f;
+    };
+
+    /// @brief Is a compressed animation track. The keys lie on the frames of the resampled clip,
+    /// every key is stored in 48 bits: a vector quantized on 16 bits per axis against the track
+    /// bounds or a smallest-three quaternion (the three smallest components on 15 bits each and
+    /// the index of the largest one in the remaining bits)
+    struct CompressedTrack
+    {
+        //Frame of each key, increasing. A constant track has a single key on frame 0
+        std::vector<uint16_t> frames;
+        //Three quantized values for each key
+        std::vector<uint16_t> values;
+        //Bounds of the vector tracks, unused by the rotation tracks. A quantized value q decodes to minimum + step * q
+        glm::vec3 minimum = glm::vec3(0.0f);
+        glm::vec3 step = glm::vec3(0.0f);
+
+        int KeyCount() const { return static_cast<int>(frames.size()); }
+        /// @brief Finds the key which starts the interval containing frame
+        /// @param frame The animation time expressed in frames
+        /// @param cursor The cursor of the animator, the search restarts from here
+        int FindKey(float frame, int* cursor = nullptr) const;
+        /// @brief Returns the interpolation factor between key and key + 1
+        float GetFactor(int key, float frame) const;
+        glm::vec3 DecodeVector(int key) const;
+        glm::quat DecodeRotation(int key) const;
+        size_t MemoryUsage() const;
+    };
+
+    /// @brief Returns the angle in radians of the rotation between two quaternions
+    float RotationAngle(const glm::quat& a, const glm::quat& b);
+    /// @brief Compresses a vector track sampled on every frame. Keys which the linear interpolation
+    /// of their neighbours reconstructs within maxError are removed
+    CompressedTrack CompressVectorTrack(const std::vector<glm::vec3>& samples, float maxError);
+    /// @brief Compresses a rotation track sampled on every frame. Keys which the slerp of their
+    /// neighbours reconstructs within maxError radians are removed
+    CompressedTrack CompressRotationTrack(const std::vector<glm::quat>& samples, float maxError);
+}
@@ -67,12 +67,11 @@ namespace Minerva
         vkGetPhysicalDeviceFeatures(currentDevice, &deviceFeatures);
        
 
-        //I want only a dedicated GPU
+        /*I prefer a dedicated GPU, the other devices are kept as a fallback so the engine 
+        also runs on integrated GPUs and on the software driver (lavapipe)*/
         if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
         {
-            score += 200;
-        }else{
-            return  0;
+            score += 1000000;
         }
 
         // Maximum possible size of textures affects graphics quality
@@ -161,15 +160,38 @@ namespace Minerva
             {
                 indices.graphicsFamily = index;
             }
+            //The families without graphics run beside the graphics queue, the first one of each kind is taken
+            bool graphics = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+            bool compute = (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+            if (!graphics && !compute && (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !indices.transferFamily.has_value())
+            {
+                indices.transferFamily = index;
+            }
+            if (!graphics && compute && !indices.computeFamily.has_value())
+            {
+                indices.computeFamily = index;
+            }
             index++;
         }
         return indices;
     }
+    bool Device::GraphicsQueueSupportsCompute(const VkSurfaceKHR& windowSurface)
+    {
+        QueueFamilyIndices indices = FindQueueFamilies(physicalDevice, windowSurface);
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+        return (queueFamilies[indices.graphicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+    }
     void Device::CreateLogicalDevice(DebugManager& debugManager, const VkSurfaceKHR& windowSurface)
     {
         QueueFamilyIndices indices = FindQueueFamilies(physicalDevice, windowSurface);
         std::vector<VkDeviceQueueCreateInfo> queuesInfo {};
-        std::set<uint32_t> engineFamilies {indices.graphicsFamily.value(), indices.presentFamily.value()};
+        graphicsFamily = indices.graphicsFamily.value();
+        transferFamily = indices.transferFamily.value_or(graphicsFamily);
+        computeFamily = indices.computeFamily.value_or(graphicsFamily);
+        std::set<uint32_t> engineFamilies {graphicsFamily, indices.presentFamily.value(), transferFamily, computeFamily};
         float queuePriority = 1.0f;
         for(auto engineFamily : engineFamilies)
         {
@@ -181,14 +203,39 @@ namespace Minerva
             queuesInfo.emplace_back(tempQueueCreateInfo);
         }
 
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+        multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+        maxDrawIndirectCount = multiDrawIndirect ? deviceProperties.limits.maxDrawIndirectCount : 1;
+
         VkPhysicalDeviceFeatures deviceFeatures{};
         deviceFeatures.samplerAnisotropy = VK_TRUE;
+        deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+
+        //vkCmdDrawIndexedIndirectCount is core since Vulkan 1.2, behind a feature
+        VkPhysicalDeviceVulkan12Features supportedFeatures12{};
+        supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        if (deviceProperties.apiVersion >= VK_API_VERSION_1_2)
+        {
+            VkPhysicalDeviceFeatures2 supportedFeatures2{};
+            supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            supportedFeatures2.pNext = &supportedFeatures12;
+            vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures2);
+        }
+        drawIndirectCount = supportedFeatures12.drawIndirectCount == VK_TRUE && multiDrawIndirect;
+        VkPhysicalDeviceVulkan12Features deviceFeatures12{};
+        deviceFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        deviceFeatures12.drawIndirectCount = drawIndirectCount ? VK_TRUE : VK_FALSE;
 
         VkDeviceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
         createInfo.pQueueCreateInfos = queuesInfo.data();
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queuesInfo.size());
         createInfo.pEnabledFeatures = &deviceFeatures;
+        if (deviceProperties.apiVersion >= VK_API_VERSION_1_2)
+            createInfo.pNext = &deviceFeatures12;
         createInfo.enabledExtensionCount = static_cast<uint32_t>(neededDeviceExtensions.size());
         createInfo.ppEnabledExtensionNames = neededDeviceExtensions.data();
 
@@ -207,6 +254,16 @@ namespace Minerva
         }
         vkGetDeviceQueue(logicalDevice, indices.graphicsFamily.value(), 0, &graphicsQueue);
         vkGetDeviceQueue(logicalDevice, indices.presentFamily.value(), 0, &presentationQueue);
+        vkGetDeviceQueue(logicalDevice, transferFamily, 0, &transferQueue);
+        vkGetDeviceQueue(logicalDevice, computeFamily, 0, &computeQueue);
+        std::cout << "Queues: graphics family " << graphicsFamily << ", uploads on family " << transferFamily 
+        << ", compute on family " << computeFamily << "\n";
+    }
+
+    std::vector<uint32_t> Device::BufferSharingFamilies() const
+    {
+        std::set<uint32_t> families {graphicsFamily, transferFamily, computeFamily};
+        return std::vector<uint32_t>(families.begin(), families.end());
     }
 
     void Device::PrintInfoDeviceSelected()
@@ -242,6 +299,11 @@ namespace Minerva
         swapChainImageFormat = std::move(other.swapChainImageFormat);
         graphicsQueue = std::move(other.graphicsQueue);
         presentationQueue = std::move(other.presentationQueue);
+        transferQueue = std::move(other.transferQueue);
+        computeQueue = std::move(other.computeQueue);
+        graphicsFamily = other.graphicsFamily;
+        transferFamily = other.transferFamily;
+        computeFamily = other.computeFamily;
         presentMode = std::move(other.presentMode);
         surfaceFormat = std::move(other.surfaceFormat);
         logicalDevice = std::move(other.logicalDevice);
@@ -251,6 +313,8 @@ namespace Minerva
         other.physicalDevice = VK_NULL_HANDLE;
         other.graphicsQueue = VK_NULL_HANDLE;
         other.presentationQueue = VK_NULL_HANDLE;
+        other.transferQueue = VK_NULL_HANDLE;
+        other.computeQueue = VK_NULL_HANDLE;
         vkDestroyDevice(other.logicalDevice, nullptr);
          for (auto imageView : other.swapChainImageViews) {
             vkDestroyImageView(logicalDevice, imageView, nullptr);
@@ -267,6 +331,11 @@ namespace Minerva
         swapChainImageFormat = std::move(other.swapChainImageFormat);
         graphicsQueue = std::move(other.graphicsQueue);
         presentationQueue = std::move(other.presentationQueue);
+        transferQueue = std::move(other.transferQueue);
+        computeQueue = std::move(other.computeQueue);
+        graphicsFamily = other.graphicsFamily;
+        transferFamily = other.transferFamily;
+        computeFamily = other.computeFamily;
         presentMode = std::move(other.presentMode);
         surfaceFormat = std::move(other.surfaceFormat);
         logicalDevice = std::move(other.logicalDevice);
@@ -276,6 +345,8 @@ namespace Minerva
         other.physicalDevice = VK_NULL_HANDLE;
         other.graphicsQueue = VK_NULL_HANDLE;
         other.presentationQueue = VK_NULL_HANDLE;
+        other.transferQueue = VK_NULL_HANDLE;
+        other.computeQueue = VK_NULL_HANDLE;
         vkDestroyDevice(other.logicalDevice, nullptr);
          for (auto imageView : other.swapChainImageViews) {
             vkDestroyImageView(logicalDevice, imageView, nullptr);
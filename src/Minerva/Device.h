@@ -13,6 +13,10 @@ namespace Minerva
         std::optional<uint32_t> graphicsFamily;
         /*Is a presentation queue which presents images to the surface created in Window class*/
         std::optional<uint32_t> presentFamily;
+        /*A family with copies only, the DMA engine of discrete GPUs. Without it the uploads use the graphics queue*/
+        std::optional<uint32_t> transferFamily;
+        /*A family with compute and no graphics, its dispatches overlap the render pass*/
+        std::optional<uint32_t> computeFamily;
 
         bool IsComplete() const
         {
@@ -37,23 +41,43 @@ namespace Minerva
         VkFormat swapChainImageFormat;
         VkQueue graphicsQueue = VK_NULL_HANDLE;
         VkQueue presentationQueue = VK_NULL_HANDLE;
+        //The graphics queue when the device has no family of their own
+        VkQueue transferQueue = VK_NULL_HANDLE;
+        VkQueue computeQueue = VK_NULL_HANDLE;
+        uint32_t graphicsFamily = 0;
+        uint32_t transferFamily = 0;
+        uint32_t computeFamily = 0;
         VkPresentModeKHR presentMode;
         VkSurfaceFormatKHR surfaceFormat;
         //The handle of logical device
         VkDevice logicalDevice = VK_NULL_HANDLE;
         std::vector<VkImageView> swapChainImageViews;
+        //Enabled when supported, otherwise every indirect draw is a separate call
+        bool multiDrawIndirect = false;
+        uint32_t maxDrawIndirectCount = 1;
+        //Enabled when supported, the GPU driven draws of the meshlet culling need it
+        bool drawIndirectCount = false;
         /// @brief Pick the best physical device 
         /// @param vulkanInstance The Vulkan instance
         void PickMostSuitableDevice(const VkInstance& vulkanInstance, const VkSurfaceKHR& windowSurface);
         /// @brief Finds a queue families indices and used them to create a new QueueFamilyIndices obj.
-        /// At the moment I search only for a queues capable to graphics operations and presentation operations
+        /// Besides the graphics and presentation families I search for a transfer only and a compute only family
         /// @param currentDevice The current physical device where I search the queue
         /// @param windowSurface The surface where I search the support
         /// @return The QueueFamilyIndices obj
         QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice currentDevice, const VkSurfaceKHR& windowSurface);
-        /// @brief Creates the logical device and the graphics queue 
+        /// @brief Checks if the compute dispatches can be recorded in the command buffers of the graphics queue
+        /// @param windowSurface The surface used to find the queue families
+        bool GraphicsQueueSupportsCompute(const VkSurfaceKHR& windowSurface);
+        /// @brief Creates the logical device and a queue for each family found, the transfer and compute
+        /// queues fall back to the graphics one
         /// @param debugManager The DebugManager obj useful to access  to validationLayers vector 
         void CreateLogicalDevice(DebugManager& debugManager, const VkSurfaceKHR& windowSurface);
+        bool HasTransferQueue() const { return transferFamily != graphicsFamily; }
+        bool HasAsyncCompute() const { return computeFamily != graphicsFamily; }
+        /// @brief The distinct families of the graphics, transfer and compute queues. The buffers are shared
+        /// by all of them, so they need no ownership transfer between the queues
+        std::vector<uint32_t> BufferSharingFamilies() const;
         /// @brief Prints some info about the selected physical device
         void PrintInfoDeviceSelected();
         /// @brief Obtains all swap chain datails of current device. 
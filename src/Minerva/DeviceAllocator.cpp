@@ -0,0 +1,479 @@
+#include "DeviceAllocator.h"
+#include <stdexcept>
+#include <algorithm>
+
+namespace Minerva
+{
+    static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    static uint32_t HighestBit(uint64_t value)
+    {
+        uint32_t bit = 0;
+        while (value >>= 1)
+            bit++;
+        return bit;
+    }
+
+    static uint32_t LowestBit(uint64_t value)
+    {
+        uint32_t bit = 0;
+        while (!(value & 1))
+        {
+            value >>= 1;
+            bit++;
+        }
+        return bit;
+    }
+
+    void DeviceAllocator::Init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice)
+    {
+        device = logicalDevice;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        bufferImageGranularity = std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1);
+        maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+        memoryTypes.clear();
+        memoryTypes.resize(memoryProperties.memoryTypeCount);
+    }
+
+    DeviceAllocation DeviceAllocator::AllocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties)
+    {
+        VkMemoryDedicatedRequirements dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+        VkMemoryRequirements2 requirements{};
+        requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        requirements.pNext = &dedicatedRequirements;
+        VkBufferMemoryRequirementsInfo2 requirementsInfo{};
+        requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+        requirementsInfo.buffer = buffer;
+        vkGetBufferMemoryRequirements2(device, &requirementsInfo, &requirements);
+
+        VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+        dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicatedInfo.buffer = buffer;
+        //Buffers are linear resources, like everything else placed by this allocator except the optimal images
+        DeviceAllocation allocation = Allocate(requirements, properties, 1, dedicatedInfo);
+        if (vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+        {
+            Free(allocation);
+            throw std::runtime_error("failed to bind buffer memory!");
+        }
+        return allocation;
+    }
+
+    DeviceAllocation DeviceAllocator::AllocateImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties)
+    {
+        VkMemoryDedicatedRequirements dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+        VkMemoryRequirements2 requirements{};
+        requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        requirements.pNext = &dedicatedRequirements;
+        VkImageMemoryRequirementsInfo2 requirementsInfo{};
+        requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+        requirementsInfo.image = image;
+        vkGetImageMemoryRequirements2(device, &requirementsInfo, &requirements);
+
+        VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+        dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicatedInfo.image = image;
+        /*An optimal image starts and ends on a page of bufferImageGranularity bytes, so no linear resource
+        can share a page with it whatever its neighbours are*/
+        VkDeviceSize granularity = tiling == VK_IMAGE_TILING_OPTIMAL ? bufferImageGranularity : 1;
+        DeviceAllocation allocation = Allocate(requirements, properties, granularity, dedicatedInfo);
+        if (vkBindImageMemory(device, image, allocation.memory, allocation.offset) != VK_SUCCESS)
+        {
+            Free(allocation);
+            throw std::runtime_error("failed to bind image memory!");
+        }
+        return allocation;
+    }
+
+    DeviceAllocation DeviceAllocator::Allocate(const VkMemoryRequirements2 &requirements, VkMemoryPropertyFlags properties,
+    VkDeviceSize granularity, const VkMemoryDedicatedAllocateInfo &dedicatedInfo)
+    {
+        const VkMemoryRequirements& memRequirements = requirements.memoryRequirements;
+        auto dedicatedRequirements = static_cast<const VkMemoryDedicatedRequirements*>(requirements.pNext);
+        std::lock_guard<std::mutex> lock(mutex);
+        DeviceAllocation allocation;
+        allocation.memoryType = FindMemoryType(memRequirements.memoryTypeBits, properties);
+        VkDeviceSize alignment = std::max(memRequirements.alignment, granularity);
+        VkDeviceSize size = AlignUp(memRequirements.size, granularity);
+        VkDeviceSize blockSize = BlockSize(allocation.memoryType);
+        MemoryType& memoryType = memoryTypes[allocation.memoryType];
+
+        bool dedicated = size > blockSize / 2 || dedicatedRequirements->prefersDedicatedAllocation
+        || dedicatedRequirements->requiresDedicatedAllocation;
+        if (!dedicated)
+        {
+            for (uint32_t i = 0; i < memoryType.blocks.size() && allocation.block == DeviceAllocation::NO_BLOCK; i++)
+            {
+                Block* block = memoryType.blocks[i].get();
+                if (block && AllocateFromBlock(*block, size, alignment, allocation.node, allocation.offset))
+                    allocation.block = i;
+            }
+            if (allocation.block == DeviceAllocation::NO_BLOCK)
+            {
+                uint32_t blockIndex = CreateBlock(allocation.memoryType);
+                if (blockIndex != DeviceAllocation::NO_BLOCK
+                && AllocateFromBlock(*memoryType.blocks[blockIndex], size, alignment, allocation.node, allocation.offset))
+                    allocation.block = blockIndex;
+            }
+            if (allocation.block != DeviceAllocation::NO_BLOCK)
+            {
+                Block& block = *memoryType.blocks[allocation.block];
+                allocation.memory = block.memory;
+                allocation.size = size;
+                if (block.mapped)
+                    allocation.mapped = static_cast<char*>(block.mapped) + allocation.offset;
+                block.allocationCount++;
+                block.used += size;
+                return allocation;
+            }
+        }
+
+        //Too large for a block, or no room left for a new block: the resource gets memory of its own
+        allocation.offset = 0;
+        allocation.size = memRequirements.size;
+        allocation.memory = AllocateMemory(allocation.memoryType, allocation.size, &dedicatedInfo, &allocation.mapped);
+        if (!allocation.IsValid())
+            throw std::runtime_error("failed to allocate device memory!");
+        memoryType.dedicatedCount++;
+        memoryType.dedicatedBytes += allocation.size;
+        return allocation;
+    }
+
+    void DeviceAllocator::Free(DeviceAllocation &allocation)
+    {
+        if (!allocation.IsValid())
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        MemoryType& memoryType = memoryTypes[allocation.memoryType];
+        if (allocation.block == DeviceAllocation::NO_BLOCK)
+        {
+            vkFreeMemory(device, allocation.memory, nullptr);
+            memoryType.dedicatedCount--;
+            memoryType.dedicatedBytes -= allocation.size;
+            allocation = DeviceAllocation();
+            return;
+        }
+
+        Block& block = *memoryType.blocks[allocation.block];
+        FreeNode(block, allocation.node);
+        block.allocationCount--;
+        block.used -= allocation.size;
+        /*An empty block is kept, so the staging buffers of the uploads don't allocate device memory each
+        time. A second empty block of the same type is released*/
+        if (block.allocationCount == 0)
+        {
+            for (uint32_t i = 0; i < memoryType.blocks.size(); i++)
+            {
+                Block* other = memoryType.blocks[i].get();
+                if (i != allocation.block && other && other->allocationCount == 0)
+                {
+                    vkFreeMemory(device, block.memory, nullptr);
+                    memoryType.blocks[allocation.block].reset();
+                    break;
+                }
+            }
+        }
+        allocation = DeviceAllocation();
+    }
+
+    std::vector<DeviceHeapStats> DeviceAllocator::Stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<DeviceHeapStats> stats(memoryProperties.memoryHeapCount);
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+        {
+            stats[i].heapSize = memoryProperties.memoryHeaps[i].size;
+            stats[i].deviceLocal = memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        }
+        for (uint32_t type = 0; type < memoryTypes.size(); type++)
+        {
+            DeviceHeapStats& heap = stats[memoryProperties.memoryTypes[type].heapIndex];
+            const MemoryType& memoryType = memoryTypes[type];
+            heap.dedicatedCount += memoryType.dedicatedCount;
+            heap.allocationCount += memoryType.dedicatedCount;
+            heap.reserved += memoryType.dedicatedBytes;
+            heap.used += memoryType.dedicatedBytes;
+            for (const auto& block : memoryType.blocks)
+            {
+                if (!block)
+                    continue;
+                heap.blockCount++;
+                heap.allocationCount += block->allocationCount;
+                heap.reserved += block->size;
+                heap.used += block->used;
+                heap.free += block->size - block->used;
+                for (const Node& node : block->nodes)
+                {
+                    if (node.free)
+                        heap.largestFree = std::max(heap.largestFree, node.size);
+                }
+            }
+        }
+        return stats;
+    }
+
+    uint32_t DeviceAllocator::MemoryObjectCount() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t count = 0;
+        for (const auto& memoryType : memoryTypes)
+        {
+            count += memoryType.dedicatedCount;
+            for (const auto& block : memoryType.blocks)
+                count += block ? 1 : 0;
+        }
+        return count;
+    }
+
+    DeviceAllocator::~DeviceAllocator()
+    {
+        for (auto& memoryType : memoryTypes)
+        {
+            for (auto& block : memoryType.blocks)
+            {
+                if (block)
+                    vkFreeMemory(device, block->memory, nullptr);
+            }
+        }
+    }
+
+    uint32_t DeviceAllocator::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+    {
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    VkDeviceSize DeviceAllocator::BlockSize(uint32_t memoryType) const
+    {
+        //Small heaps, like the host visible window on the device memory, get blocks of an eighth of their size
+        VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+        return std::min(BLOCK_SIZE, std::max<VkDeviceSize>(heapSize / 8 / (1 << 20), 1) << 20);
+    }
+
+    VkDeviceMemory DeviceAllocator::AllocateMemory(uint32_t memoryType, VkDeviceSize size, const void *next, void **mapped)
+    {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.pNext = next;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryType;
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+            return VK_NULL_HANDLE;
+        *mapped = nullptr;
+        if ((memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        && vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS)
+        {
+            vkFreeMemory(device, memory, nullptr);
+            throw std::runtime_error("failed to map memory!");
+        }
+        return memory;
+    }
+
+    uint32_t DeviceAllocator::CreateBlock(uint32_t memoryType)
+    {
+        auto block = std::make_unique<Block>();
+        block->size = BlockSize(memoryType);
+        block->memory = AllocateMemory(memoryType, block->size, nullptr, &block->mapped);
+        if (block->memory == VK_NULL_HANDLE)
+            return DeviceAllocation::NO_BLOCK;
+        for (auto& freeList : block->freeLists)
+            std::fill(std::begin(freeList), std::end(freeList), NO_NODE);
+        //The whole block starts as a single free range
+        uint32_t node = NewNode(*block);
+        block->nodes[node].size = block->size;
+        InsertFree(*block, node);
+
+        auto& blocks = memoryTypes[memoryType].blocks;
+        auto hole = std::find(blocks.begin(), blocks.end(), nullptr);
+        if (hole != blocks.end())
+        {
+            *hole = std::move(block);
+            return static_cast<uint32_t>(hole - blocks.begin());
+        }
+        blocks.emplace_back(std::move(block));
+        return static_cast<uint32_t>(blocks.size() - 1);
+    }
+
+    void DeviceAllocator::Mapping(VkDeviceSize size, uint32_t &firstLevel, uint32_t &secondLevel)
+    {
+        if (size < SMALL_SIZE)
+        {
+            firstLevel = 0;
+            secondLevel = static_cast<uint32_t>(size / (SMALL_SIZE / SECOND_LEVEL_COUNT));
+            return;
+        }
+        uint32_t highestBit = HighestBit(size);
+        firstLevel = highestBit - HighestBit(SMALL_SIZE) + 1;
+        secondLevel = static_cast<uint32_t>(size >> (highestBit - SECOND_LEVEL_BITS)) & (SECOND_LEVEL_COUNT - 1);
+    }
+
+    uint32_t DeviceAllocator::NewNode(Block &block)
+    {
+        if (block.unusedNodes == NO_NODE)
+        {
+            block.nodes.emplace_back();
+            return static_cast<uint32_t>(block.nodes.size() - 1);
+        }
+        uint32_t node = block.unusedNodes;
+        block.unusedNodes = block.nodes[node].nextFree;
+        block.nodes[node] = Node();
+        return node;
+    }
+
+    void DeviceAllocator::InsertFree(Block &block, uint32_t node)
+    {
+        Node& range = block.nodes[node];
+        uint32_t firstLevel, secondLevel;
+        Mapping(range.size, firstLevel, secondLevel);
+        uint32_t& head = block.freeLists[firstLevel][secondLevel];
+        range.free = true;
+        range.prevFree = NO_NODE;
+        range.nextFree = head;
+        if (head != NO_NODE)
+            block.nodes[head].prevFree = node;
+        head = node;
+        block.firstLevelMap |= 1ull << firstLevel;
+        block.secondLevelMap[firstLevel] |= 1u << secondLevel;
+    }
+
+    void DeviceAllocator::RemoveFree(Block &block, uint32_t node)
+    {
+        Node& range = block.nodes[node];
+        uint32_t firstLevel, secondLevel;
+        Mapping(range.size, firstLevel, secondLevel);
+        if (range.prevFree != NO_NODE)
+            block.nodes[range.prevFree].nextFree = range.nextFree;
+        else
+            block.freeLists[firstLevel][secondLevel] = range.nextFree;
+        if (range.nextFree != NO_NODE)
+            block.nodes[range.nextFree].prevFree = range.prevFree;
+        range.free = false;
+        range.prevFree = NO_NODE;
+        range.nextFree = NO_NODE;
+        if (block.freeLists[firstLevel][secondLevel] == NO_NODE)
+        {
+            block.secondLevelMap[firstLevel] &= ~(1u << secondLevel);
+            if (block.secondLevelMap[firstLevel] == 0)
+                block.firstLevelMap &= ~(1ull << firstLevel);
+        }
+    }
+
+    uint32_t DeviceAllocator::FindFree(const Block &block, VkDeviceSize size, VkDeviceSize alignment)
+    {
+        /*Any free range of the class above the padded size is large enough, so the search looks at the
+        head of a list and never walks it*/
+        VkDeviceSize searchSize = size + alignment - 1;
+        if (searchSize < SMALL_SIZE)
+            searchSize += SMALL_SIZE / SECOND_LEVEL_COUNT - 1;
+        else
+            searchSize += (1ull << (HighestBit(searchSize) - SECOND_LEVEL_BITS)) - 1;
+        if (searchSize > block.size)
+            return NO_NODE;
+        uint32_t firstLevel, secondLevel;
+        Mapping(searchSize, firstLevel, secondLevel);
+
+        uint32_t secondLevelMap = block.secondLevelMap[firstLevel] & (~0u << secondLevel);
+        if (secondLevelMap == 0)
+        {
+            uint64_t firstLevelMap = firstLevel + 1 < 64 ? block.firstLevelMap & (~0ull << (firstLevel + 1)) : 0;
+            if (firstLevelMap == 0)
+                return NO_NODE;
+            firstLevel = LowestBit(firstLevelMap);
+            secondLevelMap = block.secondLevelMap[firstLevel];
+        }
+        return block.freeLists[firstLevel][LowestBit(secondLevelMap)];
+    }
+
+    bool DeviceAllocator::AllocateFromBlock(Block &block, VkDeviceSize size, VkDeviceSize alignment,
+    uint32_t &node, VkDeviceSize &offset)
+    {
+        node = FindFree(block, size, alignment);
+        if (node == NO_NODE)
+            return false;
+        RemoveFree(block, node);
+        offset = AlignUp(block.nodes[node].offset, alignment);
+
+        //The bytes skipped by the alignment become a free range before the allocation
+        VkDeviceSize padding = offset - block.nodes[node].offset;
+        if (padding > 0)
+        {
+            uint32_t front = NewNode(block);
+            Node& range = block.nodes[node];
+            Node& frontRange = block.nodes[front];
+            frontRange.offset = range.offset;
+            frontRange.size = padding;
+            frontRange.prevPhysical = range.prevPhysical;
+            frontRange.nextPhysical = node;
+            if (range.prevPhysical != NO_NODE)
+                block.nodes[range.prevPhysical].nextPhysical = front;
+            range.prevPhysical = front;
+            range.offset += padding;
+            range.size -= padding;
+            InsertFree(block, front);
+        }
+        //And so do the bytes left after it
+        if (block.nodes[node].size > size)
+        {
+            uint32_t back = NewNode(block);
+            Node& range = block.nodes[node];
+            Node& backRange = block.nodes[back];
+            backRange.offset = range.offset + size;
+            backRange.size = range.size - size;
+            backRange.prevPhysical = node;
+            backRange.nextPhysical = range.nextPhysical;
+            if (range.nextPhysical != NO_NODE)
+                block.nodes[range.nextPhysical].prevPhysical = back;
+            range.nextPhysical = back;
+            range.size = size;
+            InsertFree(block, back);
+        }
+        return true;
+    }
+
+    void DeviceAllocator::FreeNode(Block &block, uint32_t node)
+    {
+        //Merged with the free neighbours, so two free ranges are never adjacent
+        uint32_t prev = block.nodes[node].prevPhysical;
+        if (prev != NO_NODE && block.nodes[prev].free)
+        {
+            RemoveFree(block, prev);
+            Node& prevRange = block.nodes[prev];
+            Node& range = block.nodes[node];
+            range.offset = prevRange.offset;
+            range.size += prevRange.size;
+            range.prevPhysical = prevRange.prevPhysical;
+            if (range.prevPhysical != NO_NODE)
+                block.nodes[range.prevPhysical].nextPhysical = node;
+            prevRange.nextFree = block.unusedNodes;
+            block.unusedNodes = prev;
+        }
+        uint32_t next = block.nodes[node].nextPhysical;
+        if (next != NO_NODE && block.nodes[next].free)
+        {
+            RemoveFree(block, next);
+            Node& nextRange = block.nodes[next];
+            Node& range = block.nodes[node];
+            range.size += nextRange.size;
+            range.nextPhysical = nextRange.nextPhysical;
+            if (range.nextPhysical != NO_NODE)
+                block.nodes[range.nextPhysical].prevPhysical = node;
+            nextRange.nextFree = block.unusedNodes;
+            block.unusedNodes = next;
+        }
+        InsertFree(block, node);
+    }
+}
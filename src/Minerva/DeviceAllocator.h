@@ -0,0 +1,145 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Minerva
+{
+    /// @brief A range of device memory owned by a buffer or an image. The range lives inside a block shared
+    /// with other resources, or in a memory object of its own when the allocation is dedicated
+    struct DeviceAllocation
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        //Host address of the range when the memory is host visible, the blocks stay mapped until freed
+        void* mapped = nullptr;
+        uint32_t memoryType = 0;
+        //Block of the memory type holding the range, NO_BLOCK for a dedicated allocation
+        uint32_t block = NO_BLOCK;
+        //Node of the block describing the range
+        uint32_t node = 0;
+
+        static constexpr uint32_t NO_BLOCK = UINT32_MAX;
+        bool IsValid() const { return memory != VK_NULL_HANDLE; }
+    };
+
+    /// @brief Memory of a heap as seen by the allocator. Free bytes are the unused bytes of the blocks,
+    /// the fragmentation is the share of them that the largest free range can't serve
+    struct DeviceHeapStats
+    {
+        VkDeviceSize heapSize = 0;
+        bool deviceLocal = false;
+        uint32_t blockCount = 0;
+        uint32_t dedicatedCount = 0;
+        uint32_t allocationCount = 0;
+        //Bytes of the blocks and of the dedicated allocations
+        VkDeviceSize reserved = 0;
+        VkDeviceSize used = 0;
+        VkDeviceSize free = 0;
+        VkDeviceSize largestFree = 0;
+        float Fragmentation() const { return free == 0 ? 0.0f : 1.0f - static_cast<float>(largestFree) / free; }
+    };
+
+    /// @brief Sub-allocates buffers and images from large blocks of device memory, one list of blocks for
+    /// each memory type. The ranges of a block are handed out by a two level segregated fit (TLSF) allocator,
+    /// so finding and freeing a range takes constant time. Resources larger than half a block, or which ask
+    /// for it, get a dedicated allocation. It's thread safe
+    class DeviceAllocator
+    {
+    public:
+        //Bytes of a block, smaller on the heaps which can't hold at least eight of them
+        static constexpr VkDeviceSize BLOCK_SIZE = 64ull << 20;
+        /// @brief Reads the memory types and the limits of the device, call it once the logical device exists
+        void Init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice);
+        /// @brief Allocates and binds the memory of a buffer
+        /// @param properties The properties the memory type must have
+        DeviceAllocation AllocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties);
+        /// @brief Allocates and binds the memory of an image
+        /// @param tiling Optimal images are kept bufferImageGranularity apart from the linear resources
+        DeviceAllocation AllocateImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties);
+        /// @brief Gives the range back to its block, or frees the dedicated memory. Resets the allocation,
+        /// an empty allocation is ignored
+        void Free(DeviceAllocation& allocation);
+        /// @brief Usage of every heap of the device
+        std::vector<DeviceHeapStats> Stats() const;
+        /// @brief Number of live device memory objects, bounded by maxMemoryAllocationCount
+        uint32_t MemoryObjectCount() const;
+        uint32_t MaxMemoryObjectCount() const { return maxAllocationCount; }
+
+        DeviceAllocator() = default;
+        ~DeviceAllocator();
+
+        DeviceAllocator(const DeviceAllocator& other) = delete;
+        DeviceAllocator& operator=(const DeviceAllocator& other) = delete;
+    private:
+        //First level classes split the sizes by powers of two, the second level splits each of them in 16
+        static constexpr uint32_t SECOND_LEVEL_BITS = 4;
+        static constexpr uint32_t SECOND_LEVEL_COUNT = 1 << SECOND_LEVEL_BITS;
+        //Sizes below it share the first class, in steps of SMALL_SIZE / SECOND_LEVEL_COUNT bytes
+        static constexpr VkDeviceSize SMALL_SIZE = 256;
+        static constexpr uint32_t FIRST_LEVEL_COUNT = 64 - 7;
+        static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+        struct Node
+        {
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+            //Neighbours in the block, by address
+            uint32_t prevPhysical = NO_NODE;
+            uint32_t nextPhysical = NO_NODE;
+            //Neighbours in the free list of the class, or the next unused node
+            uint32_t prevFree = NO_NODE;
+            uint32_t nextFree = NO_NODE;
+            bool free = false;
+        };
+        struct Block
+        {
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            VkDeviceSize size = 0;
+            void* mapped = nullptr;
+            std::vector<Node> nodes;
+            uint32_t unusedNodes = NO_NODE;
+            uint64_t firstLevelMap = 0;
+            uint32_t secondLevelMap[FIRST_LEVEL_COUNT] = {};
+            uint32_t freeLists[FIRST_LEVEL_COUNT][SECOND_LEVEL_COUNT];
+            uint32_t allocationCount = 0;
+            VkDeviceSize used = 0;
+        };
+        struct MemoryType
+        {
+            std::vector<std::unique_ptr<Block>> blocks;
+            uint32_t dedicatedCount = 0;
+            VkDeviceSize dedicatedBytes = 0;
+        };
+
+        VkDevice device = VK_NULL_HANDLE;
+        VkPhysicalDeviceMemoryProperties memoryProperties{};
+        VkDeviceSize bufferImageGranularity = 1;
+        uint32_t maxAllocationCount = 0;
+        std::vector<MemoryType> memoryTypes;
+        mutable std::mutex mutex;
+
+        /// @brief Places the resource in a block, or in its own memory when it's large or prefers it
+        /// @param dedicatedInfo Names the resource, chained to its memory when the allocation is dedicated
+        DeviceAllocation Allocate(const VkMemoryRequirements2& requirements, VkMemoryPropertyFlags properties,
+        VkDeviceSize granularity, const VkMemoryDedicatedAllocateInfo& dedicatedInfo);
+        uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+        VkDeviceSize BlockSize(uint32_t memoryType) const;
+        /// @return The new memory, mapped when host visible, or VK_NULL_HANDLE when the heap is full
+        VkDeviceMemory AllocateMemory(uint32_t memoryType, VkDeviceSize size, const void* next, void** mapped);
+        /// @return The index of the new block, NO_BLOCK when the heap is full
+        uint32_t CreateBlock(uint32_t memoryType);
+        static void Mapping(VkDeviceSize size, uint32_t& firstLevel, uint32_t& secondLevel);
+        static uint32_t NewNode(Block& block);
+        static void InsertFree(Block& block, uint32_t node);
+        static void RemoveFree(Block& block, uint32_t node);
+        /// @brief Finds a free node large enough for any placement of size bytes at the given alignment
+        static uint32_t FindFree(const Block& block, VkDeviceSize size, VkDeviceSize alignment);
+        static bool AllocateFromBlock(Block& block, VkDeviceSize size, VkDeviceSize alignment,
+        uint32_t& node, VkDeviceSize& offset);
+        static void FreeNode(Block& block, uint32_t node);
+    };
+}
@@ -0,0 +1,746 @@
+#include "EngineBenchmark.h"
+#include "Bone.h"
+#include "AnimationManager.h"
+#include "JobSystem.h"
+#include "PoseKernels.h"
+#include "ModelLoader.h"
+#include "AssetLoader.h"
+#include "ObjLoader.h"
+#include "EngineVars.h"
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+
+namespace Minerva
+{
+    /// @brief Builds an animation channel with keyCount keys, one key per tick on every track
+    static aiNodeAnim* CreateSyntheticChannel(int keyCount)
+    {
+        aiNodeAnim* channel = new aiNodeAnim();
+        channel->mNumPositionKeys = keyCount;
+        channel->mNumRotationKeys = keyCount;
+        channel->mNumScalingKeys = keyCount;
+        channel->mPositionKeys = new aiVectorKey[keyCount];
+        channel->mRotationKeys = new aiQuatKey[keyCount];
+        channel->mScalingKeys = new aiVectorKey[keyCount];
+        for (int i = 0; i < keyCount; i++)
+        {
+            float angle = 0.1f * i;
+            channel->mPositionKeys[i] = aiVectorKey(i, aiVector3D(std::sin(angle), std::cos(angle), 0.0f));
+            channel->mRotationKeys[i] = aiQuatKey(i, aiQuaternion(aiVector3D(0.0f, 1.0f, 0.0f), angle));
+            channel->mScalingKeys[i] = aiVectorKey(i, aiVector3D(1.0f));
+        }
+        return channel;
+    }
+
+    /// @brief Plays the bone like an animator does, a small time step every frame, and returns 
+    /// the average cost of one sample in nanoseconds
+    template<typename SampleFunction>
+    static double MeasureSampling(float duration, int sampleCount, SampleFunction sample)
+    {
+        const float timeStep = 0.5f;
+        float animationTime = 0.0f;
+        float checksum = 0.0f;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < sampleCount; i++)
+        {
+            animationTime = std::fmod(animationTime + timeStep, duration);
+            checksum += sample(animationTime)[3][0];
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        //The checksum keeps the compiler from removing the loop
+        if (checksum == 12345.0f)
+            std::cout << "";
+        return std::chrono::duration<double, std::nano>(end - start).count() / sampleCount;
+    }
+
+    void EngineBenchmark::KeyframeSampling()
+    {
+        const int sampleCount = 50000;
+        std::ostringstream report;
+        report << "Keyframe sampling (ns per bone sample)\n";
+        report << std::setw(8) << "keys" << std::setw(12) << "linear" << std::setw(12) << "cursor" 
+        << std::setw(12) << "resampled" << "\n";
+        report << std::fixed << std::setprecision(1);
+
+        for (int keyCount : {32, 256, 2048, 16384})
+        {
+            aiNodeAnim* channel = CreateSyntheticChannel(keyCount);
+            Bone sourceBone("benchmark", 0, channel);
+            Bone resampledBone = sourceBone;
+            delete channel;
+            float duration = static_cast<float>(keyCount - 1);
+            resampledBone.Resample(1.0f, duration);
+
+            TrackCursor cursor;
+            double linear = MeasureSampling(duration, sampleCount, 
+            [&](float time) { return sourceBone.Sample(time); });
+            double cached = MeasureSampling(duration, sampleCount, 
+            [&](float time) { return sourceBone.Sample(time, &cursor); });
+            double resampled = MeasureSampling(duration, sampleCount, 
+            [&](float time) { return resampledBone.Sample(time); });
+
+            report << std::setw(8) << keyCount << std::setw(12) << linear << std::setw(12) << cached 
+            << std::setw(12) << resampled << "\n";
+        }
+        Publish(report.str());
+    }
+
+    void EngineBenchmark::AnimationScaling(const std::vector<Animator> &animators, size_t batchSize)
+    {
+        const int frameCount = 20;
+        const float deltaTime = 1.0f / 60.0f;
+        std::vector<Animator> benchAnimators = animators;
+        std::vector<BonePalette> palettes(benchAnimators.size());
+
+        std::vector<unsigned> threadCounts = {1, 2, 4, 8};
+        unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+        if (hardwareThreads != 1 && hardwareThreads != 2 && hardwareThreads != 4 && hardwareThreads != 8)
+            threadCounts.emplace_back(hardwareThreads);
+
+        std::ostringstream report;
+        report << "Animation update scaling (" << benchAnimators.size() << " animators, " 
+        << batchSize << " per job)\n";
+        report << std::setw(8) << "threads" << std::setw(16) << "animators/ms" << std::setw(10) 
+        << "speedup" << "\n";
+        report << std::fixed << std::setprecision(1);
+
+        double singleThreadRate = 0.0;
+        for (unsigned threadCount : threadCounts)
+        {
+            JobSystem jobs;
+            jobs.Start(threadCount);
+            auto update = [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                    benchAnimators[i].UpdateAnimation(deltaTime, palettes[i]);
+            };
+            //Warm up, so every thread has grown its scratch buffers
+            jobs.ParallelFor(benchAnimators.size(), batchSize, update);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int frame = 0; frame < frameCount; frame++)
+                jobs.ParallelFor(benchAnimators.size(), batchSize, update);
+            auto end = std::chrono::high_resolution_clock::now();
+            jobs.Stop();
+
+            double milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+            double rate = benchAnimators.size() * frameCount / milliseconds;
+            if (threadCount == 1)
+                singleThreadRate = rate;
+            report << std::setw(8) << threadCount << std::setw(16) << rate << std::setw(9) 
+            << rate / singleThreadRate << "x\n";
+        }
+        Publish(report.str());
+    }
+
+    /// @brief Returns the largest difference between the elements of two sets of matrices
+    static float MaxDifference(const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b)
+    {
+        float difference = 0.0f;
+        for (size_t i = 0; i < a.size(); i++)
+            for (int column = 0; column < 4; column++)
+                for (int row = 0; row < 4; row++)
+                    difference = std::max(difference, std::fabs(a[i][column][row] - b[i][column][row]));
+        return difference;
+    }
+
+    void EngineBenchmark::PoseKernels()
+    {
+        //Not a multiple of the batch width, so the padded tail is checked too
+        const size_t boneCount = 1021;
+        const int repeatCount = 2000;
+        //The kernels run the same math as the scalar reference in a different order
+        const float kernelTolerance = 1e-5f;
+        //Corrected nlerp against slerp, for keys up to 90 degrees apart
+        const float slerpTolerance = 5e-4f;
+
+        std::mt19937 generator(7);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> factor(0.0f, 1.0f);
+        TrsKeys keys;
+        keys.Resize(boneCount);
+        std::vector<glm::vec3> p0(boneCount), p1(boneCount), s0(boneCount), s1(boneCount);
+        std::vector<glm::quat> q0(boneCount), q1(boneCount);
+        for (size_t i = 0; i < boneCount; i++)
+        {
+            p0[i] = glm::vec3(unit(generator), unit(generator), unit(generator));
+            p1[i] = glm::vec3(unit(generator), unit(generator), unit(generator));
+            s0[i] = glm::vec3(1.0f + 0.5f * unit(generator));
+            s1[i] = glm::vec3(1.0f + 0.5f * unit(generator));
+            q0[i] = glm::normalize(glm::quat(unit(generator), unit(generator), unit(generator), unit(generator)));
+            glm::vec3 axis = glm::normalize(glm::vec3(unit(generator), unit(generator), unit(generator)) + 
+            glm::vec3(0.0f, 0.0f, 1e-3f));
+            q1[i] = glm::angleAxis(glm::half_pi<float>() * factor(generator), axis) * q0[i];
+            //Half of the keys are stored on the opposite hemisphere
+            if (i % 2)
+                q1[i] = -q1[i];
+
+            keys.positionFactor[i] = factor(generator);
+            keys.rotationFactor[i] = factor(generator);
+            keys.scaleFactor[i] = factor(generator);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                keys.position0[axis][i] = p0[i][axis];
+                keys.position1[axis][i] = p1[i][axis];
+                keys.scale0[axis][i] = s0[i][axis];
+                keys.scale1[axis][i] = s1[i][axis];
+            }
+            for (int axis = 0; axis < 4; axis++)
+            {
+                keys.rotation0[axis][i] = q0[i][axis];
+                keys.rotation1[axis][i] = q1[i][axis];
+            }
+        }
+
+        auto composeGlm = [&](std::vector<glm::mat4>& output)
+        {
+            for (size_t i = 0; i < boneCount; i++)
+            {
+                glm::vec3 position = glm::mix(p0[i], p1[i], keys.positionFactor[i]);
+                glm::vec3 scale = glm::mix(s0[i], s1[i], keys.scaleFactor[i]);
+                glm::quat rotation = glm::normalize(glm::slerp(q0[i], q1[i], keys.rotationFactor[i]));
+                output[i] = glm::translate(glm::mat4(1.0f), position) * glm::toMat4(rotation) * 
+                glm::scale(glm::mat4(1.0f), scale);
+            }
+        };
+        auto toMatrices = [&](const std::vector<Affine3x4>& affines, std::vector<glm::mat4>& output)
+        {
+            for (size_t i = 0; i < boneCount; i++)
+                StoreAffine(affines[i], output[i]);
+        };
+
+        std::vector<Affine3x4> scalarAffines(boneCount), simdAffines(boneCount);
+        std::vector<glm::mat4> reference(boneCount), scalar(boneCount), simd(boneCount);
+        composeGlm(reference);
+
+        std::ostringstream report;
+        report << "Pose kernels (" << ComposeTrsPath() << ", " << boneCount << " bones)\n";
+        report << std::scientific << std::setprecision(2);
+        bool passed = true;
+        for (NlerpAccuracy accuracy : {NlerpAccuracy::Fast, NlerpAccuracy::Corrected})
+        {
+            ComposeTrsScalar(keys, scalarAffines.data(), accuracy);
+            ComposeTrs(keys, simdAffines.data(), accuracy);
+            toMatrices(scalarAffines, scalar);
+            toMatrices(simdAffines, simd);
+            float kernelError = MaxDifference(scalar, simd);
+            float slerpError = MaxDifference(reference, simd);
+            bool kernelPassed = kernelError <= kernelTolerance;
+            bool slerpPassed = accuracy == NlerpAccuracy::Fast || slerpError <= slerpTolerance;
+            passed = passed && kernelPassed && slerpPassed;
+            report << (accuracy == NlerpAccuracy::Fast ? "fast nlerp" : "corrected nlerp") 
+            << ": SIMD vs scalar " << kernelError << (kernelPassed ? " (ok)" : " (FAIL)") 
+            << ", vs glm slerp " << slerpError << (accuracy == NlerpAccuracy::Fast ? "" : 
+            slerpPassed ? " (ok)" : " (FAIL)") << "\n";
+        }
+
+        //The hierarchy product against glm, every bone is the child of the previous one
+        const size_t chainLength = 8;
+        std::vector<Affine3x4> chain(simdAffines.begin(), simdAffines.begin() + chainLength);
+        std::vector<glm::mat4> chainReference(simd.begin(), simd.begin() + chainLength);
+        std::vector<glm::mat4> chainMatrices(chainLength);
+        StoreAffine(chain[0], chainMatrices[0]);
+        for (size_t i = 1; i < chainLength; i++)
+        {
+            MultiplyAffine(chain[i - 1], simdAffines[i], chain[i]);
+            StoreAffine(chain[i], chainMatrices[i]);
+            chainReference[i] = chainReference[i - 1] * simd[i];
+        }
+        float chainError = MaxDifference(chainReference, chainMatrices);
+        //The error grows with the depth and the scale of the chain
+        bool chainPassed = chainError <= kernelTolerance * 10.0f;
+        passed = passed && chainPassed;
+        report << "affine product vs glm (" << chainLength << " levels): " << chainError << (chainPassed ? " (ok)" : " (FAIL)") << "\n";
+        report << (passed ? "PASS" : "FAIL") << "\n";
+
+        auto measure = [&](auto compose)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int repeat = 0; repeat < repeatCount; repeat++)
+                compose();
+            auto end = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration<double, std::nano>(end - start).count() / (repeatCount * boneCount);
+        };
+        double glmTime = measure([&]() { composeGlm(reference); });
+        double scalarTime = measure([&]() { ComposeTrsScalar(keys, scalarAffines.data(), NlerpAccuracy::Corrected); });
+        double simdTime = measure([&]() { ComposeTrs(keys, simdAffines.data(), NlerpAccuracy::Corrected); });
+        //The checksum keeps the compiler from removing the loops
+        if (reference[0][3][0] + scalarAffines[0].rows[0].w + simdAffines[0].rows[0].w == 12345.0f)
+            std::cout << "";
+
+        report << std::fixed << std::setprecision(1) << "ns per bone: glm " << glmTime << ", scalar " 
+        << scalarTime << ", " << ComposeTrsPath() << " " << simdTime << " (" << scalarTime / simdTime 
+        << "x over scalar)\n";
+        Publish(report.str());
+    }
+
+    void EngineBenchmark::ClipCompression(const std::vector<Animation> &animations, ModelLoader *model, 
+    const ClipCompressionSettings &settings)
+    {
+        std::vector<Animation> sources(animations.size());
+        for (size_t i = 0; i < animations.size(); i++)
+        {
+            float sampleRate = animations[i].sampleRate > 0.0f ? animations[i].sampleRate : DEFAULT_COMPRESSION_RATE;
+            sources[i].CreateAnimation(animations[i].path, model, sampleRate);
+        }
+        CompareCompression(sources, settings);
+    }
+
+    /// @brief Returns the number of keys stored by the clip
+    static int CountKeys(const Animation& animation)
+    {
+        int keyCount = 0;
+        for (const auto& bone : animation.bones)
+            keyCount += bone.numPositions + bone.numRotations + bone.numScalings;
+        return keyCount;
+    }
+
+    /// @brief Plays the clip like an animator at 60 frames per second, gathering the keys of every 
+    /// bone into the pose batch, and returns the average cost of one bone in nanoseconds
+    static double MeasureDecoding(const Animation& animation, int frameCount)
+    {
+        TrsKeys keys;
+        keys.Resize(animation.bones.size());
+        std::vector<TrackCursor> cursors(animation.bones.size());
+        const float timeStep = animation.ticksPerSecond / 60.0f;
+        float animationTime = 0.0f;
+        float checksum = 0.0f;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int frame = 0; frame < frameCount; frame++)
+        {
+            animationTime = std::fmod(animationTime + timeStep, animation.duration);
+            for (size_t i = 0; i < animation.bones.size(); i++)
+                animation.bones[i].GatherKeys(animationTime, &cursors[i], keys, i);
+            checksum += keys.rotation0[0][0];
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        //The checksum keeps the compiler from removing the loop
+        if (checksum == 12345.0f)
+            std::cout << "";
+        return std::chrono::duration<double, std::nano>(end - start).count() / 
+        (static_cast<double>(frameCount) * animation.bones.size());
+    }
+
+    void EngineBenchmark::CompareCompression(const std::vector<Animation> &sources, 
+    const ClipCompressionSettings &settings)
+    {
+        const int frameCount = 20000;
+        std::ostringstream report;
+        report << "Clip compression (tolerances: " << settings.positionError << " units, " 
+        << settings.rotationError << " rad, " << settings.scaleError << " scale)\n";
+        report << std::setw(16) << "clip" << std::setw(14) << "keys" << std::setw(18) << "KB" 
+        << std::setw(8) << "ratio" << std::setw(11) << "pos err" << std::setw(11) << "rot err" 
+        << std::setw(16) << "ns/bone decode" << "\n";
+
+        size_t totalSource = 0, totalCompressed = 0;
+        for (const auto& source : sources)
+        {
+            Animation compressed = source;
+            compressed.Compress(settings);
+
+            //The error is measured between the frames too
+            float positionError = 0.0f, rotationError = 0.0f;
+            float timeStep = source.ticksPerSecond / (4.0f * source.sampleRate);
+            for (float time = 0.0f; time <= source.duration; time += timeStep)
+            {
+                for (size_t i = 0; i < source.bones.size(); i++)
+                {
+                    const Bone& sourceBone = source.bones[i];
+                    const Bone& compressedBone = compressed.bones[i];
+                    positionError = std::max(positionError, glm::length(sourceBone.SamplePosition(time) - 
+                    compressedBone.SamplePosition(time)));
+                    rotationError = std::max(rotationError, RotationAngle(sourceBone.SampleRotation(time), 
+                    compressedBone.SampleRotation(time)));
+                }
+            }
+
+            double sourceDecode = MeasureDecoding(source, frameCount);
+            double compressedDecode = MeasureDecoding(compressed, frameCount);
+            size_t sourceBytes = source.MemoryUsage(), compressedBytes = compressed.MemoryUsage();
+            totalSource += sourceBytes;
+            totalCompressed += compressedBytes;
+
+            std::string name = source.path.substr(source.path.find_last_of("/\\") + 1);
+            std::ostringstream keys, kilobytes, decode;
+            keys << CountKeys(source) << " > " << CountKeys(compressed);
+            kilobytes << std::fixed << std::setprecision(1) << sourceBytes / 1024.0 << " > " 
+            << compressedBytes / 1024.0;
+            decode << std::fixed << std::setprecision(1) << sourceDecode << " > " << compressedDecode;
+            report << std::setw(16) << name << std::setw(14) << keys.str() << std::setw(18) << kilobytes.str() 
+            << std::setw(7) << std::fixed << std::setprecision(1) << 
+            static_cast<double>(sourceBytes) / compressedBytes << "x" << std::scientific << std::setprecision(2) 
+            << std::setw(11) << positionError << std::setw(11) << rotationError << std::setw(16) << decode.str() 
+            << "\n";
+        }
+        report << std::fixed << std::setprecision(1) << "total " << totalSource / 1024.0 << " KB > " 
+        << totalCompressed / 1024.0 << " KB\n";
+        Publish(report.str());
+    }
+
+    void EngineBenchmark::AnimationLod(const std::vector<Animator>& animators, const AnimationLodSettings& settings,
+    const glm::vec3& cameraPos, const glm::mat4& model, const std::vector<InstanceData>& instances)
+    {
+        //A multiple of every update interval, so each animator is evaluated the same number of times
+        const int frameCount = 64;
+        const float deltaTime = 1.0f / 60.0f;
+        std::vector<BonePalette> palettes(animators.size());
+
+        auto measure = [&](std::vector<Animator>& benchAnimators)
+        {
+            //Warm up, so the scratch buffers and the cached poses are allocated
+            for (size_t i = 0; i < benchAnimators.size(); i++)
+                benchAnimators[i].UpdateAnimation(deltaTime, palettes[i], 0);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int frame = 1; frame <= frameCount; frame++)
+            {
+                for (size_t i = 0; i < benchAnimators.size(); i++)
+                    benchAnimators[i].UpdateAnimation(deltaTime, palettes[i], frame);
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration<double, std::milli>(end - start).count() / frameCount;
+        };
+
+        std::vector<Animator> fullRate = animators;
+        for (auto& animator : fullRate)
+            animator.SetLod(1, 0, false);
+        double fullMilliseconds = measure(fullRate);
+
+        std::vector<Animator> reducedRate = animators;
+        std::vector<int> bandCounts;
+        SelectAnimationLod(settings, cameraPos, model, instances, reducedRate, bandCounts);
+        double lodMilliseconds = measure(reducedRate);
+
+        std::ostringstream report;
+        report << "Animation LOD (" << animators.size() << " animators, 1 thread)\n";
+        for (size_t band = 0; band < bandCounts.size(); band++)
+        {
+            report << "band " << band << ": " << bandCounts[band] << " animators, 1/" 
+            << settings.bands[band].updateInterval << " rate" 
+            << (settings.bands[band].prunedSkeleton ? ", pruned skeleton" : "") << "\n";
+        }
+        report << std::fixed << std::setprecision(3);
+        report << "full rate " << fullMilliseconds << " ms/frame, LOD " << lodMilliseconds 
+        << " ms/frame (" << std::setprecision(1) << fullMilliseconds / lodMilliseconds << "x)\n";
+        Publish(report.str());
+    }
+
+    void EngineBenchmark::AnimationBlending(const std::vector<Animation>& animations)
+    {
+        const int poseCount = 2000;
+        const float deltaTime = 1.0f / 60.0f;
+        const size_t maxClips = MAX_ANIMATION_LAYERS + 1;
+        //Distinct copies, since a clip already blended only changes its weight
+        std::vector<Animation> clips;
+        clips.reserve(maxClips);
+        for (size_t i = 0; i < maxClips; i++)
+            clips.emplace_back(animations[i % animations.size()]);
+        BonePalette palette;
+
+        std::vector<double> nanoseconds;
+        for (size_t clipCount = 1; clipCount <= maxClips; clipCount++)
+        {
+            Animator animator;
+            animator.CreateAnimator(&clips[0], 0.0f, 1.0f);
+            for (size_t clip = 1; clip < clipCount; clip++)
+                animator.SetBlendWeight(&clips[clip], 1.0f);
+            //Warm up, so the pose pool of the thread is allocated
+            animator.UpdateAnimation(deltaTime, palette);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < poseCount; i++)
+                animator.UpdateAnimation(deltaTime, palette);
+            auto end = std::chrono::high_resolution_clock::now();
+            nanoseconds.emplace_back(std::chrono::duration<double, std::nano>(end - start).count() / poseCount);
+        }
+
+        //Least squares line through the blended poses, the single clip skips the accumulation
+        double meanX = 0.0, meanY = 0.0;
+        for (size_t i = 1; i < nanoseconds.size(); i++)
+        {
+            meanX += static_cast<double>(i + 1);
+            meanY += nanoseconds[i];
+        }
+        meanX /= nanoseconds.size() - 1;
+        meanY /= nanoseconds.size() - 1;
+        double covariance = 0.0, variance = 0.0;
+        for (size_t i = 1; i < nanoseconds.size(); i++)
+        {
+            covariance += (i + 1 - meanX) * (nanoseconds[i] - meanY);
+            variance += (i + 1 - meanX) * (i + 1 - meanX);
+        }
+        double slope = covariance / variance, intercept = meanY - slope * meanX;
+
+        std::ostringstream report;
+        report << "Animation blending (" << clips[0].bones.size() << " tracks, 1 thread)\n";
+        report << std::fixed << std::setprecision(0);
+        for (size_t i = 0; i < nanoseconds.size(); i++)
+        {
+            report << i + 1 << " clips: " << nanoseconds[i] << " ns/pose";
+            if (i > 0)
+                report << ", linear fit " << intercept + slope * (i + 1);
+            report << "\n";
+        }
+        report << "cost of a layer: " << slope << " ns\n";
+        Publish(report.str());
+    }
+
+    void EngineBenchmark::MeshOptimization(ModelLoader* model, const std::vector<std::string>& fileNames, 
+    const MeshOptimizationSettings& settings)
+    {
+        //Only the geometry is measured, the bones found by the import are dropped afterwards
+        std::map<std::string, Mesh::BoneInfo> infoBoneMap = model->infoBoneMap;
+        int boneNumber = model->boneNumber;
+
+        std::ostringstream report;
+        report << "Mesh optimization (FIFO cache of " << settings.cacheSize << " vertices)\n";
+        report << std::fixed << std::setprecision(3);
+        for (const auto& fileName : fileNames)
+        {
+            std::vector<Mesh> meshes = model->ImportMeshes(fileName);
+            //Triangle weighted ACMR and vertex weighted ATVR of the exporter order, Tipsify and overdraw
+            double acmr[3] = {}, atvr[3] = {};
+            double cacheMilliseconds = 0.0, overdrawMilliseconds = 0.0, fetchMilliseconds = 0.0;
+            size_t triangles = 0, vertices = 0;
+            for (auto& mesh : meshes)
+            {
+                if (mesh.indices.empty())
+                    continue;
+                double meshTriangles = static_cast<double>(mesh.indices.size() / 3);
+                double meshVertices = static_cast<double>(mesh.vertices.size());
+                auto accumulate = [&](int stage, const std::vector<uint32_t>& indices)
+                {
+                    VertexCacheStats stats = AnalyzeVertexCache(indices, mesh.vertices.size(), settings.cacheSize);
+                    acmr[stage] += stats.acmr * meshTriangles;
+                    atvr[stage] += stats.atvr * meshVertices;
+                };
+                accumulate(0, mesh.indices);
+
+                std::vector<uint32_t> clusters;
+                auto start = std::chrono::high_resolution_clock::now();
+                std::vector<uint32_t> indices = OptimizeVertexCache(mesh.indices, mesh.vertices.size(), 
+                settings.cacheSize, &clusters);
+                auto end = std::chrono::high_resolution_clock::now();
+                cacheMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+                accumulate(1, indices);
+
+                start = std::chrono::high_resolution_clock::now();
+                indices = OptimizeOverdraw(indices, mesh.vertices, clusters, settings.cacheSize, settings.overdrawThreshold);
+                end = std::chrono::high_resolution_clock::now();
+                overdrawMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+                accumulate(2, indices);
+
+                start = std::chrono::high_resolution_clock::now();
+                OptimizeVertexFetch(mesh.vertices, indices);
+                end = std::chrono::high_resolution_clock::now();
+                fetchMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+
+                triangles += mesh.indices.size() / 3;
+                vertices += mesh.vertices.size();
+            }
+            if (triangles == 0)
+            {
+                report << fileName << ": no triangles\n";
+                continue;
+            }
+
+            const char* stages[3] = {"exporter order", "vertex cache", "vertex cache + overdraw"};
+            report << fileName << ": " << meshes.size() << " meshes, " << triangles << " triangles, " 
+            << vertices << " vertices\n";
+            for (int stage = 0; stage < 3; stage++)
+            {
+                report << "  " << stages[stage] << ": ACMR " << acmr[stage] / triangles 
+                << ", ATVR " << atvr[stage] / vertices << "\n";
+            }
+            report << "  import stage: cache " << cacheMilliseconds << " ms, overdraw " << overdrawMilliseconds 
+            << " ms, fetch " << fetchMilliseconds << " ms\n";
+        }
+
+        model->infoBoneMap = infoBoneMap;
+        model->boneNumber = boneNumber;
+        Publish(report.str());
+    }
+
+    void EngineBenchmark::AssetLoading(const SampleType &sample, const TextureManager &textures, int clipCopies)
+    {
+        SampleType benchSample = sample;
+        benchSample.animName.clear();
+        for (int copy = 0; copy < std::max(clipCopies, 1); copy++)
+            benchSample.animName.insert(benchSample.animName.end(), sample.animName.begin(), 
+            sample.animName.begin() + std::min(static_cast<size_t>(std::max(sample.animNumber, 0)), sample.animName.size()));
+        benchSample.animNumber = static_cast<int>(benchSample.animName.size());
+
+        std::vector<unsigned> threadCounts = {1, 2, 4, 8};
+        unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+        if (hardwareThreads != 1 && hardwareThreads != 2 && hardwareThreads != 4 && hardwareThreads != 8)
+            threadCounts.emplace_back(hardwareThreads);
+
+        AssetLoader loader;
+        //Warm up, so the cooked files exist and sit in the file cache for every run
+        {
+            JobSystem jobs;
+            jobs.Start(1);
+            ModelLoader model;
+            loader.Load(benchSample, model, textures, jobs);
+            jobs.Stop();
+        }
+
+        std::ostringstream report;
+        report << "Asset loading (" << benchSample.modelName << ", " << benchSample.textureName << ", " 
+        << benchSample.animNumber << " clips), ms\n";
+        report << std::setw(8) << "threads" << std::setw(9) << "model" << std::setw(9) << "texture" 
+        << std::setw(9) << "clips" << std::setw(9) << "bones" << std::setw(9) << "total" << std::setw(10) 
+        << "speedup" << "\n";
+        report << std::fixed << std::setprecision(1);
+
+        double singleThreadTotal = 0.0;
+        for (unsigned threadCount : threadCounts)
+        {
+            JobSystem jobs;
+            jobs.Start(threadCount);
+            ModelLoader model;
+            LoadedAssets assets = loader.Load(benchSample, model, textures, jobs);
+            jobs.Stop();
+
+            const AssetLoadTimes& times = assets.times;
+            if (threadCount == 1)
+                singleThreadTotal = times.Total();
+            report << std::setw(8) << threadCount << std::setw(9) << times.model << std::setw(9) << times.texture
+            << std::setw(9) << times.clipWave << std::setw(9) << times.bones << std::setw(9) << times.Total() 
+            << std::setw(9) << singleThreadTotal / times.Total() << "x\n";
+        }
+        report << "model and texture run in the same wave, the clips follow once the bones of the model are known\n";
+        Publish(report.str());
+    }
+
+    void EngineBenchmark::ObjLoading(ModelLoader *model, int gridSize)
+    {
+        gridSize = std::max(gridSize, 1);
+        std::string path = (std::filesystem::temp_directory_path() / "MinervaObjBenchmark.obj").string();
+        {
+            //A wavy grid: every vertex has its own position and uv, the quads share one normal per row
+            std::ofstream file(path, std::ios::trunc);
+            file << std::fixed << std::setprecision(6);
+            for (int y = 0; y <= gridSize; y++)
+                for (int x = 0; x <= gridSize; x++)
+                    file << "v " << x << " " << std::sin(x * 0.1f) * std::cos(y * 0.1f) << " " << y << "\n";
+            for (int y = 0; y <= gridSize; y++)
+                for (int x = 0; x <= gridSize; x++)
+                    file << "vt " << static_cast<float>(x) / gridSize << " " << static_cast<float>(y) / gridSize << "\n";
+            for (int y = 0; y < gridSize; y++)
+                file << "vn 0 1 " << std::sin(y * 0.1f) << "\n";
+            for (int y = 0; y < gridSize; y++)
+            {
+                for (int x = 0; x < gridSize; x++)
+                {
+                    int corners[4] = {y * (gridSize + 1) + x + 1, y * (gridSize + 1) + x + 2, 
+                    (y + 1) * (gridSize + 1) + x + 2, (y + 1) * (gridSize + 1) + x + 1};
+                    file << "f";
+                    for (int corner : corners)
+                        file << " " << corner << "/" << corner << "/" << y + 1;
+                    file << "\n";
+                }
+            }
+        }
+        std::error_code error;
+        double megabytes = std::filesystem::file_size(path, error) / (1024.0 * 1024.0);
+
+        auto count = [](const std::vector<Mesh>& meshes, size_t& vertices, size_t& triangles)
+        {
+            vertices = triangles = 0;
+            for (const auto& mesh : meshes)
+            {
+                vertices += mesh.vertices.size();
+                triangles += mesh.indices.size() / 3;
+            }
+        };
+
+        std::ostringstream report;
+        report << "OBJ loading (" << gridSize << "x" << gridSize << " quads, " << std::fixed << std::setprecision(1) 
+        << megabytes << " MB)\n";
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<Mesh> meshes = model->ImportAssimpMeshes(path);
+        auto end = std::chrono::high_resolution_clock::now();
+        double assimpTime = std::chrono::duration<double, std::milli>(end - start).count();
+        size_t vertices = 0, triangles = 0;
+        count(meshes, vertices, triangles);
+        meshes.clear();
+        report << std::setw(10) << "Assimp" << ": " << assimpTime << " ms, " << triangles << " triangles, " 
+        << vertices << " vertices\n";
+
+        std::vector<unsigned> threadCounts = {1, 2, 4, 8};
+        unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+        if (hardwareThreads != 1 && hardwareThreads != 2 && hardwareThreads != 4 && hardwareThreads != 8)
+            threadCounts.emplace_back(hardwareThreads);
+        for (unsigned threadCount : threadCounts)
+        {
+            JobSystem jobs;
+            jobs.Start(threadCount);
+            start = std::chrono::high_resolution_clock::now();
+            bool loaded = LoadObj(path, &jobs, meshes);
+            end = std::chrono::high_resolution_clock::now();
+            jobs.Stop();
+            if (!loaded)
+            {
+                report << "the fast path can't read the grid\n";
+                break;
+            }
+            double time = std::chrono::duration<double, std::milli>(end - start).count();
+            count(meshes, vertices, triangles);
+            meshes.clear();
+            report << std::setw(2) << threadCount << " threads: " << time << " ms, " << triangles << " triangles, " 
+            << vertices << " vertices, " << assimpTime / time << "x over Assimp\n";
+        }
+        std::filesystem::remove(path, error);
+        Publish(report.str());
+    }
+
+    void EngineBenchmark::RenderRecording(size_t callCount)
+    {
+        const int frameCount = 20;
+        std::vector<unsigned> threadCounts = {1, 2, 4, 8};
+        unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+        if (hardwareThreads != 1 && hardwareThreads != 2 && hardwareThreads != 4 && hardwareThreads != 8)
+            threadCounts.emplace_back(hardwareThreads);
+
+        std::ostringstream report;
+        report << "Render pass recording (" << callCount << " draw calls, " << engineRenderer.drawCount 
+        << " draws of the scene)\n";
+        report << std::setw(8) << "threads" << std::setw(12) << "ms/frame" << std::setw(10) << "speedup" << "\n";
+        report << std::fixed << std::setprecision(3);
+
+        double singleThreadTime = 0.0;
+        for (unsigned threadCount : threadCounts)
+        {
+            JobSystem jobs;
+            jobs.Start(threadCount);
+            double milliseconds = engineRenderer.MeasureRecording(jobs, callCount, frameCount);
+            jobs.Stop();
+            if (milliseconds == 0.0)
+            {
+                report << "The scene has no draws to record\n";
+                break;
+            }
+            if (threadCount == 1)
+                singleThreadTime = milliseconds;
+            report << std::setw(8) << threadCount << std::setw(12) << milliseconds << std::setw(9) 
+            << std::setprecision(1) << singleThreadTime / milliseconds << "x\n" << std::setprecision(3);
+        }
+        Publish(report.str());
+    }
+
+    void EngineBenchmark::Publish(const std::string &report)
+    {
+        std::cout << report << std::endl;
+        lastReport = report;
+    }
+}
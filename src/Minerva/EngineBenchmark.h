@@ -0,0 +1,83 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "ClipCompression.h"
+#include "AnimationLod.h"
+#include "MeshOptimizer.h"
+
+namespace Minerva
+{
+    class Animator;
+    class Animation;
+    class ModelLoader;
+    class TextureManager;
+    struct SampleType;
+
+    /// @brief Collects the CPU benchmarks of the engine. They are started from MinervaUI, the 
+    /// results are printed on the console and kept in lastReport to be shown in the UI
+    class EngineBenchmark
+    {
+    public:
+        std::string lastReport;
+        /// @brief Measures the cost of sampling one bone using the linear search, the cached 
+        /// cursor and the resampled tracks, for clips of increasing length
+        void KeyframeSampling();
+        /// @brief Measures how many animators per millisecond the job system evaluates with 
+        /// 1, 2, 4, 8 and all the hardware threads
+        /// @param animators The animators of the scene, they are copied so their state is untouched
+        /// @param batchSize The number of animators of a job
+        void AnimationScaling(const std::vector<Animator>& animators, size_t batchSize);
+        /// @brief Checks the SIMD pose kernels against the scalar reference and glm, then measures 
+        /// the cost of composing one bone with glm, the scalar kernel and the SIMD kernel
+        void PoseKernels();
+        /// @brief Reimports the clips without compression and compares them with their compressed 
+        /// version: keys, memory, largest error and cost of decoding the keys of one bone
+        /// @param animations The clips of the scene, only their path and sample rate are used
+        /// @param model The model animated by the clips
+        /// @param settings The tolerances of the compression
+        void ClipCompression(const std::vector<Animation>& animations, ModelLoader* model, 
+        const ClipCompressionSettings& settings);
+        /// @brief Same as ClipCompression, on clips already imported without compression
+        void CompareCompression(const std::vector<Animation>& sources, const ClipCompressionSettings& settings);
+        /// @brief Measures the CPU time of a frame of animation updates at full rate and with the 
+        /// animation LOD, on a single thread
+        /// @param animators The animators of the scene, they are copied so their state is untouched
+        /// @param settings The LOD bands
+        /// @param cameraPos The position of the camera used to select the bands
+        /// @param model The model matrix applied to every instance
+        /// @param instances The instance data of the scene
+        void AnimationLod(const std::vector<Animator>& animators, const AnimationLodSettings& settings,
+        const glm::vec3& cameraPos, const glm::mat4& model, const std::vector<InstanceData>& instances);
+        /// @brief Measures the cost of a blended pose with 1 to MAX_ANIMATION_LAYERS + 1 active clips,
+        /// the cost of each extra layer should stay the same
+        /// @param animations The clips of the scene, they are copied so every layer plays its own clip
+        void AnimationBlending(const std::vector<Animation>& animations);
+        /// @brief Reimports the models and reports ACMR and ATVR of the exporter order, after the 
+        /// vertex cache pass and after the overdraw pass, with the time taken by the import stage
+        /// @param model The loader used for the import, its bones are left as they were
+        /// @param fileNames The models to measure
+        /// @param settings The cache size and the overdraw threshold, the passes run even when not enabled
+        void MeshOptimization(ModelLoader* model, const std::vector<std::string>& fileNames, 
+        const MeshOptimizationSettings& settings);
+        /// @brief Loads the assets of the sample into a scratch scene with 1, 2, 4, 8 and all the hardware 
+        /// threads, reporting the time of every phase and the speedup of the whole load. The clips are loaded
+        /// clipCopies times, to show how the load scales with their number. The skeletons of the live clips
+        /// are shared, so only the first run of an empty engine reads them from disk
+        /// @param sample The sample to load, its model must be cookable or importable again
+        /// @param textures Decodes the texture
+        /// @param clipCopies The number of times every clip of the sample is loaded
+        void AssetLoading(const SampleType& sample, const TextureManager& textures, int clipCopies);
+        /// @brief Writes a grid of gridSize x gridSize quads as an OBJ file, then reads it with Assimp and with
+        /// the OBJ fast path on 1, 2, 4, 8 and all the hardware threads, comparing time and merged vertices
+        /// @param model The loader used for the Assimp import, the grid has no bones so it is left untouched
+        /// @param gridSize The quads of a side, 1024 writes two million triangles
+        void ObjLoading(ModelLoader* model, int gridSize);
+        /// @brief Records callCount draw calls of the scene into secondary command buffers with 1, 2, 4, 8 and all
+        /// the hardware threads, every thread recording a slice, and reports the time of a frame and the speedup.
+        /// The buffers are never submitted
+        /// @param callCount The number of calls, a call for each draw like a device without multiDrawIndirect
+        void RenderRecording(size_t callCount);
+    private:
+        void Publish(const std::string& report);
+    };
+}
@@ -10,6 +10,12 @@ namespace Minerva
         glm::mat4 model;
         glm::mat4 view;
         glm::mat4 proj;
+        //Time in seconds used by the baked animations
+        float animationTime = 0.0f;
+        //1 when the vertex shader reads the baked animation buffer instead of the palettes
+        uint32_t bakedAnimation = 0;
+        //Number of poses shared by the instances, the instance i draws the pose i % poseCount
+        uint32_t poseCount = 1;
     };
     class Transformation
     {
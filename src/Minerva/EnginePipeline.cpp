@@ -1,16 +1,16 @@
 #include "EnginePipeline.h"
 #include <fstream>
 #include "EngineVars.h"
+#include "MeshCache.h"
+#include <chrono>
+#include <cstring>
 #include <iostream>
-
-
-
-
-//!TO-DO: Implement a pipeline cache to increase performance
+#include <utility>
 
 namespace Minerva
 {
-    void EnginePipeline::CreatePipeline(const std::string& vertShaderName, const std::string& fragShaderName)
+    void EnginePipeline::CreatePipeline(const std::string& vertShaderName, const std::string& fragShaderName,
+    const Mesh::VertexLayout& vertexLayout)
     { 
         std::string totalVertPath = SHADERS_PATH + vertShaderName + FILE_TYPE;
         std::string totalFragPath = SHADERS_PATH + fragShaderName + FILE_TYPE;
@@ -43,8 +43,8 @@ namespace Minerva
         dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
         dynamicState.pDynamicStates = dynamicStates.data();
 
-        auto bindingDescription = Minerva::Mesh::Vertex::getBindingDescription();
-        auto attributeDescriptions = Minerva::Mesh::Vertex::getAttributeDescriptions();
+        auto bindingDescription = Minerva::Mesh::Vertex::getBindingDescription(vertexLayout);
+        auto attributeDescriptions = Minerva::Mesh::Vertex::getAttributeDescriptions(vertexLayout);
         
         VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
         vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -146,23 +146,163 @@ namespace Minerva
         pipelineInfo.renderPass = engineRenderer.renderPass;
         pipelineInfo.subpass = 0;
 
-        if (vkCreateGraphicsPipelines(engineDevice.logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+        auto start = std::chrono::high_resolution_clock::now();
+        if (vkCreateGraphicsPipelines(engineDevice.logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
             throw std::runtime_error("failed to create graphics pipeline!");
         }
+        creationMilliseconds += std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
 
         vkDestroyShaderModule(engineDevice.logicalDevice, fragShaderModule, nullptr);
         vkDestroyShaderModule(engineDevice.logicalDevice, vertShaderModule, nullptr);
     }
 
+    void EnginePipeline::CreateComputePipeline(const std::string& compShaderName, VkDescriptorSetLayout setLayout, 
+    uint32_t pushConstantSize)
+    {
+        auto compShaderCode = ReadFile(SHADERS_PATH + compShaderName + FILE_TYPE);
+        VkShaderModule compShaderModule = CreateShaderModule(compShaderCode);
+
+        VkPipelineShaderStageCreateInfo compShaderStageInfo{};
+        compShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        compShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        compShaderStageInfo.module = compShaderModule;
+        compShaderStageInfo.pName = "main";
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = pushConstantSize;
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &setLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(engineDevice.logicalDevice, &pipelineLayoutInfo, nullptr, &computePipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute pipeline layout!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = compShaderStageInfo;
+        pipelineInfo.layout = computePipelineLayout;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        if (vkCreateComputePipelines(engineDevice.logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute pipeline!");
+        }
+        creationMilliseconds += std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+        vkDestroyShaderModule(engineDevice.logicalDevice, compShaderModule, nullptr);
+    }
+
+    void EnginePipeline::CreatePipelineCache()
+    {
+        PipelineCacheHeader expected = DeviceCacheHeader();
+        MappedFile file;
+        const unsigned char* initialData = nullptr;
+        if (file.Open(PIPELINE_CACHE_PATH))
+        {
+            FileCursor cursor(file);
+            PipelineCacheHeader header;
+            VkPipelineCacheHeaderVersionOne dataHeader{};
+            bool valid = cursor.Read(&header, sizeof(header)) && header.magic == expected.magic 
+            && header.version == expected.version && header.vendorID == expected.vendorID 
+            && header.deviceID == expected.deviceID && header.driverVersion == expected.driverVersion
+            && memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) == 0
+            && memcmp(header.driverUUID, expected.driverUUID, VK_UUID_SIZE) == 0
+            && header.dataSize >= sizeof(dataHeader) && cursor.Fits(cursor.offset, header.dataSize);
+            //The data starts with the header of the driver, checked as well before the driver parses the rest
+            if (valid)
+            {
+                const unsigned char* data = file.Data() + cursor.offset;
+                memcpy(&dataHeader, data, sizeof(dataHeader));
+                valid = HashBytes(data, static_cast<size_t>(header.dataSize)) == header.dataHash
+                && dataHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+                && dataHeader.vendorID == expected.vendorID && dataHeader.deviceID == expected.deviceID
+                && memcmp(dataHeader.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+            }
+            if (valid)
+            {
+                initialData = file.Data() + cursor.offset;
+                loadedCacheSize = static_cast<size_t>(header.dataSize);
+            }
+            else
+                std::cout << "Pipeline cache written by another device or driver, starting from an empty one\n";
+        }
+
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = loadedCacheSize;
+        cacheInfo.pInitialData = initialData;
+        if (vkCreatePipelineCache(engineDevice.logicalDevice, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+    }
+
+    void EnginePipeline::SavePipelineCache()
+    {
+        if (pipelineCache == VK_NULL_HANDLE)
+            return;
+        size_t dataSize = 0;
+        if (vkGetPipelineCacheData(engineDevice.logicalDevice, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+            return;
+        PipelineCacheHeader header = DeviceCacheHeader();
+        std::vector<unsigned char> file(sizeof(header) + dataSize);
+        //The driver may return less than it asked room for
+        if (vkGetPipelineCacheData(engineDevice.logicalDevice, pipelineCache, &dataSize, file.data() + sizeof(header)) != VK_SUCCESS)
+            return;
+        file.resize(sizeof(header) + dataSize);
+        header.dataSize = dataSize;
+        header.dataHash = HashBytes(file.data() + sizeof(header), dataSize);
+        memcpy(file.data(), &header, sizeof(header));
+        if (WriteFileAtomically(PIPELINE_CACHE_PATH, file.data(), file.size()))
+            std::cout << "Pipeline cache saved: " << dataSize / 1024 << " KB\n";
+    }
+
+    PipelineCacheHeader EnginePipeline::DeviceCacheHeader() const
+    {
+        PipelineCacheHeader header;
+        VkPhysicalDeviceIDProperties idProperties{};
+        idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        vkGetPhysicalDeviceProperties(engineDevice.physicalDevice, &properties.properties);
+        //The driver UUID is core since Vulkan 1.1
+        if (properties.properties.apiVersion >= VK_API_VERSION_1_1)
+        {
+            properties.pNext = &idProperties;
+            vkGetPhysicalDeviceProperties2(engineDevice.physicalDevice, &properties);
+            memcpy(header.driverUUID, idProperties.driverUUID, VK_UUID_SIZE);
+        }
+        header.vendorID = properties.properties.vendorID;
+        header.deviceID = properties.properties.deviceID;
+        header.driverVersion = properties.properties.driverVersion;
+        memcpy(header.pipelineCacheUUID, properties.properties.pipelineCacheUUID, VK_UUID_SIZE);
+        return header;
+    }
+
     EnginePipeline::~EnginePipeline()
     {
         std::cout << "Destruction Pipeline... \n";
+        vkDestroyPipelineCache(engineDevice.logicalDevice, pipelineCache, nullptr);
         vkDestroyPipeline(engineDevice.logicalDevice, graphicsPipeline, nullptr);
         vkDestroyPipelineLayout(engineDevice.logicalDevice, pipelineLayout, nullptr);
+        vkDestroyPipeline(engineDevice.logicalDevice, computePipeline, nullptr);
+        vkDestroyPipelineLayout(engineDevice.logicalDevice, computePipelineLayout, nullptr);
     }
 
     EnginePipeline::EnginePipeline(EnginePipeline &&other) noexcept
     {
+        computePipeline = std::exchange(other.computePipeline, VK_NULL_HANDLE);
+        computePipelineLayout = std::exchange(other.computePipelineLayout, VK_NULL_HANDLE);
+        pipelineCache = std::exchange(other.pipelineCache, VK_NULL_HANDLE);
+        loadedCacheSize = other.loadedCacheSize;
+        creationMilliseconds = other.creationMilliseconds;
         graphicsPipeline = std::move(other.graphicsPipeline);
         pipelineLayout = std::move(other.pipelineLayout);
 
@@ -172,6 +312,11 @@ namespace Minerva
 
     EnginePipeline &EnginePipeline::operator=(EnginePipeline &&other) noexcept
     {
+        computePipeline = std::exchange(other.computePipeline, VK_NULL_HANDLE);
+        computePipelineLayout = std::exchange(other.computePipelineLayout, VK_NULL_HANDLE);
+        pipelineCache = std::exchange(other.pipelineCache, VK_NULL_HANDLE);
+        loadedCacheSize = other.loadedCacheSize;
+        creationMilliseconds = other.creationMilliseconds;
         graphicsPipeline = std::move(other.graphicsPipeline);
         pipelineLayout = std::move(other.pipelineLayout);
 
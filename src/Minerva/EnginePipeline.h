@@ -2,19 +2,62 @@
 #include <vector>
 #include <string>
 #include "vulkan/vulkan.h"
+#include "Mesh.h"
 
 namespace Minerva
 {
+    /*The pipeline cache file is this header followed by the data of vkGetPipelineCacheData. The data only
+    helps the device and driver which wrote it, any other one starts from an empty cache*/
+    constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x4843504Du; //"MPCH"
+    constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
+    struct PipelineCacheHeader
+    {
+        uint32_t magic = PIPELINE_CACHE_MAGIC;
+        uint32_t version = PIPELINE_CACHE_VERSION;
+        uint32_t vendorID = 0;
+        uint32_t deviceID = 0;
+        uint32_t driverVersion = 0;
+        uint32_t padding = 0;
+        uint64_t dataSize = 0;
+        //A truncated or corrupted file is discarded instead of reaching the driver
+        uint64_t dataHash = 0;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE] = {};
+        //Zero when the device doesn't report it
+        uint8_t driverUUID[VK_UUID_SIZE] = {};
+    };
+
     class EnginePipeline
     {
         
     public:
         VkPipeline graphicsPipeline;
         VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+        //Shared by every pipeline of the engine and of ImGui
+        VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+        //Bytes of cache data loaded from disk, zero on a cold start
+        size_t loadedCacheSize = 0;
+        //Time spent creating the pipelines, ImGui included
+        double creationMilliseconds = 0.0;
+        /// @brief Creates the pipeline cache, seeded with the file of the last run when it was written by the
+        /// same device and driver. Call it once the logical device exists
+        void CreatePipelineCache();
+        /// @brief Writes the cache back to disk, replacing the file atomically. Call it once the device is idle
+        void SavePipelineCache();
         /// @brief Creates the graphics pipeline
         /// @param vertShaderName The name of vertex shader
         /// @param fragShaderName The name of fragment shader
-        void CreatePipeline(const std::string& vertShaderName, const std::string& fragShaderName);
+        /// @param vertexLayout The streams of the mesh drawn by the pipeline
+        void CreatePipeline(const std::string& vertShaderName, const std::string& fragShaderName,
+        const Mesh::VertexLayout& vertexLayout);
+        VkPipeline computePipeline = VK_NULL_HANDLE;
+        VkPipelineLayout computePipelineLayout = VK_NULL_HANDLE;
+        /// @brief Creates the compute pipeline
+        /// @param compShaderName The name of compute shader
+        /// @param setLayout The layout of the only descriptor set read by the shader
+        /// @param pushConstantSize The size in bytes of the push constants of the shader
+        void CreateComputePipeline(const std::string& compShaderName, VkDescriptorSetLayout setLayout, 
+        uint32_t pushConstantSize);
         EnginePipeline() = default;
         ~EnginePipeline();
 
@@ -26,6 +69,7 @@ namespace Minerva
     private:     
         const std::string SHADERS_PATH = "C:/UNIMI/TESI/Phoenix/src/Minerva/Shaders/";
         const std::string FILE_TYPE = ".spv";
+        const std::string PIPELINE_CACHE_PATH = SHADERS_PATH + "pipelineCache.bin";
         
 
         /// @brief Reads the compiled shader file 
@@ -35,6 +79,8 @@ namespace Minerva
         /// @brief Creates a shader module using the shader code
         /// @return The VkShaderModule handle 
         VkShaderModule CreateShaderModule(const std::vector<char>& code);
+        /// @brief Fills the header with the identity of the current device and driver
+        PipelineCacheHeader DeviceCacheHeader() const;
         
     };
 }
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include "EngineStartup.h"
 #include <iostream>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
 
 
 namespace Minerva
@@ -8,6 +12,8 @@ namespace Minerva
     Window windowInstance;
     DebugManager debugLayer;
     Device engineDevice;
+    DeviceAllocator engineAllocator;
+    UploadManager engineUploader;
     EnginePipeline enginePipeline;
     Renderer engineRenderer;
     Transformation engineTransform;
@@ -30,8 +36,24 @@ namespace Minerva
             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
             UNBuffers.uniformBuffers[i], UNBuffers.uniformBuffersMemory[i]);
 
-            vkMapMemory(engineDevice.logicalDevice, UNBuffers.uniformBuffersMemory[i], 0,
-            bufferSize, 0, &UNBuffers.uniformBuffersMapped[i]);
+            UNBuffers.uniformBuffersMapped[i] = UNBuffers.uniformBuffersMemory[i].mapped;
+        }
+    }
+
+    void CreateStorageBuffers(StorageBuffers& SBuffers, VkDeviceSize bufferSize)
+    {
+        SBuffers.size = bufferSize;
+        SBuffers.storageBuffers.resize(engineRenderer.MAX_FRAMES_IN_FLIGHT);
+        SBuffers.storageBuffersMemory.resize(engineRenderer.MAX_FRAMES_IN_FLIGHT);
+        SBuffers.storageBuffersMapped.resize(engineRenderer.MAX_FRAMES_IN_FLIGHT);
+
+        for (size_t i = 0; i < engineRenderer.MAX_FRAMES_IN_FLIGHT; i++) {
+            engineRenderer.CreateBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
+            SBuffers.storageBuffers[i], SBuffers.storageBuffersMemory[i]);
+
+            //The buffer stays mapped for the whole life of the engine
+            SBuffers.storageBuffersMapped[i] = SBuffers.storageBuffersMemory[i].mapped;
         }
     }
 
@@ -50,28 +72,61 @@ namespace Minerva
         samplesTest["0"].scale = 10.0f;
         samplesTest["0"].rowDim = 20;
         samplesTest["0"].distanceMultiplier = 30.0f;
+        samplesTest["0"].meshOptimization.enabled = true;
+        samplesTest["0"].meshLod.enabled = true;
 
         samplesTest["1"].animNumber = 3;
         samplesTest["1"].animName.emplace_back("monsterIdle.fbx");
         samplesTest["1"].animName.emplace_back("monsterWalk.fbx");
         samplesTest["1"].animName.emplace_back("monsterRun.fbx");
+        samplesTest["1"].animSampleRate = 30.0f;
+        samplesTest["1"].animCompression.enabled = true;
+        samplesTest["1"].animLod.enabled = true;
+        samplesTest["1"].meshOptimization.enabled = true;
+        samplesTest["1"].meshLod.enabled = true;
         samplesTest["1"].modelName = "monster.fbx";
         samplesTest["1"].textureName = "monsterColor.png";
         samplesTest["1"].scale = 0.2f;
         samplesTest["1"].rowDim = 40;
         samplesTest["1"].distanceMultiplier = 45.0f;
 
+        //The same crowd with the clips baked for the vertex shader, for tens of thousands of instances
+        samplesTest["2"] = samplesTest["1"];
+        samplesTest["2"].animBakeRate = 30.0f;
+
+        //The crowd shares a few poses, each one skinned once by a compute pass
+        samplesTest["3"] = samplesTest["1"];
+        samplesTest["3"].animPoseCount = 64;
+        samplesTest["3"].computeSkinning = true;
+
+        //The static model culled by meshlets, which draw the full meshes
+        samplesTest["4"] = samplesTest["0"];
+        samplesTest["4"].meshLod.enabled = false;
+        samplesTest["4"].meshletCulling = true;
+
          
         std::string key;
 
         std::cout << "Choose the model which you want rendered: \n"
         << "Insert '0' to render the static model\n"
-        << "Insert '1' to render the skeletal model\n";
+        << "Insert '1' to render the skeletal model\n"
+        << "Insert '2' to render the skeletal model with the animations baked for the GPU\n"
+        << "Insert '3' to render the skeletal model skinned by a compute pass\n"
+        << "Insert '4' to render the static model culled by meshlets in a compute pass\n"
+        << "Insert 'b' to measure the vertex cache efficiency of the models before choosing\n";
         std::cin >> key;
+        while(key == "b")
+        {
+            benchmark.MeshOptimization(&engineModLoader, {samplesTest["0"].modelName, samplesTest["1"].modelName},
+            samplesTest["0"].meshOptimization);
+            std::cout << "Choose the model which you want rendered: ";
+            std::cin >> key;
+        }
         std::cout << "Select the instance number: ";
         std::cin >> engineModLoader.instanceNumber;
 
         SampleType choosenSample = samplesTest[key];
+        animationLod = choosenSample.animLod;
 
         windowInstance.EngineInitWindow(windowInstance.WIDTH, windowInstance.HEIGHT);
         engineInstance.CreateInstance();
@@ -80,43 +135,185 @@ namespace Minerva
         engineDevice.PickMostSuitableDevice(engineInstance.instance, windowInstance.windowSurface);
         engineDevice.PrintInfoDeviceSelected();
         engineDevice.CreateLogicalDevice(debugLayer, windowInstance.windowSurface);
+        engineAllocator.Init(engineDevice.physicalDevice, engineDevice.logicalDevice);
+        engineUploader.Init(engineDevice.transferFamily, engineDevice.transferQueue, 
+        engineDevice.graphicsFamily, engineDevice.graphicsQueue);
+        enginePipeline.CreatePipelineCache();
         engineDevice.CreateSwapChain();
         engineDevice.CreateImageViews();
         engineRenderer.CreateRenderPass();
         engineRenderer.CreateDescriptorSetLayout();
-        enginePipeline.CreatePipeline("vert", "frag");
+        //The baked clips are evaluated by the vertex shader, so they can't be skinned in advance
+        bool computeSkinning = choosenSample.computeSkinning && choosenSample.animBakeRate <= 0.0f;
+        if(computeSkinning && !engineDevice.GraphicsQueueSupportsCompute(windowInstance.windowSurface))
+        {
+            std::cout << "The graphics queue doesn't support compute, the vertex shader skins the instances\n";
+            computeSkinning = false;
+        }
         engineRenderer.CreateCommandPool();
         engineRenderer.CreateDepthResources();
         engineRenderer.CreateFramebuffers();
-        texture.CreateTextureImage(choosenSample.textureName);
+        
+        choosenSample.meshOptimization.meshlets = choosenSample.meshletCulling;
+        //The job system loads the assets, then animates or bakes the clips
+        jobSystem.Start();
+        LoadedAssets assets = assetLoader.Load(choosenSample, engineModLoader, texture, jobSystem);
+        const AssetLoadTimes& loadTimes = assets.times;
+        std::cout << "Assets loaded in " << loadTimes.Total() << " ms on " << assets.threadCount << " threads: "
+        << (engineModLoader.cookedModel.IsOpen() ? "mapped the cooked " : "imported ") << choosenSample.modelName 
+        << " in " << loadTimes.model << " ms, texture decoded in " << loadTimes.texture << " ms, " 
+        << assets.clips.size() << " clips in " << loadTimes.clipWave << " ms (" << loadTimes.clips 
+        << " ms of work), bones merged in " << loadTimes.bones << " ms\n";
+        //The upload stage runs on this thread, it is the only one recording transfers
+        auto uploadStart = std::chrono::high_resolution_clock::now();
+        texture.UploadTexture(assets.texture);
+        assets.texture = TextureData();
+        double uploadMilliseconds = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - uploadStart).count();
         texture.CreateTextureImageView();
         texture.CreateTextureSampler();
-        
-        engineModLoader.LoadModel(choosenSample.modelName);
-        if(engineModLoader.sceneMeshes[0].typeOfMesh == Mesh::MeshType::Skeletal)
+        engineRenderer.meshLod = choosenSample.meshLod;
+        //The static meshes have no skin stream, so they need a vertex shader without the bone inputs
+        const Mesh::VertexLayout& vertexLayout = engineModLoader.vertexLayout;
+        computeSkinning = computeSkinning && engineModLoader.HasSkeleton();
+        std::string vertShaderName = computeSkinning ? "skinnedVert" : "vert";
+        if(!engineModLoader.HasSkeleton())
+            vertShaderName = "staticVert";
+        //The bounds of the meshlets hold only for static meshes, and the GPU writes the number of draws
+        bool meshletCulling = choosenSample.meshletCulling && !engineModLoader.HasSkeleton();
+        if(meshletCulling && !(engineDevice.drawIndirectCount && engineDevice.GraphicsQueueSupportsCompute(windowInstance.windowSurface)))
+        {
+            std::cout << "The device can't draw a count written by the GPU, the meshes are drawn whole\n";
+            meshletCulling = false;
+        }
+        enginePipeline.CreatePipeline(vertShaderName, "frag", vertexLayout);
+        std::cout << engineModLoader.sceneMeshes.size() << " meshes, vertex streams: " << vertexLayout.VertexSize() 
+        << " bytes per vertex, " << engineModLoader.vertexCount * vertexLayout.VertexSize() / 1024 << " KB\n";
+        const Mesh::MeshBuffer& arena = engineModLoader.sceneBuffer;
+        std::cout << "Index arena: " << (arena.wideIndices.offset + arena.wideIndices.size) / 1024 << " KB, " 
+        << arena.narrowIndices.size / sizeof(uint16_t) << " of " << engineModLoader.indexCount << " indices in 16 bit\n";
+        if(engineModLoader.HasSkeleton())
         {
             
-            for(int i = 0; i < choosenSample.animNumber; i++)
+            animations = std::move(assets.clips);
+            //The clips of the same rig hold the same skeleton
+            std::vector<const Skeleton*> skeletons;
+            size_t skeletonBytes = 0;
+            for(const auto& animation : animations)
+            {
+                if(std::find(skeletons.begin(), skeletons.end(), animation.skeleton.get()) != skeletons.end())
+                    continue;
+                skeletons.emplace_back(animation.skeleton.get());
+                skeletonBytes += animation.skeleton->MemoryUsage();
+            }
+            std::cout << animations.size() << " clips sharing " << skeletons.size() << " skeletons of " 
+            << skeletonBytes / 1024.0 << " KB\n";
+            if(choosenSample.animBakeRate > 0.0f)
             {
-                Animation currentAnim;
-                currentAnim.CreateAnimation("C:/UNIMI/TESI/Phoenix/src/Minerva/Animations/" 
-                + choosenSample.animName[i], &engineModLoader);
-                animations.emplace_back(currentAnim);
+                auto start = std::chrono::high_resolution_clock::now();
+                bakedAnimations.Bake(animations, choosenSample.animBakeRate, engineModLoader.boneNumber, jobSystem);
+                auto end = std::chrono::high_resolution_clock::now();
+                std::cout << "Baked " << animations.size() << " clips at " << choosenSample.animBakeRate 
+                << " fps: " << bakedAnimations.BufferSize() / 1024 << " KB in " 
+                << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+                engineTransform.ubo.bakedAnimation = 1;
+            }
+            else
+            {
+                /*Every pose gets its own animator, by default there is a pose for each instance. 
+                Start time and speed are randomized so the crowd doesn't move in lockstep*/
+                std::mt19937 generator(42);
+                std::uniform_real_distribution<float> phase(0.0f, animations[0].duration);
+                std::uniform_real_distribution<float> speed(0.8f, 1.2f);
+                int poseCount = engineModLoader.instanceNumber;
+                if(choosenSample.animPoseCount > 0)
+                    poseCount = std::min(choosenSample.animPoseCount, poseCount);
+                animators.resize(std::max(poseCount, 1));
+                for(auto& animator : animators)
+                    animator.CreateAnimator(&animations[0], phase(generator), speed(generator));
             }
-            animator.CreateAnimator(&animations[0]);
         }
             
 
         engineModLoader.PrepareInstanceData(choosenSample);
+        if(engineTransform.ubo.bakedAnimation)
+        {
+            //The phase and speed of the baked crowd live in the instance data
+            std::mt19937 generator(42);
+            std::uniform_real_distribution<float> phase(0.0f, bakedAnimations.header.clips[0].duration);
+            std::uniform_real_distribution<float> speed(0.8f, 1.2f);
+            for(auto& instance : engineModLoader.instancesData)
+            {
+                instance.animationClip = 0;
+                instance.animationTimeOffset = phase(generator);
+                instance.animationSpeed = speed(generator);
+            }
+        }
+        uploadStart = std::chrono::high_resolution_clock::now();
         engineRenderer.CreateVertexBuffer();
+        //Only the animators write palettes, the other modes keep a single identity palette bound
+        int paletteCount = std::max(static_cast<int>(animators.size()), 1);
+        engineTransform.ubo.poseCount = static_cast<uint32_t>(paletteCount);
+        engineRenderer.CreateSkinnedVertexBuffers(computeSkinning ? paletteCount : 0);
+        if(computeSkinning)
+        {
+            std::cout << "Compute skinning of " << paletteCount << " poses: " 
+            << engineRenderer.skinnedVertexBufferSize / 1024 << " KB for each frame in flight\n";
+        }
         engineRenderer.CreateInstanceBuffer();
         engineRenderer.CreateIndexBuffer();
+        engineModLoader.ReleaseCookedModel();
+        //The copies were only recorded, the wait makes the time include the transfers
+        engineUploader.Wait(engineUploader.Flush());
+        uploadMilliseconds += std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - uploadStart).count();
+        std::cout << "Texture and buffers uploaded in " << uploadMilliseconds << " ms, " 
+        << engineUploader.SubmittedBatches() << " upload batches submitted\n";
+        engineRenderer.CreateIndirectBuffers();
+        engineRenderer.CreateMeshletBuffers(meshletCulling);
+        if(choosenSample.meshLod.enabled)
+        {
+            size_t lodCount = 0;
+            for(const auto& mesh : engineModLoader.sceneMeshes)
+                lodCount = std::max(lodCount, mesh.lods.size());
+            std::cout << "Mesh LOD: up to " << lodCount << " LODs, index arena of " << engineModLoader.indexCount 
+            << " indices for " << engineModLoader.info.numberOfPolygons * 3 << " full mesh indices\n";
+        }
+        if(meshletCulling)
+        {
+            std::cout << "Meshlet culling of " << engineRenderer.meshletCount << " meshlets: " 
+            << engineRenderer.meshletDrawBufferSize / 1024 << " KB of draws for each frame in flight\n";
+        }
         CreateUniformBuffers<UniformBufferObject>(engineRenderer.transformationUBuffers);
-        CreateUniformBuffers<BoneMatricesUniformType>(engineRenderer.animUBuffers);
+        CreateStorageBuffers(engineRenderer.animSBuffers, sizeof(BonePalette) * paletteCount);
+        for (size_t i = 0; i < engineRenderer.MAX_FRAMES_IN_FLIGHT; i++) 
+        {
+            auto palettes = static_cast<BonePalette*>(engineRenderer.animSBuffers.storageBuffersMapped[i]);
+            for (int instance = 0; instance < paletteCount; instance++)
+                for (int bone = 0; bone < MAX_BONES; bone++)
+                    palettes[instance].finalBoneMatrices[bone] = glm::mat4(1.0f);
+        }
+        engineRenderer.CreateBakedAnimationBuffer(bakedAnimations);
         engineRenderer.CreateDescriptorPool();
         engineRenderer.CreateDescriptorSets();
+        if(computeSkinning)
+            enginePipeline.CreateComputePipeline("skinningComp", engineRenderer.skinningSetLayout, sizeof(SkinningConstants));
+        else if(meshletCulling)
+            enginePipeline.CreateComputePipeline("meshletCullComp", engineRenderer.meshletCullSetLayout, sizeof(MeshletCullConstants));
         engineRenderer.CreateCommandBuffer();
         engineRenderer.CreateSyncObjects();
+        engineRenderer.CreateParallelRecording(jobSystem);
+        for(const auto& heap : engineAllocator.Stats())
+        {
+            if(heap.reserved == 0)
+                continue;
+            std::cout << (heap.deviceLocal ? "Device local heap: " : "Host heap: ") << heap.used / 1024 << " of " 
+            << heap.reserved / 1024 << " KB used by " << heap.allocationCount << " resources in " << heap.blockCount 
+            << " blocks and " << heap.dedicatedCount << " dedicated allocations, " << heap.Fragmentation() * 100.0f 
+            << "% of the free memory fragmented\n";
+        }
+        std::cout << engineAllocator.MemoryObjectCount() << " device memory objects of " 
+        << engineAllocator.MaxMemoryObjectCount() << " allowed\n";
     
         
         glfwSetInputMode(windowInstance.window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -127,26 +324,77 @@ namespace Minerva
                 camera.MouseCallback(window, xpos, ypos);
         });
         engineUI.SetupUI(*this);
+        //A warm cache skips the compilation of the shaders by the driver
+        std::cout << "Pipelines created in " << enginePipeline.creationMilliseconds << " ms with a " 
+        << (enginePipeline.loadedCacheSize > 0 ? "warm" : "cold") << " pipeline cache of " 
+        << enginePipeline.loadedCacheSize / 1024 << " KB\n";
         glfwSetKeyCallback(windowInstance.window, [](GLFWwindow* window, int key, int scancode, int action, int mods)
         {
             windowInstance.KeyPressCallback(window, key, scancode, action, mods);
         });
           
     }
+    void EngineStartup::PlayAnimation(size_t clip)
+    {
+        if(clip >= animations.size())
+            return;
+        if(engineTransform.ubo.bakedAnimation)
+        {
+            for(auto& instance : engineModLoader.instancesData)
+                instance.animationClip = static_cast<uint32_t>(clip);
+            engineRenderer.UploadInstanceBuffer();
+        }
+        for(auto& animator : animators)
+            animator.CrossFade(&animations[clip], CROSSFADE_TIME, animator.currentTime);
+    }
+    void EngineStartup::BlendLocomotion(float speed)
+    {
+        if(animations.size() < 3)
+            return;
+        float idle = std::max(0.0f, 1.0f - speed);
+        float walk = std::max(0.0f, 1.0f - std::fabs(speed - 1.0f));
+        float run = std::max(0.0f, speed - 1.0f);
+        for(auto& animator : animators)
+        {
+            animator.SetBlendWeight(&animations[0], idle);
+            animator.SetBlendWeight(&animations[1], walk);
+            animator.SetBlendWeight(&animations[2], run);
+        }
+    }
     void EngineStartup::Loop()
     {
-        
+        uint64_t frame = 0;
         while (!glfwWindowShouldClose(windowInstance.window)) {
             
             glfwPollEvents();
-            if(engineModLoader.sceneMeshes[0].typeOfMesh == Mesh::MeshType::Skeletal)
-                animator.UpdateAnimation(camera.deltaTime);
+            //The baked animations are evaluated by the vertex shader, there is no CPU work
+            if(!animators.empty())
+            {
+                //The palettes of this frame may still be read by the GPU
+                engineRenderer.WaitForCurrentFrame();
+                BonePalette* palettes = engineRenderer.GetFramePalettes();
+                float deltaTime = camera.deltaTime;
+                if(animationLod.enabled)
+                {
+                    SelectAnimationLod(animationLod, camera.cameraPos, engineTransform.ubo.model, 
+                    engineModLoader.instancesData, animators, lodBandCounts);
+                }
+                //Returns when all the poses are written, before the command buffer is submitted
+                jobSystem.ParallelFor(animators.size(), ANIMATORS_PER_JOB, [&](size_t begin, size_t end)
+                {
+                    for(size_t i = begin; i < end; i++)
+                        animators[i].UpdateAnimation(deltaTime, palettes[i], frame);
+                });
+            }
+            frame++;
             camera.ProcessUserInput(windowInstance.window);
             engineRenderer.DrawFrame();
             
             
         }
         vkDeviceWaitIdle(engineDevice.logicalDevice);
+        enginePipeline.SavePipelineCache();
+        jobSystem.Stop();
     }
 
     
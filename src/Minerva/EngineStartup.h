@@ -2,6 +2,9 @@
 #include "AnimationManager.h"
 #include <unordered_map>
 #include "EngineVars.h"
+#include "EngineBenchmark.h"
+#include "JobSystem.h"
+#include "AssetLoader.h"
 namespace Minerva
 {
     
@@ -11,12 +14,32 @@ namespace Minerva
         std::unordered_map<std::string, SampleType> samplesTest
         {
             {"0", SampleType()},
-            {"1", SampleType()}
+            {"1", SampleType()},
+            {"2", SampleType()},
+            {"3", SampleType()},
+            {"4", SampleType()}
             
         };
         std::vector<Animation> animations;
-        Animator animator;
+        std::vector<Animator> animators;
+        BakedAnimations bakedAnimations;
+        EngineBenchmark benchmark;
+        JobSystem jobSystem;
+        AssetLoader assetLoader;
+        //Number of animators evaluated by a single job
+        const size_t ANIMATORS_PER_JOB = 32;
+        AnimationLodSettings animationLod;
+        //Number of animators in each LOD band during the last frame
+        std::vector<int> lodBandCounts;
+        //Duration in seconds of the crossfade between the clips of the animators
+        const float CROSSFADE_TIME = 0.3f;
+        float locomotionSpeed = 0.0f;
         void RunEngine();
+        /// @brief Switches every instance to the clip, on the animators or on the baked instance data
+        /// @param clip The index of the clip inside animations
+        void PlayAnimation(size_t clip);
+        /// @brief Blends the first three clips by speed on every animator: 0 is idle, 1 walk, 2 run
+        void BlendLocomotion(float speed);
     private:
         
         void Start();
@@ -3,6 +3,8 @@
 #include "DebugManager.h"
 #include "Window.h"
 #include "Device.h"
+#include "DeviceAllocator.h"
+#include "UploadManager.h"
 #include "EnginePipeline.h"
 #include "Renderer.h"
 #include "TextureManager.h"
@@ -20,6 +22,8 @@ namespace Minerva
     extern Window windowInstance;
     extern DebugManager debugLayer;
     extern Device engineDevice;
+    extern DeviceAllocator engineAllocator;
+    extern UploadManager engineUploader;
     extern EnginePipeline enginePipeline;
     extern Renderer engineRenderer;
     extern Transformation engineTransform;
@@ -0,0 +1,153 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+namespace Minerva
+{
+    void JobSystem::Start(unsigned threadCount)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        queues.clear();
+        for (unsigned i = 0; i < threadCount; i++)
+            queues.emplace_back(std::make_unique<WorkerQueue>());
+
+        running = true;
+        //Queue 0 belongs to the thread which calls ParallelFor
+        for (unsigned i = 1; i < threadCount; i++)
+            workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+    }
+
+    void JobSystem::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            running = false;
+        }
+        sleepCondition.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+        workers.clear();
+    }
+
+    void JobSystem::Dispatch(size_t count, size_t batchSize, RangeCallback callback, void* context)
+    {
+        if (count == 0)
+            return;
+        if (queues.empty())
+        {
+            callback(context, 0, count);
+            return;
+        }
+
+        batchSize = std::max<size_t>(batchSize, 1);
+        size_t batchCount = (count + batchSize - 1) / batchSize;
+        Batch state;
+        state.callback = callback;
+        state.context = context;
+        state.remaining = batchCount;
+
+        //The batches are spread round robin, then the idle workers balance the load by stealing
+        for (size_t batch = 0; batch < batchCount; batch++)
+        {
+            Job job;
+            job.batch = &state;
+            job.begin = batch * batchSize;
+            job.end = std::min(job.begin + batchSize, count);
+
+            WorkerQueue& queue = *queues[batch % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(job);
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            pendingJobs += batchCount;
+        }
+        sleepCondition.notify_all();
+
+        while (state.remaining.load(std::memory_order_acquire) > 0)
+        {
+            Job job;
+            if (TryGetJob(0, job))
+                Execute(job);
+            else
+                std::this_thread::yield();
+        }
+
+        //Every job has finished, so the exception can leave the batch safely
+        if (state.error)
+            std::rethrow_exception(state.error);
+    }
+
+    unsigned JobSystem::ThreadCount() const
+    {
+        return static_cast<unsigned>(std::max<size_t>(queues.size(), 1));
+    }
+
+    JobSystem::~JobSystem()
+    {
+        Stop();
+    }
+
+    void JobSystem::WorkerLoop(unsigned workerIndex)
+    {
+        while (true)
+        {
+            Job job;
+            if (TryGetJob(workerIndex, job))
+            {
+                Execute(job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepCondition.wait(lock, [this] { return !running || pendingJobs.load() > 0; });
+            if (!running)
+                return;
+        }
+    }
+
+    bool JobSystem::TryGetJob(unsigned workerIndex, Job &job)
+    {
+        size_t queueCount = queues.size();
+        for (size_t i = 0; i < queueCount; i++)
+        {
+            WorkerQueue& queue = *queues[(workerIndex + i) % queueCount];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.jobs.empty())
+                continue;
+
+            //The owner takes the most recent job, the thieves take the oldest one
+            if (i == 0)
+            {
+                job = queue.jobs.back();
+                queue.jobs.pop_back();
+            }
+            else
+            {
+                job = queue.jobs.front();
+                queue.jobs.pop_front();
+            }
+            pendingJobs--;
+            return true;
+        }
+        return false;
+    }
+
+    void JobSystem::Execute(const Job &job)
+    {
+        Batch& batch = *job.batch;
+        //An exception escaping a worker thread would terminate the process, so it is kept for the caller
+        try
+        {
+            batch.callback(batch.context, job.begin, job.end);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(batch.errorMutex);
+            if (!batch.error)
+                batch.error = std::current_exception();
+        }
+        batch.remaining.fetch_sub(1, std::memory_order_release);
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Minerva
+{
+    /// @brief Is a work-stealing thread pool. Every worker owns a queue of jobs, it pops its own jobs 
+    /// from the back and, when the queue is empty, steals from the front of the other queues. 
+    /// The thread which calls ParallelFor works as worker 0 until all its jobs are done
+    class JobSystem
+    {
+    public:
+        /// @brief Starts the workers
+        /// @param threadCount The number of threads including the caller, zero means one per core
+        void Start(unsigned threadCount = 0);
+        /// @brief Stops and joins the workers
+        void Stop();
+        /// @brief Splits [0, count) in batches and runs them on all threads. Returns when every 
+        /// batch has been executed, so it is also the join point. If a job throws, the first 
+        /// exception is rethrown here after the join
+        /// @param count The number of elements
+        /// @param batchSize The number of elements processed by a single job
+        /// @param function The function which processes the range [begin, end)
+        template<typename Function>
+        void ParallelFor(size_t count, size_t batchSize, Function&& function)
+        {
+            //The callable stays on the caller's stack, the jobs only keep a pointer to it
+            auto invoke = [](void* context, size_t begin, size_t end)
+            {
+                (*static_cast<std::remove_reference_t<Function>*>(context))(begin, end);
+            };
+            Dispatch(count, batchSize, invoke, const_cast<void*>(static_cast<const void*>(&function)));
+        }
+        unsigned ThreadCount() const;
+
+        JobSystem() = default;
+        ~JobSystem();
+
+        JobSystem(const JobSystem& other) = delete;
+        JobSystem& operator=(const JobSystem& other) = delete;
+    private:
+        using RangeCallback = void(*)(void* context, size_t begin, size_t end);
+        /// @brief Is shared by the jobs of a single ParallelFor call
+        struct Batch
+        {
+            RangeCallback callback = nullptr;
+            void* context = nullptr;
+            std::atomic<size_t> remaining = 0;
+            std::mutex errorMutex;
+            std::exception_ptr error;
+        };
+        struct Job
+        {
+            Batch* batch = nullptr;
+            size_t begin = 0;
+            size_t end = 0;
+        };
+        struct WorkerQueue
+        {
+            std::mutex mutex;
+            std::deque<Job> jobs;
+        };
+        std::vector<std::unique_ptr<WorkerQueue>> queues;
+        std::vector<std::thread> workers;
+        std::mutex sleepMutex;
+        std::condition_variable sleepCondition;
+        //Jobs pushed in a queue and not yet taken by a thread
+        std::atomic<size_t> pendingJobs = 0;
+        bool running = false;
+
+        void Dispatch(size_t count, size_t batchSize, RangeCallback callback, void* context);
+        void WorkerLoop(unsigned workerIndex);
+        bool TryGetJob(unsigned workerIndex, Job& job);
+        static void Execute(const Job& job);
+    };
+}
@@ -1,67 +1,116 @@
 #include "Mesh.h"
 #include "EngineVars.h"
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
 
 
 namespace Minerva
 {
+    /// @brief Appends a stream to data, starting on the next multiple of STREAM_ALIGNMENT
+    static Mesh::StreamRange AppendStream(std::vector<unsigned char>& data, size_t vertexCount, uint32_t stride)
+    {
+        Mesh::StreamRange range;
+        range.offset = (data.size() + Mesh::STREAM_ALIGNMENT - 1) / Mesh::STREAM_ALIGNMENT * Mesh::STREAM_ALIGNMENT;
+        range.size = static_cast<VkDeviceSize>(vertexCount) * stride;
+        data.resize(range.offset + range.size);
+        return range;
+    }
 
-    Mesh::~Mesh()
+    Mesh::VertexStreams Mesh::PackVertexStreams(const std::vector<Mesh>& meshes, const VertexLayout& vertexLayout)
     {
-        vkDestroyBuffer(engineDevice.logicalDevice, meshBuffer.indexBuffer, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, meshBuffer.indexBufferMemory, nullptr);
-        vkDestroyBuffer(engineDevice.logicalDevice, meshBuffer.vertexBuffer, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, meshBuffer.vertexBufferMemory, nullptr);
+        size_t vertexCount = 0;
+        for (const auto& mesh : meshes)
+            vertexCount = std::max(vertexCount, mesh.baseVertex + mesh.vertices.size());
+
+        VertexStreams streams;
+        streams.position = AppendStream(streams.data, vertexCount, vertexLayout.PositionStride());
+        streams.shading = AppendStream(streams.data, vertexCount, vertexLayout.ShadingStride());
+        if (vertexLayout.skinned)
+            streams.skin = AppendStream(streams.data, vertexCount, vertexLayout.SkinStride());
+
+        for (const auto& mesh : meshes)
+        {
+            for (size_t meshVertex = 0; meshVertex < mesh.vertices.size(); meshVertex++)
+            {
+                const Vertex& vertex = mesh.vertices[meshVertex];
+                size_t i = mesh.baseVertex + meshVertex;
+                std::memcpy(&streams.data[streams.position.offset + i * vertexLayout.PositionStride()], 
+                &vertex.pos, sizeof(glm::vec3));
+
+                uint32_t shading[2] = {glm::packHalf2x16(vertex.texCoord), 
+                glm::packSnorm4x8(glm::vec4(vertex.normal, 0.0f))};
+                std::memcpy(&streams.data[streams.shading.offset + i * vertexLayout.ShadingStride()], 
+                shading, vertexLayout.ShadingStride());
+
+                if (!vertexLayout.skinned)
+                    continue;
+                unsigned char* skin = &streams.data[streams.skin.offset + i * vertexLayout.SkinStride()];
+                for (int slot = 0; slot < MAX_BONE_PER_VERTEX; slot++)
+                {
+                    if (vertexLayout.wideBoneIndices)
+                    {
+                        int16_t boneID = static_cast<int16_t>(std::clamp(vertex.boneID[slot], -1, INT16_MAX));
+                        std::memcpy(skin + slot * sizeof(int16_t), &boneID, sizeof(int16_t));
+                    }
+                    else
+                    {
+                        skin[slot] = static_cast<unsigned char>(static_cast<int8_t>(std::clamp(vertex.boneID[slot], -1, INT8_MAX)));
+                    }
+                }
+                uint32_t weights = glm::packUnorm4x8(glm::vec4(vertex.weight[0], vertex.weight[1], 
+                vertex.weight[2], vertex.weight[3]));
+                std::memcpy(skin + (vertexLayout.wideBoneIndices ? 8 : 4), &weights, sizeof(uint32_t));
+            }
+        }
+        return streams;
+    }
+
+    std::vector<unsigned char> Mesh::PackIndices(const std::vector<Mesh>& meshes, const MeshBuffer& arena)
+    {
+        std::vector<unsigned char> data(std::max<VkDeviceSize>(arena.wideIndices.offset + arena.wideIndices.size, 
+        sizeof(uint32_t)));
+        //The indices stay relative to their mesh, the draws add the base vertex
+        auto narrowIndices = reinterpret_cast<uint16_t*>(data.data() + arena.narrowIndices.offset);
+        auto wideIndices = reinterpret_cast<uint32_t*>(data.data() + arena.wideIndices.offset);
+        for (const auto& mesh : meshes)
+        {
+            if (mesh.indexType == VK_INDEX_TYPE_UINT16)
+            {
+                std::transform(mesh.indices.begin(), mesh.indices.end(), narrowIndices + mesh.firstIndex,
+                [](uint32_t index) { return static_cast<uint16_t>(index); });
+            }
+            else
+            {
+                std::memcpy(wideIndices + mesh.firstIndex, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+            }
+        }
+        return data;
     }
 
     Mesh::Mesh(Mesh &&other) noexcept
     {
         vertices = std::move(other.vertices);
         indices = std::move(other.indices);
-        meshBuffer.size = std::move(other.meshBuffer.size);
-        meshBuffer.vertexBuffer = std::move(other.meshBuffer.vertexBuffer);
-        meshBuffer.vertexBufferMemory = std::move(other.meshBuffer.vertexBufferMemory);
-        meshBuffer.indexBuffer = std::move(other.meshBuffer.indexBuffer);
-        meshBuffer.indexBufferMemory = std::move(other.meshBuffer.indexBufferMemory);
-
-        free(other.vertices.data());
-        free(other.indices.data());
-        other.meshBuffer.size = 0;
-        vkDestroyBuffer(engineDevice.logicalDevice, other.meshBuffer.indexBuffer, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, other.meshBuffer.indexBufferMemory, nullptr);
-        vkDestroyBuffer(engineDevice.logicalDevice, other.meshBuffer.vertexBuffer, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, other.meshBuffer.vertexBufferMemory, nullptr);
-
+        typeOfMesh = other.typeOfMesh;
+        baseVertex = other.baseVertex;
+        firstIndex = other.firstIndex;
+        indexType = other.indexType;
+        meshlets = std::move(other.meshlets);
+        lods = std::move(other.lods);
+        boundingSphere = other.boundingSphere;
     }
     Mesh &Mesh::operator=(Mesh &&other) noexcept
     {
         vertices = std::move(other.vertices);
         indices = std::move(other.indices);
-        meshBuffer.size = std::move(other.meshBuffer.size);
-        meshBuffer.vertexBuffer = std::move(other.meshBuffer.vertexBuffer);
-        meshBuffer.vertexBufferMemory = std::move(other.meshBuffer.vertexBufferMemory);
-        meshBuffer.indexBuffer = std::move(other.meshBuffer.indexBuffer);
-        meshBuffer.indexBufferMemory = std::move(other.meshBuffer.indexBufferMemory);
-
-        free(other.vertices.data());
-        free(other.indices.data());
-        other.meshBuffer.size = 0;
-        vkDestroyBuffer(engineDevice.logicalDevice, other.meshBuffer.indexBuffer, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, other.meshBuffer.indexBufferMemory, nullptr);
-        vkDestroyBuffer(engineDevice.logicalDevice, other.meshBuffer.vertexBuffer, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, other.meshBuffer.vertexBufferMemory, nullptr);
-
+        typeOfMesh = other.typeOfMesh;
+        baseVertex = other.baseVertex;
+        firstIndex = other.firstIndex;
+        indexType = other.indexType;
+        meshlets = std::move(other.meshlets);
+        lods = std::move(other.lods);
+        boundingSphere = other.boundingSphere;
         return *this;
     }
 }
-
-namespace std {
-    template<> struct hash<Minerva::Mesh::Vertex> {
-        size_t operator()(Minerva::Mesh::Vertex const& vertex) const {
-            return ((hash<glm::vec3>()(vertex.pos) ^
-                   (hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^
-                   (hash<glm::vec2>()(vertex.texCoord) << 1);
-        }
-    };
-}
\ No newline at end of file
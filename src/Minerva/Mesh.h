@@ -7,11 +7,14 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
 #define MAX_BONE_PER_VERTEX 4
 #define MAX_BONES 100
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include "DeviceAllocator.h"
 
 namespace Minerva
 {
@@ -19,83 +22,154 @@ namespace Minerva
     {
         glm::vec3 instancePos;
         float instanceScale;
+        //Clip, time offset in seconds and playback speed read by the baked animation path of base.vert
+        uint32_t animationClip = 0;
+        float animationTimeOffset = 0.0f;
+        float animationSpeed = 1.0f;
     };
 
     class Mesh
     {
     public:
+        /// @brief Binding of each vertex stream. The instance data keeps binding 1
+        enum VertexBinding : uint32_t
+        {
+            POSITION_BINDING = 0,
+            INSTANCE_BINDING = 1,
+            SHADING_BINDING = 2,
+            SKIN_BINDING = 3
+        };
+
+        /// @brief Describes the compact vertex streams uploaded to the GPU. Positions stay full floats,
+        /// the shading stream holds half-float UVs and optional snorm normals, the skin stream holds 
+        /// 8 or 16 bit bone indices and unorm8 weights and exists only for skeletal meshes
+        struct VertexLayout
+        {
+            bool skinned = false;
+            //The shaders don't light the meshes, so the normals are left out by default
+            bool normals = false;
+            //16 bit bone indices, needed when the skeleton has more than 127 bones
+            bool wideBoneIndices = false;
+
+            uint32_t PositionStride() const { return sizeof(glm::vec3); }
+            uint32_t ShadingStride() const { return normals ? 8 : 4; }
+            uint32_t SkinStride() const { return skinned ? (wideBoneIndices ? 12 : 8) : 0; }
+            uint32_t VertexSize() const { return PositionStride() + ShadingStride() + SkinStride(); }
+        };
+
+        /// @brief The vertex as imported, packed into the streams of a VertexLayout before the upload
         struct Vertex 
         {
-            glm::vec3 offsetPos;
-            float offsetScale;
             glm::vec3 pos;
-            glm::vec3 color;
+            glm::vec3 normal;
             glm::vec2 texCoord;
             int boneID[MAX_BONE_PER_VERTEX];
             float weight[MAX_BONE_PER_VERTEX];
             
 
             bool operator==(const Vertex& other) const {
-                return pos == other.pos && color == other.color && texCoord == other.texCoord;
+                return pos == other.pos && normal == other.normal && texCoord == other.texCoord;
             }
 
-            static  std::array<VkVertexInputBindingDescription, 2> getBindingDescription() 
+            static std::vector<VkVertexInputBindingDescription> getBindingDescription(const VertexLayout& layout) 
             {
-                std::array<VkVertexInputBindingDescription, 2> bindingDescriptions;
-                bindingDescriptions[0].binding = 0;
-                bindingDescriptions[0].stride = sizeof(Vertex);
-                bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-                bindingDescriptions[1].binding = 1;
-                bindingDescriptions[1].stride = sizeof(InstanceData);
-                bindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+                std::vector<VkVertexInputBindingDescription> bindingDescriptions;
+                bindingDescriptions.push_back({POSITION_BINDING, layout.PositionStride(), VK_VERTEX_INPUT_RATE_VERTEX});
+                bindingDescriptions.push_back({INSTANCE_BINDING, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE});
+                bindingDescriptions.push_back({SHADING_BINDING, layout.ShadingStride(), VK_VERTEX_INPUT_RATE_VERTEX});
+                if(layout.skinned)
+                    bindingDescriptions.push_back({SKIN_BINDING, layout.SkinStride(), VK_VERTEX_INPUT_RATE_VERTEX});
                 return bindingDescriptions;
             }
 
-            static std::array<VkVertexInputAttributeDescription, 7> getAttributeDescriptions() 
+            /// @brief Generates the attributes of the layout. The locations match the shaders: 
+            /// 0 position, 2 UV, 3-4 and 7-8 instance, 5 bone indices, 6 weights, 9 normal
+            static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(const VertexLayout& layout) 
             {
-                std::array<VkVertexInputAttributeDescription, 7> attributeDescriptions{};
+                std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
                 //Position
-                attributeDescriptions[0].binding = 0;
-                attributeDescriptions[0].location = 0;
-                attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-                attributeDescriptions[0].offset = offsetof(Vertex, pos);
-
-                //Color
-                attributeDescriptions[1].binding = 0;
-                attributeDescriptions[1].location = 1;
-                attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-                attributeDescriptions[1].offset = offsetof(Vertex, color);
+                attributeDescriptions.push_back({0, POSITION_BINDING, VK_FORMAT_R32G32B32_SFLOAT, 0});
 
                 //UV coord
-                attributeDescriptions[2].binding = 0;
-                attributeDescriptions[2].location = 2;
-                attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-                attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
-
-                //Instance pos
-                attributeDescriptions[3].binding = 1;
-                attributeDescriptions[3].location = 3;
-                attributeDescriptions[3].format = VK_FORMAT_R32G32B32_SFLOAT;
-                attributeDescriptions[3].offset = offsetof(Vertex, offsetPos);
-
-                attributeDescriptions[4].binding = 1;
-                attributeDescriptions[4].location = 4;
-                attributeDescriptions[4].format = VK_FORMAT_R32_SFLOAT;
-                attributeDescriptions[4].offset = offsetof(Vertex, offsetScale);
-
-                attributeDescriptions[5].binding = 0;
-                attributeDescriptions[5].location = 5;
-                attributeDescriptions[5].format = VK_FORMAT_R32G32B32A32_SINT;
-                attributeDescriptions[5].offset = offsetof(Vertex, boneID);
-
-                attributeDescriptions[6].binding = 0;
-                attributeDescriptions[6].location = 6;
-                attributeDescriptions[6].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-                attributeDescriptions[6].offset = offsetof(Vertex, weight);
+                attributeDescriptions.push_back({2, SHADING_BINDING, VK_FORMAT_R16G16_SFLOAT, 0});
+                //Normal
+                if(layout.normals)
+                    attributeDescriptions.push_back({9, SHADING_BINDING, VK_FORMAT_R8G8B8A8_SNORM, 4});
+
+                //Instance pos and scale
+                attributeDescriptions.push_back({3, INSTANCE_BINDING, VK_FORMAT_R32G32B32_SFLOAT, 
+                offsetof(InstanceData, instancePos)});
+                attributeDescriptions.push_back({4, INSTANCE_BINDING, VK_FORMAT_R32_SFLOAT, 
+                offsetof(InstanceData, instanceScale)});
+
+                //Bone indices are signed, -1 marks the unused slots
+                if(layout.skinned)
+                {
+                    attributeDescriptions.push_back({5, SKIN_BINDING, layout.wideBoneIndices ? 
+                    VK_FORMAT_R16G16B16A16_SINT : VK_FORMAT_R8G8B8A8_SINT, 0});
+                    attributeDescriptions.push_back({6, SKIN_BINDING, VK_FORMAT_R8G8B8A8_UNORM, 
+                    layout.wideBoneIndices ? 8u : 4u});
+                }
+
+                //Instance baked animation clip
+                attributeDescriptions.push_back({7, INSTANCE_BINDING, VK_FORMAT_R32_UINT, 
+                offsetof(InstanceData, animationClip)});
+
+                //Instance baked animation time offset and speed
+                attributeDescriptions.push_back({8, INSTANCE_BINDING, VK_FORMAT_R32G32_SFLOAT, 
+                offsetof(InstanceData, animationTimeOffset)});
                 return attributeDescriptions;
             }
         };
+
+        /// @brief A stream inside the vertex buffer
+        struct StreamRange
+        {
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+        };
+
+        /// @brief The streams of the mesh packed one after the other, each one starts on a multiple 
+        /// of STREAM_ALIGNMENT so it can also be bound as a storage buffer
+        struct VertexStreams
+        {
+            std::vector<unsigned char> data;
+            StreamRange position;
+            StreamRange shading;
+            StreamRange skin;
+        };
+        static constexpr VkDeviceSize STREAM_ALIGNMENT = 256;
+        //Meshes up to this many vertices are drawn with 16 bit indices
+        static constexpr size_t MAX_NARROW_INDEX_VERTICES = 65536;
+
+        /// @brief A run of at most MESHLET_MAX_TRIANGLES triangles using at most MESHLET_MAX_VERTICES vertices,
+        /// with the bounds used by meshletCull.comp. Same layout as the meshlets of the shader
+        struct Meshlet
+        {
+            //Center and radius of the bounding sphere, in model space
+            glm::vec4 sphere = glm::vec4(0.0f);
+            //Average normal and sine of the spread of the normals. A cutoff of 1 is never backfacing
+            glm::vec4 cone = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+            //Range in the indices of the mesh, moved to the index arena when the meshlets are uploaded
+            uint32_t firstIndex = 0;
+            uint32_t indexCount = 0;
+            int32_t vertexOffset = 0;
+            //1 when the mesh is drawn with 32 bit indices
+            uint32_t wideIndices = 0;
+        };
+        static constexpr size_t MESHLET_MAX_VERTICES = 64;
+        static constexpr size_t MESHLET_MAX_TRIANGLES = 124;
+
+        /// @brief A level of detail of the mesh: a range of its indices drawing a simplified surface
+        struct Lod
+        {
+            //Range in the indices of the mesh, relative to the firstIndex of the mesh once placed
+            uint32_t firstIndex = 0;
+            uint32_t indexCount = 0;
+            //Largest distance from the full surface, in model units
+            float error = 0.0f;
+        };
+
         enum MeshType
         {
             Static = 0,
@@ -104,17 +178,24 @@ namespace Minerva
         struct InstanceBuffer 
         {
             VkBuffer buffer{ VK_NULL_HANDLE };
-            VkDeviceMemory memory{ VK_NULL_HANDLE };
+            DeviceAllocation memory;
             size_t size = 0;
         } ;
 
-         struct MeshBuffer
+        /// @brief The vertex and index arenas shared by every mesh of the scene
+        struct MeshBuffer
         {
             VkBuffer vertexBuffer = VK_NULL_HANDLE;
-            VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
+            DeviceAllocation vertexBufferMemory;
             VkBuffer indexBuffer = VK_NULL_HANDLE;
-            VkDeviceMemory indexBufferMemory = VK_NULL_HANDLE;
+            DeviceAllocation indexBufferMemory;
             size_t size = 0;
+            StreamRange position;
+            StreamRange shading;
+            StreamRange skin;
+            //Bytes of the 16 bit and 32 bit batches of the index arena, the firstIndex of a mesh is relative to its batch
+            StreamRange narrowIndices;
+            StreamRange wideIndices;
         };
 
         struct BoneInfo
@@ -124,11 +205,27 @@ namespace Minerva
         };
         std::vector<Vertex> vertices;
         std::vector<uint32_t> indices;
-        MeshBuffer meshBuffer;
         MeshType typeOfMesh;
+        //Placement of the mesh inside the shared vertex and index arenas of ModelLoader
+        uint32_t baseVertex = 0;
+        uint32_t firstIndex = 0;
+        //Narrowest index type able to address every vertex of the mesh, chosen when the mesh is placed
+        VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+        //Empty unless the import stage built them
+        std::vector<Meshlet> meshlets;
+        //The first LOD is the full mesh, the coarser ones follow it in indices
+        std::vector<Lod> lods;
+        //Center and radius of the bounding sphere, in model space
+        glm::vec4 boundingSphere = glm::vec4(0.0f);
+
+        /// @brief Packs the vertices of every mesh into the streams of layout, each mesh starts at its baseVertex
+        static VertexStreams PackVertexStreams(const std::vector<Mesh>& meshes, const VertexLayout& layout);
+        /// @brief Packs the indices of every mesh into the batches of the index arena, narrowed to 16 bit
+        /// for the meshes that allow it. Never empty, so the buffer can always be created and bound
+        static std::vector<unsigned char> PackIndices(const std::vector<Mesh>& meshes, const MeshBuffer& arena);
 
         Mesh() = default;
-        ~Mesh();
+        ~Mesh() = default;
 
         Mesh(const Mesh&) = delete;
         Mesh& operator=(const Mesh&) = delete;
@@ -141,4 +238,13 @@ namespace Minerva
     
 }
 
-
+namespace std {
+    //Hashes the attributes compared by Vertex::operator==, so equal vertices can be merged
+    template<> struct hash<Minerva::Mesh::Vertex> {
+        size_t operator()(Minerva::Mesh::Vertex const& vertex) const {
+            return ((hash<glm::vec3>()(vertex.pos) ^
+                   (hash<glm::vec3>()(vertex.normal) << 1)) >> 1) ^
+                   (hash<glm::vec2>()(vertex.texCoord) << 1);
+        }
+    };
+}
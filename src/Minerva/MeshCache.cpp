@@ -0,0 +1,150 @@
+#include "MeshCache.h"
+#include <utility>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <thread>
+#include <functional>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Minerva
+{
+    bool MappedFile::Open(const std::string& path)
+    {
+        Close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!view)
+        {
+            if (mapping)
+                CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+        fileHandle = file;
+        mappingHandle = mapping;
+        data = static_cast<const unsigned char*>(view);
+        size = static_cast<size_t>(fileSize.QuadPart);
+#else
+        int file = open(path.c_str(), O_RDONLY);
+        if (file < 0)
+            return false;
+        struct stat fileStat;
+        if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+        {
+            close(file);
+            return false;
+        }
+        void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        //The mapping keeps the file alive
+        close(file);
+        if (view == MAP_FAILED)
+            return false;
+        data = static_cast<const unsigned char*>(view);
+        size = static_cast<size_t>(fileStat.st_size);
+#endif
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+        if (!data)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(static_cast<HANDLE>(mappingHandle));
+        CloseHandle(static_cast<HANDLE>(fileHandle));
+#else
+        munmap(const_cast<unsigned char*>(data), size);
+#endif
+        data = nullptr;
+        size = 0;
+        fileHandle = nullptr;
+        mappingHandle = nullptr;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept
+    {
+        data = std::exchange(other.data, nullptr);
+        size = std::exchange(other.size, 0);
+        fileHandle = std::exchange(other.fileHandle, nullptr);
+        mappingHandle = std::exchange(other.mappingHandle, nullptr);
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Close();
+            data = std::exchange(other.data, nullptr);
+            size = std::exchange(other.size, 0);
+            fileHandle = std::exchange(other.fileHandle, nullptr);
+            mappingHandle = std::exchange(other.mappingHandle, nullptr);
+        }
+        return *this;
+    }
+
+    uint64_t HashBytes(const void* bytes, size_t size, uint64_t hash)
+    {
+        const unsigned char* byte = static_cast<const unsigned char*>(bytes);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= byte[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    bool WriteFileAtomically(const std::string& path, const void* bytes, size_t size)
+    {
+        //Clips loaded at once may cook the same skeleton, every thread writes its own temporary file
+        std::string temporaryPath = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+            file.write(static_cast<const char*>(bytes), static_cast<std::streamsize>(size));
+            if (!file)
+            {
+                std::cout << "Can't write " << path << "\n";
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temporaryPath, path, error);
+        if (error)
+        {
+            std::cout << "Can't write " << path << ": " << error.message() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    void AppendBytes(std::vector<unsigned char>& file, const void* bytes, size_t size)
+    {
+        file.insert(file.end(), static_cast<const unsigned char*>(bytes), static_cast<const unsigned char*>(bytes) + size);
+    }
+}
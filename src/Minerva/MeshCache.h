@@ -0,0 +1,141 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include "Mesh.h"
+
+namespace Minerva
+{
+    /// @brief Read only view of a whole file mapped into memory. The pages are read by the OS on first
+    /// access, so the data can be copied straight into staging memory without an intermediate buffer
+    class MappedFile
+    {
+    public:
+        /// @brief Maps the file, closing the one mapped before
+        /// @return False when the file can't be opened or is empty
+        bool Open(const std::string& path);
+        void Close();
+        const unsigned char* Data() const { return data; }
+        size_t Size() const { return size; }
+        bool IsOpen() const { return data != nullptr; }
+
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+    private:
+        const unsigned char* data = nullptr;
+        size_t size = 0;
+        //Handles of the file and of its mapping, only used on Windows
+        void* fileHandle = nullptr;
+        void* mappingHandle = nullptr;
+    };
+
+    /// @brief Reads a mapped file front to back, every read is checked against the end of the file
+    struct FileCursor
+    {
+        const unsigned char* data = nullptr;
+        size_t size = 0;
+        size_t offset = 0;
+
+        explicit FileCursor(const MappedFile& file) : data(file.Data()), size(file.Size()) {}
+        bool Fits(uint64_t start, uint64_t length) const { return start <= size && length <= size - start; }
+        bool Read(void* target, size_t length)
+        {
+            if (!Fits(offset, length))
+                return false;
+            std::memcpy(target, data + offset, length);
+            offset += length;
+            return true;
+        }
+        /// @brief Reads count elements into values, checking the size before allocating
+        template<typename T>
+        bool Read(std::vector<T>& values, uint64_t count)
+        {
+            if (!Fits(offset, count * sizeof(T)))
+                return false;
+            values.resize(static_cast<size_t>(count));
+            return Read(values.data(), values.size() * sizeof(T));
+        }
+        bool Read(std::string& text, uint32_t length)
+        {
+            if (!Fits(offset, length))
+                return false;
+            text.assign(reinterpret_cast<const char*>(data + offset), length);
+            offset += length;
+            return true;
+        }
+    };
+
+    /// @brief Writes the bytes into a temporary file renamed over path, so a crash never leaves a 
+    /// truncated file behind
+    /// @return False, after printing the reason, when the file can't be written
+    bool WriteFileAtomically(const std::string& path, const void* bytes, size_t size);
+    /// @brief Appends the bytes of a trivially copyable value or array to a file being built in memory
+    void AppendBytes(std::vector<unsigned char>& file, const void* bytes, size_t size);
+
+    /// @brief 64 bit FNV-1a hash of the bytes
+    /// @param hash The hash of the bytes before these, to hash several ranges as one
+    uint64_t HashBytes(const void* bytes, size_t size, uint64_t hash = 14695981039346656037ull);
+
+    /*A cooked model is laid out as: the header, a CookedMeshRecord for each mesh followed by its meshlets
+    and LODs, the bones, then the vertex streams and the index arena exactly as they are uploaded*/
+    constexpr uint32_t COOKED_MODEL_MAGIC = 0x4D43494Du; //"MICM"
+    //Bump it whenever the layout of the file or of the GPU data changes
+    constexpr uint32_t COOKED_MODEL_VERSION = 1;
+
+    struct CookedModelHeader
+    {
+        uint32_t magic = COOKED_MODEL_MAGIC;
+        uint32_t version = COOKED_MODEL_VERSION;
+        //Hash of the source file and of the import settings the model was cooked from
+        uint64_t sourceHash = 0;
+        uint64_t settingsHash = 0;
+        uint32_t meshCount = 0;
+        uint32_t boneCount = 0;
+        uint32_t vertexCount = 0;
+        uint32_t indexCount = 0;
+        //Mesh::VertexLayout flags of the vertex streams
+        uint32_t skinned = 0;
+        uint32_t normals = 0;
+        uint32_t wideBoneIndices = 0;
+        uint32_t padding = 0;
+        //Ranges of the streams inside the vertex data, and of the batches inside the index data
+        Mesh::StreamRange position;
+        Mesh::StreamRange shading;
+        Mesh::StreamRange skin;
+        Mesh::StreamRange narrowIndices;
+        Mesh::StreamRange wideIndices;
+        //Ranges of the vertex and index data inside the file
+        Mesh::StreamRange vertexData;
+        Mesh::StreamRange indexData;
+    };
+
+    struct CookedMeshRecord
+    {
+        uint32_t typeOfMesh = 0;
+        uint32_t vertexCount = 0;
+        //Every index of the mesh, the LODs included
+        uint32_t indexCount = 0;
+        uint32_t indexType = 0;
+        uint32_t baseVertex = 0;
+        uint32_t firstIndex = 0;
+        uint32_t meshletCount = 0;
+        uint32_t lodCount = 0;
+        glm::vec4 boundingSphere = glm::vec4(0.0f);
+    };
+
+    struct CookedBoneRecord
+    {
+        glm::mat4 offset;
+        int32_t id = 0;
+        //Length of the name written after the record
+        uint32_t nameLength = 0;
+    };
+}
@@ -0,0 +1,335 @@
+#include "MeshLod.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <unordered_map>
+#include <limits>
+#include <cmath>
+#include <cstring>
+
+namespace Minerva
+{
+    /// @brief Symmetric 4x4 matrix of the squared distances from a set of planes, weighted by their area
+    struct Quadric
+    {
+        double a00 = 0.0, a01 = 0.0, a02 = 0.0, a03 = 0.0;
+        double a11 = 0.0, a12 = 0.0, a13 = 0.0;
+        double a22 = 0.0, a23 = 0.0;
+        double a33 = 0.0;
+        double weight = 0.0;
+
+        void Add(const Quadric& other)
+        {
+            a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+            a11 += other.a11; a12 += other.a12; a13 += other.a13;
+            a22 += other.a22; a23 += other.a23;
+            a33 += other.a33;
+            weight += other.weight;
+        }
+        /// @brief Weighted mean of the squared distances of the point from the planes
+        double Evaluate(const glm::vec3& point) const
+        {
+            if (weight <= 0.0)
+                return 0.0;
+            double x = point.x, y = point.y, z = point.z;
+            double sum = a00 * x * x + a11 * y * y + a22 * z * z + a33
+            + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z + a03 * x + a13 * y + a23 * z);
+            return std::max(sum / weight, 0.0);
+        }
+        static Quadric FromPlane(const glm::dvec3& normal, double distance, double weight)
+        {
+            Quadric quadric;
+            quadric.a00 = weight * normal.x * normal.x; quadric.a01 = weight * normal.x * normal.y;
+            quadric.a02 = weight * normal.x * normal.z; quadric.a03 = weight * normal.x * distance;
+            quadric.a11 = weight * normal.y * normal.y; quadric.a12 = weight * normal.y * normal.z;
+            quadric.a13 = weight * normal.y * distance;
+            quadric.a22 = weight * normal.z * normal.z; quadric.a23 = weight * normal.z * distance;
+            quadric.a33 = weight * distance * distance;
+            quadric.weight = weight;
+            return quadric;
+        }
+    };
+
+    /// @brief Sum of the differences between the normalized bone weights of the vertices, from 0 to 2
+    static float SkinDistance(const Mesh::Vertex& a, const Mesh::Vertex& b)
+    {
+        float totalA = 0.0f, totalB = 0.0f;
+        for (int i = 0; i < MAX_BONE_PER_VERTEX; i++)
+        {
+            totalA += a.boneID[i] >= 0 ? a.weight[i] : 0.0f;
+            totalB += b.boneID[i] >= 0 ? b.weight[i] : 0.0f;
+        }
+        if (totalA <= 0.0f || totalB <= 0.0f)
+            return totalA == totalB ? 0.0f : 2.0f;
+
+        //Every bone is counted once, at its first slot in either vertex
+        float distance = 0.0f;
+        auto weightOf = [](const Mesh::Vertex& vertex, int bone, float total)
+        {
+            float weight = 0.0f;
+            for (int i = 0; i < MAX_BONE_PER_VERTEX; i++)
+                weight += vertex.boneID[i] == bone ? vertex.weight[i] : 0.0f;
+            return weight / total;
+        };
+        for (int i = 0; i < MAX_BONE_PER_VERTEX; i++)
+        {
+            int bone = a.boneID[i];
+            if (bone >= 0 && std::find(a.boneID, a.boneID + i, bone) == a.boneID + i)
+                distance += std::abs(weightOf(a, bone, totalA) - weightOf(b, bone, totalB));
+            bone = b.boneID[i];
+            if (bone >= 0 && std::find(b.boneID, b.boneID + i, bone) == b.boneID + i
+            && std::find(a.boneID, a.boneID + MAX_BONE_PER_VERTEX, bone) == a.boneID + MAX_BONE_PER_VERTEX)
+                distance += weightOf(b, bone, totalB);
+        }
+        return distance;
+    }
+
+    std::vector<uint32_t> SimplifyMesh(const std::vector<Mesh::Vertex>& vertices, const std::vector<uint32_t>& indices,
+    size_t targetIndexCount, float maxError, float* resultError)
+    {
+        size_t vertexCount = vertices.size();
+        std::vector<uint32_t> result = indices;
+        double appliedError = 0.0;
+
+        //Vertices sharing a position with another one sit on a seam, moving them would open the surface
+        std::vector<bool> locked(vertexCount, false);
+        std::vector<uint32_t> positionId(vertexCount);
+        {
+            std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+            auto hashPosition = [](const glm::vec3& pos)
+            {
+                uint32_t bits[3];
+                std::memcpy(bits, &pos, sizeof(bits));
+                return (static_cast<uint64_t>(bits[0]) * 73856093u) ^ (static_cast<uint64_t>(bits[1]) * 19349663u)
+                ^ (static_cast<uint64_t>(bits[2]) * 83492791u);
+            };
+            for (uint32_t v = 0; v < vertexCount; v++)
+            {
+                positionId[v] = v;
+                auto& bucket = buckets[hashPosition(vertices[v].pos)];
+                for (uint32_t other : bucket)
+                {
+                    if (vertices[other].pos == vertices[v].pos)
+                    {
+                        positionId[v] = positionId[other];
+                        locked[v] = true;
+                        locked[other] = true;
+                        break;
+                    }
+                }
+                bucket.emplace_back(v);
+            }
+        }
+        //Edges of a single triangle lie on a border, so their vertices stay too
+        {
+            std::unordered_map<uint64_t, int> edgeUses;
+            auto edgeKey = [&](uint32_t a, uint32_t b)
+            {
+                uint64_t low = std::min(positionId[a], positionId[b]), high = std::max(positionId[a], positionId[b]);
+                return (high << 32) | low;
+            };
+            for (size_t i = 0; i < result.size(); i += 3)
+                for (int e = 0; e < 3; e++)
+                    edgeUses[edgeKey(result[i + e], result[i + (e + 1) % 3])]++;
+            for (size_t i = 0; i < result.size(); i += 3)
+            {
+                for (int e = 0; e < 3; e++)
+                {
+                    uint32_t a = result[i + e], b = result[i + (e + 1) % 3];
+                    if (edgeUses[edgeKey(a, b)] == 1)
+                    {
+                        locked[a] = true;
+                        locked[b] = true;
+                    }
+                }
+            }
+        }
+
+        std::vector<Quadric> quadrics(vertexCount);
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            glm::dvec3 a = vertices[result[i]].pos, b = vertices[result[i + 1]].pos, c = vertices[result[i + 2]].pos;
+            glm::dvec3 normal = glm::cross(b - a, c - a);
+            double area = glm::length(normal);
+            if (area <= 0.0)
+                continue;
+            normal /= area;
+            Quadric plane = Quadric::FromPlane(normal, -glm::dot(normal, a), area);
+            for (int corner = 0; corner < 3; corner++)
+                quadrics[result[i + corner]].Add(plane);
+        }
+        bool skinned = false;
+        for (const auto& vertex : vertices)
+            skinned = skinned || vertex.boneID[0] >= 0;
+
+        struct Collapse
+        {
+            uint32_t from;
+            uint32_t to;
+            double cost;
+        };
+        const double maxCost = static_cast<double>(maxError) * maxError;
+        std::vector<Collapse> collapses;
+        std::vector<uint32_t> remap(vertexCount), firstAdjacent, adjacency;
+        std::vector<bool> touched(vertexCount);
+
+        //Every pass applies the cheapest collapses whose neighbourhoods don't overlap
+        while (result.size() > targetIndexCount)
+        {
+            firstAdjacent.assign(vertexCount + 1, 0);
+            for (uint32_t index : result)
+                firstAdjacent[index + 1]++;
+            for (size_t v = 0; v < vertexCount; v++)
+                firstAdjacent[v + 1] += firstAdjacent[v];
+            adjacency.resize(result.size());
+            std::vector<uint32_t> fill(firstAdjacent.begin(), firstAdjacent.end() - 1);
+            for (size_t i = 0; i < result.size(); i++)
+                adjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+
+            collapses.clear();
+            for (size_t i = 0; i < result.size(); i += 3)
+            {
+                for (int e = 0; e < 3; e++)
+                {
+                    uint32_t from = result[i + e], to = result[i + (e + 1) % 3];
+                    for (int direction = 0; direction < 2; direction++, std::swap(from, to))
+                    {
+                        if (locked[from])
+                            continue;
+                        Quadric quadric = quadrics[from];
+                        quadric.Add(quadrics[to]);
+                        double cost = quadric.Evaluate(vertices[to].pos);
+                        if (skinned)
+                            cost += SkinDistance(vertices[from], vertices[to]) * maxCost;
+                        if (cost <= maxCost)
+                            collapses.push_back({from, to, cost});
+                    }
+                }
+            }
+            if (collapses.empty())
+                break;
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b)
+            {
+                return a.cost < b.cost;
+            });
+
+            for (uint32_t v = 0; v < vertexCount; v++)
+                remap[v] = v;
+            std::fill(touched.begin(), touched.end(), false);
+            size_t removedIndices = 0;
+            for (const auto& collapse : collapses)
+            {
+                if (result.size() - removedIndices <= targetIndexCount)
+                    break;
+                if (touched[collapse.from] || touched[collapse.to])
+                    continue;
+
+                //The triangles kept around the moved vertex must not flip or become needles
+                bool valid = true;
+                size_t removedTriangles = 0;
+                for (uint32_t k = firstAdjacent[collapse.from]; k < firstAdjacent[collapse.from + 1] && valid; k++)
+                {
+                    const uint32_t* triangle = &result[adjacency[k] * 3];
+                    if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                    {
+                        removedTriangles++;
+                        continue;
+                    }
+                    glm::vec3 before[3], after[3];
+                    for (int corner = 0; corner < 3; corner++)
+                    {
+                        before[corner] = vertices[triangle[corner]].pos;
+                        after[corner] = triangle[corner] == collapse.from ? vertices[collapse.to].pos : before[corner];
+                    }
+                    glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                    glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                    float lengths = glm::length(normalBefore) * glm::length(normalAfter);
+                    valid = lengths > 0.0f && glm::dot(normalBefore, normalAfter) > 0.25f * lengths;
+                }
+                if (!valid)
+                    continue;
+
+                for (uint32_t k = firstAdjacent[collapse.from]; k < firstAdjacent[collapse.from + 1]; k++)
+                    for (int corner = 0; corner < 3; corner++)
+                        touched[result[adjacency[k] * 3 + corner]] = true;
+                remap[collapse.from] = collapse.to;
+                quadrics[collapse.to].Add(quadrics[collapse.from]);
+                appliedError = std::max(appliedError, collapse.cost);
+                removedIndices += removedTriangles * 3;
+            }
+            if (removedIndices == 0)
+                break;
+
+            size_t write = 0;
+            for (size_t i = 0; i < result.size(); i += 3)
+            {
+                uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+                if (a == b || b == c || a == c)
+                    continue;
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+            result.resize(write);
+        }
+
+        if (resultError)
+            *resultError = static_cast<float>(std::sqrt(appliedError));
+        return result;
+    }
+
+    void BuildLodChain(Mesh& mesh, const MeshLodSettings& settings, int cacheSize)
+    {
+        glm::vec3 minimum(std::numeric_limits<float>::max()), maximum(-std::numeric_limits<float>::max());
+        for (const auto& vertex : mesh.vertices)
+        {
+            minimum = glm::min(minimum, vertex.pos);
+            maximum = glm::max(maximum, vertex.pos);
+        }
+        glm::vec3 center = mesh.vertices.empty() ? glm::vec3(0.0f) : (minimum + maximum) * 0.5f;
+        float radius = 0.0f;
+        for (const auto& vertex : mesh.vertices)
+            radius = std::max(radius, glm::length(vertex.pos - center));
+        mesh.boundingSphere = glm::vec4(center, radius);
+
+        mesh.lods.clear();
+        mesh.lods.push_back({0, static_cast<uint32_t>(mesh.indices.size()), 0.0f});
+        if (!settings.enabled)
+            return;
+
+        std::vector<uint32_t> previous = mesh.indices;
+        float error = 0.0f;
+        for (int lod = 1; lod < settings.lodCount; lod++)
+        {
+            size_t target = static_cast<size_t>(previous.size() / 3 * settings.reduction) * 3;
+            float lodError = 0.0f;
+            std::vector<uint32_t> simplified = SimplifyMesh(mesh.vertices, previous, target, settings.maxError * radius, &lodError);
+            if (simplified.empty() || simplified.size() * 10 > previous.size() * 9)
+                break;
+            //Each LOD is simplified from the previous one, so the errors add up
+            error += lodError;
+            simplified = OptimizeVertexCache(simplified, mesh.vertices.size(), cacheSize);
+            mesh.lods.push_back({static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(simplified.size()), error});
+            mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+            previous.swap(simplified);
+        }
+    }
+
+    size_t SelectMeshLod(const MeshLodSettings& settings, const Mesh& mesh, const InstanceData& instance,
+    const glm::mat4& model, const glm::vec3& cameraPos, float pixelsPerUnit)
+    {
+        if (!settings.enabled || mesh.lods.size() < 2)
+            return 0;
+        glm::vec3 localCenter = glm::vec3(mesh.boundingSphere) * instance.instanceScale + instance.instancePos;
+        glm::vec3 center = glm::vec3(model * glm::vec4(localCenter, 1.0f));
+        //Uniform scale of the model matrix, times the scale of the instance
+        float scale = glm::length(glm::vec3(model[0])) * instance.instanceScale;
+        //The nearest point of the bounds gives the largest projection of the error
+        float distance = std::max(glm::length(center - cameraPos) - mesh.boundingSphere.w * scale, 1e-3f);
+        float pixelsPerModelUnit = scale * pixelsPerUnit / distance;
+
+        size_t lod = 0;
+        while (lod + 1 < mesh.lods.size() && mesh.lods[lod + 1].error * pixelsPerModelUnit <= settings.pixelError)
+            lod++;
+        return lod;
+    }
+}
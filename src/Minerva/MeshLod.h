@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+namespace Minerva
+{
+    /// @brief Settings of the mesh LOD. The chain is built at import, every frame each instance
+    /// draws the coarsest LOD whose error stays under pixelError on screen
+    struct MeshLodSettings
+    {
+        bool enabled = false;
+        //Number of LODs including the full mesh
+        int lodCount = 4;
+        //Fraction of the triangles of the previous LOD targeted by the next one
+        float reduction = 0.5f;
+        //Largest error of a single simplification, as a fraction of the radius of the mesh
+        float maxError = 0.05f;
+        //Largest error on screen, in pixels, accepted when selecting a LOD
+        float pixelError = 1.0f;
+    };
+
+    /// @brief Simplifies the triangles with quadric error edge collapses. Every collapse moves a vertex
+    /// onto a neighbour, so the remaining vertices keep their attributes and skin weights. The vertices
+    /// on borders and UV seams stay in place, collapses between vertices with different skin weights
+    /// are charged to the error
+    /// @param targetIndexCount The simplification stops once the indices are this many or fewer
+    /// @param maxError The largest distance from the original surface accepted, in model units
+    /// @param resultError Receives the largest error of the collapses applied
+    /// @return The indices of the simplified triangles, into the same vertices
+    std::vector<uint32_t> SimplifyMesh(const std::vector<Mesh::Vertex>& vertices, const std::vector<uint32_t>& indices,
+    size_t targetIndexCount, float maxError, float* resultError = nullptr);
+    /// @brief Computes the bounding sphere of the mesh and appends the LODs to its indices, each one
+    /// simplified from the previous and reordered for the vertex cache. The chain stops early when
+    /// a LOD can't drop at least a tenth of the triangles within the error
+    void BuildLodChain(Mesh& mesh, const MeshLodSettings& settings, int cacheSize);
+    /// @brief Returns the coarsest LOD of the mesh whose error, seen from the camera, is under the pixel error
+    /// @param model The model matrix applied to every instance
+    /// @param pixelsPerUnit Pixels covered by one world unit at distance one: half the viewport height
+    /// divided by the tangent of half the vertical field of view
+    size_t SelectMeshLod(const MeshLodSettings& settings, const Mesh& mesh, const InstanceData& instance,
+    const glm::mat4& model, const glm::vec3& cameraPos, float pixelsPerUnit);
+}
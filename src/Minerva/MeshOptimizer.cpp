@@ -0,0 +1,460 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+
+namespace Minerva
+{
+    VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize)
+    {
+        VertexCacheStats stats;
+        if (indices.empty())
+            return stats;
+        //A vertex is cached while fewer than cacheSize misses happened after its own
+        std::vector<uint32_t> cacheTime(vertexCount, 0);
+        std::vector<bool> referenced(vertexCount, false);
+        uint32_t time = static_cast<uint32_t>(cacheSize) + 1;
+        size_t misses = 0, referencedCount = 0;
+        for (uint32_t index : indices)
+        {
+            if (time - cacheTime[index] > static_cast<uint32_t>(cacheSize))
+            {
+                cacheTime[index] = time++;
+                misses++;
+            }
+            if (!referenced[index])
+            {
+                referenced[index] = true;
+                referencedCount++;
+            }
+        }
+        stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+        stats.atvr = static_cast<float>(misses) / referencedCount;
+        return stats;
+    }
+
+    std::vector<uint32_t> OptimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount,
+    int cacheSize, std::vector<uint32_t>* clusters)
+    {
+        size_t triangleCount = indices.size() / 3;
+        const uint32_t cacheLimit = static_cast<uint32_t>(cacheSize);
+
+        //Triangles around every vertex, live counts the ones not emitted yet
+        std::vector<uint32_t> live(vertexCount, 0);
+        for (uint32_t index : indices)
+            live[index]++;
+        std::vector<uint32_t> firstAdjacent(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            firstAdjacent[v + 1] = firstAdjacent[v] + live[v];
+        std::vector<uint32_t> adjacency(indices.size());
+        std::vector<uint32_t> fill(firstAdjacent.begin(), firstAdjacent.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+        std::vector<uint32_t> cacheTime(vertexCount, 0);
+        uint32_t time = cacheLimit + 1;
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> deadEnds, candidates, result;
+        deadEnds.reserve(indices.size());
+        result.reserve(indices.size());
+        size_t scanCursor = 0;
+
+        //Recent vertices with live triangles first, then the next one in index order
+        auto skipDeadEnd = [&]() -> int64_t
+        {
+            while (!deadEnds.empty())
+            {
+                uint32_t vertex = deadEnds.back();
+                deadEnds.pop_back();
+                if (live[vertex] > 0)
+                    return vertex;
+            }
+            for (; scanCursor < vertexCount; scanCursor++)
+            {
+                if (live[scanCursor] > 0)
+                    return static_cast<int64_t>(scanCursor);
+            }
+            return -1;
+        };
+
+        int64_t fanning = skipDeadEnd();
+        bool deadEnd = true;
+        while (fanning >= 0)
+        {
+            if (deadEnd && clusters)
+                clusters->emplace_back(static_cast<uint32_t>(result.size() / 3));
+
+            candidates.clear();
+            for (uint32_t k = firstAdjacent[fanning]; k < firstAdjacent[fanning + 1]; k++)
+            {
+                uint32_t triangle = adjacency[k];
+                if (emitted[triangle])
+                    continue;
+                emitted[triangle] = true;
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    uint32_t vertex = indices[triangle * 3 + corner];
+                    result.emplace_back(vertex);
+                    deadEnds.emplace_back(vertex);
+                    candidates.emplace_back(vertex);
+                    live[vertex]--;
+                    if (time - cacheTime[vertex] > cacheLimit)
+                        cacheTime[vertex] = time++;
+                }
+            }
+
+            //The oldest candidate which stays in cache while its remaining triangles are fanned
+            int64_t best = -1;
+            int64_t bestPriority = -1;
+            for (uint32_t vertex : candidates)
+            {
+                if (live[vertex] == 0)
+                    continue;
+                int64_t priority = 0;
+                if (time - cacheTime[vertex] + 2 * live[vertex] <= cacheLimit)
+                    priority = time - cacheTime[vertex];
+                if (priority > bestPriority)
+                {
+                    best = vertex;
+                    bestPriority = priority;
+                }
+            }
+            deadEnd = best < 0;
+            fanning = deadEnd ? skipDeadEnd() : best;
+        }
+
+        if (clusters)
+        {
+            clusters->erase(std::unique(clusters->begin(), clusters->end()), clusters->end());
+            while (!clusters->empty() && clusters->back() >= triangleCount)
+                clusters->pop_back();
+        }
+        return result;
+    }
+
+    /// @brief Counts the misses of a fresh FIFO cache on the triangles [first, last)
+    static size_t CountMisses(const std::vector<uint32_t>& indices, size_t first, size_t last,
+    std::vector<uint32_t>& cacheTime, uint32_t& time, uint32_t cacheLimit)
+    {
+        //Moving the clock past the cache size empties the cache
+        time += cacheLimit + 1;
+        size_t misses = 0;
+        for (size_t i = first * 3; i < last * 3; i++)
+        {
+            if (time - cacheTime[indices[i]] > cacheLimit)
+            {
+                cacheTime[indices[i]] = time++;
+                misses++;
+            }
+        }
+        return misses;
+    }
+
+    std::vector<uint32_t> OptimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<Mesh::Vertex>& vertices,
+    const std::vector<uint32_t>& clusters, int cacheSize, float threshold)
+    {
+        size_t triangleCount = indices.size() / 3;
+        const uint32_t cacheLimit = static_cast<uint32_t>(cacheSize);
+        std::vector<uint32_t> cacheTime(vertices.size(), 0);
+        uint32_t time = 0;
+
+        /*Every run started from a dead end is split again where a fresh cache has already reached
+        the ACMR of the whole run (within threshold), so the split costs few extra transforms*/
+        std::vector<uint32_t> splits;
+        for (size_t c = 0; c < clusters.size(); c++)
+        {
+            size_t start = clusters[c];
+            size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+            float runAcmr = static_cast<float>(CountMisses(indices, start, end, cacheTime, time, cacheLimit)) / (end - start);
+
+            splits.emplace_back(static_cast<uint32_t>(start));
+            time += cacheLimit + 1;
+            size_t misses = 0, splitStart = start;
+            for (size_t triangle = start; triangle < end; triangle++)
+            {
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    uint32_t vertex = indices[triangle * 3 + corner];
+                    if (time - cacheTime[vertex] > cacheLimit)
+                    {
+                        cacheTime[vertex] = time++;
+                        misses++;
+                    }
+                }
+                size_t splitTriangles = triangle + 1 - splitStart;
+                if (triangle + 1 < end && static_cast<float>(misses) / splitTriangles <= threshold * runAcmr)
+                {
+                    splits.emplace_back(static_cast<uint32_t>(triangle + 1));
+                    splitStart = triangle + 1;
+                    misses = 0;
+                    time += cacheLimit + 1;
+                }
+            }
+        }
+
+        //Area weighted centroid and normal of every cluster
+        struct Cluster
+        {
+            size_t start;
+            size_t end;
+            glm::vec3 centroid;
+            glm::vec3 normal;
+            float sortKey;
+        };
+        std::vector<Cluster> sorted;
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for (size_t s = 0; s < splits.size(); s++)
+        {
+            Cluster cluster{splits[s], s + 1 < splits.size() ? splits[s + 1] : triangleCount, glm::vec3(0.0f), glm::vec3(0.0f), 0.0f};
+            float clusterArea = 0.0f;
+            for (size_t triangle = cluster.start; triangle < cluster.end; triangle++)
+            {
+                const glm::vec3& a = vertices[indices[triangle * 3]].pos;
+                const glm::vec3& b = vertices[indices[triangle * 3 + 1]].pos;
+                const glm::vec3& c = vertices[indices[triangle * 3 + 2]].pos;
+                glm::vec3 areaNormal = glm::cross(b - a, c - a);
+                float area = glm::length(areaNormal);
+                cluster.centroid += (a + b + c) / 3.0f * area;
+                cluster.normal += areaNormal;
+                clusterArea += area;
+            }
+            meshCentroid += cluster.centroid;
+            meshArea += clusterArea;
+            if (clusterArea > 0.0f)
+                cluster.centroid /= clusterArea;
+            sorted.emplace_back(cluster);
+        }
+        if (meshArea > 0.0f)
+            meshCentroid /= meshArea;
+
+        //Clusters on the outside, facing away from the center, tend to hide the others
+        for (auto& cluster : sorted)
+        {
+            float length = glm::length(cluster.normal);
+            glm::vec3 normal = length > 0.0f ? cluster.normal / length : glm::vec3(0.0f);
+            cluster.sortKey = glm::dot(cluster.centroid - meshCentroid, normal);
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b)
+        {
+            return a.sortKey > b.sortKey;
+        });
+
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+        for (const auto& cluster : sorted)
+            result.insert(result.end(), indices.begin() + cluster.start * 3, indices.begin() + cluster.end * 3);
+        return result;
+    }
+
+    void OptimizeVertexFetch(std::vector<Mesh::Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        const uint32_t unused = std::numeric_limits<uint32_t>::max();
+        std::vector<uint32_t> remap(vertices.size(), unused);
+        uint32_t nextVertex = 0;
+        for (uint32_t& index : indices)
+        {
+            if (remap[index] == unused)
+                remap[index] = nextVertex++;
+            index = remap[index];
+        }
+        for (auto& target : remap)
+        {
+            if (target == unused)
+                target = nextVertex++;
+        }
+
+        std::vector<Mesh::Vertex> reordered(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+            reordered[remap[i]] = vertices[i];
+        vertices.swap(reordered);
+    }
+
+    /// @brief Bounding sphere and normal cone of the triangles [first, last)
+    static void ComputeMeshletBounds(Mesh::Meshlet& meshlet, const std::vector<Mesh::Vertex>& vertices,
+    const std::vector<uint32_t>& indices, size_t first, size_t last)
+    {
+        glm::vec3 minimum(std::numeric_limits<float>::max());
+        glm::vec3 maximum(-std::numeric_limits<float>::max());
+        glm::vec3 axis(0.0f);
+        std::vector<glm::vec3> normals;
+        normals.reserve(last - first);
+        for (size_t triangle = first; triangle < last; triangle++)
+        {
+            const glm::vec3& a = vertices[indices[triangle * 3]].pos;
+            const glm::vec3& b = vertices[indices[triangle * 3 + 1]].pos;
+            const glm::vec3& c = vertices[indices[triangle * 3 + 2]].pos;
+            minimum = glm::min(minimum, glm::min(a, glm::min(b, c)));
+            maximum = glm::max(maximum, glm::max(a, glm::max(b, c)));
+            //Counter clockwise triangles are front facing, degenerate ones can't be culled anyway
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float length = glm::length(normal);
+            if (length > 0.0f)
+            {
+                normals.emplace_back(normal / length);
+                axis += normals.back();
+            }
+        }
+
+        glm::vec3 center = (minimum + maximum) * 0.5f;
+        float radius = 0.0f;
+        for (size_t i = first * 3; i < last * 3; i++)
+            radius = std::max(radius, glm::length(vertices[indices[i]].pos - center));
+        meshlet.sphere = glm::vec4(center, radius);
+
+        float axisLength = glm::length(axis);
+        if (normals.empty() || axisLength <= 0.0f)
+            return;
+        axis /= axisLength;
+        float minimumDot = 1.0f;
+        for (const auto& normal : normals)
+            minimumDot = std::min(minimumDot, glm::dot(axis, normal));
+        //Normals spread over more than a hemisphere always have a front facing triangle
+        float cutoff = minimumDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minimumDot * minimumDot);
+        meshlet.cone = glm::vec4(axis, cutoff);
+    }
+
+    std::vector<Mesh::Meshlet> BuildMeshlets(const std::vector<Mesh::Vertex>& vertices, std::vector<uint32_t>& indices,
+    int cacheSize, size_t maxVertices, size_t maxTriangles)
+    {
+        std::vector<Mesh::Meshlet> meshlets;
+        size_t triangleCount = indices.size() / 3;
+        size_t vertexCount = vertices.size();
+
+        std::vector<uint32_t> firstAdjacent(vertexCount + 1, 0);
+        for (uint32_t index : indices)
+            firstAdjacent[index + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            firstAdjacent[v + 1] += firstAdjacent[v];
+        std::vector<uint32_t> adjacency(indices.size());
+        std::vector<uint32_t> fill(firstAdjacent.begin(), firstAdjacent.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+        std::vector<glm::vec3> normals(triangleCount, glm::vec3(0.0f));
+        for (size_t triangle = 0; triangle < triangleCount; triangle++)
+        {
+            const glm::vec3& a = vertices[indices[triangle * 3]].pos;
+            glm::vec3 normal = glm::cross(vertices[indices[triangle * 3 + 1]].pos - a, vertices[indices[triangle * 3 + 2]].pos - a);
+            float length = glm::length(normal);
+            normals[triangle] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        }
+
+        //Meshlet which last used every vertex, so the unique vertices are counted without a set
+        const uint32_t unused = std::numeric_limits<uint32_t>::max();
+        std::vector<uint32_t> owner(vertexCount, unused);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> result, meshletVertices;
+        result.reserve(indices.size());
+        size_t seedCursor = 0;
+
+        while (true)
+        {
+            //The next meshlet starts from the first triangle left in the cache optimized order
+            while (seedCursor < triangleCount && emitted[seedCursor])
+                seedCursor++;
+            if (seedCursor == triangleCount)
+                break;
+            uint32_t current = static_cast<uint32_t>(meshlets.size());
+            Mesh::Meshlet meshlet;
+            meshlet.firstIndex = static_cast<uint32_t>(result.size());
+            meshletVertices.clear();
+            glm::vec3 axis(0.0f);
+            size_t meshletTriangles = 0;
+            int64_t next = static_cast<int64_t>(seedCursor);
+
+            while (next >= 0)
+            {
+                uint32_t triangle = static_cast<uint32_t>(next);
+                emitted[triangle] = true;
+                meshletTriangles++;
+                axis += normals[triangle];
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    uint32_t vertex = indices[triangle * 3 + corner];
+                    result.emplace_back(vertex);
+                    if (owner[vertex] != current)
+                    {
+                        owner[vertex] = current;
+                        meshletVertices.emplace_back(vertex);
+                    }
+                }
+                if (meshletTriangles == maxTriangles)
+                    break;
+
+                /*Grows towards the neighbour adding the fewest vertices, then the one closest to the average
+                normal, so the meshlets stay compact and their normal cones narrow*/
+                next = -1;
+                size_t bestNew = 3;
+                float bestDot = -2.0f;
+                for (uint32_t vertex : meshletVertices)
+                {
+                    for (uint32_t k = firstAdjacent[vertex]; k < firstAdjacent[vertex + 1]; k++)
+                    {
+                        uint32_t candidate = adjacency[k];
+                        if (emitted[candidate])
+                            continue;
+                        size_t newVertices = 0;
+                        for (int corner = 0; corner < 3; corner++)
+                            newVertices += owner[indices[candidate * 3 + corner]] != current ? 1 : 0;
+                        if (meshletVertices.size() + newVertices > maxVertices)
+                            continue;
+                        float dot = glm::dot(normals[candidate], axis);
+                        if (newVertices < bestNew || (newVertices == bestNew && dot > bestDot))
+                        {
+                            next = candidate;
+                            bestNew = newVertices;
+                            bestDot = dot;
+                        }
+                    }
+                }
+            }
+            meshlet.indexCount = static_cast<uint32_t>(result.size() - meshlet.firstIndex);
+            meshlets.emplace_back(meshlet);
+        }
+
+        indices.swap(result);
+        //Tipsify again inside every meshlet, on indices local to the meshlet
+        std::vector<uint32_t> localIndices, globalVertices;
+        for (const auto& meshlet : meshlets)
+        {
+            localIndices.clear();
+            globalVertices.clear();
+            for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++)
+            {
+                uint32_t vertex = indices[i];
+                auto local = std::find(globalVertices.begin(), globalVertices.end(), vertex);
+                localIndices.emplace_back(static_cast<uint32_t>(local - globalVertices.begin()));
+                if (local == globalVertices.end())
+                    globalVertices.emplace_back(vertex);
+            }
+            localIndices = OptimizeVertexCache(localIndices, globalVertices.size(), cacheSize);
+            for (size_t i = 0; i < localIndices.size(); i++)
+                indices[meshlet.firstIndex + i] = globalVertices[localIndices[i]];
+        }
+        for (auto& meshlet : meshlets)
+            ComputeMeshletBounds(meshlet, vertices, indices, meshlet.firstIndex / 3, (meshlet.firstIndex + meshlet.indexCount) / 3);
+        return meshlets;
+    }
+
+    void OptimizeMesh(Mesh& mesh, const MeshOptimizationSettings& settings)
+    {
+        if (mesh.indices.empty() || !(settings.enabled || settings.meshlets))
+            return;
+        if (settings.enabled)
+        {
+            std::vector<uint32_t> clusters;
+            std::vector<uint32_t> indices = OptimizeVertexCache(mesh.indices, mesh.vertices.size(), settings.cacheSize,
+            settings.reduceOverdraw ? &clusters : nullptr);
+            if (settings.reduceOverdraw)
+                indices = OptimizeOverdraw(indices, mesh.vertices, clusters, settings.cacheSize, settings.overdrawThreshold);
+            mesh.indices.swap(indices);
+        }
+        //The meshlets only regroup the triangles, so the vertex order follows them
+        if (settings.meshlets)
+            mesh.meshlets = BuildMeshlets(mesh.vertices, mesh.indices, settings.cacheSize);
+        if (settings.enabled)
+            OptimizeVertexFetch(mesh.vertices, mesh.indices);
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "Mesh.h"
+
+namespace Minerva
+{
+    /// @brief Options of the import-time mesh optimization. The triangles are reordered for the
+    /// post-transform vertex cache, then the vertices are reordered by first use
+    struct MeshOptimizationSettings
+    {
+        bool enabled = false;
+        //Size of the FIFO cache targeted by the triangle order
+        int cacheSize = 16;
+        //Sorts the triangle clusters front to back from outside the mesh, at a small cache cost
+        bool reduceOverdraw = true;
+        //Largest ACMR of a cluster, relative to the ACMR of its run of triangles, accepted when splitting it
+        float overdrawThreshold = 1.05f;
+        //Splits the optimized triangles into meshlets, needed by the meshlet culling. Runs even when enabled is false
+        bool meshlets = false;
+    };
+
+    /// @brief Efficiency of a triangle order on a simulated FIFO cache
+    struct VertexCacheStats
+    {
+        //Average cache miss ratio: transformed vertices per triangle, 0.5 at best, 3 at worst
+        float acmr = 0.0f;
+        //Average transform to vertex ratio: transformed vertices per referenced vertex, 1 at best
+        float atvr = 0.0f;
+    };
+
+    /// @brief Simulates a FIFO post-transform cache on the triangle list
+    VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize);
+    /// @brief Reorders the triangles with Tipsify: it fans around the vertex that keeps the most
+    /// triangles in cache and jumps to a dead-end vertex when no cached vertex is left
+    /// @param clusters When given, receives the first triangle of every run which started from a dead end
+    std::vector<uint32_t> OptimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount,
+    int cacheSize, std::vector<uint32_t>* clusters = nullptr);
+    /// @brief Splits the clusters of OptimizeVertexCache where the cache cost allows it, then sorts
+    /// them so the ones facing away from the center of the mesh are drawn first
+    std::vector<uint32_t> OptimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<Mesh::Vertex>& vertices,
+    const std::vector<uint32_t>& clusters, int cacheSize, float threshold);
+    /// @brief Reorders the vertices by first use in the index buffer and remaps the indices.
+    /// Unused vertices are moved to the end
+    void OptimizeVertexFetch(std::vector<Mesh::Vertex>& vertices, std::vector<uint32_t>& indices);
+    /// @brief Groups the triangles into meshlets grown over shared vertices, each seeded by the first triangle
+    /// left in the current order. The indices are rewritten so every meshlet is a contiguous range,
+    /// its triangles reordered for a cache of cacheSize vertices
+    std::vector<Mesh::Meshlet> BuildMeshlets(const std::vector<Mesh::Vertex>& vertices, std::vector<uint32_t>& indices,
+    int cacheSize, size_t maxVertices = Mesh::MESHLET_MAX_VERTICES, size_t maxTriangles = Mesh::MESHLET_MAX_TRIANGLES);
+    /// @brief Runs every pass enabled in settings on the mesh
+    void OptimizeMesh(Mesh& mesh, const MeshOptimizationSettings& settings);
+}
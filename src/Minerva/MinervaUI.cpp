@@ -1,6 +1,7 @@
 #include "EngineVars.h"
 #include "MinervaUI.h"
 #include "EngineStartup.h"
+#include <chrono>
 
 
 
@@ -62,9 +63,13 @@ namespace Minerva
         imGuiImplInfo.PhysicalDevice = engineDevice.physicalDevice;
         imGuiImplInfo.ImageCount = engineRenderer.MAX_FRAMES_IN_FLIGHT;
         imGuiImplInfo.MinImageCount = engineRenderer.MAX_FRAMES_IN_FLIGHT;
-        imGuiImplInfo.PipelineCache = nullptr; //!TO-DO Implement a pipeline cache to increase performance
+        imGuiImplInfo.PipelineCache = enginePipeline.pipelineCache;
         
+        //ImGui creates its pipeline here, from the same cache
+        auto start = std::chrono::high_resolution_clock::now();
         ImGui_ImplVulkan_Init(&imGuiImplInfo);
+        enginePipeline.creationMilliseconds += std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
         
     }
 
@@ -86,23 +91,102 @@ namespace Minerva
             ImGui::Text("Number of triangles: %d", engineModLoader.info.numberOfPolygons  * engineModLoader.instanceNumber);
             ImGui::Text("Number of vertices: %d", engineModLoader.info.numberOfVertices  * engineModLoader.instanceNumber);
             ImGui::Text("Number of instances: %d", engineModLoader.instanceNumber);
-            if(engineModLoader.sceneMeshes[0].typeOfMesh == Mesh::MeshType::Skeletal)
+            ImGui::Text("Meshes: %zu, indirect draws: %u (%u with 16 bit indices)", engineModLoader.sceneMeshes.size(), 
+            engineRenderer.drawCount, engineRenderer.narrowDrawCount);
+            ImGui::Text("Draws and render pass recorded in %.3f ms, %zu calls in %u secondary command buffers", 
+            engineRenderer.recordMilliseconds, engineRenderer.frameDrawCalls.size(), engineRenderer.recordedSlices);
+            //The draws of the culling pass are counted by the GPU, a call for each one isn't possible
+            if(engineDevice.multiDrawIndirect && engineRenderer.meshletCount == 0)
+                ImGui::Checkbox("A call for each draw", &engineRenderer.perDrawCalls);
+            ImGui::Text("Vertex size: %u bytes", engineModLoader.vertexLayout.VertexSize());
+            if(engineRenderer.meshletCount > 0)
             {
-                if(ImGui::Button("Idle"))
+                ImGui::Text("Visible meshlets: %u of %u", engineRenderer.VisibleMeshletDraws(), 
+                engineRenderer.meshletCount * static_cast<uint32_t>(engineModLoader.instanceNumber));
+            }
+            //The meshlets cover only the full meshes, so the LODs are drawn only without the culling pass
+            else
+            {
+                ImGui::Checkbox("Mesh LOD", &engineRenderer.meshLod.enabled);
+                if(engineRenderer.meshLod.enabled)
+                    ImGui::SliderFloat("LOD pixel error", &engineRenderer.meshLod.pixelError, 0.1f, 16.0f, "%.1f");
+                ImGui::Text("Triangles rendered: %llu of %llu", static_cast<unsigned long long>(engineRenderer.renderedTriangles),
+                static_cast<unsigned long long>(engineModLoader.info.numberOfPolygons) * engineModLoader.instanceNumber);
+                for(size_t lod = 0; lod < engineRenderer.lodInstanceCounts.size(); lod++)
+                    ImGui::Text("LOD %zu: %u instances", lod, engineRenderer.lodInstanceCounts[lod]);
+            }
+            if(engineModLoader.HasSkeleton())
+            {
+                ImGui::Text("Animation: %s", engineTransform.ubo.bakedAnimation ? "baked on the GPU" : "CPU animators");
+                if(engineRenderer.skinnedPoseCount > 0)
+                    ImGui::Text("Compute skinning: %u poses", engineRenderer.skinnedPoseCount);
+                else if(!engineTransform.ubo.bakedAnimation)
+                    ImGui::Text("Poses: %u", engineTransform.ubo.poseCount);
+                const auto& lod = this->engine->animationLod;
+                for(size_t band = 0; lod.enabled && band < this->engine->lodBandCounts.size(); band++)
                 {
-                    this->engine->animator.PlayAnimation(&this->engine->animations[0]);
+                    ImGui::Text("LOD %zu: %d animators, 1/%d rate%s", band, this->engine->lodBandCounts[band],
+                    lod.bands[band].updateInterval, lod.bands[band].prunedSkeleton ? ", pruned" : "");
                 }
+                if(ImGui::Button("Idle"))
+                    this->engine->PlayAnimation(0);
 
                 if(ImGui::Button("Walk"))
-                {
-                    this->engine->animator.PlayAnimation(&this->engine->animations[1]);
-                }
+                    this->engine->PlayAnimation(1);
 
                 if(ImGui::Button("Run"))
+                    this->engine->PlayAnimation(2);
+
+                if(!this->engine->animators.empty() && this->engine->animations.size() >= 3 &&
+                ImGui::SliderFloat("Locomotion speed", &this->engine->locomotionSpeed, 0.0f, 2.0f))
+                    this->engine->BlendLocomotion(this->engine->locomotionSpeed);
+            }    
+            if(ImGui::CollapsingHeader("Device memory"))
+            {
+                ImGui::Text("Memory objects: %u of %u", engineAllocator.MemoryObjectCount(), engineAllocator.MaxMemoryObjectCount());
+                std::vector<DeviceHeapStats> heaps = engineAllocator.Stats();
+                for(size_t heap = 0; heap < heaps.size(); heap++)
                 {
-                    this->engine->animator.PlayAnimation(&this->engine->animations[2]);
+                    const DeviceHeapStats& stats = heaps[heap];
+                    if(stats.reserved == 0)
+                        continue;
+                    ImGui::Text("Heap %zu%s: %.1f of %.1f MB used, %u blocks, %u dedicated, %.0f%% fragmented", heap, 
+                    stats.deviceLocal ? " (device local)" : "", stats.used / 1048576.0, stats.reserved / 1048576.0, 
+                    stats.blockCount, stats.dedicatedCount, stats.Fragmentation() * 100.0f);
                 }
-            }    
+            }
+            if(ImGui::CollapsingHeader("Benchmarks"))
+            {
+                if(ImGui::Button("Keyframe sampling"))
+                    this->engine->benchmark.KeyframeSampling();
+                if(ImGui::Button("Pose kernels"))
+                    this->engine->benchmark.PoseKernels();
+                if(!this->engine->animations.empty() && ImGui::Button("Clip compression"))
+                {
+                    this->engine->benchmark.ClipCompression(this->engine->animations, &engineModLoader, 
+                    this->engine->samplesTest["1"].animCompression);
+                }
+                if(!this->engine->animators.empty() && ImGui::Button("Animation update scaling"))
+                {
+                    this->engine->benchmark.AnimationScaling(this->engine->animators, 
+                    this->engine->ANIMATORS_PER_JOB);
+                }
+                if(!this->engine->animators.empty() && ImGui::Button("Animation LOD"))
+                {
+                    this->engine->benchmark.AnimationLod(this->engine->animators, this->engine->animationLod,
+                    camera.cameraPos, engineTransform.ubo.model, engineModLoader.instancesData);
+                }
+                if(!this->engine->animations.empty() && ImGui::Button("Animation blending"))
+                    this->engine->benchmark.AnimationBlending(this->engine->animations);
+                //The skeletal sample has the clips, every clip is loaded four times
+                if(ImGui::Button("Asset loading"))
+                    this->engine->benchmark.AssetLoading(this->engine->samplesTest["1"], texture, 4);
+                if(ImGui::Button("OBJ loading"))
+                    this->engine->benchmark.ObjLoading(&engineModLoader, 1024);
+                if(ImGui::Button("Render pass recording"))
+                    this->engine->benchmark.RenderRecording(4096);
+                ImGui::TextUnformatted(this->engine->benchmark.lastReport.c_str());
+            }
             ImGui::PopFont();
             ImGui::End();
         }
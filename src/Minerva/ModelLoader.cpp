@@ -1,49 +1,290 @@
 #include "ModelLoader.h"
 #include <queue>
+#include <cstdint>
+#include <utility>
+#include <filesystem>
+#include <cstring>
+#include <stdexcept>
 #include "EngineVars.h"
+#include "ObjLoader.h"
+#include <algorithm>
+#include <cctype>
 
 
 namespace Minerva
 {
-    void ModelLoader::LoadModel(std::string fileName)
+    /// @brief Hash of every setting that changes the cooked meshes
+    static uint64_t HashImportSettings(const MeshOptimizationSettings& settings, const MeshLodSettings& lodSettings)
+    {
+        //Field by field, so the padding of the structs doesn't reach the hash
+        uint64_t hash = HashBytes(&settings.enabled, sizeof(settings.enabled));
+        hash = HashBytes(&settings.cacheSize, sizeof(settings.cacheSize), hash);
+        hash = HashBytes(&settings.reduceOverdraw, sizeof(settings.reduceOverdraw), hash);
+        hash = HashBytes(&settings.overdrawThreshold, sizeof(settings.overdrawThreshold), hash);
+        hash = HashBytes(&settings.meshlets, sizeof(settings.meshlets), hash);
+        hash = HashBytes(&lodSettings.enabled, sizeof(lodSettings.enabled), hash);
+        hash = HashBytes(&lodSettings.lodCount, sizeof(lodSettings.lodCount), hash);
+        hash = HashBytes(&lodSettings.reduction, sizeof(lodSettings.reduction), hash);
+        return HashBytes(&lodSettings.maxError, sizeof(lodSettings.maxError), hash);
+    }
+
+    void ModelLoader::LoadModel(std::string fileName, const MeshOptimizationSettings& settings, 
+    const MeshLodSettings& lodSettings)
+    {
+        //The meshes of a cooked model have no vertices left to place again with the new ones
+        if(cookedVertices.size > 0)
+            throw std::runtime_error("a cooked model must be the only model of the scene!");
+        //The cooked arenas are uploaded as they are, so only the first model of the scene can use them
+        bool cacheable = useMeshCache && sceneMeshes.empty();
+        std::string cookedPath = MODELS_PATH + fileName + COOKED_MODEL_EXTENSION;
+        uint64_t sourceHash = 0, settingsHash = HashImportSettings(settings, lodSettings);
+        if(cacheable)
+        {
+            MappedFile source;
+            cacheable = source.Open(MODELS_PATH + fileName);
+            if(cacheable)
+                sourceHash = HashBytes(source.Data(), source.Size());
+            if(cacheable && LoadCookedModel(cookedPath, sourceHash, settingsHash))
+                return;
+        }
+
+        for(auto& mesh : ImportMeshes(fileName))
+        {
+            OptimizeMesh(mesh, settings);
+            BuildLodChain(mesh, lodSettings, settings.cacheSize);
+            //The coarser LODs follow the full mesh in its indices
+            info.numberOfPolygons += static_cast<int>(mesh.lods[0].indexCount / 3);
+            info.numberOfVertices += static_cast<int>(mesh.vertices.size());
+            sceneMeshes.emplace_back(std::move(mesh));
+        }
+        /*Static scenes have no skin stream. In a skinned arena the static meshes keep the -1 bone 
+        indices, so the shaders don't skin them. The 8 bit bone indices hold up to 127 bones*/
+        for(const auto& mesh : sceneMeshes)
+            vertexLayout.skinned = vertexLayout.skinned || mesh.typeOfMesh == Mesh::MeshType::Skeletal;
+        vertexLayout.wideBoneIndices = boneNumber > INT8_MAX;
+        info.numberOfBones = boneNumber;
+        PlaceMeshes();
+        if(cacheable && !sceneMeshes.empty())
+            CookModel(cookedPath, sourceHash, settingsHash);
+
+    }
+    bool ModelLoader::LoadCookedModel(const std::string& path, uint64_t sourceHash, uint64_t settingsHash)
+    {
+        if(!cookedModel.Open(path))
+            return false;
+        const unsigned char* data = cookedModel.Data();
+        size_t size = cookedModel.Size();
+        size_t cursor = 0;
+        auto fits = [size](VkDeviceSize offset, VkDeviceSize length)
+        {
+            return offset <= size && length <= size - offset;
+        };
+        auto read = [&](void* target, size_t length)
+        {
+            if(!fits(cursor, length))
+                return false;
+            std::memcpy(target, data + cursor, length);
+            cursor += length;
+            return true;
+        };
+
+        CookedModelHeader header;
+        bool valid = read(&header, sizeof(header)) && header.magic == COOKED_MODEL_MAGIC 
+        && header.version == COOKED_MODEL_VERSION && header.sourceHash == sourceHash 
+        && header.settingsHash == settingsHash && header.normals == static_cast<uint32_t>(vertexLayout.normals)
+        && fits(header.vertexData.offset, header.vertexData.size) && fits(header.indexData.offset, header.indexData.size)
+        && fits(cursor, static_cast<VkDeviceSize>(header.meshCount) * sizeof(CookedMeshRecord));
+
+        std::vector<Mesh> meshes;
+        MeshInfo cookedInfo;
+        for(uint32_t i = 0; valid && i < header.meshCount; i++)
+        {
+            CookedMeshRecord record;
+            valid = read(&record, sizeof(record)) && record.lodCount > 0
+            && fits(cursor, static_cast<VkDeviceSize>(record.meshletCount) * sizeof(Mesh::Meshlet) 
+            + static_cast<VkDeviceSize>(record.lodCount) * sizeof(Mesh::Lod));
+            if(!valid)
+                break;
+            Mesh mesh;
+            mesh.typeOfMesh = static_cast<Mesh::MeshType>(record.typeOfMesh);
+            mesh.indexType = static_cast<VkIndexType>(record.indexType);
+            mesh.baseVertex = record.baseVertex;
+            mesh.firstIndex = record.firstIndex;
+            mesh.boundingSphere = record.boundingSphere;
+            mesh.meshlets.resize(record.meshletCount);
+            mesh.lods.resize(record.lodCount);
+            read(mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Mesh::Meshlet));
+            read(mesh.lods.data(), mesh.lods.size() * sizeof(Mesh::Lod));
+            cookedInfo.numberOfPolygons += static_cast<int>(mesh.lods[0].indexCount / 3);
+            cookedInfo.numberOfVertices += static_cast<int>(record.vertexCount);
+            meshes.emplace_back(std::move(mesh));
+        }
+
+        std::map<std::string, Mesh::BoneInfo> bones;
+        for(uint32_t i = 0; valid && i < header.boneCount; i++)
+        {
+            CookedBoneRecord record;
+            valid = read(&record, sizeof(record)) && fits(cursor, record.nameLength);
+            if(!valid)
+                break;
+            std::string name(reinterpret_cast<const char*>(data + cursor), record.nameLength);
+            cursor += record.nameLength;
+            bones[name] = {record.id, record.offset};
+        }
+        if(!valid)
+        {
+            cookedModel.Close();
+            return false;
+        }
+
+        sceneMeshes = std::move(meshes);
+        infoBoneMap = std::move(bones);
+        boneNumber = static_cast<int>(header.boneCount);
+        vertexLayout.skinned = header.skinned != 0;
+        vertexLayout.wideBoneIndices = header.wideBoneIndices != 0;
+        vertexCount = header.vertexCount;
+        indexCount = header.indexCount;
+        sceneBuffer.position = header.position;
+        sceneBuffer.shading = header.shading;
+        sceneBuffer.skin = header.skin;
+        sceneBuffer.narrowIndices = header.narrowIndices;
+        sceneBuffer.wideIndices = header.wideIndices;
+        cookedVertices = header.vertexData;
+        cookedIndices = header.indexData;
+        info.numberOfPolygons += cookedInfo.numberOfPolygons;
+        info.numberOfVertices += cookedInfo.numberOfVertices;
+        info.numberOfBones = boneNumber;
+        return true;
+    }
+    void ModelLoader::CookModel(const std::string& path, uint64_t sourceHash, uint64_t settingsHash) const
+    {
+        Mesh::VertexStreams streams = Mesh::PackVertexStreams(sceneMeshes, vertexLayout);
+        std::vector<unsigned char> indices = Mesh::PackIndices(sceneMeshes, sceneBuffer);
+
+        CookedModelHeader header;
+        header.sourceHash = sourceHash;
+        header.settingsHash = settingsHash;
+        header.meshCount = static_cast<uint32_t>(sceneMeshes.size());
+        header.boneCount = static_cast<uint32_t>(infoBoneMap.size());
+        header.vertexCount = vertexCount;
+        header.indexCount = indexCount;
+        header.skinned = vertexLayout.skinned;
+        header.normals = vertexLayout.normals;
+        header.wideBoneIndices = vertexLayout.wideBoneIndices;
+        header.position = streams.position;
+        header.shading = streams.shading;
+        header.skin = streams.skin;
+        header.narrowIndices = sceneBuffer.narrowIndices;
+        header.wideIndices = sceneBuffer.wideIndices;
+
+        //Meshes and bones first, their size gives the offset of the arenas
+        std::vector<unsigned char> records;
+        auto append = [&records](const void* bytes, size_t length)
+        {
+            records.insert(records.end(), static_cast<const unsigned char*>(bytes), 
+            static_cast<const unsigned char*>(bytes) + length);
+        };
+        for(const auto& mesh : sceneMeshes)
+        {
+            CookedMeshRecord record;
+            record.typeOfMesh = static_cast<uint32_t>(mesh.typeOfMesh);
+            record.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+            record.indexCount = static_cast<uint32_t>(mesh.indices.size());
+            record.indexType = static_cast<uint32_t>(mesh.indexType);
+            record.baseVertex = mesh.baseVertex;
+            record.firstIndex = mesh.firstIndex;
+            record.meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+            record.lodCount = static_cast<uint32_t>(mesh.lods.size());
+            record.boundingSphere = mesh.boundingSphere;
+            append(&record, sizeof(record));
+            append(mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Mesh::Meshlet));
+            append(mesh.lods.data(), mesh.lods.size() * sizeof(Mesh::Lod));
+        }
+        for(const auto& [name, bone] : infoBoneMap)
+        {
+            CookedBoneRecord record;
+            record.offset = bone.offset;
+            record.id = bone.id;
+            record.nameLength = static_cast<uint32_t>(name.size());
+            append(&record, sizeof(record));
+            append(name.data(), name.size());
+        }
+        //The arenas start aligned, like the streams inside them
+        auto align = [](VkDeviceSize offset) { return (offset + Mesh::STREAM_ALIGNMENT - 1) / Mesh::STREAM_ALIGNMENT * Mesh::STREAM_ALIGNMENT; };
+        header.vertexData.offset = align(sizeof(header) + records.size());
+        header.vertexData.size = streams.data.size();
+        header.indexData.offset = align(header.vertexData.offset + header.vertexData.size);
+        header.indexData.size = indices.size();
+
+        std::vector<unsigned char> file;
+        file.reserve(header.indexData.offset + header.indexData.size);
+        AppendBytes(file, &header, sizeof(header));
+        AppendBytes(file, records.data(), records.size());
+        file.resize(header.vertexData.offset, 0);
+        AppendBytes(file, streams.data.data(), streams.data.size());
+        file.resize(header.indexData.offset, 0);
+        AppendBytes(file, indices.data(), indices.size());
+        //A crash never leaves a truncated cooked model behind
+        WriteFileAtomically(path, file.data(), file.size());
+    }
+    void ModelLoader::ReleaseCookedModel()
+    {
+        cookedModel.Close();
+    }
+    std::vector<Mesh> ModelLoader::ImportMeshes(const std::string& fileName)
+    {
+        std::string path = MODELS_PATH + fileName;
+        std::string extension = std::filesystem::path(fileName).extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), 
+        [](unsigned char character) { return static_cast<char>(std::tolower(character)); });
+        std::vector<Mesh> meshes;
+        if(useObjFastPath && extension == ".obj")
+        {
+            if(LoadObj(path, jobSystem, meshes))
+                return meshes;
+            std::cout << fileName << " can't be read by the OBJ fast path, it is imported by Assimp\n";
+        }
+        return ImportAssimpMeshes(path);
+    }
+    std::vector<Mesh> ModelLoader::ImportAssimpMeshes(const std::string& path)
     {
         Assimp::Importer importer;
+        std::vector<Mesh> meshes;
 
-        const aiScene *scene = importer.ReadFile((MODELS_PATH + fileName).c_str(), 
+        const aiScene *scene = importer.ReadFile(path.c_str(), 
         aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices );
 
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) 
         {
             std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
-            return;
+            return meshes;
         }
-        ProcessAssimpNode(scene->mRootNode, scene);
-        if(sceneMeshes[0].vertices[0].boneID[0] == -1)
-            sceneMeshes[0].typeOfMesh = Mesh::MeshType::Static;
-        else
-            sceneMeshes[0].typeOfMesh = Mesh::MeshType::Skeletal;
-
+        ProcessAssimpNode(scene->mRootNode, scene, meshes);
+        return meshes;
     }
-    void ModelLoader::ProcessAssimpNode(aiNode *node, const aiScene *scene)
+    void ModelLoader::ProcessAssimpNode(aiNode *node, const aiScene *scene, std::vector<Mesh>& meshes)
     {
          // process all the node's meshes (if any)
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            sceneMeshes.emplace_back(ProcessAssimpMesh(mesh, scene));
+            meshes.emplace_back(ProcessAssimpMesh(mesh, scene));
         }
         // then do the same for each of its children
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            ProcessAssimpNode(node->mChildren[i], scene);
+            ProcessAssimpNode(node->mChildren[i], scene, meshes);
         }
 
     }
     Mesh ModelLoader::ProcessAssimpMesh(aiMesh *mesh, const aiScene *scene)
     {
-        std::vector<Minerva::Mesh::Vertex> tempVertices;
-        std::vector<uint32_t> tempIndices;
         Mesh createdMesh;
+        //Written straight into the mesh, the sizes are known up front
+        std::vector<Minerva::Mesh::Vertex>& tempVertices = createdMesh.vertices;
+        std::vector<uint32_t>& tempIndices = createdMesh.indices;
+        tempVertices.reserve(mesh->mNumVertices);
+        tempIndices.reserve(static_cast<size_t>(mesh->mNumFaces) * 3);
         
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
@@ -54,7 +295,10 @@ namespace Minerva
             currentVertex.pos.y = mesh->mVertices[i].y;
             currentVertex.pos.z = mesh->mVertices[i].z;
 
-            currentVertex.color = glm::vec3 {1.0f};
+            if(mesh->HasNormals())
+                currentVertex.normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+            else
+                currentVertex.normal = glm::vec3(0.0f);
 
             //UVCoord loading
             if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
@@ -79,14 +323,10 @@ namespace Minerva
                 tempIndices.emplace_back(face.mIndices[j]);
         }
         
-        createdMesh.vertices = tempVertices;
-        createdMesh.indices = tempIndices;
+        createdMesh.typeOfMesh = mesh->mNumBones > 0 ? Mesh::MeshType::Skeletal : Mesh::MeshType::Static;
         if(mesh->mNumBones > 0)
             ExtractBoneWeightForVertices(createdMesh.vertices, mesh, scene);
         
-        info.numberOfBones = mesh->mNumBones;
-        info.numberOfPolygons = mesh->mNumFaces;
-        info.numberOfVertices = mesh->mNumVertices;
         return createdMesh;
     }
     void ModelLoader::PrepareInstanceData(SampleType type)
@@ -162,6 +402,30 @@ namespace Minerva
 
     }
 
+    void ModelLoader::PlaceMeshes()
+    {
+        vertexCount = 0;
+        indexCount = 0;
+        uint32_t narrowIndexCount = 0, wideIndexCount = 0;
+        for(auto& mesh : sceneMeshes)
+        {
+            //The indices are relative to the base vertex, so only the size of the mesh matters
+            bool narrow = mesh.vertices.size() <= Mesh::MAX_NARROW_INDEX_VERTICES;
+            mesh.indexType = narrow ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+            uint32_t& batchCount = narrow ? narrowIndexCount : wideIndexCount;
+            mesh.baseVertex = vertexCount;
+            mesh.firstIndex = batchCount;
+            vertexCount += static_cast<uint32_t>(mesh.vertices.size());
+            batchCount += static_cast<uint32_t>(mesh.indices.size());
+        }
+        indexCount = narrowIndexCount + wideIndexCount;
+        sceneBuffer.narrowIndices.offset = 0;
+        sceneBuffer.narrowIndices.size = narrowIndexCount * sizeof(uint16_t);
+        //The offset of a 32 bit index buffer binding must be a multiple of 4
+        sceneBuffer.wideIndices.offset = (sceneBuffer.narrowIndices.size + 3) / 4 * 4;
+        sceneBuffer.wideIndices.size = wideIndexCount * sizeof(uint32_t);
+    }
+
     glm::mat4 ModelLoader::ConvertMatrixToGLMFormat(const aiMatrix4x4 &from)
     {
         glm::mat4 to;
@@ -176,7 +440,11 @@ namespace Minerva
     ModelLoader::~ModelLoader()
     {
         vkDestroyBuffer(engineDevice.logicalDevice, instanceBuffer.buffer, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, instanceBuffer.memory, nullptr);
+        engineAllocator.Free(instanceBuffer.memory);
+        vkDestroyBuffer(engineDevice.logicalDevice, sceneBuffer.indexBuffer, nullptr);
+        engineAllocator.Free(sceneBuffer.indexBufferMemory);
+        vkDestroyBuffer(engineDevice.logicalDevice, sceneBuffer.vertexBuffer, nullptr);
+        engineAllocator.Free(sceneBuffer.vertexBufferMemory);
     }
 
     ModelLoader::ModelLoader(ModelLoader &&other) noexcept
@@ -185,10 +453,17 @@ namespace Minerva
         instanceBuffer = std::move(other.instanceBuffer);
         instancesData = std::move(other.instancesData);
         sceneMeshes = std::move(other.sceneMeshes);
+        sceneBuffer = std::exchange(other.sceneBuffer, Mesh::MeshBuffer());
+        vertexLayout = other.vertexLayout;
+        vertexCount = other.vertexCount;
+        indexCount = other.indexCount;
+        cookedModel = std::move(other.cookedModel);
+        cookedVertices = other.cookedVertices;
+        cookedIndices = other.cookedIndices;
 
         other.instanceNumber = 0;
         vkDestroyBuffer(engineDevice.logicalDevice, other.instanceBuffer.buffer, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, other.instanceBuffer.memory, nullptr);
+        engineAllocator.Free(other.instanceBuffer.memory);
         free(other.instancesData.data());
         free(other.sceneMeshes.data());
         
@@ -199,10 +474,17 @@ namespace Minerva
         instanceBuffer = std::move(other.instanceBuffer);
         instancesData = std::move(other.instancesData);
         sceneMeshes = std::move(other.sceneMeshes);
+        sceneBuffer = std::exchange(other.sceneBuffer, Mesh::MeshBuffer());
+        vertexLayout = other.vertexLayout;
+        vertexCount = other.vertexCount;
+        indexCount = other.indexCount;
+        cookedModel = std::move(other.cookedModel);
+        cookedVertices = other.cookedVertices;
+        cookedIndices = other.cookedIndices;
 
         other.instanceNumber = 0;
         vkDestroyBuffer(engineDevice.logicalDevice, other.instanceBuffer.buffer, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, other.instanceBuffer.memory, nullptr);
+        engineAllocator.Free(other.instanceBuffer.memory);
         free(other.instancesData.data());
         free(other.sceneMeshes.data());
         return *this;
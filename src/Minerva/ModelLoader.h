@@ -2,24 +2,46 @@
 #pragma once
 #include <map>
 #include "Mesh.h"
+#include "ClipCompression.h"
+#include "AnimationLod.h"
+#include "MeshOptimizer.h"
+#include "MeshLod.h"
+#include "MeshCache.h"
 namespace Minerva
 {
+    class JobSystem;
+
     struct SampleType
     {
         std::string textureName;
         std::string modelName;
         std::vector<std::string> animName;
         int animNumber;
+        //Sample rate of the resampled animation tracks, zero keeps the source keys
+        float animSampleRate = 0.0f;
+        ClipCompressionSettings animCompression;
+        //Frames per second of the clips baked for the GPU, zero evaluates one animator per instance on the CPU
+        float animBakeRate = 0.0f;
+        //Number of poses evaluated on the CPU and shared by the instances, zero gives every instance its own pose
+        int animPoseCount = 0;
+        //Skins every pose once in a compute pass instead of skinning every instance in the vertex shader
+        bool computeSkinning = false;
+        AnimationLodSettings animLod;
+        MeshOptimizationSettings meshOptimization;
+        //Culls the meshlets of every instance in a compute pass, only static models are culled
+        bool meshletCulling = false;
+        MeshLodSettings meshLod;
         float scale;
         int rowDim;
         float distanceMultiplier;
     };
 
+    /// @brief Totals of every mesh loaded
     struct MeshInfo
     {
-        int numberOfVertices;
-        int numberOfPolygons;
-        int numberOfBones;
+        int numberOfVertices = 0;
+        int numberOfPolygons = 0;
+        int numberOfBones = 0;
     };
     class ModelLoader
     {
@@ -29,15 +51,55 @@ namespace Minerva
         std::vector<InstanceData> instancesData;
         Mesh::InstanceBuffer instanceBuffer;
         std::vector<Mesh> sceneMeshes;
+        //Vertex and index arenas holding every mesh, the meshes know their base vertex and first index
+        Mesh::MeshBuffer sceneBuffer;
+        //Layout of the vertex arena, skinned when at least one mesh is skeletal
+        Mesh::VertexLayout vertexLayout;
+        uint32_t vertexCount = 0;
+        uint32_t indexCount = 0;
         std::map<std::string, Mesh::BoneInfo> infoBoneMap;
         int boneNumber = 0;
-        void LoadModel(std::string fileName);
-        void ProcessAssimpNode(aiNode *node, const aiScene *scene);
+        //Reads the first model of the scene from its cooked file when the source and the settings still match
+        bool useMeshCache = true;
+        /*Cooked model read by LoadModel, the arenas are copied from the mapping until ReleaseCookedModel.
+        Its meshes keep no vertices and indices on the CPU, so no other model can join the scene*/
+        MappedFile cookedModel;
+        //Ranges of the vertex and index arenas inside cookedModel
+        Mesh::StreamRange cookedVertices;
+        Mesh::StreamRange cookedIndices;
+        //Reads the OBJ files with LoadObj instead of Assimp
+        bool useObjFastPath = true;
+        //Parses the OBJ files in parallel when set, the loader may run inside one of its jobs
+        JobSystem* jobSystem = nullptr;
+        /// @brief Appends the meshes of the model to sceneMeshes, optimized by settings, and places them in the arenas.
+        /// Every mesh gets its LOD chain, only the full mesh when lodSettings is disabled. A model loaded into an
+        /// empty scene is read from its cooked file, and imported then cooked again when the file is stale
+        void LoadModel(std::string fileName, const MeshOptimizationSettings& settings = {}, 
+        const MeshLodSettings& lodSettings = {});
+        /// @brief Maps a cooked model and takes its meshes, bones and arena layout
+        /// @return False, leaving the scene untouched, when the file is missing, corrupted or cooked from
+        /// another source or other settings
+        bool LoadCookedModel(const std::string& path, uint64_t sourceHash, uint64_t settingsHash);
+        /// @brief Writes the meshes of the scene, their bones and the packed arenas into a cooked model
+        void CookModel(const std::string& path, uint64_t sourceHash, uint64_t settingsHash) const;
+        /// @brief Unmaps the cooked model once the arenas are uploaded
+        void ReleaseCookedModel();
+        /// @brief Reads the meshes of the model in the order written by the exporter, their bones are 
+        /// added to infoBoneMap. OBJ files are read by the fast path unless it can't parse them
+        std::vector<Mesh> ImportMeshes(const std::string& fileName);
+        /// @brief Reads the meshes of the file through Assimp, whatever its format
+        /// @param path The full path of the file
+        std::vector<Mesh> ImportAssimpMeshes(const std::string& path);
+        bool HasSkeleton() const { return vertexLayout.skinned; }
+        void ProcessAssimpNode(aiNode *node, const aiScene *scene, std::vector<Mesh>& meshes);
         Mesh ProcessAssimpMesh(aiMesh *mesh, const aiScene *scene);
         void PrepareInstanceData(SampleType type);
         void SetupBoneData(Minerva::Mesh::Vertex& currentVertex, int boneID = -1, float weight = 0.0f);
         void ExtractBoneWeightForVertices(std::vector<Mesh::Vertex>& vertices, aiMesh* mesh, const aiScene* scene);
         static glm::mat4 ConvertMatrixToGLMFormat(const aiMatrix4x4&from);
+        /// @brief Assigns the base vertex, the index type and the first index of every mesh, in loading order.
+        /// The 16 bit indices are packed first in the index arena, the 32 bit ones follow
+        void PlaceMeshes();
         ModelLoader() = default;
         ~ModelLoader();
         
@@ -49,6 +111,8 @@ namespace Minerva
     private:
         
         const std::string MODELS_PATH = "C:/UNIMI/TESI/Phoenix/src/Minerva/Models/";
+        //Appended to the name of the source model to name its cooked file
+        const std::string COOKED_MODEL_EXTENSION = ".cooked";
     };
     
 }
\ No newline at end of file
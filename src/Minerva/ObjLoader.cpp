@@ -0,0 +1,527 @@
+#include "ObjLoader.h"
+#include "MeshCache.h"
+#include "JobSystem.h"
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+
+namespace Minerva
+{
+    //Marks a corner without texture coordinates or normal, and an empty slot of the vertex table
+    constexpr uint32_t OBJ_MISSING = UINT32_MAX;
+    //Corners hashed by a single job
+    constexpr size_t OBJ_HASH_BATCH = 65536;
+
+    /// @brief A corner of a triangle: the indices of its position, texture coordinates and normal
+    struct ObjCorner
+    {
+        uint32_t position = 0;
+        uint32_t texCoord = OBJ_MISSING;
+        uint32_t normal = OBJ_MISSING;
+    };
+
+    /// @brief A run of whole lines of the file, parsed by a single job
+    struct ObjChunk
+    {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+        //Elements declared by the chunk, and by the chunks before it
+        size_t counts[3] = {};
+        size_t bases[3] = {};
+        //Materials named by the usemtl lines of the chunk, then their ids
+        std::vector<std::string> materialNames;
+        std::vector<uint32_t> materialIds;
+        //Material in use at the start of the chunk
+        uint32_t startMaterial = 0;
+        //Triangle corners of every material
+        std::vector<std::vector<ObjCorner>> corners;
+        bool valid = true;
+    };
+
+    enum ObjElement
+    {
+        OBJ_POSITION = 0,
+        OBJ_TEXCOORD = 1,
+        OBJ_NORMAL = 2
+    };
+
+    template<typename Function>
+    static void ForEach(JobSystem* jobSystem, size_t count, size_t batchSize, Function&& function)
+    {
+        if (jobSystem)
+            jobSystem->ParallelFor(count, batchSize, function);
+        else
+            function(0, count);
+    }
+
+    static const char* SkipBlanks(const char* cursor, const char* end)
+    {
+        while (cursor < end && (*cursor == ' ' || *cursor == '\t'))
+            cursor++;
+        return cursor;
+    }
+
+    /// @brief Returns the position of the line feed ending the line, or end
+    static const char* FindLineEnd(const char* cursor, const char* end)
+    {
+        const void* feed = std::memchr(cursor, '\n', static_cast<size_t>(end - cursor));
+        return feed ? static_cast<const char*>(feed) : end;
+    }
+
+    /// @brief True when the line starts with the keyword followed by a blank
+    static bool IsKeyword(const char* cursor, const char* lineEnd, const char* keyword)
+    {
+        size_t length = std::strlen(keyword);
+        return static_cast<size_t>(lineEnd - cursor) > length && std::memcmp(cursor, keyword, length) == 0
+        && (cursor[length] == ' ' || cursor[length] == '\t');
+    }
+
+    static bool ParseFloat(const char*& cursor, const char* end, float& value)
+    {
+        cursor = SkipBlanks(cursor, end);
+        if (cursor < end && *cursor == '+')
+            cursor++;
+        auto result = std::from_chars(cursor, end, value);
+        if (result.ec != std::errc())
+            return false;
+        cursor = result.ptr;
+        return true;
+    }
+
+    /// @brief Parses a 1 based index, or a negative one relative to the elements declared before the line
+    /// @param before The elements declared before the line
+    /// @param total The elements declared by the whole file
+    /// @param index The 0 based index
+    static bool ParseIndex(const char*& cursor, const char* end, size_t before, size_t total, uint32_t& index)
+    {
+        long long value = 0;
+        auto result = std::from_chars(cursor, end, value);
+        if (result.ec != std::errc() || value == 0)
+            return false;
+        cursor = result.ptr;
+        long long resolved = value > 0 ? value - 1 : static_cast<long long>(before) + value;
+        if (resolved < 0 || resolved >= static_cast<long long>(total))
+            return false;
+        index = static_cast<uint32_t>(resolved);
+        return true;
+    }
+
+    /// @brief Parses a corner of a face: position, position/uv, position//normal or position/uv/normal
+    static bool ParseCorner(const char*& cursor, const char* end, const size_t (&before)[3], const size_t (&totals)[3],
+    ObjCorner& corner)
+    {
+        if (!ParseIndex(cursor, end, before[OBJ_POSITION], totals[OBJ_POSITION], corner.position))
+            return false;
+        corner.texCoord = OBJ_MISSING;
+        corner.normal = OBJ_MISSING;
+        if (cursor < end && *cursor == '/')
+        {
+            cursor++;
+            if (cursor < end && *cursor != '/'
+            && !ParseIndex(cursor, end, before[OBJ_TEXCOORD], totals[OBJ_TEXCOORD], corner.texCoord))
+                return false;
+            if (cursor < end && *cursor == '/')
+            {
+                cursor++;
+                if (!ParseIndex(cursor, end, before[OBJ_NORMAL], totals[OBJ_NORMAL], corner.normal))
+                    return false;
+            }
+        }
+        //The corners are separated by blanks
+        return cursor == end || *cursor == ' ' || *cursor == '\t';
+    }
+
+    /// @brief Calls function with the start and the end of every line of the chunk, without the line feed
+    /// and the carriage return. Stops when function returns false
+    template<typename LineFunction>
+    static void ForEachLine(const ObjChunk& chunk, LineFunction function)
+    {
+        const char* cursor = chunk.begin;
+        while (cursor < chunk.end)
+        {
+            const char* lineEnd = FindLineEnd(cursor, chunk.end);
+            const char* next = lineEnd < chunk.end ? lineEnd + 1 : lineEnd;
+            if (lineEnd > cursor && lineEnd[-1] == '\r')
+                lineEnd--;
+            if (!function(SkipBlanks(cursor, lineEnd), lineEnd))
+                return;
+            cursor = next;
+        }
+    }
+
+    /// @brief First pass: counts the elements of the chunk and collects its materials, so every chunk
+    /// knows where its elements go before they are parsed
+    static void ScanChunk(ObjChunk& chunk)
+    {
+        ForEachLine(chunk, [&](const char* cursor, const char* lineEnd)
+        {
+            if (cursor == lineEnd || *cursor == '#')
+                return true;
+            //Free-form geometry and continued lines are left to Assimp
+            if (lineEnd[-1] == '\\' || IsKeyword(cursor, lineEnd, "cstype"))
+            {
+                chunk.valid = false;
+                return false;
+            }
+            if (IsKeyword(cursor, lineEnd, "v"))
+                chunk.counts[OBJ_POSITION]++;
+            else if (IsKeyword(cursor, lineEnd, "vt"))
+                chunk.counts[OBJ_TEXCOORD]++;
+            else if (IsKeyword(cursor, lineEnd, "vn"))
+                chunk.counts[OBJ_NORMAL]++;
+            else if (IsKeyword(cursor, lineEnd, "usemtl"))
+            {
+                const char* name = SkipBlanks(cursor + 6, lineEnd);
+                const char* nameEnd = lineEnd;
+                while (nameEnd > name && (nameEnd[-1] == ' ' || nameEnd[-1] == '\t'))
+                    nameEnd--;
+                chunk.materialNames.emplace_back(name, nameEnd);
+            }
+            return true;
+        });
+    }
+
+    /// @brief Second pass: writes the elements of the chunk at their place in the file arrays and
+    /// triangulates its faces
+    static void ParseChunk(ObjChunk& chunk, const size_t (&totals)[3], size_t materialCount, glm::vec3* positions,
+    glm::vec2* texCoords, glm::vec3* normals)
+    {
+        chunk.corners.resize(materialCount);
+        size_t before[3] = {chunk.bases[0], chunk.bases[1], chunk.bases[2]};
+        uint32_t material = chunk.startMaterial;
+        size_t materialLine = 0;
+        std::vector<ObjCorner> polygon;
+        ForEachLine(chunk, [&](const char* cursor, const char* lineEnd)
+        {
+            bool valid = true;
+            if (IsKeyword(cursor, lineEnd, "v"))
+            {
+                glm::vec3& position = positions[before[OBJ_POSITION]++];
+                cursor += 1;
+                valid = ParseFloat(cursor, lineEnd, position.x) && ParseFloat(cursor, lineEnd, position.y)
+                && ParseFloat(cursor, lineEnd, position.z);
+            }
+            else if (IsKeyword(cursor, lineEnd, "vt"))
+            {
+                glm::vec2& texCoord = texCoords[before[OBJ_TEXCOORD]++];
+                cursor += 2;
+                texCoord.y = 0.0f;
+                valid = ParseFloat(cursor, lineEnd, texCoord.x);
+                //The second coordinate is optional, then flipped like aiProcess_FlipUVs does
+                if (valid && SkipBlanks(cursor, lineEnd) < lineEnd)
+                    valid = ParseFloat(cursor, lineEnd, texCoord.y);
+                texCoord.y = 1.0f - texCoord.y;
+            }
+            else if (IsKeyword(cursor, lineEnd, "vn"))
+            {
+                glm::vec3& normal = normals[before[OBJ_NORMAL]++];
+                cursor += 2;
+                valid = ParseFloat(cursor, lineEnd, normal.x) && ParseFloat(cursor, lineEnd, normal.y)
+                && ParseFloat(cursor, lineEnd, normal.z);
+            }
+            else if (IsKeyword(cursor, lineEnd, "f"))
+            {
+                polygon.clear();
+                cursor = SkipBlanks(cursor + 1, lineEnd);
+                while (valid && cursor < lineEnd)
+                {
+                    ObjCorner corner;
+                    valid = ParseCorner(cursor, lineEnd, before, totals, corner);
+                    polygon.emplace_back(corner);
+                    cursor = SkipBlanks(cursor, lineEnd);
+                }
+                //Faces with less than three corners are points and lines, which aren't drawn
+                std::vector<ObjCorner>& corners = chunk.corners[material];
+                for (size_t i = 1; valid && i + 1 < polygon.size(); i++)
+                {
+                    corners.emplace_back(polygon[0]);
+                    corners.emplace_back(polygon[i]);
+                    corners.emplace_back(polygon[i + 1]);
+                }
+            }
+            else if (IsKeyword(cursor, lineEnd, "usemtl"))
+            {
+                material = chunk.materialIds[materialLine++];
+            }
+            chunk.valid = valid;
+            return valid;
+        });
+    }
+
+    /// @brief Mixes the bits of a hash, so its low bits can pick the shard and the slot
+    static uint64_t MixHash(uint64_t hash)
+    {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        return hash ^ (hash >> 33);
+    }
+
+    /// @brief Points every element to the first element equal to it. The elements are split in shards by
+    /// hash and every shard fills its own open addressing table, so the result doesn't depend on the threads
+    /// @param hashes The mixed hash of every element
+    /// @param equal Compares two elements by index
+    /// @param firstEqual Receives the index of the first element equal to each element, itself when unique
+    template<typename EqualFunction>
+    static void FindFirstEqual(const std::vector<uint64_t>& hashes, EqualFunction equal, JobSystem* jobSystem,
+    std::vector<uint32_t>& firstEqual)
+    {
+        size_t count = hashes.size();
+        size_t shardCount = jobSystem ? jobSystem->ThreadCount() : 1;
+        firstEqual.resize(count);
+        if (count == 0)
+            return;
+
+        /*The elements are bucketed by shard once: every chunk counts its elements of each shard, the prefix sum
+        gives each chunk its place in the list of every shard, then the chunks scatter their indices there*/
+        size_t chunkCount = shardCount;
+        size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+        std::vector<size_t> chunkOffsets(chunkCount * shardCount, 0);
+        ForEach(jobSystem, chunkCount, 1, [&](size_t begin, size_t end)
+        {
+            for (size_t chunk = begin; chunk < end; chunk++)
+            {
+                size_t* chunkCounts = &chunkOffsets[chunk * shardCount];
+                for (size_t i = chunk * chunkSize; i < std::min(count, (chunk + 1) * chunkSize); i++)
+                    chunkCounts[hashes[i] % shardCount]++;
+            }
+        });
+        //Shard by shard and chunk by chunk, so every shard lists its elements in increasing order
+        std::vector<size_t> shardStarts(shardCount + 1, 0);
+        size_t offset = 0;
+        for (size_t shard = 0; shard < shardCount; shard++)
+        {
+            shardStarts[shard] = offset;
+            for (size_t chunk = 0; chunk < chunkCount; chunk++)
+            {
+                size_t chunkElements = chunkOffsets[chunk * shardCount + shard];
+                chunkOffsets[chunk * shardCount + shard] = offset;
+                offset += chunkElements;
+            }
+        }
+        shardStarts[shardCount] = offset;
+        std::vector<uint32_t> shardElements(count);
+        ForEach(jobSystem, chunkCount, 1, [&](size_t begin, size_t end)
+        {
+            for (size_t chunk = begin; chunk < end; chunk++)
+            {
+                size_t* chunkCursors = &chunkOffsets[chunk * shardCount];
+                for (size_t i = chunk * chunkSize; i < std::min(count, (chunk + 1) * chunkSize); i++)
+                    shardElements[chunkCursors[hashes[i] % shardCount]++] = static_cast<uint32_t>(i);
+            }
+        });
+
+        ForEach(jobSystem, shardCount, 1, [&](size_t begin, size_t end)
+        {
+            for (size_t shard = begin; shard < end; shard++)
+            {
+                size_t tableSize = 16;
+                while (tableSize < (shardStarts[shard + 1] - shardStarts[shard]) * 2)
+                    tableSize *= 2;
+                std::vector<uint32_t> table(tableSize, OBJ_MISSING);
+                for (size_t element = shardStarts[shard]; element < shardStarts[shard + 1]; element++)
+                {
+                    uint32_t i = shardElements[element];
+                    size_t slot = (hashes[i] / shardCount) & (tableSize - 1);
+                    while (true)
+                    {
+                        uint32_t candidate = table[slot];
+                        if (candidate == OBJ_MISSING)
+                        {
+                            table[slot] = i;
+                            firstEqual[i] = i;
+                            break;
+                        }
+                        if (hashes[candidate] == hashes[i] && equal(candidate, i))
+                        {
+                            firstEqual[i] = candidate;
+                            break;
+                        }
+                        slot = (slot + 1) & (tableSize - 1);
+                    }
+                }
+            }
+        });
+    }
+
+    /// @brief Builds the vertices and the indices of a mesh from its corners, merging the identical vertices.
+    /// The corners repeating the same indices are merged first, then the remaining vertices are merged by
+    /// value with the hash of Mesh::Vertex. The vertices keep the order of their first corner
+    static void MergeVertices(const std::vector<ObjCorner>& corners, const std::vector<glm::vec3>& positions,
+    const std::vector<glm::vec2>& texCoords, const std::vector<glm::vec3>& normals, JobSystem* jobSystem, Mesh& mesh)
+    {
+        auto makeVertex = [&](const ObjCorner& corner)
+        {
+            Mesh::Vertex vertex;
+            vertex.pos = positions[corner.position];
+            vertex.normal = corner.normal != OBJ_MISSING ? normals[corner.normal] : glm::vec3(0.0f);
+            vertex.texCoord = corner.texCoord != OBJ_MISSING ? texCoords[corner.texCoord] : glm::vec2(0.0f);
+            for (int i = 0; i < MAX_BONE_PER_VERTEX; i++)
+            {
+                vertex.boneID[i] = -1;
+                vertex.weight[i] = 0.0f;
+            }
+            return vertex;
+        };
+
+        size_t cornerCount = corners.size();
+        std::vector<uint64_t> hashes(cornerCount);
+        ForEach(jobSystem, cornerCount, OBJ_HASH_BATCH, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                const ObjCorner& corner = corners[i];
+                hashes[i] = MixHash((static_cast<uint64_t>(corner.position) << 32 | corner.texCoord) ^ MixHash(corner.normal));
+            }
+        });
+        std::vector<uint32_t> firstCorners;
+        FindFirstEqual(hashes, [&](size_t a, size_t b)
+        {
+            return corners[a].position == corners[b].position && corners[a].texCoord == corners[b].texCoord
+            && corners[a].normal == corners[b].normal;
+        }, jobSystem, firstCorners);
+
+        std::vector<uint32_t> uniqueCorners;
+        for (size_t i = 0; i < cornerCount; i++)
+        {
+            if (firstCorners[i] == i)
+                uniqueCorners.emplace_back(static_cast<uint32_t>(i));
+        }
+        hashes.resize(uniqueCorners.size());
+        ForEach(jobSystem, uniqueCorners.size(), OBJ_HASH_BATCH, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+                hashes[i] = MixHash(std::hash<Mesh::Vertex>()(makeVertex(corners[uniqueCorners[i]])));
+        });
+        std::vector<uint32_t> firstVertices;
+        FindFirstEqual(hashes, [&](size_t a, size_t b)
+        {
+            return makeVertex(corners[uniqueCorners[a]]) == makeVertex(corners[uniqueCorners[b]]);
+        }, jobSystem, firstVertices);
+
+        size_t vertexCount = 0;
+        for (size_t i = 0; i < uniqueCorners.size(); i++)
+            vertexCount += firstVertices[i] == i;
+        mesh.vertices.reserve(vertexCount);
+        mesh.indices.resize(cornerCount);
+        //Every corner comes after the corner it points to, whose index is already final
+        size_t unique = 0;
+        for (size_t i = 0; i < cornerCount; i++)
+        {
+            if (firstCorners[i] != i)
+            {
+                mesh.indices[i] = mesh.indices[firstCorners[i]];
+                continue;
+            }
+            if (firstVertices[unique] == unique)
+            {
+                mesh.indices[i] = static_cast<uint32_t>(mesh.vertices.size());
+                mesh.vertices.emplace_back(makeVertex(corners[i]));
+            }
+            else
+            {
+                mesh.indices[i] = mesh.indices[uniqueCorners[firstVertices[unique]]];
+            }
+            unique++;
+        }
+        mesh.typeOfMesh = Mesh::MeshType::Static;
+    }
+
+    bool LoadObj(const std::string& path, JobSystem* jobSystem, std::vector<Mesh>& meshes)
+    {
+        MappedFile file;
+        if (!file.Open(path))
+            return false;
+        const char* data = reinterpret_cast<const char*>(file.Data());
+        const char* fileEnd = data + file.Size();
+
+        std::vector<ObjChunk> chunks;
+        for (const char* cursor = data; cursor < fileEnd;)
+        {
+            ObjChunk chunk;
+            chunk.begin = cursor;
+            chunk.end = cursor + std::min(OBJ_CHUNK_SIZE, static_cast<size_t>(fileEnd - cursor));
+            if (chunk.end < fileEnd)
+                chunk.end = std::min(FindLineEnd(chunk.end, fileEnd) + 1, fileEnd);
+            cursor = chunk.end;
+            chunks.emplace_back(std::move(chunk));
+        }
+        ForEach(jobSystem, chunks.size(), 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+                ScanChunk(chunks[i]);
+        });
+
+        //Material 0 holds the faces before the first usemtl
+        std::vector<std::string> materials(1);
+        std::unordered_map<std::string, uint32_t> materialIds;
+        size_t totals[3] = {};
+        uint32_t material = 0;
+        for (auto& chunk : chunks)
+        {
+            if (!chunk.valid)
+                return false;
+            for (int element = 0; element < 3; element++)
+            {
+                chunk.bases[element] = totals[element];
+                totals[element] += chunk.counts[element];
+            }
+            chunk.startMaterial = material;
+            for (const auto& name : chunk.materialNames)
+            {
+                auto inserted = materialIds.emplace(name, static_cast<uint32_t>(materials.size()));
+                if (inserted.second)
+                    materials.emplace_back(name);
+                material = inserted.first->second;
+                chunk.materialIds.emplace_back(material);
+            }
+        }
+        //The corners and the vertex table index with 32 bits
+        if (totals[OBJ_POSITION] == 0 || totals[OBJ_POSITION] >= OBJ_MISSING || totals[OBJ_TEXCOORD] >= OBJ_MISSING
+        || totals[OBJ_NORMAL] >= OBJ_MISSING)
+            return false;
+
+        std::vector<glm::vec3> positions(totals[OBJ_POSITION]);
+        std::vector<glm::vec2> texCoords(totals[OBJ_TEXCOORD]);
+        std::vector<glm::vec3> normals(totals[OBJ_NORMAL]);
+        ForEach(jobSystem, chunks.size(), 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+                ParseChunk(chunks[i], totals, materials.size(), positions.data(), texCoords.data(), normals.data());
+        });
+
+        for (const auto& chunk : chunks)
+        {
+            if (!chunk.valid)
+                return false;
+        }
+
+        std::vector<Mesh> loaded;
+        for (size_t i = 0; i < materials.size(); i++)
+        {
+            size_t cornerCount = 0;
+            for (const auto& chunk : chunks)
+                cornerCount += chunk.corners[i].size();
+            if (cornerCount == 0)
+                continue;
+            if (cornerCount >= OBJ_MISSING)
+                return false;
+            std::vector<ObjCorner> corners;
+            corners.reserve(cornerCount);
+            for (auto& chunk : chunks)
+            {
+                corners.insert(corners.end(), chunk.corners[i].begin(), chunk.corners[i].end());
+                std::vector<ObjCorner>().swap(chunk.corners[i]);
+            }
+            Mesh mesh;
+            MergeVertices(corners, positions, texCoords, normals, jobSystem, mesh);
+            loaded.emplace_back(std::move(mesh));
+        }
+        for (auto& mesh : loaded)
+            meshes.emplace_back(std::move(mesh));
+        return true;
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "Mesh.h"
+
+namespace Minerva
+{
+    class JobSystem;
+
+    //Bytes of the file parsed by a single job, the chunks are split on line boundaries
+    constexpr size_t OBJ_CHUNK_SIZE = 1 << 20;
+
+    /// @brief Reads the polygons of a Wavefront OBJ file straight into static meshes, without the scene graph
+    /// of Assimp. The file is mapped and parsed in chunks by the job system, the polygons are triangulated
+    /// as fans and the identical vertices are merged. The meshes match the Assimp import with
+    /// aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices, one mesh per material
+    /// @param path The path of the file
+    /// @param jobSystem Parses the chunks and merges the vertices in parallel, null parses on the calling thread
+    /// @param meshes Receives the meshes, in order of first use of their material
+    /// @return False, leaving meshes untouched, when the file can't be mapped, is malformed or uses the
+    /// free-form geometry only Assimp reads
+    bool LoadObj(const std::string& path, JobSystem* jobSystem, std::vector<Mesh>& meshes);
+}
@@ -0,0 +1,458 @@
+#include "PoseKernels.h"
+#include <cmath>
+#include <algorithm>
+#if defined(MINERVA_SSE) || defined(MINERVA_AVX2)
+#include <immintrin.h>
+#endif
+
+namespace Minerva
+{
+    void TrsKeys::Resize(size_t boneCount)
+    {
+        count = boneCount;
+        size_t paddedCount = (boneCount + POSE_BATCH_WIDTH - 1) / POSE_BATCH_WIDTH * POSE_BATCH_WIDTH;
+        if (positionFactor.size() >= paddedCount)
+            return;
+
+        //The padding lanes hold identity keys, so the kernels never normalize a zero quaternion
+        for (int axis = 0; axis < 3; axis++)
+        {
+            position0[axis].resize(paddedCount, 0.0f);
+            position1[axis].resize(paddedCount, 0.0f);
+            scale0[axis].resize(paddedCount, 1.0f);
+            scale1[axis].resize(paddedCount, 1.0f);
+        }
+        for (int axis = 0; axis < 4; axis++)
+        {
+            rotation0[axis].resize(paddedCount, axis == 3 ? 1.0f : 0.0f);
+            rotation1[axis].resize(paddedCount, axis == 3 ? 1.0f : 0.0f);
+        }
+        positionFactor.resize(paddedCount, 0.0f);
+        rotationFactor.resize(paddedCount, 0.0f);
+        scaleFactor.resize(paddedCount, 0.0f);
+    }
+
+    void TrsKeys::SetConstant(size_t lane, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            position0[axis][lane] = position1[axis][lane] = position[axis];
+            scale0[axis][lane] = scale1[axis][lane] = scale[axis];
+        }
+        //glm stores the quaternions as x, y, z, w
+        for (int axis = 0; axis < 4; axis++)
+            rotation0[axis][lane] = rotation1[axis][lane] = rotation[axis];
+        positionFactor[lane] = rotationFactor[lane] = scaleFactor[lane] = 0.0f;
+    }
+
+    void TrsKeys::Clear()
+    {
+        //The second keys only need to be finite, a zero factor ignores them
+        for (int axis = 0; axis < 3; axis++)
+        {
+            std::fill(position0[axis].begin(), position0[axis].end(), 0.0f);
+            std::fill(scale0[axis].begin(), scale0[axis].end(), 0.0f);
+        }
+        for (int axis = 0; axis < 4; axis++)
+            std::fill(rotation0[axis].begin(), rotation0[axis].end(), 0.0f);
+        std::fill(positionFactor.begin(), positionFactor.end(), 0.0f);
+        std::fill(rotationFactor.begin(), rotationFactor.end(), 0.0f);
+        std::fill(scaleFactor.begin(), scaleFactor.end(), 0.0f);
+    }
+
+    TrsKeys &PosePool::Acquire(size_t boneCount)
+    {
+        if (used == buffers.size())
+            buffers.emplace_back(std::make_unique<TrsKeys>());
+        TrsKeys& buffer = *buffers[used++];
+        buffer.Resize(boneCount);
+        return buffer;
+    }
+
+    void PosePool::Release(size_t count)
+    {
+        used -= std::min(count, used);
+    }
+
+    PosePool &PosePool::ForThisThread()
+    {
+        thread_local PosePool pool;
+        return pool;
+    }
+
+    /*Adjusts the nlerp factor so the blended rotation follows slerp. The polynomial fit depends on the
+    cosine of the angle between the quaternions (see "Approximating slerp", A. Kapoulkine)*/
+    static float CorrectNlerpFactor(float t, float cosine)
+    {
+        float d = std::fabs(cosine);
+        float A = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+        float B = 0.848013f + d * (-1.06021f + d * 0.215638f);
+        float k = A * (t - 0.5f) * (t - 0.5f) + B;
+        return t + t * (t - 0.5f) * (t - 1.0f) * k;
+    }
+
+    /// @brief Interpolates the keys of bone i, the rotation is normalized
+    static void InterpolateKeysScalar(const TrsKeys &keys, size_t i, NlerpAccuracy accuracy, 
+    float* position, float* rotation, float* scale)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            position[axis] = keys.position0[axis][i] +
+            (keys.position1[axis][i] - keys.position0[axis][i]) * keys.positionFactor[i];
+            scale[axis] = keys.scale0[axis][i] +
+            (keys.scale1[axis][i] - keys.scale0[axis][i]) * keys.scaleFactor[i];
+        }
+
+        //Takes the shortest path flipping the second quaternion when needed
+        float cosine = 0.0f;
+        for (int axis = 0; axis < 4; axis++)
+            cosine += keys.rotation0[axis][i] * keys.rotation1[axis][i];
+        float sign = cosine < 0.0f ? -1.0f : 1.0f;
+        float t = keys.rotationFactor[i];
+        if (accuracy == NlerpAccuracy::Corrected)
+            t = CorrectNlerpFactor(t, cosine);
+
+        float lengthSquared = 0.0f;
+        for (int axis = 0; axis < 4; axis++)
+        {
+            rotation[axis] = keys.rotation0[axis][i] +
+            (sign * keys.rotation1[axis][i] - keys.rotation0[axis][i]) * t;
+            lengthSquared += rotation[axis] * rotation[axis];
+        }
+        float inverseLength = 1.0f / std::sqrt(lengthSquared);
+        for (int axis = 0; axis < 4; axis++)
+            rotation[axis] *= inverseLength;
+    }
+
+    void ComposeTrsScalar(const TrsKeys &keys, Affine3x4 *output, NlerpAccuracy accuracy)
+    {
+        for (size_t i = 0; i < keys.count; i++)
+        {
+            float position[3], scale[3], rotation[4];
+            InterpolateKeysScalar(keys, i, accuracy, position, rotation, scale);
+            float x = rotation[0], y = rotation[1], z = rotation[2], w = rotation[3];
+
+            Affine3x4& affine = output[i];
+            affine.rows[0] = glm::vec4((1.0f - 2.0f * (y * y + z * z)) * scale[0],
+            2.0f * (x * y - w * z) * scale[1], 2.0f * (x * z + w * y) * scale[2], position[0]);
+            affine.rows[1] = glm::vec4(2.0f * (x * y + w * z) * scale[0],
+            (1.0f - 2.0f * (x * x + z * z)) * scale[1], 2.0f * (y * z - w * x) * scale[2], position[1]);
+            affine.rows[2] = glm::vec4(2.0f * (x * z - w * y) * scale[0],
+            2.0f * (y * z + w * x) * scale[1], (1.0f - 2.0f * (x * x + y * y)) * scale[2], position[2]);
+        }
+    }
+
+    void AccumulateTrsScalar(const TrsKeys &keys, float weight, TrsKeys &accumulated, NlerpAccuracy accuracy)
+    {
+        for (size_t i = 0; i < keys.count; i++)
+        {
+            float position[3], scale[3], rotation[4];
+            InterpolateKeysScalar(keys, i, accuracy, position, rotation, scale);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                accumulated.position0[axis][i] += position[axis] * weight;
+                accumulated.scale0[axis][i] += scale[axis] * weight;
+            }
+
+            float cosine = 0.0f;
+            for (int axis = 0; axis < 4; axis++)
+                cosine += accumulated.rotation0[axis][i] * rotation[axis];
+            float signedWeight = cosine < 0.0f ? -weight : weight;
+            for (int axis = 0; axis < 4; axis++)
+                accumulated.rotation0[axis][i] += rotation[axis] * signedWeight;
+        }
+    }
+
+#if defined(MINERVA_SSE)
+    /// @brief SSE operations used by ComposeTrsWide, 4 bones at once
+    struct SseOps
+    {
+        using V = __m128;
+        static constexpr size_t WIDTH = 4;
+        static V Load(const float* p) { return _mm_loadu_ps(p); }
+        static void Store(float* p, V a) { _mm_storeu_ps(p, a); }
+        static V Set(float value) { return _mm_set1_ps(value); }
+        static V Add(V a, V b) { return _mm_add_ps(a, b); }
+        static V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+        static V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+        static V Div(V a, V b) { return _mm_div_ps(a, b); }
+        static V Sqrt(V a) { return _mm_sqrt_ps(a); }
+        static V SignBit(V a) { return _mm_and_ps(a, _mm_set1_ps(-0.0f)); }
+        static V Xor(V a, V b) { return _mm_xor_ps(a, b); }
+        static V Abs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+        /// @brief Transposes the SoA terms of one matrix row into the rows of 4 affine transforms
+        static void StoreRow(V m0, V m1, V m2, V translation, int row, Affine3x4* output)
+        {
+            _MM_TRANSPOSE4_PS(m0, m1, m2, translation);
+            _mm_storeu_ps(&output[0].rows[row].x, m0);
+            _mm_storeu_ps(&output[1].rows[row].x, m1);
+            _mm_storeu_ps(&output[2].rows[row].x, m2);
+            _mm_storeu_ps(&output[3].rows[row].x, translation);
+        }
+    };
+#endif
+
+#if defined(MINERVA_AVX2)
+    /// @brief AVX2 operations used by ComposeTrsWide, 8 bones at once
+    struct Avx2Ops
+    {
+        using V = __m256;
+        static constexpr size_t WIDTH = 8;
+        static V Load(const float* p) { return _mm256_loadu_ps(p); }
+        static void Store(float* p, V a) { _mm256_storeu_ps(p, a); }
+        static V Set(float value) { return _mm256_set1_ps(value); }
+        static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+        static V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+        static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+        static V Div(V a, V b) { return _mm256_div_ps(a, b); }
+        static V Sqrt(V a) { return _mm256_sqrt_ps(a); }
+        static V SignBit(V a) { return _mm256_and_ps(a, _mm256_set1_ps(-0.0f)); }
+        static V Xor(V a, V b) { return _mm256_xor_ps(a, b); }
+        static V Abs(V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+        static void StoreRow(V m0, V m1, V m2, V translation, int row, Affine3x4* output)
+        {
+            V low01 = _mm256_unpacklo_ps(m0, m1);
+            V high01 = _mm256_unpackhi_ps(m0, m1);
+            V low2t = _mm256_unpacklo_ps(m2, translation);
+            V high2t = _mm256_unpackhi_ps(m2, translation);
+            //Every 128 bit half holds the row of one bone: lanes 0-3 in the low halves, 4-7 in the high ones
+            V bones04 = _mm256_shuffle_ps(low01, low2t, 0x44);
+            V bones15 = _mm256_shuffle_ps(low01, low2t, 0xEE);
+            V bones26 = _mm256_shuffle_ps(high01, high2t, 0x44);
+            V bones37 = _mm256_shuffle_ps(high01, high2t, 0xEE);
+            _mm_storeu_ps(&output[0].rows[row].x, _mm256_castps256_ps128(bones04));
+            _mm_storeu_ps(&output[1].rows[row].x, _mm256_castps256_ps128(bones15));
+            _mm_storeu_ps(&output[2].rows[row].x, _mm256_castps256_ps128(bones26));
+            _mm_storeu_ps(&output[3].rows[row].x, _mm256_castps256_ps128(bones37));
+            _mm_storeu_ps(&output[4].rows[row].x, _mm256_extractf128_ps(bones04, 1));
+            _mm_storeu_ps(&output[5].rows[row].x, _mm256_extractf128_ps(bones15, 1));
+            _mm_storeu_ps(&output[6].rows[row].x, _mm256_extractf128_ps(bones26, 1));
+            _mm_storeu_ps(&output[7].rows[row].x, _mm256_extractf128_ps(bones37, 1));
+        }
+    };
+#endif
+
+#if defined(MINERVA_SSE) || defined(MINERVA_AVX2)
+    /// @brief Interpolates the keys of the Ops::WIDTH bones starting from bone i, the rotations are normalized
+    template<typename Ops>
+    static void InterpolateKeysBatch(const TrsKeys &keys, size_t i, NlerpAccuracy accuracy, 
+    typename Ops::V* position, typename Ops::V* rotation, typename Ops::V* scale)
+    {
+        using V = typename Ops::V;
+        const V one = Ops::Set(1.0f), half = Ops::Set(0.5f);
+        V positionT = Ops::Load(&keys.positionFactor[i]);
+        V scaleT = Ops::Load(&keys.scaleFactor[i]);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            V p0 = Ops::Load(&keys.position0[axis][i]);
+            position[axis] = Ops::Add(p0, Ops::Mul(Ops::Sub(Ops::Load(&keys.position1[axis][i]), p0), positionT));
+            V s0 = Ops::Load(&keys.scale0[axis][i]);
+            scale[axis] = Ops::Add(s0, Ops::Mul(Ops::Sub(Ops::Load(&keys.scale1[axis][i]), s0), scaleT));
+        }
+
+        V q0[4], q1[4];
+        V cosine = Ops::Set(0.0f);
+        for (int axis = 0; axis < 4; axis++)
+        {
+            q0[axis] = Ops::Load(&keys.rotation0[axis][i]);
+            q1[axis] = Ops::Load(&keys.rotation1[axis][i]);
+            cosine = Ops::Add(cosine, Ops::Mul(q0[axis], q1[axis]));
+        }
+        V sign = Ops::SignBit(cosine);
+        V t = Ops::Load(&keys.rotationFactor[i]);
+        if (accuracy == NlerpAccuracy::Corrected)
+        {
+            V d = Ops::Abs(cosine);
+            V A = Ops::Add(Ops::Set(1.0904f), Ops::Mul(d, Ops::Add(Ops::Set(-3.2452f),
+            Ops::Mul(d, Ops::Sub(Ops::Set(3.55645f), Ops::Mul(d, Ops::Set(1.43519f)))))));
+            V B = Ops::Add(Ops::Set(0.848013f), Ops::Mul(d, Ops::Add(Ops::Set(-1.06021f),
+            Ops::Mul(d, Ops::Set(0.215638f)))));
+            V centered = Ops::Sub(t, half);
+            V k = Ops::Add(Ops::Mul(A, Ops::Mul(centered, centered)), B);
+            t = Ops::Add(t, Ops::Mul(Ops::Mul(t, Ops::Mul(centered, Ops::Sub(t, one))), k));
+        }
+
+        V q[4];
+        V lengthSquared = Ops::Set(0.0f);
+        for (int axis = 0; axis < 4; axis++)
+        {
+            q[axis] = Ops::Add(q0[axis], Ops::Mul(Ops::Sub(Ops::Xor(q1[axis], sign), q0[axis]), t));
+            lengthSquared = Ops::Add(lengthSquared, Ops::Mul(q[axis], q[axis]));
+        }
+        V inverseLength = Ops::Div(one, Ops::Sqrt(lengthSquared));
+        for (int axis = 0; axis < 4; axis++)
+            rotation[axis] = Ops::Mul(q[axis], inverseLength);
+    }
+
+    /// @brief Evaluates the Ops::WIDTH bones starting from bone i
+    template<typename Ops>
+    static void ComposeTrsBatch(const TrsKeys &keys, size_t i, Affine3x4 *output, NlerpAccuracy accuracy)
+    {
+        using V = typename Ops::V;
+        const V one = Ops::Set(1.0f), two = Ops::Set(2.0f);
+        V position[3], rotation[4], scale[3];
+        InterpolateKeysBatch<Ops>(keys, i, accuracy, position, rotation, scale);
+        V x = rotation[0], y = rotation[1], z = rotation[2], w = rotation[3];
+
+        V xx = Ops::Mul(x, x), yy = Ops::Mul(y, y), zz = Ops::Mul(z, z);
+        V xy = Ops::Mul(x, y), xz = Ops::Mul(x, z), yz = Ops::Mul(y, z);
+        V wx = Ops::Mul(w, x), wy = Ops::Mul(w, y), wz = Ops::Mul(w, z);
+
+        Ops::StoreRow(Ops::Mul(Ops::Sub(one, Ops::Mul(two, Ops::Add(yy, zz))), scale[0]),
+        Ops::Mul(Ops::Mul(two, Ops::Sub(xy, wz)), scale[1]),
+        Ops::Mul(Ops::Mul(two, Ops::Add(xz, wy)), scale[2]), position[0], 0, output);
+        Ops::StoreRow(Ops::Mul(Ops::Mul(two, Ops::Add(xy, wz)), scale[0]),
+        Ops::Mul(Ops::Sub(one, Ops::Mul(two, Ops::Add(xx, zz))), scale[1]),
+        Ops::Mul(Ops::Mul(two, Ops::Sub(yz, wx)), scale[2]), position[1], 1, output);
+        Ops::StoreRow(Ops::Mul(Ops::Mul(two, Ops::Sub(xz, wy)), scale[0]),
+        Ops::Mul(Ops::Mul(two, Ops::Add(yz, wx)), scale[1]),
+        Ops::Mul(Ops::Sub(one, Ops::Mul(two, Ops::Add(xx, yy))), scale[2]), position[2], 2, output);
+    }
+
+    /// @brief The SIMD version of AccumulateTrsScalar. The key arrays are padded, so the last batch 
+    /// is processed whole: the padding lanes accumulate identity keys
+    template<typename Ops>
+    static void AccumulateTrsWide(const TrsKeys &keys, float weight, TrsKeys &accumulated, NlerpAccuracy accuracy)
+    {
+        using V = typename Ops::V;
+        const V weights = Ops::Set(weight);
+        for (size_t i = 0; i < keys.count; i += Ops::WIDTH)
+        {
+            V position[3], rotation[4], scale[3];
+            InterpolateKeysBatch<Ops>(keys, i, accuracy, position, rotation, scale);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                float* accumulatedPosition = &accumulated.position0[axis][i];
+                Ops::Store(accumulatedPosition, Ops::Add(Ops::Load(accumulatedPosition), Ops::Mul(position[axis], weights)));
+                float* accumulatedScale = &accumulated.scale0[axis][i];
+                Ops::Store(accumulatedScale, Ops::Add(Ops::Load(accumulatedScale), Ops::Mul(scale[axis], weights)));
+            }
+
+            V accumulatedRotation[4];
+            V cosine = Ops::Set(0.0f);
+            for (int axis = 0; axis < 4; axis++)
+            {
+                accumulatedRotation[axis] = Ops::Load(&accumulated.rotation0[axis][i]);
+                cosine = Ops::Add(cosine, Ops::Mul(accumulatedRotation[axis], rotation[axis]));
+            }
+            V signedWeights = Ops::Xor(weights, Ops::SignBit(cosine));
+            for (int axis = 0; axis < 4; axis++)
+            {
+                Ops::Store(&accumulated.rotation0[axis][i], 
+                Ops::Add(accumulatedRotation[axis], Ops::Mul(rotation[axis], signedWeights)));
+            }
+        }
+    }
+
+    /// @brief The SIMD version of ComposeTrsScalar, written once for every instruction set
+    template<typename Ops>
+    static void ComposeTrsWide(const TrsKeys &keys, Affine3x4 *output, NlerpAccuracy accuracy)
+    {
+        size_t i = 0;
+        for (; i + Ops::WIDTH <= keys.count; i += Ops::WIDTH)
+            ComposeTrsBatch<Ops>(keys, i, &output[i], accuracy);
+
+        //The key arrays are padded, so the last partial batch is evaluated whole and only the valid bones are copied
+        if (i < keys.count)
+        {
+            Affine3x4 tail[Ops::WIDTH];
+            ComposeTrsBatch<Ops>(keys, i, tail, accuracy);
+            for (size_t lane = 0; lane < keys.count - i; lane++)
+                output[i + lane] = tail[lane];
+        }
+    }
+#endif
+
+    void ComposeTrs(const TrsKeys &keys, Affine3x4 *output, NlerpAccuracy accuracy)
+    {
+#if defined(MINERVA_AVX2)
+        ComposeTrsWide<Avx2Ops>(keys, output, accuracy);
+#elif defined(MINERVA_SSE)
+        ComposeTrsWide<SseOps>(keys, output, accuracy);
+#else
+        ComposeTrsScalar(keys, output, accuracy);
+#endif
+    }
+
+    void AccumulateTrs(const TrsKeys &keys, float weight, TrsKeys &accumulated, NlerpAccuracy accuracy)
+    {
+#if defined(MINERVA_AVX2)
+        AccumulateTrsWide<Avx2Ops>(keys, weight, accumulated, accuracy);
+#elif defined(MINERVA_SSE)
+        AccumulateTrsWide<SseOps>(keys, weight, accumulated, accuracy);
+#else
+        AccumulateTrsScalar(keys, weight, accumulated, accuracy);
+#endif
+    }
+
+    const char* ComposeTrsPath()
+    {
+#if defined(MINERVA_AVX2)
+        return "AVX2";
+#elif defined(MINERVA_SSE)
+        return "SSE";
+#else
+        return "scalar";
+#endif
+    }
+
+    void MultiplyAffine(const Affine3x4 &parent, const Affine3x4 &local, Affine3x4 &output)
+    {
+#if defined(MINERVA_SSE)
+        __m128 localRow0 = _mm_loadu_ps(&local.rows[0].x);
+        __m128 localRow1 = _mm_loadu_ps(&local.rows[1].x);
+        __m128 localRow2 = _mm_loadu_ps(&local.rows[2].x);
+        //Adds the parent translation, the implicit last row of local is (0, 0, 0, 1)
+        const __m128 translationMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+        for (int row = 0; row < 3; row++)
+        {
+            __m128 parentRow = _mm_loadu_ps(&parent.rows[row].x);
+            __m128 result = _mm_mul_ps(_mm_shuffle_ps(parentRow, parentRow, 0x00), localRow0);
+            result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(parentRow, parentRow, 0x55), localRow1));
+            result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(parentRow, parentRow, 0xAA), localRow2));
+            result = _mm_add_ps(result, _mm_and_ps(parentRow, translationMask));
+            _mm_storeu_ps(&output.rows[row].x, result);
+        }
+#else
+        Affine3x4 result;
+        for (int row = 0; row < 3; row++)
+        {
+            const glm::vec4& parentRow = parent.rows[row];
+            result.rows[row] = parentRow.x * local.rows[0] + parentRow.y * local.rows[1] +
+            parentRow.z * local.rows[2] + glm::vec4(0.0f, 0.0f, 0.0f, parentRow.w);
+        }
+        output = result;
+#endif
+    }
+
+    Affine3x4 ToAffine(const glm::mat4 &matrix)
+    {
+        //glm matrices are column major
+        Affine3x4 affine;
+        for (int row = 0; row < 3; row++)
+            affine.rows[row] = glm::vec4(matrix[0][row], matrix[1][row], matrix[2][row], matrix[3][row]);
+        return affine;
+    }
+
+    void DecomposeAffine(const Affine3x4 &affine, glm::vec3 &position, glm::quat &rotation, glm::vec3 &scale)
+    {
+        glm::mat3 basis;
+        for (int column = 0; column < 3; column++)
+        {
+            glm::vec3 axis(affine.rows[0][column], affine.rows[1][column], affine.rows[2][column]);
+            scale[column] = glm::length(axis);
+            basis[column] = scale[column] > 0.0f ? axis / scale[column] : axis;
+        }
+        position = glm::vec3(affine.rows[0].w, affine.rows[1].w, affine.rows[2].w);
+        rotation = glm::normalize(glm::quat_cast(basis));
+    }
+
+    void StoreAffine(const Affine3x4 &affine, glm::mat4 &matrix)
+    {
+        for (int column = 0; column < 4; column++)
+        {
+            matrix[column] = glm::vec4(affine.rows[0][column], affine.rows[1][column],
+            affine.rows[2][column], column == 3 ? 1.0f : 0.0f);
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#if defined(__AVX2__)
+    #define MINERVA_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define MINERVA_SSE 1
+#endif
+
+namespace Minerva
+{
+    /// @brief Is an affine transform stored as the first three rows of a 4x4 matrix.
+    /// Every row holds the three rotation-scale terms and the translation
+    struct Affine3x4
+    {
+        glm::vec4 rows[3];
+    };
+
+    /// @brief Selects how the rotation keys are blended
+    enum class NlerpAccuracy
+    {
+        //Plain normalized lerp
+        Fast = 0,
+        //Normalized lerp with the interpolation factor adjusted to follow slerp closely
+        Corrected = 1
+    };
+
+    /// @brief Keys of a batch of bones in SoA layout. Element i of every array belongs to bone i.
+    /// The arrays are padded to a multiple of the widest SIMD batch with identity keys
+    struct TrsKeys
+    {
+        std::vector<float> position0[3], position1[3], positionFactor;
+        std::vector<float> rotation0[4], rotation1[4], rotationFactor;
+        std::vector<float> scale0[3], scale1[3], scaleFactor;
+        size_t count = 0;
+
+        /// @brief Sets the number of bones, the storage only grows
+        void Resize(size_t boneCount);
+        /// @brief Writes a constant transform into one lane, both keys are equal
+        void SetConstant(size_t lane, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+        /// @brief Zeroes the first keys and all the factors, so the batch can accumulate a blended pose
+        void Clear();
+    };
+
+    /// @brief Is a pool of pose buffers owned by a single thread. The buffers only grow, so once the 
+    /// pool is warm acquiring and releasing them never touches the heap
+    class PosePool
+    {
+    public:
+        /// @brief Takes a buffer sized for boneCount bones. The content is left from the previous use
+        TrsKeys& Acquire(size_t boneCount);
+        /// @brief Gives back the last count buffers acquired
+        void Release(size_t count = 1);
+        /// @brief Returns the pool of the calling thread
+        static PosePool& ForThisThread();
+    private:
+        std::vector<std::unique_ptr<TrsKeys>> buffers;
+        size_t used = 0;
+    };
+
+    //Maximum number of bones evaluated at once by the SIMD kernels
+    constexpr size_t POSE_BATCH_WIDTH = 8;
+
+    /// @brief Scalar reference: blends the keys and composes translation * rotation * scale
+    /// @param keys The keys of the bones
+    /// @param output One affine transform for each bone
+    void ComposeTrsScalar(const TrsKeys& keys, Affine3x4* output, NlerpAccuracy accuracy);
+    /// @brief Same as ComposeTrsScalar, using the widest SIMD path available in this build
+    /// (AVX2 8 bones at once, SSE 4 bones at once, scalar otherwise)
+    void ComposeTrs(const TrsKeys& keys, Affine3x4* output, NlerpAccuracy accuracy);
+    /// @brief Returns the name of the path used by ComposeTrs
+    const char* ComposeTrsPath();
+    /// @brief Scalar reference: interpolates the keys like ComposeTrsScalar and adds the local transforms, 
+    /// scaled by weight, to the first keys of accumulated. Every rotation is flipped into the hemisphere 
+    /// of the accumulated one. The factors of accumulated stay zero, so ComposeTrs turns the blended 
+    /// pose into affine transforms, normalizing the rotations
+    /// @param keys The keys of one layer
+    /// @param weight The weight of the layer, the weights of all the layers should sum to one
+    /// @param accumulated The blended pose, cleared before the first layer
+    void AccumulateTrsScalar(const TrsKeys& keys, float weight, TrsKeys& accumulated, NlerpAccuracy accuracy);
+    /// @brief Same as AccumulateTrsScalar, using the SIMD path of ComposeTrs
+    void AccumulateTrs(const TrsKeys& keys, float weight, TrsKeys& accumulated, NlerpAccuracy accuracy);
+
+    /// @brief Composes two affine transforms, the implicit last row is (0, 0, 0, 1)
+    void MultiplyAffine(const Affine3x4& parent, const Affine3x4& local, Affine3x4& output);
+    Affine3x4 ToAffine(const glm::mat4& matrix);
+    /// @brief Splits an affine transform without shear into translation, rotation and scale
+    void DecomposeAffine(const Affine3x4& affine, glm::vec3& position, glm::quat& rotation, glm::vec3& scale);
+    void StoreAffine(const Affine3x4& affine, glm::mat4& matrix);
+}
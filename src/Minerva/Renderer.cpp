@@ -2,7 +2,10 @@
 #include <stdexcept>
 #include <iostream>
 #include <chrono>
+#include <algorithm>
+#include <cstddef>
 #include "EngineVars.h"
+#include "JobSystem.h"
 
 
 
@@ -105,6 +108,12 @@ namespace Minerva
         if (vkCreateCommandPool(engineDevice.logicalDevice, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
             throw std::runtime_error("failed to create command pool!");
         }
+        if (engineDevice.HasAsyncCompute()) {
+            poolInfo.queueFamilyIndex = engineDevice.computeFamily;
+            if (vkCreateCommandPool(engineDevice.logicalDevice, &poolInfo, nullptr, &computeCommandPool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create command pool!");
+            }
+        }
     }
     void Renderer::CreateCommandBuffer()
     {
@@ -118,6 +127,53 @@ namespace Minerva
         if (vkAllocateCommandBuffers(engineDevice.logicalDevice, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
             throw std::runtime_error("failed to allocate command buffers!");
         }
+
+        //The passes are known by now, without them the compute queue stays idle
+        asyncCompute = engineDevice.HasAsyncCompute() && (skinnedPoseCount > 0 || meshletCount > 0);
+        if (!asyncCompute)
+            return;
+        computeCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        allocInfo.commandPool = computeCommandPool;
+        if (vkAllocateCommandBuffers(engineDevice.logicalDevice, &allocInfo, computeCommandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
+    }
+    void Renderer::CreateParallelRecording(JobSystem& jobs)
+    {
+        recordingJobs = &jobs;
+        recordingSliceCount = jobs.ThreadCount();
+        if (recordingSliceCount < 2) {
+            recordingSliceCount = 0;
+            return;
+        }
+        //The pools are reset whole once the fence of their frame is signaled
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = engineDevice.graphicsFamily;
+        slicePools.resize(MAX_FRAMES_IN_FLIGHT * recordingSliceCount);
+        sliceCommandBuffers.resize(slicePools.size());
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+        for (size_t i = 0; i < slicePools.size(); i++) {
+            if (vkCreateCommandPool(engineDevice.logicalDevice, &poolInfo, nullptr, &slicePools[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create command pool!");
+            }
+            allocInfo.commandPool = slicePools[i];
+            if (vkAllocateCommandBuffers(engineDevice.logicalDevice, &allocInfo, &sliceCommandBuffers[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate command buffers!");
+            }
+        }
+        sliceResults.resize(recordingSliceCount);
+        secondaryCommandBuffers.resize(recordingSliceCount + 1);
+        uiCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = (uint32_t) uiCommandBuffers.size();
+        if (vkAllocateCommandBuffers(engineDevice.logicalDevice, &allocInfo, uiCommandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
     }
     void Renderer::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
     {
@@ -127,6 +183,8 @@ namespace Minerva
         if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
             throw std::runtime_error("failed to begin recording command buffer!");
         }
+        if (!asyncCompute)
+            RecordComputePasses(commandBuffer);
         
         VkRenderPassBeginInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -141,43 +199,256 @@ namespace Minerva
 
         renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
         renderPassInfo.pClearValues = clearValues.data();
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);         
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, enginePipeline.graphicsPipeline);
-
-            VkViewport viewport{};
-            viewport.x = 0.0f;
-            viewport.y = 0.0f;
-            viewport.width = static_cast<float>(engineDevice.swapChainExtent.width);
-            viewport.height = static_cast<float>(engineDevice.swapChainExtent.height);
-            viewport.minDepth = 0.0f;
-            viewport.maxDepth = 1.0f;
-            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-            VkRect2D scissor{};
-            scissor.offset = {0, 0};
-            scissor.extent = engineDevice.swapChainExtent;
-            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-            Mesh* mesh = &engineModLoader.sceneMeshes[0];
-            VkBuffer vertexBuffers[] = {mesh->meshBuffer.vertexBuffer};
-            VkDeviceSize offsets[] = {0};
-            vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-            vkCmdBindVertexBuffers(commandBuffer, 1, 1, &engineModLoader.instanceBuffer.buffer, offsets);
-            vkCmdBindIndexBuffer(commandBuffer, mesh->meshBuffer.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 
-            enginePipeline.pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
-            
-            
-            vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(mesh->indices.size()), 
-            engineModLoader.instanceNumber, 0, 0, 0);
-
-            engineUI.RenderUI(commandBuffers[currentFrame]);
+        //The LOD selection writing the draws is part of the CPU cost of the frame
+        auto recordStart = std::chrono::high_resolution_clock::now();
+        //A single call draws every mesh, without multiDrawIndirect each draw needs its own call
+        WriteIndirectDraws();
+        BuildDrawCalls();
+        //Every slice gets enough calls to pay for its secondary command buffer
+        uint32_t sliceCount = static_cast<uint32_t>(std::min<size_t>(recordingSliceCount, 
+        frameDrawCalls.size() / MIN_CALLS_PER_SLICE));
+        recordedSlices = sliceCount > 1 ? sliceCount : 0;
+        if (recordedSlices == 0) {
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            RecordDraws(commandBuffer, frameDrawCalls, 0, frameDrawCalls.size());
+            engineUI.RenderUI(commandBuffer);
+        } else {
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            VkCommandBufferInheritanceInfo inheritanceInfo{};
+            inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritanceInfo.renderPass = renderPass;
+            inheritanceInfo.subpass = 0;
+            inheritanceInfo.framebuffer = swapChainFramebuffers[imageIndex];
+            VkCommandBufferBeginInfo secondaryInfo{};
+            secondaryInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            secondaryInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            secondaryInfo.pInheritanceInfo = &inheritanceInfo;
+
+            /*Each job owns the pool of its slice, so the pools need no lock. The jobs can't throw,
+            they keep their result and the errors are raised here after the join*/
+            size_t callsPerSlice = (frameDrawCalls.size() + sliceCount - 1) / sliceCount;
+            recordingJobs->ParallelFor(sliceCount, 1, [&](size_t begin, size_t end) {
+                for (size_t slice = begin; slice < end; slice++) {
+                    size_t sliceIndex = currentFrame * recordingSliceCount + slice;
+                    vkResetCommandPool(engineDevice.logicalDevice, slicePools[sliceIndex], 0);
+                    VkCommandBuffer sliceCommandBuffer = sliceCommandBuffers[sliceIndex];
+                    sliceResults[slice] = vkBeginCommandBuffer(sliceCommandBuffer, &secondaryInfo);
+                    if (sliceResults[slice] != VK_SUCCESS)
+                        continue;
+                    size_t firstCall = std::min(slice * callsPerSlice, frameDrawCalls.size());
+                    RecordDraws(sliceCommandBuffer, frameDrawCalls, firstCall, std::min(firstCall + callsPerSlice, frameDrawCalls.size()));
+                    sliceResults[slice] = vkEndCommandBuffer(sliceCommandBuffer);
+                }
+            });
+            for (uint32_t slice = 0; slice < sliceCount; slice++) {
+                if (sliceResults[slice] != VK_SUCCESS) {
+                    throw std::runtime_error("failed to record command buffer!");
+                }
+            }
+
+            //ImGui isn't thread safe, the UI is recorded on this thread once the slices are done
+            VkCommandBuffer& uiCommandBuffer = uiCommandBuffers[currentFrame];
+            if (vkBeginCommandBuffer(uiCommandBuffer, &secondaryInfo) != VK_SUCCESS) {
+                throw std::runtime_error("failed to begin recording command buffer!");
+            }
+            engineUI.RenderUI(uiCommandBuffer);
+            if (vkEndCommandBuffer(uiCommandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to record command buffer!");
+            }
+            std::copy_n(sliceCommandBuffers.begin() + currentFrame * recordingSliceCount, sliceCount, 
+            secondaryCommandBuffers.begin());
+            secondaryCommandBuffers[sliceCount] = uiCommandBuffer;
+            vkCmdExecuteCommands(commandBuffer, sliceCount + 1, secondaryCommandBuffers.data());
+        }
+        recordMilliseconds = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - recordStart).count();
 
         vkCmdEndRenderPass(commandBuffer);
+        if (meshletCount > 0) {
+            //The counts reach the host once the fence of the frame is signaled
+            VkBufferCopy region{};
+            region.size = MESHLET_DRAW_HEADER;
+            vkCmdCopyBuffer(commandBuffer, meshletDrawBuffers[currentFrame], meshletDrawCounts.storageBuffers[currentFrame], 1, &region);
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
         if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
             throw std::runtime_error("failed to record command buffer!");
         }
     }
+    void Renderer::BuildDrawCalls()
+    {
+        frameDrawCalls.clear();
+        const Mesh::MeshBuffer& arena = engineModLoader.sceneBuffer;
+        //Each index type is a batch with its own index buffer binding
+        struct IndexBatch { VkIndexType type; VkDeviceSize offset; uint32_t firstDraw; uint32_t endDraw; };
+        IndexBatch batches[] = {{VK_INDEX_TYPE_UINT16, arena.narrowIndices.offset, 0, narrowDrawCount},
+        {VK_INDEX_TYPE_UINT32, arena.wideIndices.offset, narrowDrawCount, drawCount}};
+        //With the meshlet culling the GPU writes the draws and their count, the batches split the meshlets instead
+        if (meshletCount > 0) {
+            batches[0].endDraw = narrowMeshletCount * static_cast<uint32_t>(engineModLoader.instanceNumber);
+            batches[1].firstDraw = batches[0].endDraw;
+            batches[1].endDraw = meshletCount * static_cast<uint32_t>(engineModLoader.instanceNumber);
+        }
+        for (uint32_t b = 0; b < 2; b++) {
+            const IndexBatch& batch = batches[b];
+            if (batch.firstDraw == batch.endDraw)
+                continue;
+            if (meshletCount > 0) {
+                frameDrawCalls.push_back({batch.type, batch.offset, batch.firstDraw, 
+                std::min(batch.endDraw - batch.firstDraw, engineDevice.maxDrawIndirectCount), b * sizeof(uint32_t), true});
+                continue;
+            }
+            uint32_t drawsPerCall = perDrawCalls ? 1 : engineDevice.maxDrawIndirectCount;
+            for (uint32_t firstDraw = batch.firstDraw; firstDraw < batch.endDraw; firstDraw += drawsPerCall) {
+                uint32_t callDraws = std::min(batch.endDraw - firstDraw, drawsPerCall);
+                frameDrawCalls.push_back({batch.type, batch.offset, firstDraw, callDraws, 0, false});
+            }
+        }
+    }
+
+    void Renderer::RecordDraws(VkCommandBuffer commandBuffer, const std::vector<RenderDrawCall>& calls, size_t firstCall, size_t endCall)
+    {
+        //A secondary command buffer inherits no state, so every range binds its own
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, enginePipeline.graphicsPipeline);
+
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = static_cast<float>(engineDevice.swapChainExtent.width);
+        viewport.height = static_cast<float>(engineDevice.swapChainExtent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.offset = {0, 0};
+        scissor.extent = engineDevice.swapChainExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        const Mesh::MeshBuffer& arena = engineModLoader.sceneBuffer;
+        //Every stream lives in the same buffer, the skin stream is bound only for skeletal meshes
+        VkBuffer vertexBuffers[] = {arena.vertexBuffer, engineModLoader.instanceBuffer.buffer, 
+        arena.vertexBuffer, arena.vertexBuffer};
+        VkDeviceSize offsets[] = {arena.position.offset, 0, arena.shading.offset, arena.skin.offset};
+        uint32_t bindingCount = engineModLoader.vertexLayout.skinned ? 4 : 3;
+        vkCmdBindVertexBuffers(commandBuffer, 0, bindingCount, vertexBuffers, offsets);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 
+        enginePipeline.pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
+
+        VkBuffer indirectBuffer = indirectBuffers.storageBuffers[currentFrame];
+        VkBuffer drawBuffer = meshletCount > 0 ? meshletDrawBuffers[currentFrame] : VK_NULL_HANDLE;
+        VkDeviceSize boundIndexOffset = VK_WHOLE_SIZE;
+        for (size_t i = firstCall; i < endCall; i++) {
+            const RenderDrawCall& call = calls[i];
+            if (call.indexOffset != boundIndexOffset) {
+                vkCmdBindIndexBuffer(commandBuffer, arena.indexBuffer, call.indexOffset, call.indexType);
+                boundIndexOffset = call.indexOffset;
+            }
+            if (call.counted) {
+                vkCmdDrawIndexedIndirectCount(commandBuffer, drawBuffer, 
+                MESHLET_DRAW_HEADER + call.firstDraw * sizeof(VkDrawIndexedIndirectCommand), drawBuffer, 
+                call.countOffset, call.drawCount, sizeof(VkDrawIndexedIndirectCommand));
+                continue;
+            }
+            vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, call.firstDraw * sizeof(VkDrawIndexedIndirectCommand),
+            call.drawCount, sizeof(VkDrawIndexedIndirectCommand));
+        }
+    }
+
+    double Renderer::MeasureRecording(JobSystem& jobs, size_t callCount, int frameCount)
+    {
+        if (drawCount == 0 || callCount == 0)
+            return 0.0;
+        //The calls are only recorded, so they can point to any draw of the indirect buffer
+        const Mesh::MeshBuffer& arena = engineModLoader.sceneBuffer;
+        std::vector<RenderDrawCall> calls(callCount);
+        for (size_t i = 0; i < callCount; i++) {
+            uint32_t draw = static_cast<uint32_t>(i % drawCount);
+            bool narrow = draw < narrowDrawCount;
+            calls[i] = {narrow ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32, 
+            narrow ? arena.narrowIndices.offset : arena.wideIndices.offset, draw, 1, 0, false};
+        }
+
+        uint32_t sliceCount = jobs.ThreadCount();
+        std::vector<VkCommandPool> pools(sliceCount, VK_NULL_HANDLE);
+        std::vector<VkCommandBuffer> buffers(sliceCount);
+        std::vector<VkResult> results(sliceCount, VK_SUCCESS);
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = engineDevice.graphicsFamily;
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+        for (uint32_t slice = 0; slice < sliceCount; slice++) {
+            results[slice] = vkCreateCommandPool(engineDevice.logicalDevice, &poolInfo, nullptr, &pools[slice]);
+            if (results[slice] != VK_SUCCESS)
+                break;
+            allocInfo.commandPool = pools[slice];
+            results[slice] = vkAllocateCommandBuffers(engineDevice.logicalDevice, &allocInfo, &buffers[slice]);
+            if (results[slice] != VK_SUCCESS)
+                break;
+        }
+
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = renderPass;
+        inheritanceInfo.subpass = 0;
+        VkCommandBufferBeginInfo secondaryInfo{};
+        secondaryInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        secondaryInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        secondaryInfo.pInheritanceInfo = &inheritanceInfo;
+        size_t callsPerSlice = (callCount + sliceCount - 1) / sliceCount;
+        auto record = [&](size_t begin, size_t end) {
+            for (size_t slice = begin; slice < end; slice++) {
+                vkResetCommandPool(engineDevice.logicalDevice, pools[slice], 0);
+                results[slice] = vkBeginCommandBuffer(buffers[slice], &secondaryInfo);
+                if (results[slice] != VK_SUCCESS)
+                    continue;
+                size_t firstCall = std::min(slice * callsPerSlice, callCount);
+                RecordDraws(buffers[slice], calls, firstCall, std::min(firstCall + callsPerSlice, callCount));
+                results[slice] = vkEndCommandBuffer(buffers[slice]);
+            }
+        };
+
+        double milliseconds = 0.0;
+        bool failed = std::any_of(results.begin(), results.end(), [](VkResult result) { return result != VK_SUCCESS; });
+        if (!failed) {
+            //Warm up, so every pool has grown its memory
+            jobs.ParallelFor(sliceCount, 1, record);
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int frame = 0; frame < frameCount; frame++)
+                jobs.ParallelFor(sliceCount, 1, record);
+            milliseconds = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count() / std::max(frameCount, 1);
+            failed = std::any_of(results.begin(), results.end(), [](VkResult result) { return result != VK_SUCCESS; });
+        }
+        for (VkCommandPool pool : pools) {
+            vkDestroyCommandPool(engineDevice.logicalDevice, pool, nullptr);
+        }
+        if (failed) {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+        return milliseconds;
+    }
+
+    void Renderer::WaitForCurrentFrame()
+    {
+        vkWaitForFences(engineDevice.logicalDevice, 1, 
+        &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    }
+
+    BonePalette* Renderer::GetFramePalettes()
+    {
+        return static_cast<BonePalette*>(animSBuffers.storageBuffersMapped[currentFrame]);
+    }
+
     void Renderer::DrawFrame()
     {
         vkWaitForFences(engineDevice.logicalDevice, 1, 
@@ -199,12 +470,50 @@ namespace Minerva
         vkResetCommandBuffer(commandBuffers[currentFrame],  0);
         RecordCommandBuffer(commandBuffers[currentFrame], imageIndex);
         
+        //The uploads recorded since the last frame run before it
+        if (asyncCompute) {
+            VkCommandBuffer computeCommandBuffer = computeCommandBuffers[currentFrame];
+            vkResetCommandBuffer(computeCommandBuffer, 0);
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            if (vkBeginCommandBuffer(computeCommandBuffer, &beginInfo) != VK_SUCCESS) {
+                throw std::runtime_error("failed to begin recording command buffer!");
+            }
+            RecordComputePasses(computeCommandBuffer);
+            if (vkEndCommandBuffer(computeCommandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to record command buffer!");
+            }
+
+            //The passes read the instances, which the graphics queue may have just copied
+            VkSubmitInfo computeInfo{};
+            computeInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            VkPipelineStageFlags uploadWaitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+            if (engineUploader.FlushAndSignal(uploadFinishedSemaphores[currentFrame])) {
+                computeInfo.waitSemaphoreCount = 1;
+                computeInfo.pWaitSemaphores = &uploadFinishedSemaphores[currentFrame];
+                computeInfo.pWaitDstStageMask = &uploadWaitStage;
+            }
+            computeInfo.commandBufferCount = 1;
+            computeInfo.pCommandBuffers = &computeCommandBuffer;
+            computeInfo.signalSemaphoreCount = 1;
+            computeInfo.pSignalSemaphores = &computeFinishedSemaphores[currentFrame];
+            if (vkQueueSubmit(engineDevice.computeQueue, 1, &computeInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit compute command buffer!");
+            }
+        } else {
+            engineUploader.Flush();
+        }
+
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-        VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-        submitInfo.waitSemaphoreCount = 1;
+        /*The compute results are read as vertices, indirect draws and by the copy of the counts. The buffers are
+        shared by the families, the semaphore alone makes the writes visible*/
+        VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame], 
+        asyncCompute ? computeFinishedSemaphores[currentFrame] : VK_NULL_HANDLE};
+        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT};
+        submitInfo.waitSemaphoreCount = asyncCompute ? 2 : 1;
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
         submitInfo.commandBufferCount = 1;
@@ -260,6 +569,19 @@ namespace Minerva
                 != VK_SUCCESS ||
                 vkCreateFence(engineDevice.logicalDevice, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
 
+                throw std::runtime_error("failed to create synchronization objects for a frame!");
+            }
+        }
+        if (!asyncCompute)
+            return;
+        computeFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        uploadFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            if (vkCreateSemaphore(engineDevice.logicalDevice, &semaphoreInfo, nullptr, &computeFinishedSemaphores[i]) 
+            != VK_SUCCESS ||
+                vkCreateSemaphore(engineDevice.logicalDevice, &semaphoreInfo, nullptr, &uploadFinishedSemaphores[i]) 
+                != VK_SUCCESS) {
+
                 throw std::runtime_error("failed to create synchronization objects for a frame!");
             }
         }
@@ -267,78 +589,294 @@ namespace Minerva
 
     void Renderer::CreateVertexBuffer()
     {
-        VkDeviceSize bufferSize = sizeof(engineModLoader.sceneMeshes[0].vertices[0]) * 
-        engineModLoader.sceneMeshes[0].vertices.size();
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-         | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+        Mesh::MeshBuffer& arena = engineModLoader.sceneBuffer;
+        //A cooked model already holds the streams, mapped from the file and placed by LoadModel
+        const MappedFile& cookedModel = engineModLoader.cookedModel;
+        Mesh::VertexStreams streams;
+        const unsigned char* source = cookedModel.Data() + engineModLoader.cookedVertices.offset;
+        VkDeviceSize bufferSize = engineModLoader.cookedVertices.size;
+        if (!cookedModel.IsOpen()) {
+            streams = Mesh::PackVertexStreams(engineModLoader.sceneMeshes, engineModLoader.vertexLayout);
+            arena.position = streams.position;
+            arena.shading = streams.shading;
+            arena.skin = streams.skin;
+            source = streams.data.data();
+            bufferSize = streams.data.size();
+        }
+        //The compute skinning reads the position and skin streams from the same buffer
+        CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+        | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+        arena.vertexBuffer, arena.vertexBufferMemory);
+        //The streams are copied into the staging ring, so the cooked model can be released right away
+        engineUploader.UploadBuffer(arena.vertexBuffer, 0, source, bufferSize);
+    }
+
+    void Renderer::CreateInstanceBuffer()
+    {
+        //The meshlet culling reads the instances as a storage buffer
+        CreateBuffer(engineModLoader.instanceBuffer.size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+        | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, engineModLoader.instanceBuffer.buffer, engineModLoader.instanceBuffer.memory);
+        UploadInstanceBuffer();
+    }
 
-        void* data;
-        vkMapMemory(engineDevice.logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-            memcpy(data, engineModLoader.sceneMeshes[0].vertices.data(), (size_t) bufferSize);
-        vkUnmapMemory(engineDevice.logicalDevice, stagingBufferMemory);
+    void Renderer::UploadInstanceBuffer()
+    {
+        //The batch waits on the GPU for the frames in flight still reading the buffer, the CPU goes on
+        engineUploader.UploadBuffer(engineModLoader.instanceBuffer.buffer, 0, engineModLoader.instancesData.data(),
+        engineModLoader.instanceBuffer.size, true);
+    }
 
-        CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, engineModLoader.sceneMeshes[0].meshBuffer.vertexBuffer, 
-        engineModLoader.sceneMeshes[0].meshBuffer.vertexBufferMemory);
-        CopyBuffer(stagingBuffer, engineModLoader.sceneMeshes[0].meshBuffer.vertexBuffer, bufferSize);
+    void Renderer::CreateBakedAnimationBuffer(const BakedAnimations &bakedAnimations)
+    {
+        bakedAnimBufferSize = bakedAnimations.BufferSize();
+        std::vector<unsigned char> data(bakedAnimBufferSize);
+        bakedAnimations.CopyTo(data.data());
 
-        //destroy the staging buffer
-        vkDestroyBuffer(engineDevice.logicalDevice, stagingBuffer, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, stagingBufferMemory, nullptr);
+        CreateBuffer(bakedAnimBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, bakedAnimBuffer, bakedAnimBufferMemory);
+        engineUploader.UploadBuffer(bakedAnimBuffer, 0, data.data(), bakedAnimBufferSize);
     }
 
-    void Renderer::CreateInstanceBuffer()
+    void Renderer::CreateSkinnedVertexBuffers(uint32_t poseCount)
     {
-        VkDeviceSize bufferSize = engineModLoader.instanceBuffer.size;
-        //Temp buffer
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-         | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+        skinnedPoseCount = poseCount;
+        skinnedVertexBufferSize = sizeof(glm::vec4) * std::max<VkDeviceSize>(
+        static_cast<VkDeviceSize>(poseCount) * engineModLoader.vertexCount, 1);
+        skinnedVertexBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        skinnedVertexBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
 
-        void* data;
-        if(vkMapMemory(engineDevice.logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data)!= VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to map memory!");
+        //Written and read only by the GPU, so every frame in flight needs its own copy
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            CreateBuffer(skinnedVertexBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, skinnedVertexBuffers[i], skinnedVertexBuffersMemory[i]);
         }
-        
-        memcpy(data, engineModLoader.instancesData.data(), (size_t) bufferSize);
-        vkUnmapMemory(engineDevice.logicalDevice, stagingBufferMemory);
-        CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, engineModLoader.instanceBuffer.buffer, engineModLoader.instanceBuffer.memory);
-        CopyBuffer(stagingBuffer, engineModLoader.instanceBuffer.buffer, bufferSize);
+    }
 
-        //destroy the staging buffer
-        vkDestroyBuffer(engineDevice.logicalDevice, stagingBuffer, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, stagingBufferMemory, nullptr);
+    void Renderer::RecordComputePasses(VkCommandBuffer commandBuffer)
+    {
+        if (skinnedPoseCount > 0)
+            RecordSkinningPass(commandBuffer);
+        if (meshletCount > 0)
+            RecordMeshletCullingPass(commandBuffer);
     }
 
-    void Renderer::CreateIndexBuffer()
+    void Renderer::RecordSkinningPass(VkCommandBuffer commandBuffer)
     {
-        VkDeviceSize bufferSize = sizeof(engineModLoader.sceneMeshes[0].indices[0]) * 
-        engineModLoader.sceneMeshes[0].indices.size();
+        const Mesh::VertexLayout& layout = engineModLoader.vertexLayout;
+        SkinningConstants constants{};
+        constants.vertexCount = engineModLoader.vertexCount;
+        constants.poseCount = skinnedPoseCount;
+        constants.skinStride = layout.SkinStride() / sizeof(uint32_t);
+        constants.wideBoneIndices = layout.wideBoneIndices ? 1 : 0;
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, enginePipeline.computePipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, 
+        enginePipeline.computePipelineLayout, 0, 1, &skinningDescriptorSets[currentFrame], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, enginePipeline.computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 
+        0, sizeof(constants), &constants);
+        //One invocation for each vertex of each pose, the groups are 64 vertices wide
+        vkCmdDispatch(commandBuffer, (constants.vertexCount + 63) / 64, skinnedPoseCount, 1);
+        //On the compute queue the frame waits for the semaphore instead, the queue has no vertex stage
+        if (asyncCompute)
+            return;
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+        //The vertex shader of the render pass reads what the dispatch wrote
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = skinnedVertexBuffers[currentFrame];
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+
+    void Renderer::CreateMeshletBuffers(bool enabled)
+    {
+        //Placed like the draws of whole meshes: 16 bit batch first, indices and vertices in the arenas
+        std::vector<Mesh::Meshlet> meshlets;
+        for (VkIndexType indexType : {VK_INDEX_TYPE_UINT16, VK_INDEX_TYPE_UINT32}) {
+            for (const auto& mesh : engineModLoader.sceneMeshes) {
+                if (!enabled || mesh.indexType != indexType)
+                    continue;
+                for (Mesh::Meshlet meshlet : mesh.meshlets) {
+                    meshlet.firstIndex += mesh.firstIndex;
+                    meshlet.vertexOffset = static_cast<int32_t>(mesh.baseVertex);
+                    meshlet.wideIndices = indexType == VK_INDEX_TYPE_UINT32 ? 1 : 0;
+                    meshlets.emplace_back(meshlet);
+                }
+            }
+            if (indexType == VK_INDEX_TYPE_UINT16)
+                narrowMeshletCount = static_cast<uint32_t>(meshlets.size());
+        }
+        meshletCount = static_cast<uint32_t>(meshlets.size());
+        if (meshlets.empty())
+            meshlets.emplace_back();
+
+        meshletBufferSize = sizeof(Mesh::Meshlet) * meshlets.size();
+        CreateBuffer(meshletBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletBuffer, meshletBufferMemory);
+        engineUploader.UploadBuffer(meshletBuffer, 0, meshlets.data(), meshletBufferSize);
+
+        //Room for every meshlet of every instance, the worst case of a frame without culling
+        VkDeviceSize maxDraws = std::max<VkDeviceSize>(static_cast<VkDeviceSize>(meshletCount) * engineModLoader.instanceNumber, 1);
+        meshletDrawBufferSize = MESHLET_DRAW_HEADER + sizeof(VkDrawIndexedIndirectCommand) * maxDraws;
+        meshletDrawBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        meshletDrawBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        meshletDrawCounts.size = MESHLET_DRAW_HEADER;
+        meshletDrawCounts.storageBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        meshletDrawCounts.storageBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        meshletDrawCounts.storageBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            CreateBuffer(meshletDrawBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+            | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+            meshletDrawBuffers[i], meshletDrawBuffersMemory[i]);
+
+            CreateBuffer(meshletDrawCounts.size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT 
+            | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, meshletDrawCounts.storageBuffers[i], meshletDrawCounts.storageBuffersMemory[i]);
+            meshletDrawCounts.storageBuffersMapped[i] = meshletDrawCounts.storageBuffersMemory[i].mapped;
+            memset(meshletDrawCounts.storageBuffersMapped[i], 0, (size_t) meshletDrawCounts.size);
+        }
+    }
 
-        void* data;
-        vkMapMemory(engineDevice.logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, engineModLoader.sceneMeshes[0].indices.data(), (size_t) bufferSize);
-        vkUnmapMemory(engineDevice.logicalDevice, stagingBufferMemory);
+    void Renderer::RecordMeshletCullingPass(VkCommandBuffer commandBuffer)
+    {
+        const UniformBufferObject& ubo = engineTransform.ubo;
+        MeshletCullConstants constants{};
+        //Rows of the clip matrix combined as in Gribb and Hartmann, the depth goes from 0 to 1
+        glm::mat4 rows = glm::transpose(ubo.proj * ubo.view * ubo.model);
+        glm::vec4 planes[6] = {rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], 
+        rows[3] - rows[1], rows[2], rows[3] - rows[2]};
+        for (int i = 0; i < 6; i++)
+            constants.planes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+        constants.cameraPos = glm::inverse(ubo.view * ubo.model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        constants.meshletCount = meshletCount;
+        constants.instanceCount = static_cast<uint32_t>(engineModLoader.instanceNumber);
+        constants.narrowCapacity = narrowMeshletCount * constants.instanceCount;
+
+        //The shader appends to the counts, so they start from zero every frame
+        VkBuffer drawBuffer = meshletDrawBuffers[currentFrame];
+        vkCmdFillBuffer(commandBuffer, drawBuffer, 0, MESHLET_DRAW_HEADER, 0);
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = drawBuffer;
+        barrier.offset = 0;
+        barrier.size = MESHLET_DRAW_HEADER;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, 
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, enginePipeline.computePipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, 
+        enginePipeline.computePipelineLayout, 0, 1, &meshletCullDescriptorSets[currentFrame], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, enginePipeline.computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 
+        0, sizeof(constants), &constants);
+        //One invocation for each meshlet of each instance, the groups are 64 meshlets wide
+        vkCmdDispatch(commandBuffer, (meshletCount + 63) / 64, constants.instanceCount, 1);
+        if (asyncCompute)
+            return;
+
+        //The draws are read as indirect commands, the counts are also copied back after the frame
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+
+    uint32_t Renderer::VisibleMeshletDraws() const
+    {
+        if (meshletCount == 0)
+            return 0;
+        //The previous frame may still be running, the current one has waited for its fence
+        auto counts = static_cast<const uint32_t*>(meshletDrawCounts.storageBuffersMapped[currentFrame]);
+        return counts[0] + counts[1];
+    }
+
+    void Renderer::CreateIndexBuffer()
+    {
+        Mesh::MeshBuffer& arena = engineModLoader.sceneBuffer;
+        const MappedFile& cookedModel = engineModLoader.cookedModel;
+        std::vector<unsigned char> indices;
+        const unsigned char* source = cookedModel.Data() + engineModLoader.cookedIndices.offset;
+        VkDeviceSize bufferSize = engineModLoader.cookedIndices.size;
+        if (!cookedModel.IsOpen()) {
+            indices = Mesh::PackIndices(engineModLoader.sceneMeshes, arena);
+            source = indices.data();
+            bufferSize = indices.size();
+        }
 
-        
         CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, engineModLoader.sceneMeshes[0].meshBuffer.indexBuffer, 
-        engineModLoader.sceneMeshes[0].meshBuffer.indexBufferMemory);
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, arena.indexBuffer, arena.indexBufferMemory);
+        engineUploader.UploadBuffer(arena.indexBuffer, 0, source, bufferSize);
+    }
+
+    void Renderer::CreateIndirectBuffers()
+    {
+        //At worst every instance draws a different LOD than its neighbours
+        indirectBuffers.size = sizeof(VkDrawIndexedIndirectCommand) * 
+        std::max<VkDeviceSize>(engineModLoader.sceneMeshes.size() * std::max(engineModLoader.instanceNumber, 1), 1);
+        indirectBuffers.storageBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        indirectBuffers.storageBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        indirectBuffers.storageBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
 
-        CopyBuffer(stagingBuffer, engineModLoader.sceneMeshes[0].meshBuffer.indexBuffer, bufferSize);
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            CreateBuffer(indirectBuffers.size, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, 
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
+            indirectBuffers.storageBuffers[i], indirectBuffers.storageBuffersMemory[i]);
+
+            indirectBuffers.storageBuffersMapped[i] = indirectBuffers.storageBuffersMemory[i].mapped;
+        }
+    }
 
-        vkDestroyBuffer(engineDevice.logicalDevice, stagingBuffer, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, stagingBufferMemory, nullptr);
+    void Renderer::WriteIndirectDraws()
+    {
+        auto draws = static_cast<VkDrawIndexedIndirectCommand*>(indirectBuffers.storageBuffersMapped[currentFrame]);
+        drawCount = 0;
+        renderedTriangles = 0;
+        std::fill(lodInstanceCounts.begin(), lodInstanceCounts.end(), 0);
+        const UniformBufferObject& ubo = engineTransform.ubo;
+        glm::vec3 cameraPos = glm::inverse(ubo.view)[3];
+        float pixelsPerUnit = 0.5f * engineDevice.swapChainExtent.height * std::abs(ubo.proj[1][1]);
+        const auto& instances = engineModLoader.instancesData;
+        if (instanceLods.size() < instances.size())
+            instanceLods.resize(instances.size());
+        //The 16 bit batch first, so each batch is a contiguous range of draws
+        for (VkIndexType indexType : {VK_INDEX_TYPE_UINT16, VK_INDEX_TYPE_UINT32}) {
+            for (const auto& mesh : engineModLoader.sceneMeshes) {
+                if (mesh.lods.empty() || mesh.lods[0].indexCount == 0 || mesh.indexType != indexType)
+                    continue;
+                for (size_t i = 0; i < instances.size(); i++)
+                    instanceLods[i] = static_cast<uint8_t>(SelectMeshLod(meshLod, mesh, instances[i], ubo.model, cameraPos, pixelsPerUnit));
+                /*Each run of consecutive instances with the same LOD is a draw starting from its first instance, 
+                so gl_InstanceIndex keeps picking the same instance data and pose in every draw*/
+                for (size_t first = 0; first < instances.size();) {
+                    size_t end = first + 1;
+                    while (end < instances.size() && instanceLods[end] == instanceLods[first])
+                        end++;
+                    const Mesh::Lod& lod = mesh.lods[instanceLods[first]];
+                    VkDrawIndexedIndirectCommand& draw = draws[drawCount++];
+                    draw.indexCount = lod.indexCount;
+                    draw.instanceCount = static_cast<uint32_t>(end - first);
+                    draw.firstIndex = mesh.firstIndex + lod.firstIndex;
+                    draw.vertexOffset = static_cast<int32_t>(mesh.baseVertex);
+                    draw.firstInstance = static_cast<uint32_t>(first);
+                    renderedTriangles += static_cast<uint64_t>(lod.indexCount / 3) * (end - first);
+                    if (lodInstanceCounts.size() <= instanceLods[first])
+                        lodInstanceCounts.resize(instanceLods[first] + 1, 0);
+                    lodInstanceCounts[instanceLods[first]] += static_cast<uint32_t>(end - first);
+                    first = end;
+                }
+            }
+            if (indexType == VK_INDEX_TYPE_UINT16)
+                narrowDrawCount = drawCount;
+        }
     }
 
     void Renderer::CreateDescriptorSetLayout()
@@ -358,11 +896,24 @@ namespace Minerva
 
         VkDescriptorSetLayoutBinding animLayoutBinding{};
         animLayoutBinding.binding = 2;
-        animLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        animLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
         animLayoutBinding.descriptorCount = 1;
         animLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
-        std::array<VkDescriptorSetLayoutBinding, 3> bindings = {uboLayoutBinding, samplerLayoutBinding, animLayoutBinding};
+        VkDescriptorSetLayoutBinding bakedAnimLayoutBinding{};
+        bakedAnimLayoutBinding.binding = 3;
+        bakedAnimLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bakedAnimLayoutBinding.descriptorCount = 1;
+        bakedAnimLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        VkDescriptorSetLayoutBinding skinnedLayoutBinding{};
+        skinnedLayoutBinding.binding = 4;
+        skinnedLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        skinnedLayoutBinding.descriptorCount = 1;
+        skinnedLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        std::array<VkDescriptorSetLayoutBinding, 5> bindings = {uboLayoutBinding, samplerLayoutBinding, 
+        animLayoutBinding, bakedAnimLayoutBinding, skinnedLayoutBinding};
         VkDescriptorSetLayoutCreateInfo layoutInfo{};
         layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
         layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -371,22 +922,45 @@ namespace Minerva
         if (vkCreateDescriptorSetLayout(engineDevice.logicalDevice, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
             throw std::runtime_error("failed to create descriptor set layout!");
         }
+
+        //skinning.comp reads the position stream and the palettes, writes the skinned positions and reads the skin stream
+        std::array<VkDescriptorSetLayoutBinding, 4> skinningBindings{};
+        for (uint32_t i = 0; i < skinningBindings.size(); i++) {
+            skinningBindings[i].binding = i;
+            skinningBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            skinningBindings[i].descriptorCount = 1;
+            skinningBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        layoutInfo.bindingCount = static_cast<uint32_t>(skinningBindings.size());
+        layoutInfo.pBindings = skinningBindings.data();
+
+        if (vkCreateDescriptorSetLayout(engineDevice.logicalDevice, &layoutInfo, nullptr, &skinningSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create skinning descriptor set layout!");
+        }
+
+        //meshletCull.comp reads the meshlets and the instances, writes the draws
+        layoutInfo.bindingCount = 3;
+        if (vkCreateDescriptorSetLayout(engineDevice.logicalDevice, &layoutInfo, nullptr, &meshletCullSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create meshlet culling descriptor set layout!");
+        }
     }
 
     void Renderer::CreateDescriptorPool()
     {
-        std::array<VkDescriptorPoolSize, 2> poolSizes{};
+        std::array<VkDescriptorPoolSize, 3> poolSizes{};
         poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
         poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
         poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
         poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 2;
+        poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[2].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 10;
 
         VkDescriptorPoolCreateInfo poolInfo{};
         poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
         poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
         poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
         poolInfo.pPoolSizes = poolSizes.data();
-        poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 2;
+        poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 4;
 
         if (vkCreateDescriptorPool(engineDevice.logicalDevice, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
             throw std::runtime_error("failed to create descriptor pool!");
@@ -414,16 +988,26 @@ namespace Minerva
             bufferInfo.range = sizeof(UniformBufferObject);
 
             VkDescriptorBufferInfo animBufferInfo{};
-            animBufferInfo.buffer = animUBuffers.uniformBuffers[i];
+            animBufferInfo.buffer = animSBuffers.storageBuffers[i];
             animBufferInfo.offset = 0;
-            animBufferInfo.range = sizeof(BoneMatricesUniformType);
+            animBufferInfo.range = animSBuffers.size;
+
+            VkDescriptorBufferInfo bakedAnimBufferInfo{};
+            bakedAnimBufferInfo.buffer = bakedAnimBuffer;
+            bakedAnimBufferInfo.offset = 0;
+            bakedAnimBufferInfo.range = bakedAnimBufferSize;
+
+            VkDescriptorBufferInfo skinnedBufferInfo{};
+            skinnedBufferInfo.buffer = skinnedVertexBuffers[i];
+            skinnedBufferInfo.offset = 0;
+            skinnedBufferInfo.range = skinnedVertexBufferSize;
 
             VkDescriptorImageInfo imageInfo{};
             imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
             imageInfo.imageView = texture.textureImageView;
             imageInfo.sampler = texture.textureSampler;
 
-            std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+            std::array<VkWriteDescriptorSet, 5> descriptorWrites{};
 
             descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             descriptorWrites[0].dstSet = descriptorSets[i];
@@ -446,10 +1030,94 @@ namespace Minerva
             descriptorWrites[2].dstSet = descriptorSets[i];
             descriptorWrites[2].dstBinding = 2;
             descriptorWrites[2].dstArrayElement = 0;
-            descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
             descriptorWrites[2].descriptorCount = 1;
             descriptorWrites[2].pBufferInfo = &animBufferInfo;
 
+            descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[3].dstSet = descriptorSets[i];
+            descriptorWrites[3].dstBinding = 3;
+            descriptorWrites[3].dstArrayElement = 0;
+            descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[3].descriptorCount = 1;
+            descriptorWrites[3].pBufferInfo = &bakedAnimBufferInfo;
+
+            descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[4].dstSet = descriptorSets[i];
+            descriptorWrites[4].dstBinding = 4;
+            descriptorWrites[4].dstArrayElement = 0;
+            descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[4].descriptorCount = 1;
+            descriptorWrites[4].pBufferInfo = &skinnedBufferInfo;
+
+            vkUpdateDescriptorSets(engineDevice.logicalDevice, 
+            static_cast<uint32_t>(descriptorWrites.size()),
+            descriptorWrites.data(), 0, nullptr);
+        }
+
+        std::vector<VkDescriptorSetLayout> skinningLayouts(MAX_FRAMES_IN_FLIGHT, skinningSetLayout);
+        allocInfo.pSetLayouts = skinningLayouts.data();
+        skinningDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+        if (vkAllocateDescriptorSets(engineDevice.logicalDevice, &allocInfo, skinningDescriptorSets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate skinning descriptor sets!");
+        }
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            const Mesh::MeshBuffer& meshBuffer = engineModLoader.sceneBuffer;
+            std::array<VkDescriptorBufferInfo, 4> bufferInfos{};
+            bufferInfos[0].buffer = meshBuffer.vertexBuffer;
+            bufferInfos[0].offset = meshBuffer.position.offset;
+            bufferInfos[0].range = meshBuffer.position.size;
+            bufferInfos[1].buffer = animSBuffers.storageBuffers[i];
+            bufferInfos[1].range = animSBuffers.size;
+            bufferInfos[2].buffer = skinnedVertexBuffers[i];
+            bufferInfos[2].range = skinnedVertexBufferSize;
+            //Static meshes have no skin stream, the binding gets the position stream and is never read
+            bufferInfos[3].buffer = meshBuffer.vertexBuffer;
+            bufferInfos[3].offset = meshBuffer.skin.size > 0 ? meshBuffer.skin.offset : meshBuffer.position.offset;
+            bufferInfos[3].range = meshBuffer.skin.size > 0 ? meshBuffer.skin.size : meshBuffer.position.size;
+
+            std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
+            for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++) {
+                descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[binding].dstSet = skinningDescriptorSets[i];
+                descriptorWrites[binding].dstBinding = binding;
+                descriptorWrites[binding].dstArrayElement = 0;
+                descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                descriptorWrites[binding].descriptorCount = 1;
+                descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+            }
+            vkUpdateDescriptorSets(engineDevice.logicalDevice, 
+            static_cast<uint32_t>(descriptorWrites.size()),
+            descriptorWrites.data(), 0, nullptr);
+        }
+
+        std::vector<VkDescriptorSetLayout> meshletCullLayouts(MAX_FRAMES_IN_FLIGHT, meshletCullSetLayout);
+        allocInfo.pSetLayouts = meshletCullLayouts.data();
+        meshletCullDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+        if (vkAllocateDescriptorSets(engineDevice.logicalDevice, &allocInfo, meshletCullDescriptorSets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate meshlet culling descriptor sets!");
+        }
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            std::array<VkDescriptorBufferInfo, 3> bufferInfos{};
+            bufferInfos[0].buffer = meshletBuffer;
+            bufferInfos[0].range = meshletBufferSize;
+            bufferInfos[1].buffer = engineModLoader.instanceBuffer.buffer;
+            bufferInfos[1].range = engineModLoader.instanceBuffer.size;
+            bufferInfos[2].buffer = meshletDrawBuffers[i];
+            bufferInfos[2].range = meshletDrawBufferSize;
+
+            std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+            for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++) {
+                descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[binding].dstSet = meshletCullDescriptorSets[i];
+                descriptorWrites[binding].dstBinding = binding;
+                descriptorWrites[binding].dstArrayElement = 0;
+                descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                descriptorWrites[binding].descriptorCount = 1;
+                descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+            }
             vkUpdateDescriptorSets(engineDevice.logicalDevice, 
             static_cast<uint32_t>(descriptorWrites.size()),
             descriptorWrites.data(), 0, nullptr);
@@ -462,74 +1130,22 @@ namespace Minerva
         engineTransform.Scale(glm::vec3(0.03f), engineTransform.ubo.model);
         
         camera.UpdateViewMatrix(engineTransform.ubo.view);
+        engineTransform.ubo.animationTime = static_cast<float>(glfwGetTime());
 
         engineTransform.ubo.proj = glm::perspective(glm::radians(45.0f), engineDevice.swapChainExtent.width / 
         (float) engineDevice.swapChainExtent.height, 0.07f, 1000.0f);
 
         engineTransform.ubo.proj[1][1] *= -1;
 
-        memcpy(animUBuffers.uniformBuffersMapped[currentImage], 
-        &UNBoneMatrices, sizeof(UNBoneMatrices));
-        
         memcpy(transformationUBuffers.uniformBuffersMapped[currentImage], 
         &engineTransform.ubo, sizeof(engineTransform.ubo));
 
         
     }
 
-    VkCommandBuffer Renderer::BeginSingleTimeCommands()
+    void Renderer::TransitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, 
+    VkImageLayout oldLayout, VkImageLayout newLayout)
     {
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandPool = commandPool;
-        allocInfo.commandBufferCount = 1;
-
-        VkCommandBuffer commandBuffer;
-        if(vkAllocateCommandBuffers(engineDevice.logicalDevice, &allocInfo, &commandBuffer) != VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to allocate command buffers!");
-        }
-
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-        if(vkBeginCommandBuffer(commandBuffer, &beginInfo)!= VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to begin command buffer!");
-        }
-
-        return commandBuffer;
-    }
-
-    void Renderer::EndSingleTimeCommands(VkCommandBuffer commandBuffer)
-    {
-        if(vkEndCommandBuffer(commandBuffer)!= VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to end command buffer!");
-        }
-
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
-
-        if(vkQueueSubmit(engineDevice.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE)!= VK_SUCCESS)
-        {
-             throw std::runtime_error("failed to submit queue!");
-        }
-        if(vkQueueWaitIdle(engineDevice.graphicsQueue)!= VK_SUCCESS)
-        {
-             throw std::runtime_error("failed to queue wait!");
-        }
-
-        vkFreeCommandBuffers(engineDevice.logicalDevice, commandPool, 1, &commandBuffer);
-    }
-
-    void Renderer::TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
-    {
-        VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
         VkImageMemoryBarrier barrier{};
         barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
         barrier.oldLayout = oldLayout;
@@ -584,19 +1200,26 @@ namespace Minerva
             0, nullptr,
             1, &barrier
         );
-
-        EndSingleTimeCommands(commandBuffer);
     }
 
     void Renderer::CreateDepthResources()
     {
+        //Recreated with the swap chain, the range of the previous image goes back to the allocator
+        if (depthImageMemory.IsValid()) {
+            vkDestroyImageView(engineDevice.logicalDevice, depthImageView, nullptr);
+            vkDestroyImage(engineDevice.logicalDevice, depthImage, nullptr);
+            engineAllocator.Free(depthImageMemory);
+        }
         VkFormat depthFormat = FindDepthFormat();
         texture.CreateImage(engineDevice.swapChainExtent.width, engineDevice.swapChainExtent.height, 
         depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
         depthImageView = engineDevice.CreateImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
-        TransitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+        engineUploader.Record([&](VkCommandBuffer commandBuffer)
+        {
+            TransitionImageLayout(commandBuffer, depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+        });
     }
 
     VkFormat Renderer::FindSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling, 
@@ -629,89 +1252,28 @@ namespace Minerva
         return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
     }
 
-    uint32_t Renderer::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
-    {
-        VkPhysicalDeviceMemoryProperties memProperties;
-        vkGetPhysicalDeviceMemoryProperties(engineDevice.physicalDevice, &memProperties);
-        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-            if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-                return i;
-            }
-        }
-
-        throw std::runtime_error("failed to find suitable memory type!");
-    }
-
     void Renderer::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, 
-    VkBuffer &buffer, VkDeviceMemory &bufferMemory)
+    VkBuffer &buffer, DeviceAllocation &bufferMemory)
     {
         VkBufferCreateInfo bufferInfo{};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.size = size;
         bufferInfo.usage = usage;
         bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        //Uploaded on the transfer queue and read by the compute one, a buffer is shared instead of changing owner
+        std::vector<uint32_t> families = engineDevice.BufferSharingFamilies();
+        if (families.size() > 1) {
+            bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+            bufferInfo.pQueueFamilyIndices = families.data();
+        }
 
         if (vkCreateBuffer(engineDevice.logicalDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
             throw std::runtime_error("failed to create buffer!");
         }
 
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(engineDevice.logicalDevice, buffer, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(engineDevice.logicalDevice, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate buffer memory!");
-        }
-
-        if (vkBindBufferMemory(engineDevice.logicalDevice, buffer, bufferMemory, 0)!= VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to bind buffer memory!");
-        }
-    }
-
-    void Renderer::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
-    {
-        VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-
-        VkBufferCopy copyRegion{};
-        copyRegion.size = size;
-        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-        EndSingleTimeCommands(commandBuffer);
-    }
-
-    void Renderer::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
-    {
-        VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-        VkBufferImageCopy region{};
-        region.bufferOffset = 0;
-        region.bufferRowLength = 0;
-        region.bufferImageHeight = 0;
-
-        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.mipLevel = 0;
-        region.imageSubresource.baseArrayLayer = 0;
-        region.imageSubresource.layerCount = 1;
-
-        region.imageOffset = {0, 0, 0};
-        region.imageExtent = {
-            width,
-            height,
-            1
-        };
-        vkCmdCopyBufferToImage(
-        commandBuffer,
-        buffer,
-        image,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        1,
-        &region
-);
-        EndSingleTimeCommands(commandBuffer);
+        //A range of a shared block, bound and mapped when host visible
+        bufferMemory = engineAllocator.AllocateBuffer(buffer, properties);
     }
 
     Renderer::~Renderer()
@@ -719,7 +1281,7 @@ namespace Minerva
         std::cout << "Destruction Renderer... \n";
         vkDestroyImageView(engineDevice.logicalDevice, depthImageView, nullptr);
         vkDestroyImage(engineDevice.logicalDevice, depthImage, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, depthImageMemory, nullptr);
+        engineAllocator.Free(depthImageMemory);
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
             vkDestroySemaphore(engineDevice.logicalDevice, renderFinishedSemaphores[i], nullptr);
             vkDestroySemaphore(engineDevice.logicalDevice, imageAvailableSemaphores[i], nullptr);
@@ -728,17 +1290,45 @@ namespace Minerva
         for (auto framebuffer : swapChainFramebuffers) {
             vkDestroyFramebuffer(engineDevice.logicalDevice, framebuffer, nullptr);
         }
+        for (size_t i = 0; i < computeFinishedSemaphores.size(); i++) {
+            vkDestroySemaphore(engineDevice.logicalDevice, computeFinishedSemaphores[i], nullptr);
+            vkDestroySemaphore(engineDevice.logicalDevice, uploadFinishedSemaphores[i], nullptr);
+        }
         vkDestroyCommandPool(engineDevice.logicalDevice, commandPool, nullptr);
+        vkDestroyCommandPool(engineDevice.logicalDevice, computeCommandPool, nullptr);
+        for (auto pool : slicePools) {
+            vkDestroyCommandPool(engineDevice.logicalDevice, pool, nullptr);
+        }
         vkDestroyRenderPass(engineDevice.logicalDevice, renderPass, nullptr);
 
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
             vkDestroyBuffer(engineDevice.logicalDevice, transformationUBuffers.uniformBuffers[i], nullptr);
-            vkFreeMemory(engineDevice.logicalDevice, transformationUBuffers.uniformBuffersMemory[i], nullptr);
-            vkDestroyBuffer(engineDevice.logicalDevice, animUBuffers.uniformBuffers[i], nullptr);
-            vkFreeMemory(engineDevice.logicalDevice, animUBuffers.uniformBuffersMemory[i], nullptr);
+            engineAllocator.Free(transformationUBuffers.uniformBuffersMemory[i]);
+            vkDestroyBuffer(engineDevice.logicalDevice, animSBuffers.storageBuffers[i], nullptr);
+            engineAllocator.Free(animSBuffers.storageBuffersMemory[i]);
+        }
+        for (size_t i = 0; i < indirectBuffers.storageBuffers.size(); i++) {
+            vkDestroyBuffer(engineDevice.logicalDevice, indirectBuffers.storageBuffers[i], nullptr);
+            engineAllocator.Free(indirectBuffers.storageBuffersMemory[i]);
+        }
+        vkDestroyBuffer(engineDevice.logicalDevice, bakedAnimBuffer, nullptr);
+        engineAllocator.Free(bakedAnimBufferMemory);
+        for (size_t i = 0; i < skinnedVertexBuffers.size(); i++) {
+            vkDestroyBuffer(engineDevice.logicalDevice, skinnedVertexBuffers[i], nullptr);
+            engineAllocator.Free(skinnedVertexBuffersMemory[i]);
+        }
+        vkDestroyBuffer(engineDevice.logicalDevice, meshletBuffer, nullptr);
+        engineAllocator.Free(meshletBufferMemory);
+        for (size_t i = 0; i < meshletDrawBuffers.size(); i++) {
+            vkDestroyBuffer(engineDevice.logicalDevice, meshletDrawBuffers[i], nullptr);
+            engineAllocator.Free(meshletDrawBuffersMemory[i]);
+            vkDestroyBuffer(engineDevice.logicalDevice, meshletDrawCounts.storageBuffers[i], nullptr);
+            engineAllocator.Free(meshletDrawCounts.storageBuffersMemory[i]);
         }
         vkDestroyDescriptorPool(engineDevice.logicalDevice, descriptorPool, nullptr);
         vkDestroyDescriptorSetLayout(engineDevice.logicalDevice, descriptorSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(engineDevice.logicalDevice, skinningSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(engineDevice.logicalDevice, meshletCullSetLayout, nullptr);
     }
     Renderer::Renderer(Renderer &&other) noexcept
     {
@@ -780,12 +1370,12 @@ namespace Minerva
         for (size_t i = 0; i < other.MAX_FRAMES_IN_FLIGHT; i++) 
         {
             vkDestroyBuffer(engineDevice.logicalDevice, other.transformationUBuffers.uniformBuffers[i], nullptr);
-            vkFreeMemory(engineDevice.logicalDevice, other.transformationUBuffers.uniformBuffersMemory[i], nullptr);
+            engineAllocator.Free(other.transformationUBuffers.uniformBuffersMemory[i]);
         }
 
         vkDestroyImageView(engineDevice.logicalDevice, other.depthImageView, nullptr);
         vkDestroyImage(engineDevice.logicalDevice, other.depthImage, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, other.depthImageMemory, nullptr);
+        engineAllocator.Free(other.depthImageMemory);
 
     }
     Renderer &Renderer::operator=(Renderer &&other) noexcept
@@ -828,12 +1418,12 @@ namespace Minerva
         for (size_t i = 0; i < other.MAX_FRAMES_IN_FLIGHT; i++) 
         {
             vkDestroyBuffer(engineDevice.logicalDevice, other.transformationUBuffers.uniformBuffers[i], nullptr);
-            vkFreeMemory(engineDevice.logicalDevice, other.transformationUBuffers.uniformBuffersMemory[i], nullptr);
+            engineAllocator.Free(other.transformationUBuffers.uniformBuffersMemory[i]);
         }
 
         vkDestroyImageView(engineDevice.logicalDevice, other.depthImageView, nullptr);
         vkDestroyImage(engineDevice.logicalDevice, other.depthImage, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, other.depthImageMemory, nullptr);
+        engineAllocator.Free(other.depthImageMemory);
 
         return *this;
     }
@@ -2,6 +2,9 @@
 #include "vulkan/vulkan.h"
 #include "vector"
 #include "Mesh.h"
+#include "BakedAnimation.h"
+#include "MeshLod.h"
+#include "DeviceAllocator.h"
 
 
 namespace Minerva
@@ -9,14 +12,59 @@ namespace Minerva
     struct UniformBuffers
     {
         std::vector<VkBuffer> uniformBuffers;
-        std::vector<VkDeviceMemory> uniformBuffersMemory;
+        std::vector<DeviceAllocation> uniformBuffersMemory;
         std::vector<void*> uniformBuffersMapped;
     };
 
-    struct BoneMatricesUniformType
+    /// @brief Persistently mapped storage buffers, one for each frame in flight
+    struct StorageBuffers
+    {
+        std::vector<VkBuffer> storageBuffers;
+        std::vector<DeviceAllocation> storageBuffersMemory;
+        std::vector<void*> storageBuffersMapped;
+        VkDeviceSize size = 0;
+    };
+
+    /// @brief The bone palette of a single instance. The animation storage buffer is an array 
+    /// of palettes indexed by gl_InstanceIndex in base.vert
+    struct BonePalette
     {
         glm::mat4 finalBoneMatrices[MAX_BONES];
     };
+    /// @brief Push constants of skinning.comp. The shader reads the skin stream as an array of uints,
+    /// so its stride is given in uints
+    struct SkinningConstants
+    {
+        uint32_t vertexCount;
+        uint32_t poseCount;
+        uint32_t skinStride;
+        uint32_t wideBoneIndices;
+    };
+    /// @brief Push constants of meshletCull.comp, 128 bytes so every device can hold them
+    struct MeshletCullConstants
+    {
+        //Frustum planes in the space of the instances, normalized and pointing inside
+        glm::vec4 planes[6];
+        glm::vec4 cameraPos;
+        uint32_t meshletCount;
+        uint32_t instanceCount;
+        //Draws reserved for the 16 bit batch, the 32 bit batch starts after them
+        uint32_t narrowCapacity;
+        uint32_t padding;
+    };
+    class JobSystem;
+    /// @brief A draw call of the render pass, an indirect draw of one or more commands
+    struct RenderDrawCall
+    {
+        VkIndexType indexType;
+        //Start of the index batch in the index arena
+        VkDeviceSize indexOffset;
+        uint32_t firstDraw;
+        uint32_t drawCount;
+        //Offset of the count written by the meshlet culling, read only when counted
+        VkDeviceSize countOffset;
+        bool counted;
+    };
     class Renderer
     {
     public:
@@ -28,13 +76,79 @@ namespace Minerva
         std::vector<VkSemaphore> imageAvailableSemaphores;
         std::vector<VkSemaphore> renderFinishedSemaphores;
         std::vector<VkFence> inFlightFences;
+        /*With an async compute queue the skinning and culling passes are submitted to it, the frame waits
+        for them and they wait for the uploads submitted before the frame*/
+        bool asyncCompute = false;
+        VkCommandPool computeCommandPool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> computeCommandBuffers;
+        std::vector<VkSemaphore> computeFinishedSemaphores;
+        std::vector<VkSemaphore> uploadFinishedSemaphores;
+        /*Parallel recording of the render pass: the draw calls of a frame are split in slices, each recorded
+        by a job into a secondary command buffer from a pool of its own for every frame in flight. The UI gets
+        a secondary buffer too, the primary one executes them in order. With multiDrawIndirect a frame has
+        a call for each index batch at most and is recorded inline, unless perDrawCalls is set*/
+        JobSystem* recordingJobs = nullptr;
+        //Slices of a frame at most, zero when the jobs have a single thread
+        uint32_t recordingSliceCount = 0;
+        //Issues a call for every indirect draw, like a device without multiDrawIndirect. The draws of the culling pass are counted by the GPU and keep their calls
+        bool perDrawCalls = false;
+        std::vector<VkCommandPool> slicePools;
+        std::vector<VkCommandBuffer> sliceCommandBuffers;
+        std::vector<VkCommandBuffer> uiCommandBuffers;
+        //Result of every slice, checked on the recording thread once the jobs are joined
+        std::vector<VkResult> sliceResults;
+        //The secondary buffers executed by the frame, the slices and the UI
+        std::vector<VkCommandBuffer> secondaryCommandBuffers;
+        //Fewer calls are recorded inline, a secondary command buffer isn't free
+        static constexpr size_t MIN_CALLS_PER_SLICE = 64;
+        std::vector<RenderDrawCall> frameDrawCalls;
+        //Slices of the last frame, zero when it was recorded inline, and the CPU time of its draws and render pass
+        uint32_t recordedSlices = 0;
+        double recordMilliseconds = 0.0;
         VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
         bool framebufferResized = false;
         VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
         const int MAX_FRAMES_IN_FLIGHT = 2;
         UniformBuffers transformationUBuffers; 
-        UniformBuffers animUBuffers; 
-        BoneMatricesUniformType UNBoneMatrices;
+        StorageBuffers animSBuffers; 
+        //Device local buffer with the baked clips, read only by the vertex shader
+        VkBuffer bakedAnimBuffer = VK_NULL_HANDLE;
+        DeviceAllocation bakedAnimBufferMemory;
+        VkDeviceSize bakedAnimBufferSize = 0;
+        //Positions skinned by the compute pass, one buffer for each frame in flight. Zero poses disable the pass
+        std::vector<VkBuffer> skinnedVertexBuffers;
+        std::vector<DeviceAllocation> skinnedVertexBuffersMemory;
+        VkDeviceSize skinnedVertexBufferSize = 0;
+        uint32_t skinnedPoseCount = 0;
+        VkDescriptorSetLayout skinningSetLayout = VK_NULL_HANDLE;
+        //Indexed indirect draws of every mesh of the arenas, a draw for each run of instances drawing the
+        //same LOD, one buffer for each frame in flight
+        StorageBuffers indirectBuffers;
+        uint32_t drawCount = 0;
+        //The draws of the meshes with 16 bit indices come first in the indirect buffer
+        uint32_t narrowDrawCount = 0;
+        //Selects the LOD of every mesh and instance when the draws are written
+        MeshLodSettings meshLod;
+        //Triangles drawn by the last draws written, and the number of instances of every mesh at each LOD
+        uint64_t renderedTriangles = 0;
+        std::vector<uint32_t> lodInstanceCounts;
+        //The LOD chosen for every instance of the mesh being written, it only grows with the instances
+        std::vector<uint8_t> instanceLods;
+        //Meshlets of every mesh, in the index arena, the 16 bit ones first. Zero meshlets disable the culling pass
+        VkBuffer meshletBuffer = VK_NULL_HANDLE;
+        DeviceAllocation meshletBufferMemory;
+        VkDeviceSize meshletBufferSize = 0;
+        uint32_t meshletCount = 0;
+        uint32_t narrowMeshletCount = 0;
+        //Draws of the visible meshlets of every instance, written by the culling pass, one buffer for each frame in flight
+        std::vector<VkBuffer> meshletDrawBuffers;
+        std::vector<DeviceAllocation> meshletDrawBuffersMemory;
+        VkDeviceSize meshletDrawBufferSize = 0;
+        //Bytes before the draws of a meshlet draw buffer, holding the draw count of each batch
+        static constexpr VkDeviceSize MESHLET_DRAW_HEADER = 4 * sizeof(uint32_t);
+        //Draw counts copied back after each frame, read once the frame has finished
+        StorageBuffers meshletDrawCounts;
+        VkDescriptorSetLayout meshletCullSetLayout = VK_NULL_HANDLE;
 
         void CreateRenderPass();
         void CreateFramebuffers();
@@ -42,28 +156,71 @@ namespace Minerva
         void CreateCommandBuffer();
         void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
         void DrawFrame();
+        /// @brief Waits until the GPU has finished with the resources of the current frame, so the 
+        /// CPU can safely write into its persistently mapped buffers
+        void WaitForCurrentFrame();
+        /// @brief Gets the palettes of the current frame in flight
+        BonePalette* GetFramePalettes();
         void CreateSyncObjects();
         void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-        VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-        void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-        void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+        VkBuffer& buffer, DeviceAllocation& bufferMemory);
+        /// @brief Packs the streams of every mesh and uploads them into the vertex arena
         void CreateVertexBuffer();
         void CreateInstanceBuffer();
+        /// @brief Copies engineModLoader.instancesData into the instance buffer. The copy runs before the next
+        /// frame, once the frames in flight are done reading the buffer
+        void UploadInstanceBuffer();
+        /// @brief Creates the buffer of the baked clips, the header alone when nothing was baked
+        void CreateBakedAnimationBuffer(const BakedAnimations& bakedAnimations);
+        /// @brief Creates the output buffers of the compute skinning, a single position when poseCount is zero
+        /// @param poseCount The number of poses skinned every frame
+        void CreateSkinnedVertexBuffers(uint32_t poseCount);
+        /// @brief Creates a pool for every frame in flight and thread of the jobs, enabling the parallel recording.
+        /// Call it after CreateCommandBuffer
+        void CreateParallelRecording(JobSystem& jobs);
+        /// @brief Splits the indirect draws of the frame in the calls of the render pass
+        void BuildDrawCalls();
+        /// @brief Binds the state of the render pass and records the calls in [firstCall, endCall)
+        void RecordDraws(VkCommandBuffer commandBuffer, const std::vector<RenderDrawCall>& calls, size_t firstCall, size_t endCall);
+        /// @brief Records callCount single draw calls, taken in turn from the draws of the frame, into secondary 
+        /// command buffers split in a slice for every thread of the jobs. The buffers come from pools of their own and
+        /// are never submitted, so it can run while a frame is recorded. Used by the benchmarks
+        /// @param frameCount The number of times the calls are recorded
+        /// @return The average time to record the calls in milliseconds, zero when the frame has no draws
+        double MeasureRecording(JobSystem& jobs, size_t callCount, int frameCount);
+        /// @brief Records the compute passes of the frame, in the graphics command buffer without an async compute queue
+        void RecordComputePasses(VkCommandBuffer commandBuffer);
+        /// @brief Skins every pose of the current frame once, before the render pass reads the positions
+        void RecordSkinningPass(VkCommandBuffer commandBuffer);
+        /// @brief Uploads the meshlets of every mesh and creates the draw buffers of the culling pass, 
+        /// a single draw when the culling is disabled. Call it after CreateIndexBuffer
+        /// @param enabled Whether the meshlets replace the draws of whole meshes
+        void CreateMeshletBuffers(bool enabled);
+        /// @brief Culls the meshlets of every instance against the frustum and their normal cone, 
+        /// writing the draws of the visible ones before the render pass
+        void RecordMeshletCullingPass(VkCommandBuffer commandBuffer);
+        /// @brief Number of meshlet draws of the last finished frame, in both batches
+        uint32_t VisibleMeshletDraws() const;
+        /// @brief Concatenates the indices of every mesh into the index arena, narrowed to 16 bit for the 
+        /// meshes that allow it
         void CreateIndexBuffer();
+        /// @brief Creates the persistently mapped indirect buffers, with room for a draw for each mesh and instance
+        void CreateIndirectBuffers();
+        /// @brief Selects the LOD of every mesh for each instance and writes the draws into the indirect 
+        /// buffer of the current frame, one for each run of consecutive instances drawing the same LOD
+        void WriteIndirectDraws();
         void CreateDescriptorSetLayout();
         void CreateDescriptorPool();
         void CreateDescriptorSets();
         void UpdateUniformBuffer(uint32_t currentImage);
-        VkCommandBuffer BeginSingleTimeCommands();
-        void EndSingleTimeCommands(VkCommandBuffer commandBuffer);
-        void TransitionImageLayout(VkImage image, VkFormat format, 
+        /// @brief Records the barrier moving the image to newLayout
+        void TransitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, 
         VkImageLayout oldLayout, VkImageLayout newLayout);
         void CreateDepthResources();
         VkFormat FindSupportedFormat(const std::vector<VkFormat>& candidates, 
         VkImageTiling tiling, VkFormatFeatureFlags features);
         VkFormat FindDepthFormat();
         bool HasStencilComponent(VkFormat format);
-        uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 
         Renderer() = default;
         ~Renderer();
@@ -79,9 +236,11 @@ namespace Minerva
         
           
         VkImage depthImage;
-        VkDeviceMemory depthImageMemory;
+        DeviceAllocation depthImageMemory;
         VkImageView depthImageView;
         std::vector<VkDescriptorSet> descriptorSets;
+        std::vector<VkDescriptorSet> skinningDescriptorSets;
+        std::vector<VkDescriptorSet> meshletCullDescriptorSets;
         
         
     };
@@ -1,3 +1,7 @@
 C:/VulkanSDK/1.3.268.0/Bin/glslc.exe base.vert -o vert.spv
 C:/VulkanSDK/1.3.268.0/Bin/glslc.exe base.frag -o frag.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe skinned.vert -o skinnedVert.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe static.vert -o staticVert.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe skinning.comp -o skinningComp.spv
+C:/VulkanSDK/1.3.268.0/Bin/glslc.exe meshletCull.comp -o meshletCullComp.spv
 pause
\ No newline at end of file
@@ -1,12 +1,14 @@
 #version 450
 
+//Position stream, shading stream (half-float UVs) and skin stream (8/16 bit indices, unorm8 weights)
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 layout(location = 3) in vec3 inOffsetPos;
 layout(location = 4) in float inOffsetScale;
 layout(location = 5) in ivec4 inBoneID;
 layout(location = 6) in vec4 inWeight;
+layout(location = 7) in uint inAnimClip;
+layout(location = 8) in vec2 inAnimTime;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
@@ -15,19 +17,70 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
     mat4 view;
     mat4 proj;
+    float animationTime;
+    uint bakedAnimation;
+    uint poseCount;
 } ubo;
 
 const int MAX_BONES = 100;
 const int MAX_BONE_PER_VERTEX = 4;
 
-layout(binding = 2) uniform animBufferObk 
+//Every pose owns MAX_BONES matrices, the instance reads the palette starting at (gl_InstanceIndex % poseCount) * MAX_BONES
+layout(std430, binding = 2) readonly buffer animBufferObj 
 {
-    mat4 finalBonesMatrices[MAX_BONES];
+    mat4 finalBonesMatrices[];
 
 } anim;
 
+const int MAX_BAKED_CLIPS = 16;
+
+struct BakedClip
+{
+    uint firstFrame;
+    uint frameCount;
+    float frameRate;
+    float duration;
+};
+
+//Clips sampled at a fixed rate. Every frame stores boneCount bones, every bone the 3 rows of its affine matrix
+layout(std430, binding = 3) readonly buffer bakedBufferObj 
+{
+    uint boneCount;
+    uint clipCount;
+    uint padding0;
+    uint padding1;
+    BakedClip clips[MAX_BAKED_CLIPS];
+    vec4 rows[];
+
+} baked;
+
+//Blends the bone between two baked frames, the matrix rows are stored as the columns of the result
+mat4 BakedBoneMatrix(uint frame0, uint frame1, float factor, int bone)
+{
+    uint row0 = (frame0 * baked.boneCount + uint(bone)) * 3;
+    uint row1 = (frame1 * baked.boneCount + uint(bone)) * 3;
+    mat4 rows = mat4(mix(baked.rows[row0], baked.rows[row1], factor),
+    mix(baked.rows[row0 + 1], baked.rows[row1 + 1], factor),
+    mix(baked.rows[row0 + 2], baked.rows[row1 + 2], factor), vec4(0.0, 0.0, 0.0, 1.0));
+    return transpose(rows);
+}
+
 void main() {
 
+    uint frame0 = 0;
+    uint frame1 = 0;
+    float frameFactor = 0.0;
+    if(ubo.bakedAnimation != 0)
+    {
+        BakedClip clip = baked.clips[min(inAnimClip, baked.clipCount - 1)];
+        float clipTime = mod(ubo.animationTime * inAnimTime.y + inAnimTime.x, clip.duration);
+        float frame = clipTime * clip.frameRate;
+        uint localFrame = min(uint(frame), clip.frameCount - 1);
+        frame0 = clip.firstFrame + localFrame;
+        frame1 = clip.firstFrame + min(localFrame + 1, clip.frameCount - 1);
+        frameFactor = fract(frame);
+    }
+
     vec4 totalPosition = vec4(0.0);
     for(int i = 0 ; i < MAX_BONE_PER_VERTEX ; i++)
     {
@@ -42,12 +95,13 @@ void main() {
             totalPosition = vec4((inPosition * inOffsetScale) + inOffsetPos,1.0);
             break;
         }
-        vec4 localPosition = anim.finalBonesMatrices[inBoneID[i]] * 
-        vec4(inPosition, 1.0);
+        mat4 boneMatrix = ubo.bakedAnimation != 0 ? BakedBoneMatrix(frame0, frame1, frameFactor, inBoneID[i]) :
+        anim.finalBonesMatrices[(gl_InstanceIndex % ubo.poseCount) * MAX_BONES + inBoneID[i]];
+        vec4 localPosition = boneMatrix * vec4(inPosition, 1.0);
         totalPosition += ((localPosition * inOffsetScale) + vec4(inOffsetPos, 1.0)) * inWeight[i];
     }
 
     gl_Position = ubo.proj * ubo.view * ubo.model * totalPosition;
-    fragColor = inColor;
+    fragColor = vec3(1.0);
     fragTexCoord = inTexCoord;
 }
\ No newline at end of file
@@ -0,0 +1,42 @@
+#version 450
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in vec3 inOffsetPos;
+layout(location = 4) in float inOffsetScale;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    float animationTime;
+    uint bakedAnimation;
+    uint poseCount;
+} ubo;
+
+//Written by skinning.comp, the instance reads the pose gl_InstanceIndex % poseCount
+layout(std430, binding = 4) readonly buffer skinnedBufferObj 
+{
+    vec4 positions[];
+
+} skinned;
+
+void main() {
+
+    uint vertexCount = skinned.positions.length() / ubo.poseCount;
+    vec4 skinnedPosition = skinned.positions[(gl_InstanceIndex % ubo.poseCount) * vertexCount + gl_VertexIndex];
+
+    //Gives the same position of base.vert, which adds the instance offset to every weighted bone
+    vec4 totalPosition;
+    if(skinnedPosition.w < 0.0)
+        totalPosition = vec4((skinnedPosition.xyz * inOffsetScale) + inOffsetPos, 1.0);
+    else
+        totalPosition = skinnedPosition * inOffsetScale + vec4(inOffsetPos, 1.0) * skinnedPosition.w;
+
+    gl_Position = ubo.proj * ubo.view * ubo.model * totalPosition;
+    fragColor = vec3(1.0);
+    fragTexCoord = inTexCoord;
+}
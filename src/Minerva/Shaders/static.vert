@@ -0,0 +1,27 @@
+#version 450
+
+//Static meshes have no skin stream, only the position and shading streams are bound
+layout(location = 0) in vec3 inPosition;
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in vec3 inOffsetPos;
+layout(location = 4) in float inOffsetScale;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    float animationTime;
+    uint bakedAnimation;
+    uint poseCount;
+} ubo;
+
+void main() {
+
+    vec4 totalPosition = vec4((inPosition * inOffsetScale) + inOffsetPos, 1.0);
+    gl_Position = ubo.proj * ubo.view * ubo.model * totalPosition;
+    fragColor = vec3(1.0);
+    fragTexCoord = inTexCoord;
+}
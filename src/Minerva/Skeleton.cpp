@@ -0,0 +1,146 @@
+#include "Skeleton.h"
+#include "MeshCache.h"
+#include "ModelLoader.h"
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+
+namespace Minerva
+{
+    constexpr uint32_t COOKED_SKELETON_MAGIC = 0x4B53494Du; //"MISK"
+    constexpr uint32_t COOKED_SKELETON_VERSION = 1;
+
+    struct CookedSkeletonHeader
+    {
+        uint32_t magic = COOKED_SKELETON_MAGIC;
+        uint32_t version = COOKED_SKELETON_VERSION;
+        uint64_t hash = 0;
+        uint32_t jointCount = 0;
+        int32_t paletteSize = 0;
+    };
+
+    //Live skeletons by hash. The registry doesn't keep them alive, the last clip releasing one frees it
+    static std::mutex registryMutex;
+    static std::unordered_map<uint64_t, std::weak_ptr<const Skeleton>> registry;
+
+    int Skeleton::FindJoint(const std::string &name) const
+    {
+        auto iter = std::find(names.begin(), names.end(), name);
+        return iter == names.end() ? -1 : static_cast<int>(iter - names.begin());
+    }
+
+    size_t Skeleton::MemoryUsage() const
+    {
+        size_t bytes = joints.size() * sizeof(SkeletonJoint) + bindPoses.size() * sizeof(TrackBindPose);
+        for (const auto& name : names)
+            bytes += name.capacity();
+        return bytes;
+    }
+
+    std::shared_ptr<const Skeleton> Skeleton::FromHierarchy(const aiNode *root, const std::map<std::string, Mesh::BoneInfo> &bones)
+    {
+        Skeleton skeleton;
+        //Pre-order visit: a joint is always pushed after its parent
+        std::vector<std::pair<const aiNode*, int>> toVisit {{root, -1}};
+        while (!toVisit.empty())
+        {
+            auto [node, parent] = toVisit.back();
+            toVisit.pop_back();
+
+            SkeletonJoint joint;
+            joint.parent = parent;
+            joint.bindTransform = ToAffine(ModelLoader::ConvertMatrixToGLMFormat(node->mTransformation));
+            joint.offset = ToAffine(glm::mat4(1.0f));
+            auto boneInfo = bones.find(node->mName.C_Str());
+            if (boneInfo != bones.end() && boneInfo->second.id < MAX_BONES)
+            {
+                joint.paletteSlot = boneInfo->second.id;
+                joint.offset = ToAffine(boneInfo->second.offset);
+                skeleton.paletteSize = std::max(skeleton.paletteSize, joint.paletteSlot + 1);
+            }
+
+            int jointIndex = static_cast<int>(skeleton.joints.size());
+            skeleton.joints.emplace_back(joint);
+            skeleton.names.emplace_back(node->mName.C_Str());
+            for (int i = static_cast<int>(node->mNumChildren) - 1; i >= 0; i--)
+                toVisit.emplace_back(node->mChildren[i], jointIndex);
+        }
+        return Share(std::move(skeleton));
+    }
+
+    std::shared_ptr<const Skeleton> Skeleton::Load(const std::string &path, uint64_t hash)
+    {
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            auto live = registry.find(hash);
+            if (live != registry.end())
+            {
+                if (auto skeleton = live->second.lock())
+                    return skeleton;
+            }
+        }
+
+        MappedFile file;
+        if (!file.Open(path))
+            return nullptr;
+        FileCursor cursor(file);
+        CookedSkeletonHeader header;
+        Skeleton skeleton;
+        bool valid = cursor.Read(&header, sizeof(header)) && header.magic == COOKED_SKELETON_MAGIC
+        && header.version == COOKED_SKELETON_VERSION && header.hash == hash
+        && cursor.Read(skeleton.joints, header.jointCount);
+        skeleton.names.resize(valid ? header.jointCount : 0);
+        for (auto& name : skeleton.names)
+        {
+            uint32_t length = 0;
+            valid = valid && cursor.Read(&length, sizeof(length)) && cursor.Read(name, length);
+        }
+        if (!valid)
+            return nullptr;
+        skeleton.paletteSize = header.paletteSize;
+        auto shared = Share(std::move(skeleton));
+        //The content decides the hash, a file renamed by hand can't pass for another skeleton
+        return shared->hash == hash ? shared : nullptr;
+    }
+
+    void Skeleton::Cook(const std::string &path) const
+    {
+        CookedSkeletonHeader header;
+        header.hash = hash;
+        header.jointCount = static_cast<uint32_t>(joints.size());
+        header.paletteSize = paletteSize;
+        std::vector<unsigned char> file;
+        AppendBytes(file, &header, sizeof(header));
+        AppendBytes(file, joints.data(), joints.size() * sizeof(SkeletonJoint));
+        for (const auto& name : names)
+        {
+            uint32_t length = static_cast<uint32_t>(name.size());
+            AppendBytes(file, &length, sizeof(length));
+            AppendBytes(file, name.data(), name.size());
+        }
+        WriteFileAtomically(path, file.data(), file.size());
+    }
+
+    std::shared_ptr<const Skeleton> Skeleton::Share(Skeleton &&skeleton)
+    {
+        uint64_t hash = HashBytes(skeleton.joints.data(), skeleton.joints.size() * sizeof(SkeletonJoint));
+        for (const auto& name : skeleton.names)
+            hash = HashBytes(name.c_str(), name.size() + 1, hash);
+        skeleton.hash = hash;
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        std::weak_ptr<const Skeleton>& live = registry[hash];
+        if (auto shared = live.lock())
+            return shared;
+
+        skeleton.bindPoses.resize(skeleton.joints.size());
+        for (size_t i = 0; i < skeleton.joints.size(); i++)
+        {
+            TrackBindPose& bindPose = skeleton.bindPoses[i];
+            DecomposeAffine(skeleton.joints[i].bindTransform, bindPose.position, bindPose.rotation, bindPose.scale);
+        }
+        auto shared = std::make_shared<const Skeleton>(std::move(skeleton));
+        live = shared;
+        return shared;
+    }
+}
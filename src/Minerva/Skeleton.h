@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <cstdint>
+#include "PoseKernels.h"
+#include "Mesh.h"
+
+namespace Minerva
+{
+    /// @brief Is a joint of a skeleton. The joints are stored in a flat array sorted so that every
+    /// parent comes before its children
+    struct SkeletonJoint
+    {
+        //Index of the parent joint, -1 for the root
+        int parent = -1;
+        //Slot of the joint inside the bone palette, -1 if the joint isn't a bone
+        int paletteSlot = -1;
+        Affine3x4 bindTransform;
+        Affine3x4 offset;
+    };
+
+    /// @brief Is the local bind transform of a joint split in translation, rotation and scale
+    struct TrackBindPose
+    {
+        glm::vec3 position;
+        glm::quat rotation;
+        glm::vec3 scale;
+    };
+
+    /// @brief The node hierarchy and the bones of a rig, shared by every clip that animates it.
+    /// Skeletons are immutable once built and handed out by reference count: building or loading a
+    /// skeleton identical to a live one returns the live one
+    class Skeleton
+    {
+    public:
+        std::vector<SkeletonJoint> joints;
+        std::vector<std::string> names;
+        //Bind transform of every joint, decomposed for the tracks missing from a blended clip
+        std::vector<TrackBindPose> bindPoses;
+        //Number of palette slots written by the skeleton
+        int paletteSize = 0;
+        //Hash of the joints, their names and their bones, the identity of the skeleton
+        uint64_t hash = 0;
+
+        /// @brief Returns the index of the joint, -1 when no joint has the name
+        int FindJoint(const std::string& name) const;
+        size_t MemoryUsage() const;
+        /// @brief Flattens the node hierarchy of a scene. The joints named in bones take their palette slot and offset
+        static std::shared_ptr<const Skeleton> FromHierarchy(const aiNode* root, const std::map<std::string, Mesh::BoneInfo>& bones);
+        /// @brief Returns the live skeleton with the hash, or reads it from its cooked file
+        /// @return Null when the file is missing or doesn't hold that skeleton
+        static std::shared_ptr<const Skeleton> Load(const std::string& path, uint64_t hash);
+        /// @brief Writes the skeleton into its cooked file
+        void Cook(const std::string& path) const;
+    private:
+        /// @brief Fills the bind poses and the hash, then returns the live skeleton with the same hash if any
+        static std::shared_ptr<const Skeleton> Share(Skeleton&& skeleton);
+    };
+}
@@ -9,37 +9,31 @@ namespace Minerva
 {
     void TextureManager::CreateTextureImage(std::string textureFileName)
     {
-        int texWidth, texHeight, texChannels;
+        UploadTexture(DecodeTexture(textureFileName));
+    }
+    TextureData TextureManager::DecodeTexture(const std::string &textureFileName) const
+    {
+        TextureData textureData;
+        int texChannels;
         stbi_uc* pixels = stbi_load((TEXTURES_PATH + textureFileName).c_str(),
-         &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-        VkDeviceSize imageSize = texWidth * texHeight * 4;
+         &textureData.width, &textureData.height, &texChannels, STBI_rgb_alpha);
 
         if (!pixels) {
             throw std::runtime_error("failed to load texture image!");
         }
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        engineRenderer.CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT 
-        | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-        void* data;
-        vkMapMemory(engineDevice.logicalDevice, stagingBufferMemory, 0, imageSize, 0, &data);
-            memcpy(data, pixels, static_cast<size_t>(imageSize));
-        vkUnmapMemory(engineDevice.logicalDevice, stagingBufferMemory);
-        stbi_image_free(pixels);
-
+        textureData.pixels = std::unique_ptr<unsigned char, void(*)(void*)>(pixels, stbi_image_free);
+        return textureData;
+    }
+    void TextureManager::UploadTexture(const TextureData &textureData)
+    {
+        uint32_t texWidth = static_cast<uint32_t>(textureData.width);
+        uint32_t texHeight = static_cast<uint32_t>(textureData.height);
         CreateImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, 
         VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
-        engineRenderer.TransitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, 
-        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-            engineRenderer.CopyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth),
-            static_cast<uint32_t>(texHeight));
-        engineRenderer.TransitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-        vkDestroyBuffer(engineDevice.logicalDevice, stagingBuffer, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, stagingBufferMemory, nullptr);
+        engineUploader.UploadImage(textureImage, texWidth, texHeight, textureData.pixels.get());
     }
-    void TextureManager::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &imageMemory)
+    void TextureManager::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image, DeviceAllocation &imageMemory)
     {
         VkImageCreateInfo imageInfo{};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -60,19 +54,7 @@ namespace Minerva
             throw std::runtime_error("failed to create image!");
         }
 
-        VkMemoryRequirements memRequirements;
-        vkGetImageMemoryRequirements(engineDevice.logicalDevice, image, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = engineRenderer.FindMemoryType(memRequirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(engineDevice.logicalDevice, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate image memory!");
-        }
-
-        vkBindImageMemory(engineDevice.logicalDevice, image, imageMemory, 0);
+        imageMemory = engineAllocator.AllocateImage(image, tiling, properties);
     }
     void TextureManager::CreateTextureImageView()
     {
@@ -109,7 +91,7 @@ namespace Minerva
         vkDestroySampler(engineDevice.logicalDevice, textureSampler, nullptr);
         vkDestroyImageView(engineDevice.logicalDevice, textureImageView, nullptr);
         vkDestroyImage(engineDevice.logicalDevice, textureImage, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, textureImageMemory, nullptr);
+        engineAllocator.Free(textureImageMemory);
     }
     TextureManager::TextureManager(TextureManager &&other) noexcept
     {
@@ -121,7 +103,7 @@ namespace Minerva
         vkDestroySampler(engineDevice.logicalDevice, other.textureSampler, nullptr);
         vkDestroyImageView(engineDevice.logicalDevice, other.textureImageView, nullptr);
         vkDestroyImage(engineDevice.logicalDevice, other.textureImage, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, other.textureImageMemory, nullptr);
+        engineAllocator.Free(other.textureImageMemory);
     }
     TextureManager &TextureManager::operator=(TextureManager &&other) noexcept
     {
@@ -133,7 +115,7 @@ namespace Minerva
         vkDestroySampler(engineDevice.logicalDevice, other.textureSampler, nullptr);
         vkDestroyImageView(engineDevice.logicalDevice, other.textureImageView, nullptr);
         vkDestroyImage(engineDevice.logicalDevice, other.textureImage, nullptr);
-        vkFreeMemory(engineDevice.logicalDevice, other.textureImageMemory, nullptr);
+        engineAllocator.Free(other.textureImageMemory);
 
         return *this;
     }
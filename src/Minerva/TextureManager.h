@@ -1,19 +1,36 @@
 #pragma once 
 #include "vulkan/vulkan.h"
 #include "String"
+#include <memory>
+#include "DeviceAllocator.h"
 namespace Minerva
 {
+    /// @brief Pixels of a texture decoded on the CPU, waiting to be uploaded
+    struct TextureData
+    {
+        int width = 0;
+        int height = 0;
+        //RGBA pixels, freed by stb_image
+        std::unique_ptr<unsigned char, void(*)(void*)> pixels{nullptr, nullptr};
+        VkDeviceSize Size() const { return static_cast<VkDeviceSize>(width) * height * 4; }
+    };
+
     class TextureManager
     {
     public:
         VkImageView textureImageView = VK_NULL_HANDLE;
         VkSampler textureSampler = VK_NULL_HANDLE;
         void CreateTextureImage(std::string textureFileName);  
+        /// @brief Decodes the texture without touching the device, it can run on any thread
+        TextureData DecodeTexture(const std::string& textureFileName) const;
+        /// @brief Creates the texture image and records the copy of the decoded pixels into the upload manager,
+        /// the pixels can be released on return
+        void UploadTexture(const TextureData& textureData);
         void CreateTextureImageView();
         void CreateTextureSampler();
         void CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, 
         VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, 
-        VkDeviceMemory& imageMemory);
+        DeviceAllocation& imageMemory);
         TextureManager() = default;
         ~TextureManager();
 
@@ -25,7 +42,7 @@ namespace Minerva
     private:
         const std::string TEXTURES_PATH = "C:/UNIMI/TESI/Phoenix/src/Minerva/Textures/";
         VkImage textureImage = VK_NULL_HANDLE;
-        VkDeviceMemory textureImageMemory = VK_NULL_HANDLE;
+        DeviceAllocation textureImageMemory;
         
     };
 }
\ No newline at end of file
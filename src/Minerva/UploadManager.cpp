@@ -0,0 +1,418 @@
+#include "UploadManager.h"
+#include "EngineVars.h"
+#include <cstring>
+#include <algorithm>
+
+namespace Minerva
+{
+    //Largest chunk of a single copy, so a chunk always fits the ring once the previous batches are done
+    static constexpr VkDeviceSize MAX_CHUNK_SIZE = UploadManager::RING_SIZE / 2;
+
+    static VkCommandPool CreateUploadPool(uint32_t queueFamily)
+    {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = queueFamily;
+        if (vkCreateCommandPool(engineDevice.logicalDevice, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create command pool!");
+        }
+        return pool;
+    }
+
+    static VkCommandBuffer AllocateUploadCommands(VkCommandPool pool)
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = pool;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(engineDevice.logicalDevice, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
+        return commandBuffer;
+    }
+
+    static void BeginUploadCommands(VkCommandBuffer commandBuffer)
+    {
+        vkResetCommandBuffer(commandBuffer, 0);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin command buffer!");
+        }
+
+        //The copies may overwrite resources still used by the work submitted before, so they wait for it
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    void UploadManager::Init(uint32_t transferFamily, VkQueue transferQueue, uint32_t graphicsFamily, VkQueue graphicsQueue)
+    {
+        this->transferFamily = transferFamily;
+        this->transferQueue = transferQueue;
+        this->graphicsFamily = graphicsFamily;
+        this->graphicsQueue = graphicsQueue;
+        graphicsPool = CreateUploadPool(graphicsFamily);
+        if (HasTransferQueue())
+            transferPool = CreateUploadPool(transferFamily);
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = RING_SIZE;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        //Both queues copy from the ring
+        uint32_t families[] = {transferFamily, graphicsFamily};
+        if (HasTransferQueue()) {
+            bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufferInfo.queueFamilyIndexCount = 2;
+            bufferInfo.pQueueFamilyIndices = families;
+        }
+        if (vkCreateBuffer(engineDevice.logicalDevice, &bufferInfo, nullptr, &ringBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create buffer!");
+        }
+        ringMemory = engineAllocator.AllocateBuffer(ringBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+        | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(engineDevice.physicalDevice, &properties);
+        chunkAlignment = std::max<VkDeviceSize>(chunkAlignment, properties.limits.optimalBufferCopyOffsetAlignment);
+    }
+
+    UploadHandle UploadManager::UploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size,
+    bool inUse)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto source = static_cast<const unsigned char*>(data);
+        for (VkDeviceSize copied = 0; copied < size;)
+        {
+            VkDeviceSize chunkSize = std::min(size - copied, MAX_CHUNK_SIZE);
+            VkDeviceSize ringOffset = AllocateRing(chunkSize);
+            memcpy(static_cast<unsigned char*>(ringMemory.mapped) + ringOffset, source + copied, (size_t) chunkSize);
+
+            VkBufferCopy copyRegion{};
+            copyRegion.srcOffset = ringOffset;
+            copyRegion.dstOffset = offset + copied;
+            copyRegion.size = chunkSize;
+            //The transfer queue doesn't wait for the frames, so the copies into buffers in use stay on the graphics one
+            vkCmdCopyBuffer(inUse ? GraphicsCommands() : TransferCommands(), ringBuffer, buffer, 1, &copyRegion);
+            copied += chunkSize;
+        }
+        return openBatch.handle;
+    }
+
+    UploadHandle UploadManager::UploadImage(VkImage image, uint32_t width, uint32_t height, const void *pixels)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        VkDeviceSize rowSize = static_cast<VkDeviceSize>(width) * 4;
+        if (rowSize > MAX_CHUNK_SIZE) {
+            throw std::runtime_error("image too wide for the staging ring!");
+        }
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(TransferCommands(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        //The chunks are bands of whole rows
+        auto source = static_cast<const unsigned char*>(pixels);
+        uint32_t rowsPerChunk = static_cast<uint32_t>(MAX_CHUNK_SIZE / rowSize);
+        for (uint32_t row = 0; row < height;)
+        {
+            uint32_t rowCount = std::min(rowsPerChunk, height - row);
+            VkDeviceSize chunkSize = rowSize * rowCount;
+            VkDeviceSize ringOffset = AllocateRing(chunkSize);
+            memcpy(static_cast<unsigned char*>(ringMemory.mapped) + ringOffset, source + rowSize * row, (size_t) chunkSize);
+
+            VkBufferImageCopy region{};
+            region.bufferOffset = ringOffset;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = {0, static_cast<int32_t>(row), 0};
+            region.imageExtent = {width, rowCount, 1};
+            vkCmdCopyBufferToImage(TransferCommands(), ringBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+            row += rowCount;
+        }
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        if (!HasTransferQueue())
+        {
+            vkCmdPipelineBarrier(GraphicsCommands(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+            return openBatch.handle;
+        }
+        /*The image is exclusive, the transfer family releases it and the graphics one acquires it with the
+        same layouts. The transition happens once, between the two, the semaphore of the batch orders them*/
+        barrier.srcQueueFamilyIndex = transferFamily;
+        barrier.dstQueueFamilyIndex = graphicsFamily;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(TransferCommands(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &barrier);
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(GraphicsCommands(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &barrier);
+        return openBatch.handle;
+    }
+
+    UploadHandle UploadManager::Record(const std::function<void(VkCommandBuffer commandBuffer)> &record)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        record(GraphicsCommands());
+        return openBatch.handle;
+    }
+
+    UploadHandle UploadManager::Flush()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return FlushLocked();
+    }
+
+    bool UploadManager::FlushAndSignal(VkSemaphore semaphore)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (recording)
+            SubmitBatch(semaphore);
+        else if (lastSignaled < lastSubmitted)
+        {
+            //The batches were submitted earlier, a signal after them on the same queue covers them
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &semaphore;
+            if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit queue!");
+            }
+        }
+        else
+            return false;
+        lastSignaled = lastSubmitted;
+        while (!submittedBatches.empty() && RetireOldest(false));
+        return true;
+    }
+
+    bool UploadManager::IsComplete(UploadHandle handle)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!submittedBatches.empty() && RetireOldest(false));
+        return handle <= lastCompleted;
+    }
+
+    void UploadManager::Wait(UploadHandle handle)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        WaitLocked(handle);
+    }
+
+    void UploadManager::WaitAll()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        WaitLocked(recording ? openBatch.handle : lastSubmitted);
+    }
+
+    UploadManager::~UploadManager()
+    {
+        if (graphicsPool == VK_NULL_HANDLE)
+            return;
+        WaitAll();
+        for (const auto& batch : freeBatches)
+        {
+            vkDestroyFence(engineDevice.logicalDevice, batch.fence, nullptr);
+            vkDestroySemaphore(engineDevice.logicalDevice, batch.transferDone, nullptr);
+        }
+        //The command buffers are freed with their pools
+        vkDestroyCommandPool(engineDevice.logicalDevice, graphicsPool, nullptr);
+        vkDestroyCommandPool(engineDevice.logicalDevice, transferPool, nullptr);
+        vkDestroyBuffer(engineDevice.logicalDevice, ringBuffer, nullptr);
+        engineAllocator.Free(ringMemory);
+    }
+
+    void UploadManager::BeginBatch()
+    {
+        if (recording)
+            return;
+        if (freeBatches.empty())
+        {
+            Batch batch;
+            batch.graphicsCommands = AllocateUploadCommands(graphicsPool);
+            batch.transferCommands = batch.graphicsCommands;
+            if (HasTransferQueue())
+            {
+                batch.transferCommands = AllocateUploadCommands(transferPool);
+                VkSemaphoreCreateInfo semaphoreInfo{};
+                semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+                if (vkCreateSemaphore(engineDevice.logicalDevice, &semaphoreInfo, nullptr, &batch.transferDone) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create upload semaphore!");
+                }
+            }
+            VkFenceCreateInfo fenceInfo{};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            if (vkCreateFence(engineDevice.logicalDevice, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create upload fence!");
+            }
+            freeBatches.emplace_back(batch);
+        }
+        openBatch = freeBatches.back();
+        freeBatches.pop_back();
+        openBatch.handle = lastSubmitted + 1;
+        openBatch.transferRecording = false;
+        openBatch.graphicsRecording = false;
+        recording = true;
+    }
+
+    VkCommandBuffer UploadManager::TransferCommands()
+    {
+        if (!HasTransferQueue())
+            return GraphicsCommands();
+        BeginBatch();
+        if (!openBatch.transferRecording)
+        {
+            BeginUploadCommands(openBatch.transferCommands);
+            openBatch.transferRecording = true;
+        }
+        return openBatch.transferCommands;
+    }
+
+    VkCommandBuffer UploadManager::GraphicsCommands()
+    {
+        BeginBatch();
+        if (!openBatch.graphicsRecording)
+        {
+            BeginUploadCommands(openBatch.graphicsCommands);
+            openBatch.graphicsRecording = true;
+        }
+        return openBatch.graphicsCommands;
+    }
+
+    UploadHandle UploadManager::SubmitBatch(VkSemaphore signalSemaphore)
+    {
+        bool waitTransfer = HasTransferQueue() && openBatch.transferRecording;
+        if (waitTransfer)
+        {
+            //The signal makes the copies available, the graphics commands see them after the wait
+            if (vkEndCommandBuffer(openBatch.transferCommands) != VK_SUCCESS) {
+                throw std::runtime_error("failed to end command buffer!");
+            }
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &openBatch.transferCommands;
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &openBatch.transferDone;
+            if (vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit queue!");
+            }
+        }
+
+        /*And whatever is submitted afterwards sees what they wrote. The source stage covers the wait for the
+        transfer queue, so the chain reaches the later submissions*/
+        VkCommandBuffer graphicsCommands = GraphicsCommands();
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+        vkCmdPipelineBarrier(graphicsCommands, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+        if (vkEndCommandBuffer(graphicsCommands) != VK_SUCCESS) {
+            throw std::runtime_error("failed to end command buffer!");
+        }
+
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.waitSemaphoreCount = waitTransfer ? 1 : 0;
+        submitInfo.pWaitSemaphores = &openBatch.transferDone;
+        submitInfo.pWaitDstStageMask = &waitStage;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &graphicsCommands;
+        submitInfo.signalSemaphoreCount = signalSemaphore != VK_NULL_HANDLE ? 1 : 0;
+        submitInfo.pSignalSemaphores = &signalSemaphore;
+        //The fence comes after the wait, so it also covers the transfer commands
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, openBatch.fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit queue!");
+        }
+        openBatch.ringEnd = writeCursor;
+        submittedBatches.emplace_back(openBatch);
+        recording = false;
+        lastSubmitted = openBatch.handle;
+        return lastSubmitted;
+    }
+
+    bool UploadManager::RetireOldest(bool wait)
+    {
+        Batch& batch = submittedBatches.front();
+        if (wait)
+        {
+            if (vkWaitForFences(engineDevice.logicalDevice, 1, &batch.fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+                throw std::runtime_error("failed to wait for the upload fence!");
+            }
+        }
+        else if (vkGetFenceStatus(engineDevice.logicalDevice, batch.fence) != VK_SUCCESS)
+            return false;
+        vkResetFences(engineDevice.logicalDevice, 1, &batch.fence);
+        releaseCursor = batch.ringEnd;
+        lastCompleted = batch.handle;
+        freeBatches.emplace_back(batch);
+        submittedBatches.pop_front();
+        return true;
+    }
+
+    VkDeviceSize UploadManager::AllocateRing(VkDeviceSize size)
+    {
+        while (true)
+        {
+            VkDeviceSize position = writeCursor % RING_SIZE;
+            VkDeviceSize padding = (position + chunkAlignment - 1) / chunkAlignment * chunkAlignment - position;
+            //A chunk never wraps, the end of the ring is skipped instead
+            if (position + padding + size > RING_SIZE)
+                padding = RING_SIZE - position;
+            if (writeCursor + padding + size - releaseCursor <= RING_SIZE)
+            {
+                writeCursor += padding;
+                VkDeviceSize offset = writeCursor % RING_SIZE;
+                writeCursor += size;
+                return offset;
+            }
+            //The ring is full: the oldest batch gives its bytes back, the open one is submitted when it's the only one
+            if (submittedBatches.empty())
+                SubmitBatch();
+            RetireOldest(true);
+        }
+    }
+
+    UploadHandle UploadManager::FlushLocked()
+    {
+        if (recording)
+            SubmitBatch();
+        while (!submittedBatches.empty() && RetireOldest(false));
+        return lastSubmitted;
+    }
+
+    void UploadManager::WaitLocked(UploadHandle handle)
+    {
+        if (recording && handle >= openBatch.handle)
+            SubmitBatch();
+        while (lastCompleted < handle && !submittedBatches.empty())
+            RetireOldest(true);
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "DeviceAllocator.h"
+
+namespace Minerva
+{
+    /// @brief Identifies the batch recording an upload. The batches complete in submission order,
+    /// so a handle is complete once every batch up to it is
+    using UploadHandle = uint64_t;
+
+    /// @brief Copies CPU data into device local buffers and images without stalling the queue. The data is
+    /// written into a persistently mapped staging ring and the copies are recorded into the open batch, which
+    /// Flush submits with a fence of its own. The ring space of a batch is reused once its fence is signaled.
+    /// Uploads larger than the ring are split in chunks. With a transfer queue the copies into new resources
+    /// run on it, the graphics queue waits for them and acquires the images. Without one everything is
+    /// recorded into the same command buffer of the graphics queue
+    class UploadManager
+    {
+    public:
+        //Bytes of the staging ring
+        static constexpr VkDeviceSize RING_SIZE = 64ull << 20;
+        /// @brief Creates the ring and the command pools of the batches
+        /// @param transferFamily The family of the copies, the graphics one when the device has no transfer queue
+        /// @param graphicsFamily The family of the frames, it owns the uploaded images
+        void Init(uint32_t transferFamily, VkQueue transferQueue, uint32_t graphicsFamily, VkQueue graphicsQueue);
+        /// @brief Copies size bytes of data into the buffer, the data can be released on return
+        /// @param inUse The frames in flight may read the buffer, the copy then waits for them on the graphics queue
+        /// @return The batch holding the last chunk of the copy
+        UploadHandle UploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size,
+        bool inUse = false);
+        /// @brief Copies tightly packed RGBA8 pixels into the color image, moving it from an undefined layout
+        /// to the shader read only one. The image ends up owned by the graphics family
+        UploadHandle UploadImage(VkImage image, uint32_t width, uint32_t height, const void* pixels);
+        /// @brief Records commands of the caller into the graphics commands of the open batch, like layout transitions
+        UploadHandle Record(const std::function<void(VkCommandBuffer commandBuffer)>& record);
+        /// @brief Submits the open batch, if any, and recycles the batches already completed
+        /// @return The handle of the last submitted batch
+        UploadHandle Flush();
+        /// @brief Flushes and signals the semaphore once the batches submitted since the last signal are done,
+        /// so the work of another queue can wait for them
+        /// @return False when no batch was submitted since, the semaphore is then left unsignaled
+        bool FlushAndSignal(VkSemaphore semaphore);
+        /// @brief Polls the fences without blocking
+        bool IsComplete(UploadHandle handle);
+        /// @brief Blocks until the batch has completed, submitting it when still open
+        void Wait(UploadHandle handle);
+        /// @brief Blocks until every upload recorded so far has completed
+        void WaitAll();
+        /// @brief Number of batches submitted since Init
+        uint64_t SubmittedBatches() const { return lastSubmitted; }
+
+        UploadManager() = default;
+        ~UploadManager();
+
+        UploadManager(const UploadManager& other) = delete;
+        UploadManager& operator=(const UploadManager& other) = delete;
+    private:
+        struct Batch
+        {
+            //Copies into new resources, the same command buffer as graphicsCommands without a transfer queue
+            VkCommandBuffer transferCommands = VK_NULL_HANDLE;
+            //Image acquires, copies into resources in use and recorded commands
+            VkCommandBuffer graphicsCommands = VK_NULL_HANDLE;
+            //Signaled by the transfer commands, the graphics ones wait for it
+            VkSemaphore transferDone = VK_NULL_HANDLE;
+            VkFence fence = VK_NULL_HANDLE;
+            UploadHandle handle = 0;
+            //Write cursor of the ring after the last chunk of the batch
+            uint64_t ringEnd = 0;
+            bool transferRecording = false;
+            bool graphicsRecording = false;
+        };
+
+        VkQueue transferQueue = VK_NULL_HANDLE;
+        VkQueue graphicsQueue = VK_NULL_HANDLE;
+        uint32_t transferFamily = 0;
+        uint32_t graphicsFamily = 0;
+        VkCommandPool transferPool = VK_NULL_HANDLE;
+        VkCommandPool graphicsPool = VK_NULL_HANDLE;
+        VkBuffer ringBuffer = VK_NULL_HANDLE;
+        DeviceAllocation ringMemory;
+        //Alignment of the chunks, enough for the copies into images
+        VkDeviceSize chunkAlignment = 16;
+        /*Bytes written into and released from the ring since Init. They only grow, the position in the
+        ring is the cursor modulo RING_SIZE*/
+        uint64_t writeCursor = 0;
+        uint64_t releaseCursor = 0;
+        bool recording = false;
+        Batch openBatch;
+        std::deque<Batch> submittedBatches;
+        std::vector<Batch> freeBatches;
+        UploadHandle lastSubmitted = 0;
+        UploadHandle lastCompleted = 0;
+        UploadHandle lastSignaled = 0;
+        std::mutex mutex;
+
+        bool HasTransferQueue() const { return transferFamily != graphicsFamily; }
+        /// @brief Opens a batch unless one is recording
+        void BeginBatch();
+        /// @brief The command buffers of the open batch, begun on their first use
+        VkCommandBuffer TransferCommands();
+        VkCommandBuffer GraphicsCommands();
+        /// @param signalSemaphore Signaled by the graphics commands, VK_NULL_HANDLE for none
+        UploadHandle SubmitBatch(VkSemaphore signalSemaphore = VK_NULL_HANDLE);
+        /// @brief Recycles the oldest submitted batch
+        /// @param wait Blocks on its fence, otherwise returns false when it's still running
+        bool RetireOldest(bool wait);
+        /// @brief Reserves size bytes of the ring, submitting and waiting for batches until they are free
+        /// @return The offset of the bytes in the ring buffer
+        VkDeviceSize AllocateRing(VkDeviceSize size);
+        UploadHandle FlushLocked();
+        void WaitLocked(UploadHandle handle);
+    };
+}